@@ -0,0 +1,400 @@
+/**
+ * @brief CAN over serial end-to-end benchmark
+ * Sends frames from one module to another, over loopback UDP
+ * and over a pair of pseudo terminals (SLCAN serial path),
+ * sweeping payload sizes, burst sizes and send rates.
+ * Reports frames/s, CPU time per frame, drop rate and
+ * latency percentiles as JSON on stdout.
+ * The library's own traces go to stderr.
+ *
+ * @file main.c
+ */
+
+/* Includes -------------------------------------------- */
+/* can-serial */
+#include "can_serial.h"
+#include "can_serial_error_codes.h"
+
+/* C System */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <pty.h>
+#include <termios.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+#define DEFAULT_FRAMES      10000U
+#define UDP_PORT            15400
+#define SERIAL_BAUDRATE     3000000U
+#define MAX_BURST           32U
+#define DRAIN_TIMEOUT_NS    100000000U /* Stop waiting after 100 ms w/o progress */
+#define BENCH_CAN_ID        0x321U
+
+/* Module IDs */
+#define UDP_SENDER          0U
+#define UDP_RECEIVER        1U
+#define SERIAL_SENDER       2U
+#define SERIAL_RECEIVER     3U
+
+/* Notes ----------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+typedef enum _benchTransport {
+    BENCH_UDP    = 0U,
+    BENCH_SERIAL = 1U
+} benchTransport_t;
+
+typedef struct _benchRun {
+    benchTransport_t    transport;
+    uint8_t             payload;
+    size_t              burst;
+    uint32_t            rate;       /**< Frames/s, 0 sends as fast as possible */
+} benchRun_t;
+
+typedef struct _benchResult {
+    size_t      sent;
+    size_t      received;
+    uint64_t    wallNs;
+    uint64_t    cpuNs;
+    uint64_t    p50Ns;
+    uint64_t    p99Ns;
+    uint64_t    p999Ns;
+    uint64_t    maxNs;
+} benchResult_t;
+
+/* Variable declaration -------------------------------- */
+static const uint8_t  sPayloads[] = {0U, 4U, 8U};
+static const size_t   sBursts[]   = {1U, 8U, 32U};
+static const uint32_t sRates[]    = {0U, 20000U};
+
+static size_t sReceived = 0U;   /**< Frames delivered to the receiver, atomic */
+
+/* Serial path, the pty driver has no send time to carry.
+ * The bytes flow in order, frame n is matched to send n. */
+static uint64_t *sSendTimes   = NULL;
+static uint64_t *sSerialLats  = NULL;
+static size_t    sFrames      = 0U;
+
+static int  sMasterA = -1;  /**< Written by the serial sender's port */
+static int  sMasterB = -1;  /**< Read by the serial receiver's port */
+static bool sForwardOn = true;
+
+/* Support functions ----------------------------------- */
+static uint64_t clockNs(const clockid_t pClock) {
+    struct timespec lTime;
+    clock_gettime(pClock, &lTime);
+    return (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+}
+
+static int countFrame(const uint8_t pCallerID,
+    const uint32_t pCANID,
+    const uint8_t pSize,
+    const uint8_t * const pData,
+    const uint32_t pFlags)
+{
+    (void)pCANID;
+    (void)pSize;
+    (void)pData;
+    (void)pFlags;
+
+    const size_t lIndex = __atomic_fetch_add(&sReceived, 1U, __ATOMIC_RELAXED);
+
+    if(SERIAL_RECEIVER == pCallerID && lIndex < sFrames) {
+        sSerialLats[lIndex] = clockNs(CLOCK_MONOTONIC) - sSendTimes[lIndex];
+    }
+
+    return 0;
+}
+
+/* Plays the null-modem cable between the two ptys */
+static void *forwardThread(void *pArg) {
+    (void)pArg;
+
+    char lBuf[4096U];
+    while(__atomic_load_n(&sForwardOn, __ATOMIC_RELAXED)) {
+        const ssize_t lRead = read(sMasterA, lBuf, sizeof(lBuf));
+        if(0 >= lRead) {
+            continue;
+        }
+
+        ssize_t lDone = 0;
+        while(lDone < lRead) {
+            const ssize_t lWritten = write(sMasterB, &lBuf[lDone], (size_t)(lRead - lDone));
+            if(0 > lWritten) {
+                break;
+            }
+            lDone += lWritten;
+        }
+    }
+
+    return NULL;
+}
+
+static int cmpU64(const void *pA, const void *pB) {
+    const uint64_t lA = *(const uint64_t *)pA;
+    const uint64_t lB = *(const uint64_t *)pB;
+    return (lA > lB) - (lA < lB);
+}
+
+static uint64_t sortedPercentile(const uint64_t * const pSamples, const size_t pCount, const double pPercentile) {
+    if(0U == pCount) {
+        return 0U;
+    }
+
+    size_t lRank = (size_t)(pPercentile / 100.0 * (double)pCount + 0.5);
+    if(0U == lRank) {
+        lRank = 1U;
+    }
+    if(pCount < lRank) {
+        lRank = pCount;
+    }
+
+    return pSamples[lRank - 1U];
+}
+
+static bool setupUdp(void) {
+    if(can_serial_ERROR_NONE != CIP_createModule(UDP_SENDER)
+        || can_serial_ERROR_NONE != CIP_createModule(UDP_RECEIVER)
+        || can_serial_ERROR_NONE != CIP_setLatencyTracking(UDP_SENDER, true)
+        || can_serial_ERROR_NONE != CIP_setLatencyTracking(UDP_RECEIVER, true)
+        || can_serial_ERROR_NONE != CIP_init(UDP_SENDER, can_serial_MODE_NORMAL, UDP_PORT)
+        || can_serial_ERROR_NONE != CIP_init(UDP_RECEIVER, can_serial_MODE_NORMAL, UDP_PORT)
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(UDP_RECEIVER, UDP_RECEIVER, countFrame)
+        || can_serial_ERROR_NONE != CIP_startRxThread(UDP_RECEIVER))
+    {
+        fprintf(stderr, "[ERROR] UDP set up failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool setupSerial(pthread_t * const pForwarder) {
+    int  lSlaveA = -1;
+    int  lSlaveB = -1;
+    char lNameA[64U] = "";
+    char lNameB[64U] = "";
+
+    if(0 != openpty(&sMasterA, &lSlaveA, lNameA, NULL, NULL)
+        || 0 != openpty(&sMasterB, &lSlaveB, lNameB, NULL, NULL))
+    {
+        fprintf(stderr, "[ERROR] openpty failed\n");
+        return false;
+    }
+
+    /* Raw bytes on the master sides too */
+    struct termios lTermios;
+    if(0 == tcgetattr(sMasterB, &lTermios)) {
+        cfmakeraw(&lTermios);
+        (void)tcsetattr(sMasterB, TCSANOW, &lTermios);
+    }
+
+    if(0 != pthread_create(pForwarder, NULL, forwardThread, NULL)) {
+        fprintf(stderr, "[ERROR] Forwarder thread creation failed\n");
+        return false;
+    }
+
+    if(can_serial_ERROR_NONE != CIP_createModule(SERIAL_SENDER)
+        || can_serial_ERROR_NONE != CIP_createModule(SERIAL_RECEIVER)
+        || can_serial_ERROR_NONE != CIP_initSerial(SERIAL_SENDER, can_serial_MODE_NORMAL, lNameA, SERIAL_BAUDRATE)
+        || can_serial_ERROR_NONE != CIP_initSerial(SERIAL_RECEIVER, can_serial_MODE_NORMAL, lNameB, SERIAL_BAUDRATE)
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(SERIAL_RECEIVER, SERIAL_RECEIVER, countFrame)
+        || can_serial_ERROR_NONE != CIP_startRxThread(SERIAL_RECEIVER))
+    {
+        fprintf(stderr, "[ERROR] Serial set up failed\n");
+        return false;
+    }
+
+    /* The modules keep their own descriptors open */
+    close(lSlaveA);
+    close(lSlaveB);
+
+    return true;
+}
+
+static bool runOne(const benchRun_t * const pRun, const size_t pFrames, benchResult_t * const pResult) {
+    const cipID_t lSender = BENCH_UDP == pRun->transport ? UDP_SENDER : SERIAL_SENDER;
+
+    cipMessage_t lBurst[MAX_BURST];
+    memset(lBurst, 0, sizeof(lBurst));
+    for(size_t i = 0U; i < MAX_BURST; i++) {
+        lBurst[i].id   = BENCH_CAN_ID;
+        lBurst[i].size = pRun->payload;
+        for(uint8_t j = 0U; j < pRun->payload; j++) {
+            lBurst[i].data[j] = (uint8_t)(i + j);
+        }
+    }
+
+    memset(pResult, 0, sizeof(*pResult));
+    __atomic_store_n(&sReceived, 0U, __ATOMIC_RELAXED);
+    (void)CIP_resetLatencyHist(UDP_RECEIVER);
+
+    /* Bursts are paced on their first frame */
+    const uint64_t lPeriodNs = 0U == pRun->rate ? 0U : 1000000000U * pRun->burst / pRun->rate;
+
+    const uint64_t lCpuStart  = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    const uint64_t lWallStart = clockNs(CLOCK_MONOTONIC);
+    uint64_t lNext = lWallStart;
+
+    while(pResult->sent < pFrames) {
+        size_t lCount = pFrames - pResult->sent;
+        if(pRun->burst < lCount) {
+            lCount = pRun->burst;
+        }
+
+        if(0U != lPeriodNs) {
+            const struct timespec lDeadline = {
+                .tv_sec  = (time_t)(lNext / 1000000000U),
+                .tv_nsec = (long)(lNext % 1000000000U)
+            };
+            while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &lDeadline, NULL)) {
+                /* Retry */
+            }
+            lNext += lPeriodNs;
+        }
+
+        if(BENCH_SERIAL == pRun->transport) {
+            const uint64_t lNow = clockNs(CLOCK_MONOTONIC);
+            for(size_t i = 0U; i < lCount; i++) {
+                sSendTimes[pResult->sent + i] = lNow;
+            }
+        }
+
+        size_t lSent = 0U;
+        (void)CIP_sendBatch(lSender, lBurst, lCount, NULL, &lSent);
+        pResult->sent += lCount;
+    }
+
+    /* Drain, until everything is received or nothing moves anymore */
+    size_t   lLast     = __atomic_load_n(&sReceived, __ATOMIC_RELAXED);
+    uint64_t lProgress = clockNs(CLOCK_MONOTONIC);
+    while(lLast < pResult->sent && DRAIN_TIMEOUT_NS > clockNs(CLOCK_MONOTONIC) - lProgress) {
+        usleep(1000U);
+        const size_t lNow = __atomic_load_n(&sReceived, __ATOMIC_RELAXED);
+        if(lNow != lLast) {
+            lLast     = lNow;
+            lProgress = clockNs(CLOCK_MONOTONIC);
+        }
+    }
+
+    /* The drain timeout is not part of the run */
+    pResult->wallNs   = (lLast < pResult->sent ? lProgress : clockNs(CLOCK_MONOTONIC)) - lWallStart;
+    pResult->cpuNs    = clockNs(CLOCK_PROCESS_CPUTIME_ID) - lCpuStart;
+    pResult->received = lLast < pResult->sent ? lLast : pResult->sent;
+
+    if(BENCH_UDP == pRun->transport) {
+        cipLatencyHist_t lHist;
+        if(can_serial_ERROR_NONE != CIP_getLatencyHist(UDP_RECEIVER, &lHist)) {
+            return false;
+        }
+        pResult->p50Ns  = CIP_latencyHistPercentile(&lHist, 50.0);
+        pResult->p99Ns  = CIP_latencyHistPercentile(&lHist, 99.0);
+        pResult->p999Ns = CIP_latencyHistPercentile(&lHist, 99.9);
+        pResult->maxNs  = lHist.maxNs;
+    } else {
+        qsort(sSerialLats, pResult->received, sizeof(sSerialLats[0U]), cmpU64);
+        pResult->p50Ns  = sortedPercentile(sSerialLats, pResult->received, 50.0);
+        pResult->p99Ns  = sortedPercentile(sSerialLats, pResult->received, 99.0);
+        pResult->p999Ns = sortedPercentile(sSerialLats, pResult->received, 99.9);
+        pResult->maxNs  = 0U == pResult->received ? 0U : sSerialLats[pResult->received - 1U];
+    }
+
+    return true;
+}
+
+static void printResult(FILE * const pOut, const benchRun_t * const pRun, const benchResult_t * const pResult, const bool pFirst) {
+    const double lSeconds = (double)pResult->wallNs * 1e-9;
+
+    fprintf(pOut, "%s\n    {\"transport\": \"%s\", \"payload\": %u, \"burst\": %zu, \"rate\": %" PRIu32 ", "
+        "\"sent\": %zu, \"received\": %zu, \"frames_per_s\": %.1f, \"cpu_ns_per_frame\": %.1f, \"drop_rate\": %.6f, "
+        "\"latency_ns\": {\"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p99_9\": %" PRIu64 ", \"max\": %" PRIu64 "}}",
+        pFirst ? "" : ",",
+        BENCH_UDP == pRun->transport ? "udp" : "serial",
+        pRun->payload,
+        pRun->burst,
+        pRun->rate,
+        pResult->sent,
+        pResult->received,
+        0.0 < lSeconds ? (double)pResult->received / lSeconds : 0.0,
+        0U < pResult->sent ? (double)pResult->cpuNs / (double)pResult->sent : 0.0,
+        0U < pResult->sent ? (double)(pResult->sent - pResult->received) / (double)pResult->sent : 0.0,
+        pResult->p50Ns,
+        pResult->p99Ns,
+        pResult->p999Ns,
+        pResult->maxNs);
+}
+
+/* ----------------------------------------------------- */
+/* Main ------------------------------------------------ */
+/* ----------------------------------------------------- */
+int main(const int argc, const char * const * const argv) {
+    const size_t lFrames = 1 < argc ? strtoul(argv[1], NULL, 10) : DEFAULT_FRAMES;
+    if(0U == lFrames) {
+        fprintf(stderr, "usage : %s [frames per run]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Keep stdout for the JSON report, the library traces go to stderr */
+    FILE * const lOut = fdopen(dup(STDOUT_FILENO), "w");
+    if(NULL == lOut || 0 > dup2(STDERR_FILENO, STDOUT_FILENO)) {
+        fprintf(stderr, "[ERROR] Could not redirect stdout\n");
+        return EXIT_FAILURE;
+    }
+
+    sFrames     = lFrames;
+    sSendTimes  = calloc(lFrames, sizeof(sSendTimes[0U]));
+    sSerialLats = calloc(lFrames, sizeof(sSerialLats[0U]));
+    if(NULL == sSendTimes || NULL == sSerialLats) {
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t lForwarder;
+    if(!setupUdp() || !setupSerial(&lForwarder)) {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(lOut, "{\n  \"frames_per_run\": %zu,\n  \"runs\": [", lFrames);
+
+    bool lFirst = true;
+    for(benchTransport_t t = BENCH_UDP; t <= BENCH_SERIAL; t++) {
+        for(size_t p = 0U; p < sizeof(sPayloads) / sizeof(sPayloads[0U]); p++) {
+            for(size_t b = 0U; b < sizeof(sBursts) / sizeof(sBursts[0U]); b++) {
+                for(size_t r = 0U; r < sizeof(sRates) / sizeof(sRates[0U]); r++) {
+                    const benchRun_t lRun = {t, sPayloads[p], sBursts[b], sRates[r]};
+                    benchResult_t lResult;
+                    if(!runOne(&lRun, lFrames, &lResult)) {
+                        fprintf(stderr, "[ERROR] Benchmark run failed\n");
+                        return EXIT_FAILURE;
+                    }
+                    printResult(lOut, &lRun, &lResult, lFirst);
+                    fflush(lOut);
+                    lFirst = false;
+                }
+            }
+        }
+    }
+
+    fprintf(lOut, "\n  ]\n}\n");
+    fclose(lOut);
+
+    /* The forwarder may be blocked in read, it dies with the process */
+    __atomic_store_n(&sForwardOn, false, __ATOMIC_RELAXED);
+    for(cipID_t i = UDP_SENDER; i <= SERIAL_RECEIVER; i++) {
+        (void)CIP_reset(i, can_serial_MODE_NORMAL);
+    }
+
+    free(sSendTimes);
+    free(sSerialLats);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/**
+ * @brief CAN over serial SLCAN codec microbenchmark
+ * Reports the frames/s one core encodes/decodes.
+ *
+ * @file main.c
+ */
+
+/* Includes -------------------------------------------- */
+/* can-serial */
+#include "can_serial.h"
+#include "can_serial_slcan.h"
+
+/* C System */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Defines --------------------------------------------- */
+#define NB_FRAMES       1024U
+#define DEFAULT_ROUNDS  2000U
+
+/* Notes ----------------------------------------------- */
+
+/* Variable declaration -------------------------------- */
+static cipMessage_t sMsgs[NB_FRAMES];
+static cipMessage_t sDecoded[NB_FRAMES];
+static char         sBuf[NB_FRAMES * can_serial_SLCAN_MAX_FRAME_LEN];
+
+/* Type definitions ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static double cpuTime(void) {
+    struct timespec lTime;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &lTime);
+    return (double)lTime.tv_sec + (double)lTime.tv_nsec * 1e-9;
+}
+
+static void report(const char * const pName, const size_t pFrames, const double pSeconds) {
+    printf("[BENCH] %-14s : %8.2f Mframes/s/core (%6.1f ns/frame)\n",
+        pName, (double)pFrames / pSeconds * 1e-6, pSeconds / (double)pFrames * 1e9);
+}
+
+/* Mostly 8-byte standard frames, like a busy bus */
+static void setupFrames(void) {
+    srand(42);
+    for(size_t i = 0U; i < NB_FRAMES; i++) {
+        sMsgs[i].id    = 0U == (i % 8U) ? ((uint32_t)rand() & 0x1FFFFFFFU) : ((uint32_t)rand() & 0x7FFU);
+        sMsgs[i].flags = 0U == (i % 8U) ? can_serial_FLAG_EFF : 0U;
+        sMsgs[i].size  = 0U == (i % 4U) ? (uint8_t)(rand() % (CAN_MESSAGE_MAX_SIZE + 1U)) : CAN_MESSAGE_MAX_SIZE;
+        for(size_t j = 0U; j < CAN_MESSAGE_MAX_SIZE; j++) {
+            sMsgs[i].data[j] = (uint8_t)rand();
+        }
+    }
+}
+
+/* ----------------------------------------------------- */
+/* Main ------------------------------------------------ */
+/* ----------------------------------------------------- */
+int main(const int argc, const char * const * const argv) {
+    const size_t lRounds = 1 < argc ? strtoul(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+    const size_t lFrames = lRounds * NB_FRAMES;
+
+    setupFrames();
+
+    /* Single frame encoding */
+    size_t lLen = 0U;
+    double lStart = cpuTime();
+    for(size_t r = 0U; r < lRounds; r++) {
+        lLen = 0U;
+        for(size_t i = 0U; i < NB_FRAMES; i++) {
+            lLen += CIP_slcanEncode(&sMsgs[i], &sBuf[lLen]);
+        }
+    }
+    report("encode", lFrames, cpuTime() - lStart);
+
+    /* Batch encoding into one buffer */
+    lStart = cpuTime();
+    for(size_t r = 0U; r < lRounds; r++) {
+        if(NB_FRAMES != CIP_slcanEncodeBatch(sMsgs, NB_FRAMES, sBuf, sizeof(sBuf), &lLen)) {
+            printf("[ERROR] CIP_slcanEncodeBatch failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    report("encode batch", lFrames, cpuTime() - lStart);
+
+    /* Stream decoding of the batch */
+    size_t lConsumed = 0U;
+    lStart = cpuTime();
+    for(size_t r = 0U; r < lRounds; r++) {
+        if(NB_FRAMES != CIP_slcanParse(sBuf, lLen, sDecoded, NB_FRAMES, &lConsumed)) {
+            printf("[ERROR] CIP_slcanParse failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    report("decode batch", lFrames, cpuTime() - lStart);
+
+    printf("[BENCH] %zu frames, %.1f characters/frame\n", lFrames, (double)lLen / NB_FRAMES);
+
+    return EXIT_SUCCESS;
+}
@@ -55,7 +55,8 @@ int main(const int argc, const char * const * const argv) {
             0xEFU
         },
         0x00000000U,
-        0x00000000U
+        0x00000000U,
+        0U
     };
 
     ssize_t lReadBytes = 0;
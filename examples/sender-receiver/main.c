@@ -10,11 +10,13 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 /* Defines --------------------------------------------- */
+#define LATENCY_REPORT_PERIOD 10U /* Sends between two latency reports */
 
 /* Notes ----------------------------------------------- */
 
@@ -26,29 +28,37 @@
 extern void CIP_printMessageShort(const cipMessage_t * const pMsg);
 
 /* Support functions ----------------------------------- */
-int inputMessage(const uint8_t pID, 
-    const uint32_t pCOBID,
-    const uint8_t pSize,
-    const uint8_t * const pData,
-    const uint32_t pFlags)
+/* Every message drained in one wake-up, no copy needed */
+int inputMessages(const uint8_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount)
 {
     (void)pID;
 
-    /* Set up CAN message */
-    cipMessage_t lMsg;
-    lMsg.id = pCOBID;
-    lMsg.size = pSize;
-    lMsg.flags = pFlags;
-
-    for(uint8_t i = 0U; (i < CAN_MESSAGE_MAX_SIZE) && (i < lMsg.size); i++) {
-        lMsg.data[i] = pData[i];
+    for(size_t i = 0U; i < pCount; i++) {
+        CIP_printMessageShort(&pMsgs[i]);
     }
 
-    CIP_printMessageShort(&lMsg);
-
     return 0;
 }
 
+/* Latency from the CIP_send of the other instances to our reception */
+static void printLatency(void) {
+    cipLatencyHist_t lHist;
+    if(can_serial_ERROR_NONE != CIP_getLatencyHist(0U, &lHist) || 0U == lHist.total) {
+        printf("[INFO ] No latency samples yet, start another sender-receiver\n");
+        return;
+    }
+
+    printf("[INFO ] Latency over %" PRIu64 " frames : min %" PRIu64 " us, p50 %" PRIu64 " us, p99 %" PRIu64 " us, p99.9 %" PRIu64 " us, max %" PRIu64 " us\n",
+        lHist.total,
+        lHist.minNs / 1000U,
+        CIP_latencyHistPercentile(&lHist, 50.0) / 1000U,
+        CIP_latencyHistPercentile(&lHist, 99.0) / 1000U,
+        CIP_latencyHistPercentile(&lHist, 99.9) / 1000U,
+        lHist.maxNs / 1000U);
+}
+
 /* ----------------------------------------------------- */
 /* Main ------------------------------------------------ */
 /* ----------------------------------------------------- */
@@ -58,14 +68,26 @@ int main(const int argc, const char * const * const argv) {
 
     unsigned int lErrorCode = 0U;
 
+    /* Create the CAN over serial module */
+    if(1U != (lErrorCode = CIP_createModule(0U))) {
+        printf("[ERROR] CIP_createModule failed w/ error code %u.\n", lErrorCode);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Embed our send times and measure the latency of the others */
+    if(1U != (lErrorCode = CIP_setLatencyTracking(0U, true))) {
+        printf("[ERROR] CIP_setLatencyTracking failed w/ error code %u.\n", lErrorCode);
+        exit(EXIT_FAILURE);
+    }
+
     /* Initialize the CAN over serial module */
     if(1U != (lErrorCode = CIP_init(0U, can_serial_MODE_NORMAL, 15024))) {
         printf("[ERROR] CIP_init failed w/ error code %u.\n", lErrorCode);
         exit(EXIT_FAILURE);
     }
 
-    if(1U != (lErrorCode = CIP_setPutMessageFunction(0U, 0U, inputMessage))) {
-        printf("[ERROR] CIP_setPutMessageFunction failed w/ error code %u.\n", lErrorCode);
+    if(1U != (lErrorCode = CIP_setPutMessagesFunction(0U, 0U, inputMessages))) {
+        printf("[ERROR] CIP_setPutMessagesFunction failed w/ error code %u.\n", lErrorCode);
         exit(EXIT_FAILURE);
     }
 
@@ -84,7 +106,8 @@ int main(const int argc, const char * const * const argv) {
             0xEFU
         },
         0x00000000U,
-        0x00000000U
+        0x00000000U,
+        0U
     };
 
     if(1U != (lErrorCode = CIP_startRxThread(0U))) {
@@ -93,6 +116,7 @@ int main(const int argc, const char * const * const argv) {
     }
 
     ssize_t lReadBytes = 0;
+    unsigned int lNbSent = 0U;
 
     /* Receive the CAN message over IP */
     while(lErrorCode == can_serial_ERROR_NONE && 0 >= lReadBytes) {
@@ -101,6 +125,10 @@ int main(const int argc, const char * const * const argv) {
             exit(EXIT_FAILURE);
         }
 
+        if(0U == (++lNbSent % LATENCY_REPORT_PERIOD)) {
+            printLatency();
+        }
+
         sleep(1U);
     }
 
@@ -21,25 +21,98 @@ extern "C" {
 
 /* Defines --------------------------------------------- */
 #define CAN_MESSAGE_MAX_SIZE 8U
+#define CAN_FD_MESSAGE_MAX_SIZE 64U
 
 /* Define this beforehand if you want 
  * several CAN over serial modules. 
  */
 #ifndef can_serial_MAX_NB_MODULES
-#define can_serial_MAX_NB_MODULES 1U
+#define can_serial_MAX_NB_MODULES 8U
 #endif /* can_serial_MAX_NB_MODULES */
 
+/* Maximum number of acceptance filters (see CIP_setFilters) */
+#ifndef can_serial_MAX_NB_FILTERS
+#define can_serial_MAX_NB_FILTERS 64U
+#endif /* can_serial_MAX_NB_FILTERS */
+
+/* Send failures are counted per errno value below this one, the others in bucket 0 */
+#define can_serial_STATS_NB_ERRNO 134U
+
+/* Latency histogram : log-linear buckets, 2^SUB_BITS linear sub-buckets
+ * per power of 2 (~3 % precision), values up to 2^(MAX_EXP + 1) ns (~2 min) */
+#define can_serial_HIST_SUB_BITS    5U
+#define can_serial_HIST_MAX_EXP     36U
+#define can_serial_HIST_NB_BUCKETS  ((can_serial_HIST_MAX_EXP - can_serial_HIST_SUB_BITS + 2U) << can_serial_HIST_SUB_BITS)
+
+/* CAN message flags */
+#define can_serial_FLAG_EFF 0x00000001U /**< Extended (29 bit) CAN ID */
+#define can_serial_FLAG_RTR 0x00000002U /**< Remote transmission request */
+#define can_serial_FLAG_FDF 0x00000004U /**< CAN FD frame */
+#define can_serial_FLAG_BRS 0x00000008U /**< Bit rate switch (CAN FD only) */
+#define can_serial_FLAG_ESI 0x00000010U /**< Error state indicator (CAN FD only) */
+
+/* OR this into the CAN ID given to CIP_registerHandler for an extended (29 bit) ID */
+#define can_serial_ID_EXT 0x80000000U
+
+/* Maximum number of cyclic messages per module (see CIP_addCyclic), up to 65535 */
+#ifndef can_serial_MAX_NB_CYCLIC
+#define can_serial_MAX_NB_CYCLIC 4096U
+#endif /* can_serial_MAX_NB_CYCLIC */
+
+/* Number of files a capture rotates through (see CIP_startCapture) */
+#ifndef can_serial_CAPTURE_NB_SEGMENTS
+#define can_serial_CAPTURE_NB_SEGMENTS 4U
+#endif /* can_serial_CAPTURE_NB_SEGMENTS */
+
+/* Capture files */
+#define can_serial_CAPTURE_MAGIC    "CIPCAP1"
+#define can_serial_CAPTURE_VERSION  1U
+#define can_serial_CAPTURE_RX       0U  /**< cipCaptureRecord_t::direction */
+#define can_serial_CAPTURE_TX       1U
+
+/* Capture index file "<path>.idx" (see CIP_queryCapture) */
+#define can_serial_CAPTURE_INDEX_MAGIC    "CIPIDX1"
+#define can_serial_CAPTURE_INDEX_VERSION  1U
+#define can_serial_CAPTURE_INDEX_STD_BITS 2048U /**< One bit per 11-bit ID */
+#define can_serial_CAPTURE_INDEX_EXT_BITS 1024U /**< 29-bit IDs, hashed */
+
+/* Records per index block */
+#ifndef can_serial_CAPTURE_INDEX_BLOCK
+#define can_serial_CAPTURE_INDEX_BLOCK 1024U
+#endif /* can_serial_CAPTURE_INDEX_BLOCK */
+
+/* Capture replay (see CIP_replayCapture) */
+#define can_serial_REPLAY_RX        (1U << can_serial_CAPTURE_RX)   /**< Replay the received frames */
+#define can_serial_REPLAY_TX        (1U << can_serial_CAPTURE_TX)   /**< Replay the sent frames */
+#define can_serial_REPLAY_MAX_SPEED 0.0                             /**< Speed factor : as fast as possible */
+
+/* Log records above this level are compiled out (see cipLogLevel_t) */
+#ifndef can_serial_LOG_LEVEL_MAX
+#define can_serial_LOG_LEVEL_MAX 3U /* can_serial_LOG_DEBUG */
+#endif /* can_serial_LOG_LEVEL_MAX */
+
 /* Type definitions ------------------------------------ */
 typedef struct _cipMessage {
     uint32_t id;
     uint8_t  size;
     uint8_t  data[CAN_MESSAGE_MAX_SIZE];
     uint32_t flags;
-    uint32_t randID; /**< Random ID of the message sender */
+    uint32_t randID;    /**< Random ID of the message sender */
+    uint64_t timestamp; /**< RX time (ns since the epoch, kernel time over UDP), 0 if unknown */
 } cipMessage_t;
 
 typedef cipMessage_t canMessage_t;
 
+/* CAN FD message, only used by can_serial_MODE_FD modules */
+typedef struct _cipFdMessage {
+    uint32_t id;
+    uint8_t  size; /**< 0 to 8, 12, 16, 20, 24, 32, 48 or 64 */
+    uint8_t  data[CAN_FD_MESSAGE_MAX_SIZE];
+    uint32_t flags;
+    uint32_t randID;    /**< Random ID of the message sender */
+    uint64_t timestamp; /**< RX time (ns since the epoch, kernel time over UDP), 0 if unknown */
+} cipFdMessage_t;
+
 typedef enum _cipModes {
     can_serial_MODE_UNKNOWN = 0U,
     can_serial_MODE_NORMAL  = 1U,
@@ -48,14 +121,147 @@ typedef enum _cipModes {
 
 typedef cipMode_t canMode_t;
 
+/* Acceptance filter : a frame matches when (frame ID & mask) == (id & mask) */
+typedef struct _cipFilter {
+    uint32_t id;
+    uint32_t mask;
+    uint32_t flags; /**< can_serial_FLAG_EFF : 29-bit rule, else 11-bit rule */
+} cipFilter_t;
+
+typedef enum _cipWireFormats {
+    can_serial_WIRE_COMPACT = 0U, /**< Versioned, big-endian, variable length, several frames per datagram */
+    can_serial_WIRE_LEGACY  = 1U  /**< One raw, host-endian cipMessage_t per datagram */
+} cipWireFormat_t;
+
+/* Module counters, see CIP_getStats. Byte counts are CAN payload bytes. */
+typedef struct _cipStats {
+    /* Reception */
+    uint64_t rxFrames;          /**< Frames received and accepted by the filters */
+    uint64_t rxBytes;
+    uint64_t loopbackFrames;    /**< Own frames suppressed in user space (the UDP socket filter drops most in the kernel) */
+    uint64_t filteredFrames;    /**< Frames rejected by the acceptance filters in user space */
+    uint64_t badDatagrams;      /**< Short, truncated or inconsistent datagrams (or SLCAN garbage) */
+    uint64_t eagainSpins;       /**< Receive calls that found nothing to read */
+    uint64_t rxRingDrops;       /**< Frames dropped because the RX ring was full */
+    uint64_t callbackCalls;     /**< Put message function(s) and handler calls */
+    uint64_t callbackFailures;  /**< Calls that returned non-zero */
+    uint64_t callbackTimeNs;    /**< Time spent in the calls */
+
+    /* Transmission */
+    uint64_t txFrames;
+    uint64_t txBytes;
+    uint64_t txFailures;        /**< Frames that could not be sent */
+    uint64_t txQueueFull;       /**< Frames refused because the TX queue was full */
+    uint64_t txErrno[can_serial_STATS_NB_ERRNO]; /**< Failed send syscalls per errno */
+} cipStats_t;
+
+/* Capture file header, at the start of each segment file (see CIP_startCapture) */
+typedef struct _cipCaptureHeader {
+    char     magic[8];          /**< can_serial_CAPTURE_MAGIC */
+    uint32_t version;           /**< can_serial_CAPTURE_VERSION */
+    uint32_t recordSize;        /**< sizeof(cipCaptureRecord_t) */
+    uint64_t nbRecords;         /**< Records in this file, they follow the header */
+    uint32_t segment;           /**< Index of this file */
+    uint32_t nbSegments;
+    uint8_t  reserved[32];
+} cipCaptureHeader_t;
+
+/* One captured frame, classic or CAN FD */
+typedef struct _cipCaptureRecord {
+    uint64_t seq;               /**< Position in the capture, from 1, 0 : never written */
+    uint64_t timestamp;         /**< ns since the epoch (RX : reception time, TX : submission time) */
+    uint32_t id;
+    uint32_t flags;
+    uint8_t  size;
+    uint8_t  direction;         /**< can_serial_CAPTURE_RX or can_serial_CAPTURE_TX */
+    uint8_t  module;            /**< ID of the module */
+    uint8_t  reserved[5];
+    uint8_t  data[CAN_FD_MESSAGE_MAX_SIZE];
+} cipCaptureRecord_t;
+
+/* Capture index file header, the entries of the blocks follow it */
+typedef struct _cipCaptureIndexHeader {
+    char     magic[8];          /**< can_serial_CAPTURE_INDEX_MAGIC */
+    uint32_t version;           /**< can_serial_CAPTURE_INDEX_VERSION */
+    uint32_t entrySize;         /**< sizeof(cipCaptureIndexEntry_t) */
+    uint64_t blockRecords;      /**< Capture positions per block */
+    uint64_t nbBlocks;          /**< Entries in the file, block b uses entry b % nbBlocks */
+    uint64_t indexed;           /**< The positions below this one are indexed */
+    uint8_t  reserved[24];
+} cipCaptureIndexHeader_t;
+
+/* Summary of one block of capture positions */
+typedef struct _cipCaptureIndexEntry {
+    uint64_t block;             /**< Block number, from 1, 0 : never written */
+    uint64_t count;             /**< Records indexed */
+    uint64_t minTimestamp;
+    uint64_t maxTimestamp;
+    uint64_t stdIDs[can_serial_CAPTURE_INDEX_STD_BITS / 64U]; /**< 11-bit IDs present */
+    uint64_t extIDs[can_serial_CAPTURE_INDEX_EXT_BITS / 64U]; /**< Hashes of the 29-bit IDs present */
+} cipCaptureIndexEntry_t;
+
+/* Outcome of a query, see CIP_queryCapture */
+typedef struct _cipQueryStats {
+    uint64_t matches;       /**< Records given to the query function */
+    uint64_t blocks;        /**< Blocks in the capture */
+    uint64_t blocksRead;    /**< Blocks the index could not rule out */
+    uint64_t tailRecords;   /**< Records not indexed yet, read one by one */
+    uint64_t durationNs;
+} cipQueryStats_t;
+
+/* Outcome of a replay, see CIP_replayCapture */
+typedef struct _cipReplayStats {
+    uint64_t frames;        /**< Frames sent */
+    uint64_t failed;        /**< Frames the module could not send */
+    uint64_t missing;       /**< Positions w/o a complete record (torn or never written) */
+    uint64_t durationNs;
+    uint64_t maxLateNs;     /**< Worst delay behind the scaled original timing */
+    double   framesPerSec;
+} cipReplayStats_t;
+
+/* Send-to-receive latency histogram, see CIP_setLatencyTracking */
+typedef struct _cipLatencyHist {
+    uint64_t counts[can_serial_HIST_NB_BUCKETS]; /**< Higher values go to the last bucket */
+    uint64_t total;     /**< Number of samples */
+    uint64_t sumNs;
+    uint64_t minNs;     /**< UINT64_MAX w/o samples */
+    uint64_t maxNs;
+    uint64_t skewed;    /**< Samples received before they were sent (clocks out of sync), counted as 0 */
+} cipLatencyHist_t;
+
+typedef enum _cipLogLevel {
+    can_serial_LOG_ERROR = 0U,
+    can_serial_LOG_WARN  = 1U,
+    can_serial_LOG_INFO  = 2U,
+    can_serial_LOG_DEBUG = 3U
+} cipLogLevel_t;
+
 typedef uint8_t cipID_t;
 typedef int cipPort_t;
 
+/* Handle of a cyclic message (see CIP_addCyclic) */
+typedef uint32_t cipCyclicID_t;
+
 typedef int (*cipPutMessageFct_t)(const uint8_t, const uint32_t, const uint8_t, const uint8_t * const, const uint32_t);
 
+/* Batch put message function : caller ID, messages, number of messages. Returns 0 on success. */
+typedef int (*cipPutMessagesFct_t)(const uint8_t, const cipMessage_t * const, const size_t);
+
+/* Per CAN ID handler : user context, CAN ID, size, data, flags. Returns 0 on success. */
+typedef int (*cipHandlerFct_t)(void * const, const uint32_t, const uint8_t, const uint8_t * const, const uint32_t);
+
+/* Capture query function : user context, matching record. Returns 0 to go on. */
+typedef int (*cipQueryFct_t)(void * const, const cipCaptureRecord_t * const);
+
+/* Log sink : user context, level, formatted line (w/ its level prefix and trailing new line) */
+typedef void (*cipLogSinkFct_t)(void * const, const cipLogLevel_t, const char * const);
+
 /* CAN over serial interface ------------------------------- */
 /**
  * @brief CAN over serial module creation
+ * Resets the module slot, keeping its RX ring, TX queue,
+ * TX priority and TX bitrate settings. Optional : CIP_init
+ * and CIP_initSerial set a slot up the first time it is used.
  * 
  * @param[in]   pID     ID of the driver used.
  * 
@@ -72,6 +278,158 @@ cipErrorCode_t CIP_createModule(const cipID_t pID);
  */
 cipErrorCode_t CIP_init(const cipID_t pID, const cipMode_t pCIPMode, const cipPort_t pPort);
 
+/**
+ * @brief CAN over serial initialisation on a serial port
+ * Opens a SLCAN (Lawicel) adapter, sets it to raw mode
+ * and opens its CAN channel. SLCAN is classic CAN only,
+ * can_serial_MODE_FD is refused.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCIPMode    CAN mode.
+ * @param[in]   pDevice     Serial device path (ex: /dev/ttyUSB0).
+ * @param[in]   pBaudrate   Serial baudrate (ex: 3000000).
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_initSerial(const cipID_t pID, const cipMode_t pCIPMode, const char * const pDevice, const uint32_t pBaudrate);
+
+/**
+ * @brief Sets the capacity of the RX ring.
+ * Must be called before CIP_init. When the capacity is not 0,
+ * the RX thread stores the received messages in a lock-free
+ * single-producer/single-consumer ring instead of calling
+ * the put message function. Drain it with CIP_pollMessages.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCapacity   Number of messages (rounded up to a power of 2), 0 to disable.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setRxRingSize(const cipID_t pID, const size_t pCapacity);
+
+/**
+ * @brief Sets the capacity of the TX queue.
+ * Must be called before CIP_init. When the capacity is not 0,
+ * CIP_send and CIP_sendBatch only copy the messages in a lock-free
+ * multi-producer queue and return : a writer thread of the module
+ * sends them in batches. A full queue refuses the messages
+ * (can_serial_ERROR_FULL, see cipStats_t::txQueueFull), the send
+ * errors are only reported by CIP_getStats. CIP_reset sends the
+ * queued messages before closing the socket/serial port.
+ * CAN FD messages are always sent by the caller.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCapacity   Number of messages (rounded up to a power of 2), 0 to disable.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setTxQueueSize(const cipID_t pID, const size_t pCapacity);
+
+/**
+ * @brief Sends the queued messages in CAN ID order.
+ * Must be called before CIP_init, only applies to a module
+ * w/ a TX queue (see CIP_setTxQueueSize). The TX writer orders
+ * the pending messages like the CAN arbitration does (lower IDs
+ * first, a standard ID before the extended IDs sharing its 11
+ * upper bits) and keeps the submission order within one ID.
+ * A message of the highest pending priority waits for at most
+ * can_serial_TX_PRIORITY_BATCH_SIZE messages already being sent.
+ * The queue capacity then bounds the messages queued and not
+ * sent yet, instead of the messages not taken by the writer yet.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pEnable     true to order by CAN ID, false for the submission order.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setTxPriority(const cipID_t pID, const bool pEnable);
+
+/**
+ * @brief Paces the sent messages to a CAN bitrate.
+ * Must be called before CIP_init. CIP_send and CIP_sendBatch
+ * (or the TX writer, see CIP_setTxQueueSize) then release the
+ * messages through a token bucket filled at pBitrate : each frame
+ * costs its worst-case length on the bus, bit stuffing included,
+ * and a short burst is allowed after an idle period. This keeps
+ * SLCAN adapters from overrunning their FIFOs. A direct send
+ * blocks until the bucket pays for its frames.
+ * CAN FD messages are not paced.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pBitrate    Nominal bitrate (ex: 500000 bit/s), 0 to disable.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setTxBitrate(const cipID_t pID, const uint32_t pBitrate);
+
+/**
+ * @brief Sets the UDP wire format used to send messages.
+ * Compact (default) packs several frames per datagram and only
+ * carries the used data bytes. Legacy sends one raw cipMessage_t
+ * per datagram, for peers running older versions.
+ * Both formats are always accepted upon reception.
+ * Call it after CIP_createModule.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pFormat     Wire format.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setWireFormat(const cipID_t pID, const cipWireFormat_t pFormat);
+
+/**
+ * @brief Sets the acceptance filters.
+ * Only the frames matching at least one filter are received.
+ * 11-bit rules apply to frames w/o can_serial_FLAG_EFF and an ID up to 0x7FF,
+ * 29-bit rules to the others. Over UDP, the rules and the loopback check
+ * also run in the kernel as a socket filter, dropping the single-frame
+ * datagrams nobody wants before they are copied to user space.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pFilters    Array of pCount filters.
+ * @param[in]   pCount      Number of filters (up to can_serial_MAX_NB_FILTERS), 0 to accept every frame.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setFilters(const cipID_t pID, const cipFilter_t * const pFilters, const size_t pCount);
+
+/**
+ * @brief Enables or disables TX timestamps.
+ * Over UDP, the kernel reports when each datagram left the network stack
+ * (SO_TIMESTAMPING software TX timestamps), over a serial port
+ * it is the time the SLCAN frames were written to the tty.
+ * Read the last one with CIP_getTxTimestamp.
+ * Call it after CIP_createModule, disabled by default.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pEnable     true to enable TX timestamps.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setTxTimestamping(const cipID_t pID, const bool pEnable);
+
+/**
+ * @brief Gets the TX timestamp of the last message sent.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[out]  pTimestamp  TX time in ns since the epoch, 0 if the kernel did not report it yet.
+ * 
+ * @return Error code, can_serial_ERROR_CONFIG if TX timestamps are disabled
+ */
+cipErrorCode_t CIP_getTxTimestamp(const cipID_t pID, uint64_t * const pTimestamp);
+
+/**
+ * @brief Gets the RX timestamp of the message being handed over.
+ * Only valid from the put message function or a handler,
+ * the other receive functions fill cipMessage_t.timestamp.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[out]  pTimestamp  RX time in ns since the epoch, 0 if unknown.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_getRxTimestamp(const cipID_t pID, uint64_t * const pTimestamp);
+
 /**
  * @brief CAN over serial check for initialisation
  * 
@@ -92,6 +450,8 @@ cipErrorCode_t CIP_reset(const cipID_t pID, const cipMode_t pCIPMode);
 
 /**
  * @brief CAN over serial stop
+ * Stops the reception and waits for the RX thread to exit
+ * (or for the module to leave its reactor).
  * 
  * @param[in]   pID     ID of the driver used.
  * 
@@ -101,6 +461,7 @@ cipErrorCode_t CIP_stop(const cipID_t pID);
 
 /**
  * @brief CAN over serial restart
+ * Resumes the reception stopped by CIP_stop, if any.
  * 
  * @param[in]   pID     ID of the driver used.
  * 
@@ -111,6 +472,7 @@ cipErrorCode_t CIP_restart(const cipID_t pID);
 /** 
  * @brief CAN over serial send
  * Use this function to send a CAN message
+ * (queue it, see CIP_setTxQueueSize)
  * 
  * @param[in]   pID     ID of the driver used.
  * @param[in]   pCANID  CAN message ID.
@@ -126,6 +488,76 @@ cipErrorCode_t CIP_send(const cipID_t pID,
     const uint8_t * const pData,
     const uint32_t pFlags);
 
+/** 
+ * @brief CAN over serial batched send
+ * Use this function to send several CAN messages
+ * with as few syscalls as possible (sendmmsg).
+ * With the compact wire format, consecutive messages
+ * share datagrams.
+ * A full socket send buffer is waited on for up to
+ * can_serial_UDP_TX_TIMEOUT_MS before the messages fail.
+ * The lock is only taken once for the whole batch.
+ * With a TX queue, the messages are only queued : pResults
+ * and pSent tell which ones the queue accepted.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pMsgs       Array of pCount CAN messages (randID is ignored).
+ * @param[in]   pCount      Number of CAN messages to send.
+ * @param[out]  pResults    Optional (may be NULL) array of pCount error codes,
+ *                          one per message, to retry only the failed ones.
+ * @param[out]  pSent       Optional (may be NULL) number of messages sent (or queued).
+ * 
+ * @return Error code, can_serial_ERROR_NET if any message failed,
+ *         can_serial_ERROR_FULL if the TX queue refused some
+ */
+cipErrorCode_t CIP_sendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent);
+
+/** 
+ * @brief CAN FD send
+ * Sends a CAN FD frame (can_serial_FLAG_FDF is set).
+ * pSize is rounded up to the next CAN FD length,
+ * the padding bytes are 0.
+ * The module must be initialized in can_serial_MODE_FD.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[in]   pCANID  CAN message ID.
+ * @param[in]   pSize   CAN message size (up to CAN_FD_MESSAGE_MAX_SIZE).
+ * @param[in]   pData   CAN message data.
+ * @param[in]   pFlags  CAN message flags (ex: can_serial_FLAG_BRS).
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_sendFd(const cipID_t pID,
+    const uint32_t pCANID,
+    const uint8_t pSize,
+    const uint8_t * const pData,
+    const uint32_t pFlags);
+
+/** 
+ * @brief CAN FD batched send
+ * Same as CIP_sendBatch for CAN FD messages.
+ * A message bigger than CAN_MESSAGE_MAX_SIZE must have
+ * can_serial_FLAG_FDF set and a valid CAN FD length.
+ * The module must be initialized in can_serial_MODE_FD.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pMsgs       Array of pCount CAN FD messages (randID is ignored).
+ * @param[in]   pCount      Number of CAN FD messages to send.
+ * @param[out]  pResults    Optional (may be NULL) array of pCount error codes.
+ * @param[out]  pSent       Optional (may be NULL) number of messages sent.
+ * 
+ * @return Error code, can_serial_ERROR_NET if any message failed
+ */
+cipErrorCode_t CIP_sendFdBatch(const cipID_t pID,
+    const cipFdMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent);
+
 /**
  * @brief CAN over serial recieve
  * Use this function to get a CAN message
@@ -136,10 +568,90 @@ cipErrorCode_t CIP_send(const cipID_t pID,
  */
 cipErrorCode_t CIP_recv(const cipID_t pID, cipMessage_t * const pMsg, ssize_t * const pReadBytes);
 
+/**
+ * @brief CAN over serial batched receive
+ * Use this function to get all the CAN messages
+ * waiting on the socket, up to pMax, with as few
+ * syscalls as possible (recvmmsg).
+ * Inconsistent datagrams are dropped. Messages of a
+ * datagram that do not fit in pMsgs are kept for the next call.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pMsgs   Array of at least pMax messages.
+ * @param[in]   pMax    Maximum number of messages to receive.
+ * @param[out]  pCount  Number of messages received.
+ * 
+ * @return error_code
+ */
+cipErrorCode_t CIP_recvBatch(const cipID_t pID, cipMessage_t * const pMsgs, const size_t pMax, size_t * const pCount);
+
+/**
+ * @brief CAN FD batched receive
+ * Same as CIP_recvBatch, for can_serial_MODE_FD modules.
+ * CIP_recvBatch skips the messages bigger than CAN_MESSAGE_MAX_SIZE.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pMsgs   Array of at least pMax CAN FD messages.
+ * @param[in]   pMax    Maximum number of messages to receive.
+ * @param[out]  pCount  Number of messages received.
+ * 
+ * @return error_code
+ */
+cipErrorCode_t CIP_recvFdBatch(const cipID_t pID, cipFdMessage_t * const pMsgs, const size_t pMax, size_t * const pCount);
+
+/**
+ * @brief Get the CAN messages stored in the RX ring by the RX thread.
+ * Lock-free, must only be called from a single consumer thread.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pMsgs   Array of at least pMax messages.
+ * @param[in]   pMax    Maximum number of messages to get.
+ * @param[out]  pCount  Number of messages got.
+ * 
+ * @return error_code
+ */
+cipErrorCode_t CIP_pollMessages(const cipID_t pID, cipMessage_t * const pMsgs, const size_t pMax, size_t * const pCount);
+
+/**
+ * @brief Get the CAN FD messages stored in the RX ring by the RX thread.
+ * The RX ring of a can_serial_MODE_FD module holds CAN FD messages,
+ * the one of a classic module holds cipMessage_t (see CIP_pollMessages).
+ * Lock-free, must only be called from a single consumer thread.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pMsgs   Array of at least pMax CAN FD messages.
+ * @param[in]   pMax    Maximum number of messages to get.
+ * @param[out]  pCount  Number of messages got.
+ * 
+ * @return error_code
+ */
+cipErrorCode_t CIP_pollFdMessages(const cipID_t pID, cipFdMessage_t * const pMsgs, const size_t pMax, size_t * const pCount);
+
+/**
+ * @brief CAN FD DLC to data length
+ * 
+ * @param[in]   pDLC    Data length code (0 to 15).
+ * 
+ * @return Data length in bytes (0 to 64)
+ */
+uint8_t CIP_dlcToLength(const uint8_t pDLC);
+
+/**
+ * @brief Data length to CAN FD DLC
+ * Lengths that have no DLC are rounded up.
+ * 
+ * @param[in]   pLength Data length in bytes (0 to 64).
+ * 
+ * @return Data length code (0 to 15), 15 if pLength is over 64
+ */
+uint8_t CIP_lengthToDlc(const uint8_t pLength);
+
 /**
  * @brief Sets the function used to give a message to
  * the driver's caller's stack.
  * 
+ * CAN FD modules hand messages of up to CAN_FD_MESSAGE_MAX_SIZE bytes over.
+ * 
  * @param[in]   pID     ID of the driver used.
  * @param[in]   pFct    Function used to hand the message over to the caller.
  * 
@@ -147,6 +659,44 @@ cipErrorCode_t CIP_recv(const cipID_t pID, cipMessage_t * const pMsg, ssize_t *
  */
 cipErrorCode_t CIP_setPutMessageFunction(const cipID_t pID, const uint8_t pCallerID, const cipPutMessageFct_t pFct);
 
+/**
+ * @brief Sets the function used to give messages to
+ * the driver's caller's stack, a batch at a time.
+ * 
+ * Every message drained in one wake-up is handed over in a single call,
+ * straight from the RX buffer : the array is only valid during the call.
+ * Takes precedence over the put message function.
+ * Not available to can_serial_MODE_FD modules.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCallerID   ID given back to pFct.
+ * @param[in]   pFct        Function used to hand the messages over to the caller.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setPutMessagesFunction(const cipID_t pID, const uint8_t pCallerID, const cipPutMessagesFct_t pFct);
+
+/**
+ * @brief Registers a handler for one CAN ID
+ * 
+ * Received frames with this ID are given to pFct instead of
+ * the put message function or the RX ring, in O(1) : standard IDs
+ * index a table, extended IDs go through a hash map.
+ * Frames w/o handler still go to the put message function or the RX ring,
+ * they are dropped if there is neither.
+ * IDs above 0x7FF are extended, OR can_serial_ID_EXT in for a low extended ID.
+ * Must not be called from a handler or from the put message function.
+ * The handlers are cleared by CIP_init/CIP_initSerial.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[in]   pCANID  CAN ID, optionally ORed with can_serial_ID_EXT.
+ * @param[in]   pFct    Handler, NULL unregisters the CAN ID.
+ * @param[in]   pCtx    User context given to the handler.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_registerHandler(const cipID_t pID, const uint32_t pCANID, const cipHandlerFct_t pFct, void * const pCtx);
+
 /**
  * @brief Print a CAN over serial message (long format)
  * 
@@ -174,6 +724,7 @@ cipErrorCode_t CIP_process(const cipID_t pID);
 
 /**
  * @brief Starts the receiving thread.
+ * Fails w/ can_serial_ERROR_ALREADY_INIT while it runs.
  * 
  * @param[in]   pID     ID of the driver used.
  * 
@@ -181,6 +732,279 @@ cipErrorCode_t CIP_process(const cipID_t pID);
  */
 cipErrorCode_t CIP_startRxThread(const cipID_t pID);
 
+/**
+ * @brief Sets the number of reactor threads.
+ * With at least one reactor thread, CIP_startRxThread
+ * registers the module to a reactor, which services the
+ * sockets of many modules with epoll, instead of spawning
+ * an RX thread per module. 0 (default) disables the reactors.
+ * Cannot be changed while a module is serviced by a reactor.
+ * 
+ * @param[in]   pNbThreads  Number of reactor threads.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setReactorThreads(const size_t pNbThreads);
+
+/**
+ * @brief Snapshot of the module counters.
+ * Never blocks : the counters are read one by one w/o the module lock,
+ * so the snapshot may be a few frames off while traffic flows.
+ * The counters are reset by CIP_init/CIP_initSerial.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pStats  Counters.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_getStats(const cipID_t pID, cipStats_t * const pStats);
+
+/**
+ * @brief Resets the module counters.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_resetStats(const cipID_t pID);
+
+/**
+ * @brief Enables or disables latency tracking.
+ * The module embeds its send time (CLOCK_REALTIME) in every compact
+ * datagram it sends, and records the send-to-receive latency of every
+ * received frame that carries one in its histogram, when the frame is
+ * decoded, right before it is handed over. Across hosts, the clocks must
+ * be synchronized (PTP). Peers older than this version drop the datagrams
+ * that carry a send time. The legacy wire format cannot carry it.
+ * Call it after CIP_createModule, disabled by default.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pEnable     true to embed send times and record latencies.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setLatencyTracking(const cipID_t pID, const bool pEnable);
+
+/**
+ * @brief Snapshot of the latency histogram of a module.
+ * Does not block the receiving thread.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * @param[out]  pHist   Histogram.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_getLatencyHist(const cipID_t pID, cipLatencyHist_t * const pHist);
+
+/**
+ * @brief Clears the latency histogram of a module.
+ * 
+ * @param[in]   pID     ID of the driver used.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_resetLatencyHist(const cipID_t pID);
+
+/**
+ * @brief Clears a histogram.
+ * 
+ * @param[out]  pHist   Histogram.
+ */
+void CIP_latencyHistInit(cipLatencyHist_t * const pHist);
+
+/**
+ * @brief Adds the samples of pSrc to pDst, ex: to merge the histograms of several modules.
+ * 
+ * @param[in,out]   pDst    Histogram to add to.
+ * @param[in]       pSrc    Histogram to add.
+ */
+void CIP_latencyHistMerge(cipLatencyHist_t * const pDst, const cipLatencyHist_t * const pSrc);
+
+/**
+ * @brief Latency at a given percentile.
+ * 
+ * @param[in]   pHist       Histogram.
+ * @param[in]   pPercentile Percentile (0 to 100, ex: 99.9).
+ * 
+ * @return Highest latency of the bucket reaching the percentile (ns), 0 w/o samples
+ */
+uint64_t CIP_latencyHistPercentile(const cipLatencyHist_t * const pHist, const double pPercentile);
+
+/**
+ * @brief Sets the level of the messages the library logs.
+ * Shared by all the modules, can_serial_LOG_INFO by default.
+ * Messages above can_serial_LOG_LEVEL_MAX are compiled out.
+ * 
+ * @param[in]   pLevel  Most verbose level logged.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setLogLevel(const cipLogLevel_t pLevel);
+
+/**
+ * @brief Sets where the library logs go, stdout by default.
+ * The send and receive paths never format nor write their logs :
+ * they queue them in a lock-free ring, a background log thread
+ * formats them and calls the sink. The other messages are
+ * formatted and given to the sink by the calling thread.
+ * The sink is never called concurrently. It runs w/ the log lock held :
+ * the messages it logs synchronously are dropped (and counted),
+ * CIP_logFlush does nothing and CIP_setLogSink fails when called from it.
+ * 
+ * @param[in]   pFct    Sink, NULL restores the default one.
+ * @param[in]   pCtx    User context given to the sink.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_setLogSink(const cipLogSinkFct_t pFct, void * const pCtx);
+
+/**
+ * @brief Formats the queued log messages and gives them to the sink now,
+ * instead of waiting for the log thread. Also called at exit.
+ * 
+ * @return Number of messages written
+ */
+size_t CIP_logFlush(void);
+
+/**
+ * @brief Sends a CAN message periodically
+ * 
+ * A timer wheel thread of the module (1 ms tick) sends the message
+ * every pPeriodMs, the first time pPhaseMs after this call,
+ * through CIP_sendBatch : the TX queue, priority and pacing apply.
+ * The cyclic messages are removed by CIP_reset.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pMsg        Classic CAN message (randID and timestamp are ignored).
+ * @param[in]   pPeriodMs   Period, in ms (> 0).
+ * @param[in]   pPhaseMs    Delay before the first transmission, in ms.
+ * @param[out]  pCyclicID   Handle of the cyclic message.
+ * 
+ * @return Error code, can_serial_ERROR_FULL if can_serial_MAX_NB_CYCLIC are already sent
+ */
+cipErrorCode_t CIP_addCyclic(const cipID_t pID,
+    const cipMessage_t * const pMsg,
+    const uint32_t pPeriodMs,
+    const uint32_t pPhaseMs,
+    cipCyclicID_t * const pCyclicID);
+
+/**
+ * @brief Replaces the payload of a cyclic message
+ * 
+ * The payload is swapped in place, w/o lock nor allocation :
+ * each transmission carries either the old or the new payload, never a mix.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCyclicID   Handle given by CIP_addCyclic.
+ * @param[in]   pSize       CAN message size.
+ * @param[in]   pData       CAN message data.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_updateCyclic(const cipID_t pID,
+    const cipCyclicID_t pCyclicID,
+    const uint8_t pSize,
+    const uint8_t * const pData);
+
+/**
+ * @brief Stops sending a cyclic message
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pCyclicID   Handle given by CIP_addCyclic.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_removeCyclic(const cipID_t pID, const cipCyclicID_t pCyclicID);
+
+/**
+ * @brief Starts recording the traffic of a module
+ * 
+ * Every frame given to CIP_send* and every frame the RX thread
+ * delivers is stored, w/ its direction and timestamp, as a
+ * cipCaptureRecord_t in a ring of can_serial_CAPTURE_NB_SEGMENTS
+ * preallocated, memory-mapped files "<pPath>.<n>" : recording a frame
+ * is a few stores, w/o syscall. When a file is full, the capture
+ * goes on in the next one, overwriting the oldest frames.
+ * A background thread flushes the files (msync) periodically
+ * and keeps the index "<pPath>.idx" up to date (see CIP_queryCapture).
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pPath       Path prefix of the capture files.
+ * @param[in]   pMaxBytes   Total size of the capture files.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_startCapture(const cipID_t pID, const char * const pPath, const size_t pMaxBytes);
+
+/**
+ * @brief Stops recording, flushes and closes the capture files
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_stopCapture(const cipID_t pID);
+
+/**
+ * @brief Sends the frames of a capture again through a module
+ * 
+ * The capture files "<pPath>.<n>" (see CIP_startCapture) are mapped
+ * and their records are sent in sequence order, in batches
+ * (CIP_sendBatch, or CIP_sendFdBatch if the module is in
+ * can_serial_MODE_FD). A classic module counts the CAN FD
+ * frames as failed.
+ * W/ a speed factor, each frame leaves at its original time
+ * offset divided by the factor : the thread sleeps until shortly
+ * before that time, then spins on the clock for precision.
+ * W/ can_serial_REPLAY_MAX_SPEED, frames are sent back to back.
+ * Returns once the capture has been replayed.
+ * 
+ * @param[in]   pID         ID of the driver used.
+ * @param[in]   pPath       Path prefix of the capture files.
+ * @param[in]   pSpeed      1.0 for the original timing, 2.0 twice as fast, etc.
+ *                          or can_serial_REPLAY_MAX_SPEED.
+ * @param[in]   pDirections can_serial_REPLAY_RX and/or can_serial_REPLAY_TX.
+ * @param[out]  pStats      Outcome of the replay, may be NULL.
+ * 
+ * @return Error code (the first send error, if any)
+ */
+cipErrorCode_t CIP_replayCapture(const cipID_t pID,
+    const char * const pPath,
+    const double pSpeed,
+    const uint32_t pDirections,
+    cipReplayStats_t * const pStats);
+
+/**
+ * @brief Finds the frames of a capture by CAN ID and time
+ * 
+ * The index "<pPath>.idx" holds, for every can_serial_CAPTURE_INDEX_BLOCK
+ * positions of the capture, their time range and a bitmap of their
+ * CAN IDs. Only the blocks it cannot rule out are read. The records
+ * not indexed yet (running capture) are read one by one, the whole
+ * capture if the index is missing.
+ * pFct gets the matching records in sequence order, it may stop
+ * the query by returning non-zero.
+ * 
+ * @param[in]   pPath       Path prefix of the capture files.
+ * @param[in]   pFilters    Array of pCount filters (see CIP_setFilters).
+ * @param[in]   pCount      Number of filters, 0 for every CAN ID.
+ * @param[in]   pFrom       Earliest timestamp (ns since the epoch), included.
+ * @param[in]   pTo         Latest timestamp, included (UINT64_MAX : no limit).
+ * @param[in]   pFct        Query function.
+ * @param[in]   pCtx        User context given to pFct.
+ * @param[out]  pStats      Outcome of the query, may be NULL.
+ * 
+ * @return Error code
+ */
+cipErrorCode_t CIP_queryCapture(const char * const pPath,
+    const cipFilter_t * const pFilters,
+    const size_t pCount,
+    const uint64_t pFrom,
+    const uint64_t pTo,
+    const cipQueryFct_t pFct,
+    void * const pCtx,
+    cipQueryStats_t * const pStats);
+
 /**
  * @brief Getter for the "Thread On" variable
  * 
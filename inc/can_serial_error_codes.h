@@ -21,7 +21,8 @@ typedef enum _cipErrorCodes {
     can_serial_ERROR_ALREADY_INIT = 5,
     can_serial_ERROR_NOT_INIT     = 6,
     can_serial_ERROR_STOPPED      = 7,
-    can_serial_ERROR_CONFIG       = 8
+    can_serial_ERROR_CONFIG       = 8,
+    can_serial_ERROR_FULL         = 9
 } cipErrorCode_t;
 
 #endif /* can_serial_ERROR_CODES_H */
@@ -0,0 +1,91 @@
+/**
+ * @brief CAN over serial SLCAN (Lawicel) ASCII codec
+ * Converts between cipMessage_t and SLCAN text
+ * ('t'/'T'/'r'/'R' + hex ID + DLC + hex data + '\r').
+ *
+ * @file can_serial_slcan.h
+ */
+
+#ifndef can_serial_SLCAN_H
+#define can_serial_SLCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Defines --------------------------------------------- */
+/* Longest SLCAN frame : 'T' + 8 ID + DLC + 2 * 8 data + 4 timestamp + '\r' */
+#define can_serial_SLCAN_MAX_FRAME_LEN 31U
+
+/* Type definitions ------------------------------------ */
+
+/* SLCAN codec interface ------------------------------- */
+/**
+ * @brief Encode a CAN message as a SLCAN frame
+ *
+ * @param[in]   pMsg    CAN message to encode.
+ * @param[out]  pBuf    Output buffer, at least can_serial_SLCAN_MAX_FRAME_LEN long.
+ *
+ * @return Number of characters written (including '\r'), 0 if the message is invalid
+ */
+size_t CIP_slcanEncode(const cipMessage_t * const pMsg, char * const pBuf);
+
+/**
+ * @brief Encode CAN messages as SLCAN frames in one contiguous buffer
+ *
+ * @param[in]   pMsgs   CAN messages to encode.
+ * @param[in]   pCount  Number of CAN messages.
+ * @param[out]  pBuf    Output buffer.
+ * @param[in]   pCap    Output buffer size.
+ * @param[out]  pLen    Number of characters written.
+ *
+ * @return Number of messages encoded, stops at the first invalid message or when pBuf is full
+ */
+size_t CIP_slcanEncodeBatch(const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    char * const pBuf,
+    const size_t pCap,
+    size_t * const pLen);
+
+/**
+ * @brief Decode one SLCAN frame
+ *
+ * @param[in]   pLine   SLCAN frame, without its trailing '\r'.
+ * @param[in]   pLen    SLCAN frame length.
+ * @param[out]  pMsg    Decoded CAN message.
+ *
+ * @return Error code, can_serial_ERROR_ARG if pLine is not a valid frame
+ */
+cipErrorCode_t CIP_slcanDecode(const char * const pLine, const size_t pLen, cipMessage_t * const pMsg);
+
+/**
+ * @brief Decode SLCAN frames from a character stream
+ * A trailing partial frame is left for the next call.
+ * Non-frame lines (command acknowledges, errors) are skipped.
+ *
+ * @param[in]   pBuf        Characters received.
+ * @param[in]   pLen        Number of characters.
+ * @param[out]  pMsgs       Decoded CAN messages.
+ * @param[in]   pMax        Maximum number of messages to decode.
+ * @param[out]  pConsumed   Number of characters processed.
+ *
+ * @return Number of messages decoded
+ */
+size_t CIP_slcanParse(const char * const pBuf,
+    const size_t pLen,
+    cipMessage_t * const pMsgs,
+    const size_t pMax,
+    size_t * const pConsumed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* can_serial_SLCAN_H */
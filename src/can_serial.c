@@ -9,90 +9,491 @@
 #include "can_serial_error_codes.h"
 #include "can_serial.h"
 #include "can_serial_socket_mgt.h"
+#include "can_serial_serial_mgt.h"
+#include "can_serial_log.h"
 
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h> /* For rand() */
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/random.h>
+
+/* errno */
+#include <errno.h>
 
 /* Defines --------------------------------------------- */
 
 /* Type definitions ------------------------------------ */
 
 /* Global variables ------------------------------------ */
-cipInternalStruct_t gCIP;
+cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES]; /* One cache-line-aligned state per module */
+
+/* Support functions ----------------------------------- */
+/* Sets up the locks and tables of a slot, keeps its configuration */
+static void CIP_setupModule(const cipID_t pID) {
+    gCIP[pID].cipInstanceID = pID;
+    gCIP[pID].canSocket     = -1;
+    gCIP[pID].wakeFd        = -1;
+    gCIP[pID].txWakeFd      = -1;
+    pthread_mutex_init(&gCIP[pID].rxMutex, NULL);
+    pthread_mutex_init(&gCIP[pID].txMutex, NULL);
+    CIP_handlersInit(&gCIP[pID].handlers);
+    CIP_latencyHistInit(&gCIP[pID].latency);
+    CIP_cyclicInit(&gCIP[pID].cyclic);
+    CIP_captureInit(&gCIP[pID].capture);
+    gCIP[pID].isCreated = true;
+}
 
 /* CAN over serial main functions -------------------------- */
 cipErrorCode_t CIP_createModule(const cipID_t pID) {
     if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_createModule> Module ID %u is out of range (max %u modules)\n", pID, can_serial_MAX_NB_MODULES);
         return can_serial_ERROR_ARG;
     }
 
-    /* check if the module already exists */
-    if(gCIP.cipInstanceID != pID) {
-        return can_serial_ERROR_ARG;
+    /* check if the module is in use */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_createModule> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    /* Start from a clean slot, keeping the RX ring and TX queue configuration */
+    const size_t lRxRingCapacity  = gCIP[pID].rxRingCapacity;
+    const size_t lTxQueueCapacity = gCIP[pID].txQueueCapacity;
+    const bool   lTxPriority      = gCIP[pID].txPriority;
+    const uint32_t lTxBitrate     = gCIP[pID].txBitrate;
+    if(CIP_captureOn(&gCIP[pID].capture)) {
+        (void)CIP_stopCapture(pID);
+    }
+    CIP_ringFree(&gCIP[pID].rxRing);
+    CIP_txQueueFree(&gCIP[pID].txQueue);
+    CIP_txHeapFree(&gCIP[pID].txHeap);
+    CIP_cyclicFree(&gCIP[pID].cyclic);
+    CIP_handlersFree(&gCIP[pID].handlers);
+    memset(&gCIP[pID], 0, sizeof(cipInternalStruct_t));
+    gCIP[pID].rxRingCapacity  = lRxRingCapacity;
+    gCIP[pID].txQueueCapacity = lTxQueueCapacity;
+    gCIP[pID].txPriority      = lTxPriority;
+    gCIP[pID].txBitrate       = lTxBitrate;
+    CIP_setupModule(pID);
+
+    return can_serial_ERROR_NONE;
+}
+
+static cipErrorCode_t CIP_openTransport(const cipID_t pID) {
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport) {
+        return CIP_initSerialPort(pID);
+    }
+
+    return CIP_initCanSocket(pID);
+}
+
+static cipErrorCode_t CIP_closeTransport(const cipID_t pID) {
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport) {
+        return CIP_closeSerialPort(pID);
+    }
+
+    return CIP_closeSocket(pID);
+}
+
+static void CIP_closeTxPaceFd(const cipID_t pID) {
+    if(0 <= gCIP[pID].txPaceFd) {
+        (void)close(gCIP[pID].txPaceFd);
+        gCIP[pID].txPaceFd = -1;
+    }
+}
+
+static cipErrorCode_t CIP_initModule(const cipID_t pID, const cipMode_t pCIPMode) {
+    /* Initialize the module */
+    gCIP[pID].cipMode       = pCIPMode;
+    gCIP[pID].cipInstanceID = pID;
+    gCIP[pID].isStopped     = false;
+
+    /* Generate random ID, different for every module of every process */
+    if(sizeof(gCIP[pID].randID) != getrandom(&gCIP[pID].randID, sizeof(gCIP[pID].randID), 0U)) {
+        time_t lTime;
+        srand((unsigned)time(&lTime) ^ ((unsigned)getpid() << 8U) ^ pID);
+        gCIP[pID].randID  = (rand() & 0xFFU) << 0U;
+        gCIP[pID].randID |= (rand() & 0xFFU) << 8U;
+        gCIP[pID].randID |= (rand() & 0xFFU) << 16U;
+        gCIP[pID].randID |= (rand() & 0xFFU) << 24U;
+    }
+    CIP_LOG(can_serial_LOG_DEBUG, "Generated random ID : %u\n", gCIP[pID].randID);
+
+    /* Initialize the socket or the serial port */
+    if(can_serial_ERROR_NONE != CIP_openTransport(pID)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> Failed to initialize the CAN socket/serial port\n");
+        return can_serial_ERROR_NET;
+    }
+
+    /* Forget the datagrams received before a reset */
+    gCIP[pID].rxNbDatagrams = 0U;
+    gCIP[pID].rxDatagramIdx = 0U;
+    gCIP[pID].rxReader.left = 0U;
+
+    /* Create the eventfd used to wake the RX thread up */
+    errno = 0;
+    if(0 > (gCIP[pID].wakeFd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_init> eventfd failed !\n");
+        (void)CIP_closeTransport(pID);
+        return can_serial_ERROR_SYS;
     }
 
-    /* TODO */
+    /* Allocate the RX ring w/ slots sized to the mode, or empty it on reset */
+    const bool lFd = can_serial_MODE_FD == pCIPMode;
+    if(NULL != gCIP[pID].rxRing.frames && lFd != gCIP[pID].rxRing.isFd) {
+        CIP_ringFree(&gCIP[pID].rxRing);
+    }
+    if(0U < gCIP[pID].rxRingCapacity) {
+        if(NULL == gCIP[pID].rxRing.frames) {
+            if(can_serial_ERROR_NONE != CIP_ringInit(&gCIP[pID].rxRing, gCIP[pID].rxRingCapacity, lFd)) {
+                CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> Failed to allocate the RX ring\n");
+                (void)close(gCIP[pID].wakeFd);
+                (void)CIP_closeTransport(pID);
+                return can_serial_ERROR_SYS;
+            }
+        } else {
+            CIP_ringClear(&gCIP[pID].rxRing);
+        }
+    }
+    memset(&gCIP[pID].rxStats, 0, sizeof(cipRxCounters_t));
+    memset(&gCIP[pID].txStats, 0, sizeof(cipTxCounters_t));
+    CIP_latencyHistInit(&gCIP[pID].latency);
+
+    /* Start w/ an empty bucket, waited on w/ a timerfd when there is one */
+    gCIP[pID].txTokens      = 0U;
+    gCIP[pID].txTokensStamp = CIP_monotonicNs();
+    gCIP[pID].txPaceFd      = -1;
+    if(0U < gCIP[pID].txBitrate) {
+        errno = 0;
+        if(0 > (gCIP[pID].txPaceFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC))) {
+            CIP_LOG_ERRNO(can_serial_LOG_WARN, errno, "<CIP_init> timerfd_create failed, pacing falls back to clock_nanosleep\n");
+        }
+    }
+
+    /* Allocate the TX queue, or empty it on reset, and start its writer */
+    if(0U < gCIP[pID].txQueueCapacity) {
+        if(NULL == gCIP[pID].txQueue.slots) {
+            if(can_serial_ERROR_NONE != CIP_txQueueInit(&gCIP[pID].txQueue, gCIP[pID].txQueueCapacity)) {
+                CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> Failed to allocate the TX queue\n");
+                (void)close(gCIP[pID].wakeFd);
+                CIP_closeTxPaceFd(pID);
+                (void)CIP_closeTransport(pID);
+                return can_serial_ERROR_SYS;
+            }
+        } else {
+            CIP_txQueueClear(&gCIP[pID].txQueue);
+        }
+
+        /* The heap holds every message the queue accepted */
+        if(gCIP[pID].txPriority) {
+            if(NULL == gCIP[pID].txHeap.entries) {
+                if(can_serial_ERROR_NONE != CIP_txHeapInit(&gCIP[pID].txHeap, gCIP[pID].txQueue.mask + 1U)) {
+                    CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> Failed to allocate the TX priority queue\n");
+                    (void)close(gCIP[pID].wakeFd);
+                    CIP_closeTxPaceFd(pID);
+                    (void)CIP_closeTransport(pID);
+                    return can_serial_ERROR_SYS;
+                }
+            } else {
+                CIP_txHeapClear(&gCIP[pID].txHeap);
+            }
+        }
+        gCIP[pID].txPending = 0U;
+
+        if(can_serial_ERROR_NONE != CIP_startTxWriter(pID)) {
+            (void)close(gCIP[pID].wakeFd);
+            CIP_closeTxPaceFd(pID);
+            (void)CIP_closeTransport(pID);
+            return can_serial_ERROR_SYS;
+        }
+    }
+
+    /* Initialize thread related variables */
+    gCIP[pID].rxThreadOn     = false;
+    gCIP[pID].rxResume       = false;
+    gCIP[pID].callerID       = 0U;
+    gCIP[pID].putMessageFct  = NULL;
+    gCIP[pID].putMessagesFct = NULL;
+    CIP_handlersClear(&gCIP[pID].handlers);
+
+    gCIP[pID].isInitialized = true;
 
     return can_serial_ERROR_NONE;
 }
 
 cipErrorCode_t CIP_init(const cipID_t pID, const cipMode_t pCIPMode, const cipPort_t pPort) {
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_init> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
     /* Check if the module is already initialized */
-    if(gCIP.isInitialized) {
+    if(gCIP[pID].isInitialized) {
         /* Module is already initialized,
          * so we do nothing */
-        printf("[ERROR] <CIP_init> CAN-IP module %u is already initialized.\n", pID);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_init> CAN-IP module %u is already initialized.\n", pID);
         /* TODO : Maybe reset ? */
         return can_serial_ERROR_ALREADY_INIT;
     }
 
-    /* Initialize the module */
-    gCIP.cipMode       = pCIPMode;
-    gCIP.cipInstanceID = pID;
-    gCIP.isStopped     = false;
-
-    /* Set port */
-    gCIP.canPort = pPort;
-
-    /* Generate random ID */
-    time_t lTime;
-    srand((unsigned)time(&lTime));
-    gCIP.randID  = (rand() & 0xFFU) << 0U;
-    gCIP.randID |= (rand() & 0xFFU) << 8U;
-    gCIP.randID |= (rand() & 0xFFU) << 16U;
-    gCIP.randID |= (rand() & 0xFFU) << 24U;
-    printf("[DEBUG] Generated random ID : %u\n", gCIP.randID);
-
-    /* Initialize the socket */
-    if(can_serial_ERROR_NONE != CIP_initCanSocket(pID)) {
-        printf("[ERROR] <CIP_init> Failed to initialize socket w/ CIP_initCanSocket\n");
-        return can_serial_ERROR_NET;
+    /* CIP_createModule is optional */
+    if(!gCIP[pID].isCreated) {
+        CIP_setupModule(pID);
     }
 
-    /* Initialize thread related variables */
-    gCIP.rxThreadOn    = false;
-    gCIP.callerID      = 0U;
-    gCIP.putMessageFct = NULL;
+    /* UDP broadcast transport */
+    gCIP[pID].transport = can_serial_TRANSPORT_UDP;
+    gCIP[pID].canPort   = pPort;
+
+    return CIP_initModule(pID, pCIPMode);
+}
+
+cipErrorCode_t CIP_initSerial(const cipID_t pID, const cipMode_t pCIPMode, const char * const pDevice, const uint32_t pBaudrate) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerial> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerial> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    /* CIP_createModule is optional */
+    if(!gCIP[pID].isCreated) {
+        CIP_setupModule(pID);
+    }
+
+    if(can_serial_MODE_FD == pCIPMode) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerial> SLCAN adapters do not support CAN FD\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == pDevice || sizeof(gCIP[pID].serialDevice) <= strlen(pDevice)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerial> Invalid serial device path\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Serial port (SLCAN) transport */
+    gCIP[pID].transport      = can_serial_TRANSPORT_SERIAL;
+    gCIP[pID].serialBaudrate = pBaudrate;
+    strcpy(gCIP[pID].serialDevice, pDevice);
+
+    return CIP_initModule(pID, pCIPMode);
+}
+
+cipErrorCode_t CIP_setRxRingSize(const cipID_t pID, const size_t pCapacity) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setRxRingSize> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* The ring is allocated by CIP_init */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setRxRingSize> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    if(can_serial_RING_MAX_CAPACITY < pCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setRxRingSize> RX ring capacity %zu is too large\n", pCapacity);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(gCIP[pID].rxRingCapacity != pCapacity) {
+        CIP_ringFree(&gCIP[pID].rxRing);
+    }
+    gCIP[pID].rxRingCapacity = pCapacity;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setTxQueueSize(const cipID_t pID, const size_t pCapacity) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxQueueSize> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* The queue and its writer are set up by CIP_init */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxQueueSize> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    /* Rounded up to a power of 2, w/ a TX priority heap entry per slot */
+    if(can_serial_RING_MAX_CAPACITY < pCapacity
+        || SIZE_MAX / sizeof(cipTxSlot_t) < pCapacity
+        || SIZE_MAX / sizeof(cipTxHeapEntry_t) < pCapacity)
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxQueueSize> TX queue capacity %zu is too large\n", pCapacity);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(gCIP[pID].txQueueCapacity != pCapacity) {
+        CIP_txQueueFree(&gCIP[pID].txQueue);
+        CIP_txHeapFree(&gCIP[pID].txHeap);
+    }
+    gCIP[pID].txQueueCapacity = pCapacity;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setTxPriority(const cipID_t pID, const bool pEnable) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxPriority> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* The writer thread is set up by CIP_init */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxPriority> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    if(!pEnable) {
+        CIP_txHeapFree(&gCIP[pID].txHeap);
+    }
+    gCIP[pID].txPriority = pEnable;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setTxBitrate(const cipID_t pID, const uint32_t pBitrate) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxBitrate> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* The bucket is set up by CIP_init */
+    if(gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxBitrate> CAN-IP module %u is already initialized.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    gCIP[pID].txBitrate = pBitrate;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setWireFormat(const cipID_t pID, const cipWireFormat_t pFormat) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setWireFormat> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(can_serial_WIRE_LEGACY != pFormat && can_serial_WIRE_COMPACT != pFormat) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setWireFormat> Unknown wire format %d\n", (int)pFormat);
+        return can_serial_ERROR_ARG;
+    }
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+    gCIP[pID].wireFormat = pFormat;
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setFilters(const cipID_t pID, const cipFilter_t * const pFilters, const size_t pCount) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setFilters> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipFilterTable_t lTable;
+    if(can_serial_ERROR_NONE != CIP_filterCompile(&lTable, pFilters, pCount)) {
+        return can_serial_ERROR_ARG;
+    }
+
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+
+    gCIP[pID].filters = lTable;
+
+    /* Replace the socket filter, CIP_init attaches it otherwise */
+    if(gCIP[pID].isInitialized && can_serial_TRANSPORT_UDP == gCIP[pID].transport) {
+        lErrorCode = CIP_attachSocketFilter(pID);
+    }
+
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_setTxTimestamping(const cipID_t pID, const bool pEnable) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setTxTimestamping> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+
+    gCIP[pID].txTimestamping = pEnable;
+    gCIP[pID].txTimestamp    = 0U;
+
+    /* Reconfigure the socket, CIP_init does it otherwise */
+    if(gCIP[pID].isInitialized && can_serial_TRANSPORT_UDP == gCIP[pID].transport) {
+        lErrorCode = CIP_setSocketTimestamping(pID);
+    }
 
-    gCIP.isInitialized = true;
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_getTxTimestamp(const cipID_t pID, uint64_t * const pTimestamp) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getTxTimestamp> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == pTimestamp) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getTxTimestamp> Parameter ptr is NULL !\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!gCIP[pID].txTimestamping) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getTxTimestamp> TX timestamps are disabled on CAN-IP module %u\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+
+    /* Pick the late ones up */
+    if(gCIP[pID].isInitialized && can_serial_TRANSPORT_UDP == gCIP[pID].transport) {
+        CIP_readTxTimestamps(pID);
+    }
+    *pTimestamp = gCIP[pID].txTimestamp;
+
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
 
     return can_serial_ERROR_NONE;
 }
 
 cipErrorCode_t CIP_isInitialized(const cipID_t pID, bool * const pIsInitialized) {
     if(NULL != pIsInitialized
-        && gCIP.cipInstanceID == pID)
+        && can_serial_MAX_NB_MODULES > pID)
     {
-        *pIsInitialized = gCIP.isInitialized;
+        *pIsInitialized = gCIP[pID].isInitialized;
     } else {
-        printf("[ERROR] <CIP_isInitialized> No CAN-IP module has the ID %u.\n", pID);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_isInitialized> No CAN-IP module has the ID %u.\n", pID);
         return can_serial_ERROR_ARG;
     }
 
@@ -100,70 +501,134 @@ cipErrorCode_t CIP_isInitialized(const cipID_t pID, bool * const pIsInitialized)
 }
 
 cipErrorCode_t CIP_reset(const cipID_t pID, const cipMode_t pCIPMode) {
-    if(!gCIP.isInitialized) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_reset> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!gCIP[pID].isInitialized) {
         /* You shouldn't "reset" a non-initialized module */
-        printf("[ERROR] <CIP_reset> CAN-IP module %u is not initialized, cannot reset.\n", pID);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_reset> CAN-IP module %u is not initialized, cannot reset.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
 
-    gCIP.isStopped = true;
-    gCIP.isInitialized = false;
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport && can_serial_MODE_FD == pCIPMode) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_reset> SLCAN adapters do not support CAN FD\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    gCIP[pID].isStopped = true;
+
+    /* No more cyclic messages */
+    if(can_serial_ERROR_NONE != CIP_cyclicStop(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    /* Stop the RX thread before its socket goes away */
+    (void)CIP_wakeRxThread(pID);
+    if(can_serial_ERROR_NONE != CIP_joinRxThread(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    gCIP[pID].isInitialized = false;
 
-    /* Close the socket */
-    if(can_serial_ERROR_NONE != CIP_closeSocket(pID)) {
+    (void)close(gCIP[pID].wakeFd);
+    gCIP[pID].wakeFd = -1;
+
+    /* Send what is queued while the transport is still open */
+    if(can_serial_ERROR_NONE != CIP_stopTxWriter(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    CIP_closeTxPaceFd(pID);
+
+    /* Close the socket or the serial port */
+    if(can_serial_ERROR_NONE != CIP_closeTransport(pID)) {
         return can_serial_ERROR_NET;
     }
 
-    return CIP_init(pID, pCIPMode, gCIP.canPort);
+    return CIP_initModule(pID, pCIPMode);
 }
 
 cipErrorCode_t CIP_stop(const cipID_t pID) {
-    (void)pID; /* TODO : Multiline CAN */
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stop> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
 
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_stop> CAN-IP module %u is not initialized, cannot stop it.\n", pID);
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stop> CAN-IP module %u is not initialized, cannot stop it.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
     
-    gCIP.isStopped = true;
+    gCIP[pID].isStopped = true;
 
-    return can_serial_ERROR_NONE;
+    /* Remember to resume the reception in CIP_restart */
+    gCIP[pID].rxResume = gCIP[pID].rxThreadOn;
+
+    /* Wake the RX thread up so that it sees it is stopped, and wait for it */
+    if(can_serial_ERROR_NONE != CIP_wakeRxThread(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    return CIP_joinRxThread(pID);
 }
 
 cipErrorCode_t CIP_restart(const cipID_t pID) {
-    (void)pID; /* TODO : Multiline CAN */
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_restart> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
 
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_restart> CAN-IP module %u is not initialized, cannot restart it.\n", pID);
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_restart> CAN-IP module %u is not initialized, cannot restart it.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
-    
-    gCIP.isStopped = false;
+
+    /* CIP_stop could not wait for the RX thread if called from it */
+    if(can_serial_ERROR_NONE != CIP_joinRxThread(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    gCIP[pID].isStopped = false;
+
+    /* Spawn the RX thread again, or register to the reactor again */
+    if(gCIP[pID].rxResume) {
+        gCIP[pID].rxResume = false;
+        return CIP_startRxThread(pID);
+    }
 
     return can_serial_ERROR_NONE;
 }
 
 cipErrorCode_t CIP_process(const cipID_t pID) {
-    (void)pID;
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_process> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
 
     /* Check if the module is already initialized */
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_rxThread> CAN-IP module %u is not initialized.\n", gCIP.cipInstanceID);
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_rxThread> CAN-IP module %u is not initialized.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
 
-    if(NULL == gCIP.putMessageFct) {
-        printf("[ERROR] <CIP_rxThread> Message buffer getter function is NULL.\n");
+    if(!CIP_hasRxConsumer(&gCIP[pID])) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_rxThread> Message buffer getter function is NULL.\n");
         return can_serial_ERROR_CONFIG;
     }
 
     cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
 
-    if(!gCIP.rxThreadOn) {
+    if(!gCIP[pID].rxThreadOn) {
         /* Start reception thread */
         lErrorCode = CIP_startRxThread(pID);
         if(can_serial_ERROR_NONE != lErrorCode) {
-            printf("[ERROR] <CIP_rxThread> CIP_startRxThread failed w/ error code %u\n", lErrorCode);
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_rxThread> CIP_startRxThread failed w/ error code %u\n", lErrorCode);
             return can_serial_ERROR_SYS;
         }
     }
@@ -0,0 +1,599 @@
+/**
+ * @brief CAN over serial traffic capture
+ *
+ * The capture is a ring of can_serial_CAPTURE_NB_SEGMENTS files,
+ * preallocated and mapped when it starts : position p of the capture
+ * is record p % nbRecords of file (p / nbRecords) % NB_SEGMENTS.
+ * Recording a frame only stores into the mapping, a background
+ * thread asks the kernel to write the pages back every
+ * can_serial_CAPTURE_SYNC_PERIOD_MS.
+ *
+ * @file can_serial_capture.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_capture.h"
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Support functions ----------------------------------- */
+/* Enters the mappings, false if the capture is off */
+static inline bool CIP_captureEnter(cipCapture_t * const pCapture) {
+    (void)__atomic_fetch_add(&pCapture->users, 1U, __ATOMIC_SEQ_CST);
+    if(!__atomic_load_n(&pCapture->enabled, __ATOMIC_SEQ_CST)) {
+        (void)__atomic_fetch_sub(&pCapture->users, 1U, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    return true;
+}
+
+static inline void CIP_captureLeave(cipCapture_t * const pCapture) {
+    (void)__atomic_fetch_sub(&pCapture->users, 1U, __ATOMIC_RELEASE);
+}
+
+/* Fills the record, its sequence number last */
+static inline void CIP_captureStore(cipCaptureRecord_t * const pRecord,
+    const uint64_t pPos,
+    const cipID_t pID,
+    const uint8_t pDirection,
+    const uint32_t pCANID,
+    const uint32_t pFlags,
+    const uint8_t pSize,
+    const uint8_t * const pData,
+    const uint64_t pTimestamp)
+{
+    /* Overwriting an older lap, readers must see seq cleared before the new fields */
+    __atomic_store_n(&pRecord->seq, 0U, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    pRecord->timestamp = pTimestamp;
+    pRecord->id        = pCANID;
+    pRecord->flags     = pFlags;
+    pRecord->size      = pSize;
+    pRecord->direction = pDirection;
+    pRecord->module    = pID;
+    memset(pRecord->reserved, 0, sizeof(pRecord->reserved));
+    memcpy(pRecord->data, pData, pSize);
+
+    __atomic_store_n(&pRecord->seq, pPos + 1U, __ATOMIC_RELEASE);
+}
+
+static void CIP_captureSync(const cipCapture_t * const pCapture, const int pFlags) {
+    for(size_t i = 0U; i < can_serial_CAPTURE_NB_SEGMENTS; i++) {
+        if(0 != msync(pCapture->segments[i], pCapture->segmentBytes, pFlags)) {
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_WARN, errno, "<CIP_captureSync> msync failed on capture file %zu\n", i);
+        }
+    }
+    if(0 != msync(pCapture->index, pCapture->indexBytes, pFlags)) {
+        CIP_LOG_ASYNC_ERRNO(can_serial_LOG_WARN, errno, "<CIP_captureSync> msync failed on the index file\n");
+    }
+}
+
+static void CIP_captureUnmap(cipCapture_t * const pCapture) {
+    for(size_t i = 0U; i < can_serial_CAPTURE_NB_SEGMENTS; i++) {
+        if(NULL != pCapture->segments[i]) {
+            (void)munmap(pCapture->segments[i], pCapture->segmentBytes);
+            pCapture->segments[i] = NULL;
+        }
+    }
+    if(NULL != pCapture->index) {
+        (void)munmap(pCapture->index, pCapture->indexBytes);
+        pCapture->index = NULL;
+    }
+}
+
+static void *CIP_captureThread(void *pArg) {
+    cipCapture_t * const lCapture = pArg;
+    struct pollfd lFd = {.fd = lCapture->wakeFd, .events = POLLIN, .revents = 0};
+
+    /* Until CIP_stopCapture writes the eventfd */
+    while(0 >= poll(&lFd, 1U, (int)can_serial_CAPTURE_SYNC_PERIOD_MS)) {
+        CIP_captureIndexUpdate(lCapture);
+        CIP_captureSync(lCapture, MS_ASYNC);
+    }
+
+    return NULL;
+}
+
+/* Capture functions ----------------------------------- */
+void CIP_captureInit(cipCapture_t * const pCapture) {
+    memset(pCapture, 0, sizeof(cipCapture_t));
+    pCapture->wakeFd = -1;
+    pthread_mutex_init(&pCapture->mutex, NULL);
+}
+
+void CIP_captureMessages(const cipID_t pID,
+    const uint8_t pDirection,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    const uint64_t pTimestamp)
+{
+    cipCapture_t * const lCapture = &gCIP[pID].capture;
+    if(0U == pCount || !CIP_captureEnter(lCapture)) {
+        return;
+    }
+
+    const uint64_t lPos = __atomic_fetch_add(&lCapture->next, pCount, __ATOMIC_RELAXED);
+    for(size_t i = 0U; i < pCount; i++) {
+        const uint64_t lStamp = can_serial_CAPTURE_RX == pDirection && 0U != pMsgs[i].timestamp ? pMsgs[i].timestamp : pTimestamp;
+        CIP_captureStore(CIP_captureRecordAt(lCapture, lPos + i), lPos + i, pID, pDirection,
+            pMsgs[i].id, pMsgs[i].flags,
+            CAN_MESSAGE_MAX_SIZE < pMsgs[i].size ? CAN_MESSAGE_MAX_SIZE : pMsgs[i].size,
+            pMsgs[i].data, lStamp);
+    }
+
+    CIP_captureLeave(lCapture);
+}
+
+void CIP_captureFdMessages(const cipID_t pID,
+    const uint8_t pDirection,
+    const cipFdMessage_t * const pMsgs,
+    const size_t pCount,
+    const uint64_t pTimestamp)
+{
+    cipCapture_t * const lCapture = &gCIP[pID].capture;
+    if(0U == pCount || !CIP_captureEnter(lCapture)) {
+        return;
+    }
+
+    const uint64_t lPos = __atomic_fetch_add(&lCapture->next, pCount, __ATOMIC_RELAXED);
+    for(size_t i = 0U; i < pCount; i++) {
+        const uint64_t lStamp = can_serial_CAPTURE_RX == pDirection && 0U != pMsgs[i].timestamp ? pMsgs[i].timestamp : pTimestamp;
+        CIP_captureStore(CIP_captureRecordAt(lCapture, lPos + i), lPos + i, pID, pDirection,
+            pMsgs[i].id, pMsgs[i].flags,
+            CAN_FD_MESSAGE_MAX_SIZE < pMsgs[i].size ? CAN_FD_MESSAGE_MAX_SIZE : pMsgs[i].size,
+            pMsgs[i].data, lStamp);
+    }
+
+    CIP_captureLeave(lCapture);
+}
+
+cipErrorCode_t CIP_startCapture(const cipID_t pID, const char * const pPath, const size_t pMaxBytes) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startCapture> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startCapture> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    const size_t lSegmentBytes = pMaxBytes / can_serial_CAPTURE_NB_SEGMENTS;
+    if(NULL == pPath || PATH_MAX - 16U <= strlen(pPath)
+        || sizeof(cipCaptureHeader_t) + sizeof(cipCaptureRecord_t) > lSegmentBytes)
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startCapture> Invalid capture path or size\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCapture_t * const lCapture = &gCIP[pID].capture;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&lCapture->mutex);
+
+    if(lCapture->enabled) {
+        pthread_mutex_unlock(&lCapture->mutex);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startCapture> CAN-IP module %u is already captured\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    lCapture->segmentBytes = lSegmentBytes;
+    lCapture->nbRecords    = (lSegmentBytes - sizeof(cipCaptureHeader_t)) / sizeof(cipCaptureRecord_t);
+
+    /* Preallocate and map every file now, recording never calls the kernel */
+    for(uint32_t i = 0U; i < can_serial_CAPTURE_NB_SEGMENTS && can_serial_ERROR_NONE == lErrorCode; i++) {
+        char lPath[PATH_MAX];
+        (void)snprintf(lPath, sizeof(lPath), "%s.%u", pPath, i);
+
+        errno = 0;
+        const int lFd = open(lPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(0 > lFd) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_startCapture> Failed to open %s\n", lPath);
+            lErrorCode = can_serial_ERROR_SYS;
+            break;
+        }
+
+        const int lAllocError = posix_fallocate(lFd, 0, (off_t)lSegmentBytes);
+        void *lMap = MAP_FAILED;
+        if(0 == lAllocError) {
+            lMap = mmap(NULL, lSegmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, lFd, 0);
+        }
+        const int lErrno = 0 != lAllocError ? lAllocError : errno;
+        (void)close(lFd);
+
+        if(MAP_FAILED == lMap) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, lErrno, "<CIP_startCapture> Failed to allocate or map %s\n", lPath);
+            lErrorCode = can_serial_ERROR_SYS;
+            break;
+        }
+        lCapture->segments[i] = lMap;
+
+        cipCaptureHeader_t * const lHeader = lMap;
+        memcpy(lHeader->magic, can_serial_CAPTURE_MAGIC, sizeof(can_serial_CAPTURE_MAGIC));
+        lHeader->version    = can_serial_CAPTURE_VERSION;
+        lHeader->recordSize = sizeof(cipCaptureRecord_t);
+        lHeader->nbRecords  = lCapture->nbRecords;
+        lHeader->segment    = i;
+        lHeader->nbSegments = can_serial_CAPTURE_NB_SEGMENTS;
+    }
+
+    if(can_serial_ERROR_NONE == lErrorCode) {
+        lErrorCode = CIP_captureIndexCreate(lCapture, pPath);
+    }
+
+    if(can_serial_ERROR_NONE == lErrorCode) {
+        errno = 0;
+        if(0 > (lCapture->wakeFd = eventfd(0U, EFD_CLOEXEC))) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_startCapture> eventfd failed !\n");
+            lErrorCode = can_serial_ERROR_SYS;
+        } else if(0 != pthread_create(&lCapture->thread, NULL, CIP_captureThread, lCapture)) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_startCapture> Thread creation failed\n");
+            (void)close(lCapture->wakeFd);
+            lCapture->wakeFd = -1;
+            lErrorCode = can_serial_ERROR_SYS;
+        }
+    }
+
+    if(can_serial_ERROR_NONE == lErrorCode) {
+        lCapture->next = 0U;
+        __atomic_store_n(&lCapture->enabled, true, __ATOMIC_SEQ_CST);
+    } else {
+        CIP_captureUnmap(lCapture);
+    }
+
+    pthread_mutex_unlock(&lCapture->mutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_stopCapture(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stopCapture> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCapture_t * const lCapture = &gCIP[pID].capture;
+
+    pthread_mutex_lock(&lCapture->mutex);
+
+    if(!lCapture->enabled) {
+        pthread_mutex_unlock(&lCapture->mutex);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stopCapture> CAN-IP module %u is not captured\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    /* Let the writers already in the mappings leave */
+    __atomic_store_n(&lCapture->enabled, false, __ATOMIC_SEQ_CST);
+    while(0U != __atomic_load_n(&lCapture->users, __ATOMIC_SEQ_CST)) {
+        (void)sched_yield();
+    }
+
+    const uint64_t lEvent = 1U;
+    if(sizeof(lEvent) != write(lCapture->wakeFd, &lEvent, sizeof(lEvent))
+        || 0 != pthread_join(lCapture->thread, NULL))
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stopCapture> Failed to stop the capture thread\n");
+    }
+    (void)close(lCapture->wakeFd);
+    lCapture->wakeFd = -1;
+
+    /* Every writer left, the index covers the whole capture */
+    CIP_captureIndexUpdate(lCapture);
+    CIP_captureSync(lCapture, MS_SYNC);
+    CIP_captureUnmap(lCapture);
+
+    pthread_mutex_unlock(&lCapture->mutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+/* Capture reader functions ---------------------------- */
+cipErrorCode_t CIP_captureOpen(cipCaptureReader_t * const pReader, const char * const pPath) {
+    const cipErrorCode_t lErrorCode = CIP_captureMap(pReader, pPath);
+    if(can_serial_ERROR_NONE == lErrorCode) {
+        for(uint32_t i = 0U; i < pReader->nbSegments; i++) {
+            (void)madvise((void *)(uintptr_t)pReader->segments[i], pReader->segmentBytes, MADV_SEQUENTIAL);
+        }
+        CIP_captureLocate(pReader, 0U);
+    }
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_captureMap(cipCaptureReader_t * const pReader, const char * const pPath) {
+    if(NULL == pReader || NULL == pPath || PATH_MAX - 16U <= strlen(pPath)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_captureMap> Invalid reader or capture path\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    memset(pReader, 0, sizeof(cipCaptureReader_t));
+    pReader->nbSegments = 1U; /* Until the first header tells */
+
+    for(uint32_t i = 0U; i < pReader->nbSegments; i++) {
+        char lPath[PATH_MAX];
+        (void)snprintf(lPath, sizeof(lPath), "%s.%u", pPath, i);
+
+        errno = 0;
+        const int lFd = open(lPath, O_RDONLY | O_CLOEXEC);
+        struct stat lStat;
+        if(0 > lFd || 0 != fstat(lFd, &lStat) || sizeof(cipCaptureHeader_t) > (size_t)lStat.st_size) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_captureMap> Cannot read the capture file %s\n", lPath);
+            if(0 <= lFd) {
+                (void)close(lFd);
+            }
+            CIP_captureClose(pReader);
+            return can_serial_ERROR_SYS;
+        }
+
+        void * const lMap = mmap(NULL, (size_t)lStat.st_size, PROT_READ, MAP_SHARED, lFd, 0);
+        const int lErrno = errno;
+        (void)close(lFd);
+        if(MAP_FAILED == lMap) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, lErrno, "<CIP_captureMap> Failed to map %s\n", lPath);
+            CIP_captureClose(pReader);
+            return can_serial_ERROR_SYS;
+        }
+        pReader->segments[i] = lMap;
+
+        const cipCaptureHeader_t * const lHeader = lMap;
+        if(0U == i) {
+            pReader->segmentBytes = (size_t)lStat.st_size;
+            pReader->nbRecords    = lHeader->nbRecords;
+            pReader->nbSegments   = lHeader->nbSegments;
+        }
+
+        /* Every file must come from the same capture */
+        if(0 != memcmp(lHeader->magic, can_serial_CAPTURE_MAGIC, sizeof(can_serial_CAPTURE_MAGIC))
+            || can_serial_CAPTURE_VERSION != lHeader->version
+            || sizeof(cipCaptureRecord_t) != lHeader->recordSize
+            || i != lHeader->segment
+            || 0U == pReader->nbSegments || can_serial_CAPTURE_NB_SEGMENTS < pReader->nbSegments
+            || pReader->nbSegments != lHeader->nbSegments
+            || 0U == pReader->nbRecords || pReader->nbRecords != lHeader->nbRecords
+            || pReader->segmentBytes != (size_t)lStat.st_size
+            || (pReader->segmentBytes - sizeof(cipCaptureHeader_t)) / sizeof(cipCaptureRecord_t) < pReader->nbRecords)
+        {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_captureMap> %s is not a file of this capture\n", lPath);
+            CIP_captureClose(pReader);
+            return can_serial_ERROR_CONFIG;
+        }
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+void CIP_captureLocate(cipCaptureReader_t * const pReader, const uint64_t pLast) {
+    const uint64_t lCapacity = pReader->nbRecords * pReader->nbSegments;
+    pReader->first = 0U;
+    pReader->last  = pLast;
+
+    /* From a known record, the newer ones follow it */
+    cipCaptureRecord_t lRecord;
+    for(uint64_t i = 0U; 0U < pReader->last && i < lCapacity && CIP_captureRecord(pReader, pReader->last + 1U, &lRecord); i++) {
+        pReader->last++;
+    }
+
+    /* Else the newest record of the files */
+    for(uint32_t i = 0U; 0U == pLast && i < pReader->nbSegments; i++) {
+        const cipCaptureRecord_t * const lRecords = (const cipCaptureRecord_t *)(const void *)(pReader->segments[i] + sizeof(cipCaptureHeader_t));
+        for(uint64_t j = 0U; j < pReader->nbRecords; j++) {
+            const uint64_t lSeq = __atomic_load_n(&lRecords[j].seq, __ATOMIC_RELAXED);
+            if(pReader->last < lSeq
+                && i == ((lSeq - 1U) / pReader->nbRecords) % pReader->nbSegments
+                && j == (lSeq - 1U) % pReader->nbRecords)
+            {
+                pReader->last = lSeq;
+            }
+        }
+    }
+
+    /* The newest record tells which positions are still there */
+    if(0U < pReader->last) {
+        pReader->first = pReader->last > lCapacity ? pReader->last - lCapacity + 1U : 1U;
+    }
+}
+
+void CIP_captureClose(cipCaptureReader_t * const pReader) {
+    if(NULL == pReader) {
+        return;
+    }
+
+    for(size_t i = 0U; i < can_serial_CAPTURE_NB_SEGMENTS; i++) {
+        if(NULL != pReader->segments[i]) {
+            (void)munmap((void *)(uintptr_t)pReader->segments[i], pReader->segmentBytes);
+        }
+    }
+    memset(pReader, 0, sizeof(cipCaptureReader_t));
+}
+
+/* Replay functions ------------------------------------ */
+/* Waits for pDue (CLOCK_MONOTONIC, ns) : sleeps,
+ * then spins for the last can_serial_REPLAY_SPIN_NS */
+static void CIP_replayWait(const uint64_t pDue) {
+    if(pDue > can_serial_REPLAY_SPIN_NS + CIP_monotonicNs()) {
+        const uint64_t lWake = pDue - can_serial_REPLAY_SPIN_NS;
+        const struct timespec lTime = {.tv_sec = (time_t)(lWake / 1000000000U), .tv_nsec = (long)(lWake % 1000000000U)};
+        while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &lTime, NULL)) {
+            /* Sleep again */
+        }
+    }
+
+    while(pDue > CIP_monotonicNs()) {
+        /* Spin */
+    }
+}
+
+/* Sends the pCount messages gathered, counts and returns the first error */
+static cipErrorCode_t CIP_replayFlush(const cipID_t pID,
+    const bool pFd,
+    const cipMessage_t * const pMsgs,
+    const cipFdMessage_t * const pFdMsgs,
+    const size_t pCount,
+    cipReplayStats_t * const pStats)
+{
+    if(0U == pCount) {
+        return can_serial_ERROR_NONE;
+    }
+
+    size_t lSent = 0U;
+    const cipErrorCode_t lErrorCode = pFd ? CIP_sendFdBatch(pID, pFdMsgs, pCount, NULL, &lSent)
+        : CIP_sendBatch(pID, pMsgs, pCount, NULL, &lSent);
+
+    pStats->frames += lSent;
+    pStats->failed += pCount - lSent;
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_replayCapture(const cipID_t pID,
+    const char * const pPath,
+    const double pSpeed,
+    const uint32_t pDirections,
+    cipReplayStats_t * const pStats)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_replayCapture> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_replayCapture> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    /* !(>=) also rejects NaN */
+    if(!(can_serial_REPLAY_MAX_SPEED <= pSpeed)
+        || 0U == (pDirections & (can_serial_REPLAY_RX | can_serial_REPLAY_TX)))
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_replayCapture> Invalid speed factor or directions\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCaptureReader_t lReader;
+    cipErrorCode_t lErrorCode = CIP_captureOpen(&lReader, pPath);
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        return lErrorCode;
+    }
+
+    cipReplayStats_t lStats;
+    memset(&lStats, 0, sizeof(lStats));
+
+    const bool lFd = can_serial_MODE_FD == gCIP[pID].cipMode;
+    const bool lTimed = can_serial_REPLAY_MAX_SPEED < pSpeed;
+    cipMessage_t   lMsgs[can_serial_REPLAY_BATCH];
+    cipFdMessage_t lFdMsgs[can_serial_REPLAY_BATCH];
+    size_t lCount = 0U;
+
+    const uint64_t lStart = CIP_monotonicNs();
+    uint64_t lBase = 0U; /* Timestamp of the first frame replayed */
+
+    for(uint64_t lSeq = lReader.first; 0U < lSeq && lSeq <= lReader.last; lSeq++) {
+        cipCaptureRecord_t lRecord;
+        if(!CIP_captureRecord(&lReader, lSeq, &lRecord)) {
+            lStats.missing++;
+            continue;
+        }
+        if(0U == (pDirections & (1U << lRecord.direction))) {
+            continue;
+        }
+
+        const bool lFdFrame = CAN_MESSAGE_MAX_SIZE < lRecord.size || 0U != (lRecord.flags & can_serial_FLAG_FDF);
+        if(lFdFrame && !lFd) {
+            lStats.failed++;
+            lErrorCode = can_serial_ERROR_NONE == lErrorCode ? can_serial_ERROR_CONFIG : lErrorCode;
+            continue;
+        }
+
+        if(0U == lBase) {
+            lBase = lRecord.timestamp;
+        }
+
+        if(lTimed) {
+            /* Send what was gathered before waiting for this frame */
+            const uint64_t lOffset = lRecord.timestamp > lBase ? lRecord.timestamp - lBase : 0U;
+            const uint64_t lDue = lStart + (uint64_t)((double)lOffset / pSpeed);
+            if(lDue > CIP_monotonicNs()) {
+                const cipErrorCode_t lFlushError = CIP_replayFlush(pID, lFd, lMsgs, lFdMsgs, lCount, &lStats);
+                lErrorCode = can_serial_ERROR_NONE == lErrorCode ? lFlushError : lErrorCode;
+                lCount = 0U;
+                CIP_replayWait(lDue);
+            }
+
+            const uint64_t lLate = CIP_monotonicNs() - lDue;
+            lStats.maxLateNs = lLate > lStats.maxLateNs ? lLate : lStats.maxLateNs;
+        }
+
+        if(lFd) {
+            cipFdMessage_t * const lMsg = &lFdMsgs[lCount];
+            memset(lMsg, 0, sizeof(cipFdMessage_t));
+            lMsg->id    = lRecord.id;
+            lMsg->size  = lRecord.size;
+            lMsg->flags = lRecord.flags;
+            memcpy(lMsg->data, lRecord.data, lRecord.size);
+        } else {
+            cipMessage_t * const lMsg = &lMsgs[lCount];
+            memset(lMsg, 0, sizeof(cipMessage_t));
+            lMsg->id    = lRecord.id;
+            lMsg->size  = lRecord.size;
+            lMsg->flags = lRecord.flags;
+            memcpy(lMsg->data, lRecord.data, lRecord.size);
+        }
+
+        if(can_serial_REPLAY_BATCH == ++lCount) {
+            const cipErrorCode_t lFlushError = CIP_replayFlush(pID, lFd, lMsgs, lFdMsgs, lCount, &lStats);
+            lErrorCode = can_serial_ERROR_NONE == lErrorCode ? lFlushError : lErrorCode;
+            lCount = 0U;
+        }
+    }
+
+    const cipErrorCode_t lFlushError = CIP_replayFlush(pID, lFd, lMsgs, lFdMsgs, lCount, &lStats);
+    lErrorCode = can_serial_ERROR_NONE == lErrorCode ? lFlushError : lErrorCode;
+
+    lStats.durationNs   = CIP_monotonicNs() - lStart;
+    lStats.framesPerSec = 0U < lStats.durationNs ? 1e9 * (double)lStats.frames / (double)lStats.durationNs : 0.0;
+
+    CIP_captureClose(&lReader);
+
+    if(NULL != pStats) {
+        *pStats = lStats;
+    }
+
+    return lErrorCode;
+}
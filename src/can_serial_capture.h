@@ -0,0 +1,140 @@
+/**
+ * @brief CAN over serial traffic capture
+ *
+ * @file can_serial_capture.h
+ */
+
+#ifndef can_serial_CAPTURE_H
+#define can_serial_CAPTURE_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_ring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_CAPTURE_SYNC_PERIOD_MS 100U /**< Background msync period */
+#define can_serial_REPLAY_BATCH           32U      /**< Frames per send call during a replay */
+#define can_serial_REPLAY_SPIN_NS         100000U  /**< A replay spins on the clock for the last 100 us */
+
+/* Type definitions ------------------------------------ */
+/**
+ * @brief Capture of one module.
+ * Writers claim a position w/ a fetch-and-add on next, the position
+ * gives the file and the record, so that any thread records w/o lock.
+ * users counts the writers inside the mappings, CIP_stopCapture
+ * waits for it to drop to 0 before unmapping them.
+ */
+typedef struct _cipCapture {
+    /* Read-only while enabled */
+    uint8_t        *segments[can_serial_CAPTURE_NB_SEGMENTS]; /**< File mappings */
+    size_t          segmentBytes;
+    uint64_t        nbRecords;  /**< Per file */
+    uint8_t        *index;      /**< Index file mapping */
+    size_t          indexBytes;
+    bool            enabled;
+
+    uint64_t        next  __attribute__((aligned(can_serial_CACHE_LINE_SIZE))); /**< Next position, from 0 */
+    uint64_t        users __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+
+    /* Background flush thread, start/stop under the mutex */
+    pthread_mutex_t mutex __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+    pthread_t       thread;
+    int             wakeFd;
+    uint64_t        indexed;    /**< Next position to index, owned by the thread */
+} cipCapture_t;
+
+/**
+ * @brief Read-only view of the files of a capture.
+ * The records of positions first to last are in the mappings, in the
+ * slots their position gives, unless they were torn or never written.
+ */
+typedef struct _cipCaptureReader {
+    const uint8_t  *segments[can_serial_CAPTURE_NB_SEGMENTS];
+    size_t          segmentBytes;
+    uint64_t        nbRecords;  /**< Per file */
+    uint32_t        nbSegments;
+    uint64_t        first;      /**< Sequence number of the oldest record left, 0 : empty capture */
+    uint64_t        last;       /**< Sequence number of the newest record */
+} cipCaptureReader_t;
+
+/* Capture functions ----------------------------------- */
+void CIP_captureInit(cipCapture_t * const pCapture);
+
+/* Record the messages if the capture of module pID is on,
+ * pTimestamp is used for the messages w/o timestamp */
+void CIP_captureMessages(const cipID_t pID,
+    const uint8_t pDirection,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    const uint64_t pTimestamp);
+void CIP_captureFdMessages(const cipID_t pID,
+    const uint8_t pDirection,
+    const cipFdMessage_t * const pMsgs,
+    const size_t pCount,
+    const uint64_t pTimestamp);
+
+/* Maps the files "<pPath>.<n>" and finds the records they hold */
+cipErrorCode_t CIP_captureOpen(cipCaptureReader_t * const pReader, const char * const pPath);
+/* Only maps them, CIP_captureLocate tells which records they hold */
+cipErrorCode_t CIP_captureMap(cipCaptureReader_t * const pReader, const char * const pPath);
+void CIP_captureLocate(cipCaptureReader_t * const pReader, const uint64_t pLast);
+void CIP_captureClose(cipCaptureReader_t * const pReader);
+
+/* Index functions (can_serial_capture_index.c) -------- */
+/* Creates and maps "<pPath>.idx" for the capture */
+cipErrorCode_t CIP_captureIndexCreate(cipCapture_t * const pCapture, const char * const pPath);
+/* Indexes the records written since the last call, from the capture thread */
+void CIP_captureIndexUpdate(cipCapture_t * const pCapture);
+
+static inline uint64_t CIP_captureIndexNbBlocks(const uint64_t pCapacity) {
+    /* A ring of pCapacity positions overlaps up to this many blocks */
+    return pCapacity / can_serial_CAPTURE_INDEX_BLOCK + 2U;
+}
+
+/* Sets the bit of the CAN ID in the entry bitmaps,
+ * 29-bit IDs are hashed (Fibonacci hashing) */
+static inline void CIP_captureIndexAddID(cipCaptureIndexEntry_t * const pEntry, const uint32_t pCANID, const uint32_t pFlags) {
+    const uint32_t lID = pCANID & 0x1FFFFFFFU;
+    if(0U == (pFlags & can_serial_FLAG_EFF) && can_serial_CAPTURE_INDEX_STD_BITS > lID) {
+        pEntry->stdIDs[lID >> 6U] |= 1ULL << (lID & 63U);
+    } else {
+        const uint32_t lHash = (lID * 2654435761U) >> (32U - 10U); /* 10 bits : can_serial_CAPTURE_INDEX_EXT_BITS */
+        pEntry->extIDs[lHash >> 6U] |= 1ULL << (lHash & 63U);
+    }
+}
+
+static inline cipCaptureRecord_t *CIP_captureRecordAt(const cipCapture_t * const pCapture, const uint64_t pPos) {
+    uint8_t * const lSegment = pCapture->segments[(pPos / pCapture->nbRecords) % can_serial_CAPTURE_NB_SEGMENTS];
+
+    return (cipCaptureRecord_t *)(void *)(lSegment + sizeof(cipCaptureHeader_t)
+        + (size_t)(pPos % pCapture->nbRecords) * sizeof(cipCaptureRecord_t));
+}
+
+/* Copies the record of sequence number pSeq, false if it was not written in full */
+static inline bool CIP_captureRecord(const cipCaptureReader_t * const pReader, const uint64_t pSeq, cipCaptureRecord_t * const pRecord) {
+    const uint64_t lPos = pSeq - 1U;
+    const cipCaptureRecord_t * const lRecord = (const cipCaptureRecord_t *)(const void *)(pReader->segments[(lPos / pReader->nbRecords) % pReader->nbSegments]
+        + sizeof(cipCaptureHeader_t) + (size_t)(lPos % pReader->nbRecords) * sizeof(cipCaptureRecord_t));
+
+    if(pSeq != __atomic_load_n(&lRecord->seq, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    memcpy(pRecord, lRecord, sizeof(cipCaptureRecord_t));
+
+    /* A writer may have started overwriting it during the copy */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return pSeq == __atomic_load_n(&lRecord->seq, __ATOMIC_RELAXED);
+}
+
+static inline bool CIP_captureOn(const cipCapture_t * const pCapture) {
+    return __atomic_load_n(&pCapture->enabled, __ATOMIC_RELAXED);
+}
+
+#endif /* can_serial_CAPTURE_H */
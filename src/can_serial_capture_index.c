@@ -0,0 +1,356 @@
+/**
+ * @brief CAN over serial capture index and queries
+ *
+ * The index "<path>.idx" of a capture summarizes every block of
+ * can_serial_CAPTURE_INDEX_BLOCK positions : its time range and
+ * bitmaps of its CAN IDs. The capture thread extends it each period
+ * from the records complete since. A query reads the few entries,
+ * then only the records of the blocks they cannot rule out.
+ *
+ * @file can_serial_capture_index.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_capture.h"
+#include "can_serial_filter.h"
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+/* A query hashes the IDs of its 29-bit ranges up to this many,
+ * beyond, every block w/ 29-bit IDs is read */
+#define can_serial_QUERY_MAX_EXT_IDS 4096U
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipQuery {
+    cipFilterTable_t        table;
+    cipCaptureIndexEntry_t  wanted;     /**< Bits of the IDs the filters accept */
+    bool                    anyExt;     /**< Any 29-bit ID may match */
+    uint64_t                from;
+    uint64_t                to;
+    cipQueryFct_t           fct;
+    void                   *ctx;
+} cipQuery_t;
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Extern variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static inline cipCaptureIndexEntry_t *CIP_captureIndexEntries(uint8_t * const pIndex) {
+    return (cipCaptureIndexEntry_t *)(void *)(pIndex + sizeof(cipCaptureIndexHeader_t));
+}
+
+/* Maps "<pPath>.idx", NULL if it is missing or does not fit the capture */
+static const cipCaptureIndexHeader_t *CIP_captureIndexMap(const cipCaptureReader_t * const pReader,
+    const char * const pPath,
+    size_t * const pBytes)
+{
+    char lPath[PATH_MAX];
+    (void)snprintf(lPath, sizeof(lPath), "%s.idx", pPath);
+
+    errno = 0;
+    const int lFd = open(lPath, O_RDONLY | O_CLOEXEC);
+    struct stat lStat;
+    if(0 > lFd || 0 != fstat(lFd, &lStat) || sizeof(cipCaptureIndexHeader_t) > (size_t)lStat.st_size) {
+        CIP_LOG_ERRNO(can_serial_LOG_WARN, errno, "<CIP_captureIndexMap> No index %s, reading the whole capture\n", lPath);
+        if(0 <= lFd) {
+            (void)close(lFd);
+        }
+        return NULL;
+    }
+
+    void * const lMap = mmap(NULL, (size_t)lStat.st_size, PROT_READ, MAP_SHARED, lFd, 0);
+    (void)close(lFd);
+    if(MAP_FAILED == lMap) {
+        CIP_LOG(can_serial_LOG_WARN, "<CIP_captureIndexMap> Failed to map %s, reading the whole capture\n", lPath);
+        return NULL;
+    }
+
+    const cipCaptureIndexHeader_t * const lHeader = lMap;
+    const uint64_t lCapacity = pReader->nbRecords * pReader->nbSegments;
+    if(0 != memcmp(lHeader->magic, can_serial_CAPTURE_INDEX_MAGIC, sizeof(can_serial_CAPTURE_INDEX_MAGIC))
+        || can_serial_CAPTURE_INDEX_VERSION != lHeader->version
+        || sizeof(cipCaptureIndexEntry_t) != lHeader->entrySize
+        || 0U == lHeader->blockRecords
+        || lCapacity / lHeader->blockRecords + 2U > lHeader->nbBlocks
+        || ((size_t)lStat.st_size - sizeof(cipCaptureIndexHeader_t)) / sizeof(cipCaptureIndexEntry_t) < lHeader->nbBlocks)
+    {
+        CIP_LOG(can_serial_LOG_WARN, "<CIP_captureIndexMap> %s is not an index of this capture, reading the whole capture\n", lPath);
+        (void)munmap(lMap, (size_t)lStat.st_size);
+        return NULL;
+    }
+
+    *pBytes = (size_t)lStat.st_size;
+
+    return lHeader;
+}
+
+static cipErrorCode_t CIP_queryCompile(cipQuery_t * const pQuery, const cipFilter_t * const pFilters, const size_t pCount) {
+    const cipErrorCode_t lErrorCode = CIP_filterCompile(&pQuery->table, pFilters, pCount);
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        return lErrorCode;
+    }
+
+    memset(&pQuery->wanted, 0, sizeof(pQuery->wanted));
+    if(!pQuery->table.enabled) {
+        memset(pQuery->wanted.stdIDs, 0xFF, sizeof(pQuery->wanted.stdIDs));
+        pQuery->anyExt = true;
+        return can_serial_ERROR_NONE;
+    }
+
+    /* The 11-bit bitmaps are the same */
+    memcpy(pQuery->wanted.stdIDs, pQuery->table.stdBitmap, sizeof(pQuery->wanted.stdIDs));
+
+    uint64_t lNbIDs = 0U;
+    for(size_t i = 0U; i < pQuery->table.nbRanges; i++) {
+        lNbIDs += (uint64_t)(pQuery->table.ranges[i].hi - pQuery->table.ranges[i].lo) + 1U;
+    }
+    pQuery->anyExt = 0U < pQuery->table.nbExtRules || can_serial_QUERY_MAX_EXT_IDS < lNbIDs;
+
+    for(size_t i = 0U; !pQuery->anyExt && i < pQuery->table.nbRanges; i++) {
+        for(uint64_t lID = pQuery->table.ranges[i].lo; lID <= pQuery->table.ranges[i].hi; lID++) {
+            CIP_captureIndexAddID(&pQuery->wanted, (uint32_t)lID, can_serial_FLAG_EFF);
+        }
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+/* The block may hold a matching record */
+static bool CIP_queryBlock(const cipQuery_t * const pQuery, const cipCaptureIndexEntry_t * const pEntry) {
+    if(0U == pEntry->count || pQuery->from > pEntry->maxTimestamp || pQuery->to < pEntry->minTimestamp) {
+        return false;
+    }
+
+    uint64_t lHits = 0U;
+    for(size_t i = 0U; i < sizeof(pEntry->stdIDs) / sizeof(pEntry->stdIDs[0U]); i++) {
+        lHits |= pQuery->wanted.stdIDs[i] & pEntry->stdIDs[i];
+    }
+    for(size_t i = 0U; i < sizeof(pEntry->extIDs) / sizeof(pEntry->extIDs[0U]); i++) {
+        lHits |= (pQuery->anyExt ? UINT64_MAX : pQuery->wanted.extIDs[i]) & pEntry->extIDs[i];
+    }
+
+    return 0U != lHits;
+}
+
+/* Gives the matching records of positions pLo to pHi (excluded),
+ * false if the query function stopped the query */
+static bool CIP_queryRange(const cipQuery_t * const pQuery,
+    const cipCaptureReader_t * const pReader,
+    const uint64_t pLo,
+    const uint64_t pHi,
+    cipQueryStats_t * const pStats)
+{
+    for(uint64_t lPos = pLo; lPos < pHi; lPos++) {
+        cipCaptureRecord_t lRecord;
+        if(!CIP_captureRecord(pReader, lPos + 1U, &lRecord)
+            || pQuery->from > lRecord.timestamp || pQuery->to < lRecord.timestamp
+            || !CIP_filterAccept(&pQuery->table, lRecord.id, lRecord.flags))
+        {
+            continue;
+        }
+
+        pStats->matches++;
+        if(0 != pQuery->fct(pQuery->ctx, &lRecord)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Index functions ------------------------------------- */
+cipErrorCode_t CIP_captureIndexCreate(cipCapture_t * const pCapture, const char * const pPath) {
+    const uint64_t lNbBlocks = CIP_captureIndexNbBlocks(pCapture->nbRecords * can_serial_CAPTURE_NB_SEGMENTS);
+    const size_t   lBytes    = sizeof(cipCaptureIndexHeader_t) + (size_t)lNbBlocks * sizeof(cipCaptureIndexEntry_t);
+
+    char lPath[PATH_MAX];
+    (void)snprintf(lPath, sizeof(lPath), "%s.idx", pPath);
+
+    errno = 0;
+    const int lFd = open(lPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(0 > lFd) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_captureIndexCreate> Failed to open %s\n", lPath);
+        return can_serial_ERROR_SYS;
+    }
+
+    /* Zeroed : no block indexed yet */
+    const int lAllocError = posix_fallocate(lFd, 0, (off_t)lBytes);
+    void *lMap = MAP_FAILED;
+    if(0 == lAllocError) {
+        lMap = mmap(NULL, lBytes, PROT_READ | PROT_WRITE, MAP_SHARED, lFd, 0);
+    }
+    const int lErrno = 0 != lAllocError ? lAllocError : errno;
+    (void)close(lFd);
+
+    if(MAP_FAILED == lMap) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, lErrno, "<CIP_captureIndexCreate> Failed to allocate or map %s\n", lPath);
+        return can_serial_ERROR_SYS;
+    }
+
+    cipCaptureIndexHeader_t * const lHeader = lMap;
+    memcpy(lHeader->magic, can_serial_CAPTURE_INDEX_MAGIC, sizeof(can_serial_CAPTURE_INDEX_MAGIC));
+    lHeader->version      = can_serial_CAPTURE_INDEX_VERSION;
+    lHeader->entrySize    = sizeof(cipCaptureIndexEntry_t);
+    lHeader->blockRecords = can_serial_CAPTURE_INDEX_BLOCK;
+    lHeader->nbBlocks     = lNbBlocks;
+
+    pCapture->index      = lMap;
+    pCapture->indexBytes = lBytes;
+    pCapture->indexed    = 0U;
+
+    return can_serial_ERROR_NONE;
+}
+
+void CIP_captureIndexUpdate(cipCapture_t * const pCapture) {
+    cipCaptureIndexHeader_t * const lHeader  = (cipCaptureIndexHeader_t *)(void *)pCapture->index;
+    cipCaptureIndexEntry_t  * const lEntries = CIP_captureIndexEntries(pCapture->index);
+    const uint64_t lCapacity = pCapture->nbRecords * can_serial_CAPTURE_NB_SEGMENTS;
+    const uint64_t lNext     = __atomic_load_n(&pCapture->next, __ATOMIC_ACQUIRE);
+
+    /* The writers lapped us, the older positions are gone */
+    uint64_t lPos = pCapture->indexed;
+    if(lNext > lCapacity && lNext - lCapacity > lPos) {
+        lPos = lNext - lCapacity;
+    }
+
+    for(; lPos < lNext; lPos++) {
+        const cipCaptureRecord_t * const lRecord = CIP_captureRecordAt(pCapture, lPos);
+        const uint64_t lSeq = __atomic_load_n(&lRecord->seq, __ATOMIC_ACQUIRE);
+        if(lPos + 1U > lSeq) {
+            /* Still being written, next time */
+            break;
+        }
+        if(lPos + 1U < lSeq) {
+            /* Already overwritten */
+            continue;
+        }
+
+        const uint64_t lTimestamp = lRecord->timestamp;
+        const uint32_t lCANID     = lRecord->id;
+        const uint32_t lFlags     = lRecord->flags;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(lPos + 1U != __atomic_load_n(&lRecord->seq, __ATOMIC_RELAXED)) {
+            /* Overwritten while we read it */
+            continue;
+        }
+
+        const uint64_t lBlock = lPos / can_serial_CAPTURE_INDEX_BLOCK;
+        cipCaptureIndexEntry_t * const lEntry = &lEntries[lBlock % lHeader->nbBlocks];
+        if(lBlock + 1U != lEntry->block) {
+            /* Recycle the entry of an overwritten block */
+            memset(lEntry, 0, sizeof(cipCaptureIndexEntry_t));
+            lEntry->minTimestamp = UINT64_MAX;
+            __atomic_store_n(&lEntry->block, lBlock + 1U, __ATOMIC_RELEASE);
+        }
+
+        lEntry->count++;
+        lEntry->minTimestamp = lTimestamp < lEntry->minTimestamp ? lTimestamp : lEntry->minTimestamp;
+        lEntry->maxTimestamp = lTimestamp > lEntry->maxTimestamp ? lTimestamp : lEntry->maxTimestamp;
+        CIP_captureIndexAddID(lEntry, lCANID, lFlags);
+    }
+
+    pCapture->indexed = lPos;
+    __atomic_store_n(&lHeader->indexed, lPos, __ATOMIC_RELEASE);
+}
+
+/* Query functions ------------------------------------- */
+cipErrorCode_t CIP_queryCapture(const char * const pPath,
+    const cipFilter_t * const pFilters,
+    const size_t pCount,
+    const uint64_t pFrom,
+    const uint64_t pTo,
+    const cipQueryFct_t pFct,
+    void * const pCtx,
+    cipQueryStats_t * const pStats)
+{
+    if(NULL == pFct || pFrom > pTo) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_queryCapture> Invalid query function or time range\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    cipQuery_t lQuery;
+    cipErrorCode_t lErrorCode = CIP_queryCompile(&lQuery, pFilters, pCount);
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        return lErrorCode;
+    }
+    lQuery.from = pFrom;
+    lQuery.to   = pTo;
+    lQuery.fct  = pFct;
+    lQuery.ctx  = pCtx;
+
+    cipQueryStats_t lStats;
+    memset(&lStats, 0, sizeof(lStats));
+    const uint64_t lStart = CIP_monotonicNs();
+
+    cipCaptureReader_t lReader;
+    if(can_serial_ERROR_NONE != (lErrorCode = CIP_captureMap(&lReader, pPath))) {
+        return lErrorCode;
+    }
+
+    /* The index tells where the capture ends, w/o reading it */
+    size_t lIndexBytes = 0U;
+    const cipCaptureIndexHeader_t * const lHeader = CIP_captureIndexMap(&lReader, pPath, &lIndexBytes);
+    const uint64_t lIndexed = NULL != lHeader ? __atomic_load_n(&lHeader->indexed, __ATOMIC_ACQUIRE) : 0U;
+    CIP_captureLocate(&lReader, lIndexed);
+
+    bool lGoOn = true;
+    uint64_t lPos = 0U < lReader.first ? lReader.first - 1U : 0U;
+    const uint64_t lEnd = lReader.last;
+
+    /* Indexed blocks first */
+    if(NULL != lHeader && lPos < lIndexed) {
+        const cipCaptureIndexEntry_t * const lEntries = CIP_captureIndexEntries((uint8_t *)(uintptr_t)lHeader);
+        const uint64_t lBlockRecords = lHeader->blockRecords;
+
+        while(lGoOn && lPos < lIndexed) {
+            const uint64_t lBlock = lPos / lBlockRecords;
+            const uint64_t lHi    = (lBlock + 1U) * lBlockRecords < lIndexed ? (lBlock + 1U) * lBlockRecords : lIndexed;
+            const cipCaptureIndexEntry_t * const lEntry = &lEntries[lBlock % lHeader->nbBlocks];
+
+            lStats.blocks++;
+            if(lBlock + 1U != __atomic_load_n(&lEntry->block, __ATOMIC_ACQUIRE) || CIP_queryBlock(&lQuery, lEntry)) {
+                lStats.blocksRead++;
+                lGoOn = CIP_queryRange(&lQuery, &lReader, lPos, lHi, &lStats);
+            }
+            lPos = lHi;
+        }
+    }
+
+    /* Then the records written since the last index update */
+    if(lGoOn && lPos < lEnd) {
+        lStats.tailRecords = lEnd - lPos;
+        (void)CIP_queryRange(&lQuery, &lReader, lPos, lEnd, &lStats);
+    }
+
+    if(NULL != lHeader) {
+        (void)munmap((void *)(uintptr_t)lHeader, lIndexBytes);
+    }
+    CIP_captureClose(&lReader);
+
+    lStats.durationNs = CIP_monotonicNs() - lStart;
+    if(NULL != pStats) {
+        *pStats = lStats;
+    }
+
+    return can_serial_ERROR_NONE;
+}
@@ -0,0 +1,429 @@
+/**
+ * @brief CAN over serial cyclic messages
+ *
+ * Each module w/ cyclic messages runs a timer wheel thread woken up
+ * every tick by a periodic timerfd. The wheel mutex protects the
+ * bucket lists against CIP_addCyclic/CIP_removeCyclic, the payloads
+ * are swapped by CIP_updateCyclic under a sequence lock instead,
+ * so that updating a message never waits for the wheel.
+ *
+ * @file can_serial_cyclic.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_cyclic.h"
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+#define CYCLIC_WHEEL_MASK   (can_serial_CYCLIC_WHEEL_SIZE - 1U)
+#define CYCLIC_INDEX(pID)   ((pID) & 0xFFFFU)
+#define CYCLIC_GEN(pID)     ((uint16_t)((pID) >> 16U))
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Support functions ----------------------------------- */
+static void CIP_cyclicLink(cipCyclicWheel_t * const pWheel, const uint32_t pIdx) {
+    cipCyclic_t * const lEntry = &pWheel->entries[pIdx];
+    uint32_t * const lHead = &pWheel->buckets[lEntry->expiry & CYCLIC_WHEEL_MASK];
+
+    lEntry->prev = can_serial_CYCLIC_NONE;
+    lEntry->next = *lHead;
+    if(can_serial_CYCLIC_NONE != *lHead) {
+        pWheel->entries[*lHead].prev = pIdx;
+    }
+    *lHead = pIdx;
+}
+
+static void CIP_cyclicUnlink(cipCyclicWheel_t * const pWheel, const uint32_t pIdx) {
+    const cipCyclic_t * const lEntry = &pWheel->entries[pIdx];
+
+    if(can_serial_CYCLIC_NONE != lEntry->prev) {
+        pWheel->entries[lEntry->prev].next = lEntry->next;
+    } else {
+        pWheel->buckets[lEntry->expiry & CYCLIC_WHEEL_MASK] = lEntry->next;
+    }
+    if(can_serial_CYCLIC_NONE != lEntry->next) {
+        pWheel->entries[lEntry->next].prev = lEntry->prev;
+    }
+}
+
+/* Empties the wheel, every entry goes back to the free list */
+static void CIP_cyclicReset(cipCyclicWheel_t * const pWheel) {
+    for(uint32_t i = 0U; i < can_serial_CYCLIC_WHEEL_SIZE; i++) {
+        pWheel->buckets[i] = can_serial_CYCLIC_NONE;
+    }
+    for(uint32_t i = 0U; i < can_serial_MAX_NB_CYCLIC; i++) {
+        if(pWheel->entries[i].inUse) {
+            /* Outstanding handles become stale */
+            pWheel->entries[i].gen++;
+        }
+        pWheel->entries[i].inUse = false;
+        pWheel->entries[i].next  = i + 1U < can_serial_MAX_NB_CYCLIC ? i + 1U : can_serial_CYCLIC_NONE;
+    }
+    pWheel->freeHead = 0U;
+    pWheel->tick     = 0U;
+}
+
+/* Copies a consistent payload, retries if CIP_updateCyclic raced w/ us */
+static void CIP_cyclicRead(cipCyclic_t * const pEntry, cipMessage_t * const pMsg) {
+    uint32_t lSeq = 0U;
+    uint64_t lData = 0U;
+    uint8_t  lSize = 0U;
+
+    for(;;) {
+        lSeq  = __atomic_load_n(&pEntry->seq, __ATOMIC_ACQUIRE);
+        lData = __atomic_load_n(&pEntry->data, __ATOMIC_RELAXED);
+        lSize = __atomic_load_n(&pEntry->size, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(0U == (lSeq & 1U) && lSeq == __atomic_load_n(&pEntry->seq, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    memset(pMsg, 0, sizeof(cipMessage_t));
+    pMsg->id    = pEntry->id;
+    pMsg->flags = pEntry->flags;
+    pMsg->size  = lSize;
+    memcpy(pMsg->data, &lData, CAN_MESSAGE_MAX_SIZE);
+}
+
+static void CIP_cyclicWrite(cipCyclic_t * const pEntry, const uint8_t pSize, const uint8_t * const pData) {
+    uint64_t lData = 0U;
+    if(0U < pSize) {
+        memcpy(&lData, pData, pSize);
+    }
+
+    /* Writers take turns on the odd sequence number */
+    uint32_t lSeq = __atomic_load_n(&pEntry->seq, __ATOMIC_RELAXED);
+    do {
+        while(0U != (lSeq & 1U)) {
+            lSeq = __atomic_load_n(&pEntry->seq, __ATOMIC_RELAXED);
+        }
+    } while(!__atomic_compare_exchange_n(&pEntry->seq, &lSeq, lSeq + 1U, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&pEntry->data, lData, __ATOMIC_RELAXED);
+    __atomic_store_n(&pEntry->size, pSize, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&pEntry->seq, lSeq + 2U, __ATOMIC_RELEASE);
+}
+
+/* Returns the entry of a handle, NULL if it is stale or invalid */
+static cipCyclic_t *CIP_cyclicEntry(cipCyclicWheel_t * const pWheel, const cipCyclicID_t pCyclicID) {
+    cipCyclic_t * const lEntries = __atomic_load_n(&pWheel->entries, __ATOMIC_ACQUIRE);
+    if(NULL == lEntries || can_serial_MAX_NB_CYCLIC <= CYCLIC_INDEX(pCyclicID)) {
+        return NULL;
+    }
+
+    cipCyclic_t * const lEntry = &lEntries[CYCLIC_INDEX(pCyclicID)];
+    if(!__atomic_load_n(&lEntry->inUse, __ATOMIC_ACQUIRE)
+        || CYCLIC_GEN(pCyclicID) != __atomic_load_n(&lEntry->gen, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    return lEntry;
+}
+
+/* Moves the wheel one tick on and sends the messages due */
+static void CIP_cyclicTick(const cipID_t pID, cipMessage_t * const pMsgs) {
+    cipCyclicWheel_t * const lWheel = &gCIP[pID].cyclic;
+
+    pthread_mutex_lock(&lWheel->mutex);
+    const uint64_t lTick = ++lWheel->tick;
+
+    size_t lCount = 0U;
+    uint32_t lIdx = lWheel->buckets[lTick & CYCLIC_WHEEL_MASK];
+    while(can_serial_CYCLIC_NONE != lIdx) {
+        cipCyclic_t * const lEntry = &lWheel->entries[lIdx];
+        const uint32_t lNext = lEntry->next;
+
+        /* Due in a later round of the wheel */
+        if(lTick != lEntry->expiry) {
+            lIdx = lNext;
+            continue;
+        }
+
+        CIP_cyclicRead(lEntry, &pMsgs[lCount++]);
+
+        /* Next transmission, possibly back in this very bucket (ahead of lNext) */
+        CIP_cyclicUnlink(lWheel, lIdx);
+        lEntry->expiry += lEntry->period;
+        CIP_cyclicLink(lWheel, lIdx);
+        lIdx = lNext;
+
+        if(can_serial_CYCLIC_BATCH_SIZE == lCount) {
+            /* The bucket may change while we send : walk it again,
+             * the messages already sent are due later now */
+            pthread_mutex_unlock(&lWheel->mutex);
+            (void)CIP_sendBatch(pID, pMsgs, lCount, NULL, NULL);
+            lCount = 0U;
+            pthread_mutex_lock(&lWheel->mutex);
+            lIdx = lWheel->buckets[lTick & CYCLIC_WHEEL_MASK];
+        }
+    }
+    pthread_mutex_unlock(&lWheel->mutex);
+
+    if(0U < lCount) {
+        (void)CIP_sendBatch(pID, pMsgs, lCount, NULL, NULL);
+    }
+}
+
+static void *CIP_cyclicThread(void *pArg) {
+    /* The module ID is passed by value in the argument */
+    const cipID_t lID = (cipID_t)(uintptr_t)pArg;
+    cipCyclicWheel_t * const lWheel = &gCIP[lID].cyclic;
+
+    cipMessage_t lMsgs[can_serial_CYCLIC_BATCH_SIZE];
+
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_cyclicThread> Starting the timer wheel of module %u.\n", lID);
+    while(!__atomic_load_n(&lWheel->stop, __ATOMIC_ACQUIRE)) {
+        uint64_t lExpirations = 0U;
+        errno = 0;
+        if(sizeof(lExpirations) != read(lWheel->timerFd, &lExpirations, sizeof(lExpirations))) {
+            if(EINTR == errno) {
+                continue;
+            }
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_cyclicThread> timerfd read failed !\n");
+            break;
+        }
+
+        /* Late ticks are caught up, in order */
+        for(uint64_t i = 0U; i < lExpirations; i++) {
+            CIP_cyclicTick(lID, lMsgs);
+        }
+    }
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_cyclicThread> Timer wheel of module %u stopped.\n", lID);
+
+    return NULL;
+}
+
+/* Allocates the entries and starts the wheel thread, wheel mutex held */
+static cipErrorCode_t CIP_cyclicStart(const cipID_t pID) {
+    cipCyclicWheel_t * const lWheel = &gCIP[pID].cyclic;
+
+    if(NULL == lWheel->entries) {
+        cipCyclic_t * const lEntries = calloc(can_serial_MAX_NB_CYCLIC, sizeof(cipCyclic_t));
+        uint32_t * const lBuckets = malloc(can_serial_CYCLIC_WHEEL_SIZE * sizeof(uint32_t));
+        if(NULL == lEntries || NULL == lBuckets) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> Failed to allocate the cyclic messages\n");
+            free(lEntries);
+            free(lBuckets);
+            return can_serial_ERROR_SYS;
+        }
+        lWheel->buckets = lBuckets;
+        __atomic_store_n(&lWheel->entries, lEntries, __ATOMIC_RELEASE);
+        CIP_cyclicReset(lWheel);
+    }
+
+    errno = 0;
+    const int lTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(0 > lTimerFd) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_addCyclic> timerfd_create failed !\n");
+        return can_serial_ERROR_SYS;
+    }
+
+    /* Tick n expires n ticks from now, whenever the thread reads it */
+    struct itimerspec lTimer;
+    memset(&lTimer, 0, sizeof(lTimer));
+    lTimer.it_value.tv_nsec    = (long)can_serial_CYCLIC_TICK_NS;
+    lTimer.it_interval.tv_nsec = (long)can_serial_CYCLIC_TICK_NS;
+    errno = 0;
+    if(0 != timerfd_settime(lTimerFd, 0, &lTimer, NULL)) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_addCyclic> timerfd_settime failed !\n");
+        (void)close(lTimerFd);
+        return can_serial_ERROR_SYS;
+    }
+
+    lWheel->timerFd = lTimerFd;
+    lWheel->stop    = false;
+    if(0 != pthread_create(&lWheel->thread, NULL, CIP_cyclicThread, (void *)(uintptr_t)pID)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> Thread creation failed\n");
+        lWheel->timerFd = -1;
+        (void)close(lTimerFd);
+        return can_serial_ERROR_SYS;
+    }
+    lWheel->threadOn = true;
+
+    return can_serial_ERROR_NONE;
+}
+
+/* Cyclic functions ------------------------------------ */
+void CIP_cyclicInit(cipCyclicWheel_t * const pWheel) {
+    memset(pWheel, 0, sizeof(cipCyclicWheel_t));
+    pWheel->timerFd = -1;
+    pthread_mutex_init(&pWheel->mutex, NULL);
+}
+
+void CIP_cyclicFree(cipCyclicWheel_t * const pWheel) {
+    free(pWheel->entries);
+    free(pWheel->buckets);
+    pWheel->entries = NULL;
+    pWheel->buckets = NULL;
+}
+
+cipErrorCode_t CIP_cyclicStop(const cipID_t pID) {
+    cipCyclicWheel_t * const lWheel = &gCIP[pID].cyclic;
+
+    if(lWheel->threadOn) {
+        /* The thread sees it on its next tick */
+        __atomic_store_n(&lWheel->stop, true, __ATOMIC_RELEASE);
+        if(0 != pthread_join(lWheel->thread, NULL)) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_cyclicStop> pthread_join failed\n");
+            return can_serial_ERROR_SYS;
+        }
+        lWheel->threadOn = false;
+
+        (void)close(lWheel->timerFd);
+        lWheel->timerFd = -1;
+    }
+
+    pthread_mutex_lock(&lWheel->mutex);
+    if(NULL != lWheel->entries) {
+        CIP_cyclicReset(lWheel);
+    }
+    pthread_mutex_unlock(&lWheel->mutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_addCyclic(const cipID_t pID,
+    const cipMessage_t * const pMsg,
+    const uint32_t pPeriodMs,
+    const uint32_t pPhaseMs,
+    cipCyclicID_t * const pCyclicID)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(NULL == pMsg || NULL == pCyclicID || 0U == pPeriodMs
+        || CAN_MESSAGE_MAX_SIZE < pMsg->size || 0U != (pMsg->flags & can_serial_FLAG_FDF))
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> Invalid cyclic message\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCyclicWheel_t * const lWheel = &gCIP[pID].cyclic;
+
+    pthread_mutex_lock(&lWheel->mutex);
+
+    if(!lWheel->threadOn) {
+        const cipErrorCode_t lErrorCode = CIP_cyclicStart(pID);
+        if(can_serial_ERROR_NONE != lErrorCode) {
+            pthread_mutex_unlock(&lWheel->mutex);
+            return lErrorCode;
+        }
+    }
+
+    const uint32_t lIdx = lWheel->freeHead;
+    if(can_serial_CYCLIC_NONE == lIdx) {
+        pthread_mutex_unlock(&lWheel->mutex);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_addCyclic> CAN-IP module %u already sends %u cyclic messages\n", pID, can_serial_MAX_NB_CYCLIC);
+        return can_serial_ERROR_FULL;
+    }
+
+    cipCyclic_t * const lEntry = &lWheel->entries[lIdx];
+    lWheel->freeHead = lEntry->next;
+
+    lEntry->id     = pMsg->id;
+    lEntry->flags  = pMsg->flags;
+    lEntry->period = pPeriodMs;
+    lEntry->expiry = lWheel->tick + (0U < pPhaseMs ? pPhaseMs : 1U);
+    CIP_cyclicWrite(lEntry, pMsg->size, pMsg->data);
+    CIP_cyclicLink(lWheel, lIdx);
+    __atomic_store_n(&lEntry->inUse, true, __ATOMIC_RELEASE);
+
+    *pCyclicID = ((cipCyclicID_t)lEntry->gen << 16U) | lIdx;
+
+    pthread_mutex_unlock(&lWheel->mutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_updateCyclic(const cipID_t pID,
+    const cipCyclicID_t pCyclicID,
+    const uint8_t pSize,
+    const uint8_t * const pData)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_updateCyclic> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(CAN_MESSAGE_MAX_SIZE < pSize || (0U < pSize && NULL == pData)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_updateCyclic> Invalid payload\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCyclic_t * const lEntry = CIP_cyclicEntry(&gCIP[pID].cyclic, pCyclicID);
+    if(NULL == lEntry) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_updateCyclic> No cyclic message 0x%08X on CAN-IP module %u\n", pCyclicID, pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    CIP_cyclicWrite(lEntry, pSize, pData);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_removeCyclic(const cipID_t pID, const cipCyclicID_t pCyclicID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_removeCyclic> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipCyclicWheel_t * const lWheel = &gCIP[pID].cyclic;
+
+    pthread_mutex_lock(&lWheel->mutex);
+
+    cipCyclic_t * const lEntry = CIP_cyclicEntry(lWheel, pCyclicID);
+    if(NULL == lEntry) {
+        pthread_mutex_unlock(&lWheel->mutex);
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_removeCyclic> No cyclic message 0x%08X on CAN-IP module %u\n", pCyclicID, pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    const uint32_t lIdx = CYCLIC_INDEX(pCyclicID);
+    CIP_cyclicUnlink(lWheel, lIdx);
+    __atomic_store_n(&lEntry->inUse, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&lEntry->gen, (uint16_t)(lEntry->gen + 1U), __ATOMIC_RELAXED);
+    lEntry->next = lWheel->freeHead;
+    lWheel->freeHead = lIdx;
+
+    pthread_mutex_unlock(&lWheel->mutex);
+
+    return can_serial_ERROR_NONE;
+}
@@ -0,0 +1,72 @@
+/**
+ * @brief CAN over serial cyclic messages
+ *
+ * @file can_serial_cyclic.h
+ */
+
+#ifndef can_serial_CYCLIC_H
+#define can_serial_CYCLIC_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_CYCLIC_TICK_NS       1000000U    /**< Timer wheel resolution (1 ms) */
+#define can_serial_CYCLIC_WHEEL_SIZE    1024U       /**< Wheel buckets, power of 2 */
+#define can_serial_CYCLIC_BATCH_SIZE    64U         /**< Messages sent per CIP_sendBatch */
+#define can_serial_CYCLIC_NONE          UINT32_MAX  /**< End of a bucket list */
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipCyclic {
+    /* Payload, swapped in place by CIP_updateCyclic (seqlock) */
+    uint32_t seq;       /**< Odd while the payload is being written */
+    uint8_t  size;
+    uint64_t data;      /**< CAN_MESSAGE_MAX_SIZE bytes */
+
+    /* Under the wheel mutex */
+    uint32_t id;
+    uint32_t flags;
+    uint64_t period;    /**< In ticks */
+    uint64_t expiry;    /**< Tick of the next transmission */
+    uint32_t prev;      /**< Bucket (or free) list links */
+    uint32_t next;
+    uint16_t gen;       /**< Bumped on removal, part of the handle */
+    bool     inUse;
+} cipCyclic_t;
+
+/**
+ * @brief Hashed timer wheel of cyclic messages.
+ * A message due at tick T waits in bucket T % WHEEL_SIZE,
+ * the wheel thread walks one bucket per tick and sends
+ * the messages due at that tick. The entries are allocated
+ * once (can_serial_MAX_NB_CYCLIC), then reused.
+ */
+typedef struct _cipCyclicWheel {
+    cipCyclic_t    *entries;   /**< NULL until the first cyclic message */
+    uint32_t       *buckets;   /**< First entry of each bucket */
+    uint32_t        freeHead;
+    uint64_t        tick;      /**< Last tick processed */
+
+    pthread_mutex_t mutex;
+    pthread_t       thread;
+    bool            threadOn;
+    bool            stop;
+    int             timerFd;
+} cipCyclicWheel_t;
+
+/* Cyclic functions ------------------------------------ */
+void CIP_cyclicInit(cipCyclicWheel_t * const pWheel);
+
+/* Frees the entries, the wheel thread must be stopped */
+void CIP_cyclicFree(cipCyclicWheel_t * const pWheel);
+
+/* Stops the wheel thread of module pID and removes its cyclic messages */
+cipErrorCode_t CIP_cyclicStop(const cipID_t pID);
+
+#endif /* can_serial_CYCLIC_H */
@@ -0,0 +1,41 @@
+/**
+ * @brief CAN over serial CAN FD DLC functions
+ * 
+ * @file can_serial_dlc.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial.h"
+
+#include <stdint.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+static const uint8_t sDlcToLength[16U] = {
+    0U, 1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 12U, 16U, 20U, 24U, 32U, 48U, 64U
+};
+
+/* Indexed by (length + 3) / 4, lengths over 8 only */
+static const uint8_t sLengthToDlc[17U] = {
+    8U, 8U, 8U, 9U, 10U, 11U, 12U, 13U, 13U, 14U, 14U, 14U, 14U, 15U, 15U, 15U, 15U
+};
+
+/* DLC functions --------------------------------------- */
+uint8_t CIP_dlcToLength(const uint8_t pDLC) {
+    return sDlcToLength[pDLC & 0x0FU];
+}
+
+uint8_t CIP_lengthToDlc(const uint8_t pLength) {
+    if(CAN_MESSAGE_MAX_SIZE >= pLength) {
+        return pLength;
+    }
+
+    if(CAN_FD_MESSAGE_MAX_SIZE < pLength) {
+        return 15U;
+    }
+
+    return sLengthToDlc[(pLength + 3U) / 4U];
+}
@@ -0,0 +1,302 @@
+/**
+ * @brief CAN over serial acceptance filters
+ * 
+ * @file can_serial_filter.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_filter.h"
+#include "can_serial_wire.h"
+#include "can_serial_log.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+#define BPF_UDP_HEADER_SIZE 8U      /**< The filter sees the UDP header first */
+#define BPF_ACCEPT          0xFFFFFFFFU
+#define BPF_DROP            0U
+
+/* Scratch memory slots */
+#define BPF_MEM_ID          0U
+#define BPF_MEM_EFF         1U
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipBpfBuilder {
+    struct sock_filter *prog;
+    size_t              cap;
+    size_t              len;
+} cipBpfBuilder_t;
+
+/* Static variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static int compareRanges(const void *pA, const void *pB) {
+    const cipIdRange_t * const lA = (const cipIdRange_t *)pA;
+    const cipIdRange_t * const lB = (const cipIdRange_t *)pB;
+
+    return lA->lo < lB->lo ? -1 : (lA->lo > lB->lo ? 1 : 0);
+}
+
+/* Returns the index of the instruction */
+static size_t bpfJump(cipBpfBuilder_t * const pBuilder, const uint16_t pCode, const uint32_t pK, const uint8_t pJt, const uint8_t pJf) {
+    if(pBuilder->len < pBuilder->cap) {
+        pBuilder->prog[pBuilder->len] = (struct sock_filter)BPF_JUMP(pCode, pK, pJt, pJf);
+    }
+
+    return pBuilder->len++;
+}
+
+static size_t bpfStmt(cipBpfBuilder_t * const pBuilder, const uint16_t pCode, const uint32_t pK) {
+    return bpfJump(pBuilder, pCode, pK, 0U, 0U);
+}
+
+/* Points the BPF_JA at pIdx to the next instruction to be emitted */
+static void bpfLandHere(cipBpfBuilder_t * const pBuilder, const size_t pIdx) {
+    if(pIdx < pBuilder->cap) {
+        pBuilder->prog[pIdx].k = (uint32_t)(pBuilder->len - pIdx - 1U);
+    }
+}
+
+/* A in [lo, hi] : accept */
+static void bpfRange(cipBpfBuilder_t * const pBuilder, const uint32_t pLo, const uint32_t pHi) {
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JGE | BPF_K, pLo, 0U, 2U);
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JGT | BPF_K, pHi, 1U, 0U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_ACCEPT);
+}
+
+/* Big-endian value of a host-endian word, as BPF_W loads see it */
+static uint32_t hostToBpfWord(const uint32_t pValue) {
+    uint8_t lBytes[4U];
+    memcpy(lBytes, &pValue, sizeof(lBytes));
+
+    return ((uint32_t)lBytes[0U] << 24U) | ((uint32_t)lBytes[1U] << 16U) | ((uint32_t)lBytes[2U] << 8U) | lBytes[3U];
+}
+
+/* Compact datagrams : drops our own, loads the ID and the EFF flag of single-frame ones.
+ * Returns the index of the jump to the rules. */
+static size_t bpfCompact(cipBpfBuilder_t * const pBuilder, const uint32_t pRandID) {
+    const uint32_t lBase = BPF_UDP_HEADER_SIZE;
+
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_B   | BPF_ABS, lBase + 2U);     /* Version */
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, can_serial_WIRE_VERSION, 1U, 0U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_ACCEPT);                 /* Let the user space decide */
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_ABS, lBase + 4U);     /* Sender */
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, pRandID, 0U, 1U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_DROP);                   /* Loopback */
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_B   | BPF_ABS, lBase + 3U);     /* Frame count */
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, 1U, 1U, 0U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_ACCEPT);                 /* Filtered per frame in user space */
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_ABS, lBase + can_serial_WIRE_HEADER_SIZE);
+    (void)bpfStmt(pBuilder, BPF_ST, BPF_MEM_ID);
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JSET | BPF_K, 0x80000000U, 0U, 2U); /* Flags follow ? */
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_ABS, lBase + can_serial_WIRE_HEADER_SIZE + 4U);
+    (void)bpfStmt(pBuilder, BPF_JMP | BPF_JA, 1U);
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_IMM, 0U);
+    (void)bpfStmt(pBuilder, BPF_ALU | BPF_AND | BPF_K, can_serial_FLAG_EFF);
+    (void)bpfStmt(pBuilder, BPF_ST, BPF_MEM_EFF);
+
+    return bpfStmt(pBuilder, BPF_JMP | BPF_JA, 0U);
+}
+
+/* Legacy datagrams : drops our own, loads the host-endian ID and EFF flag */
+static void bpfLegacy(cipBpfBuilder_t * const pBuilder, const uint32_t pRandID) {
+    const uint32_t lBase = BPF_UDP_HEADER_SIZE;
+    const bool     lLittleEndian = 1U == hostToBpfWord(0x01000000U);
+
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_LEN, 0U);
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, lBase + sizeof(cipLegacyWireMessage_t), 1U, 0U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_ACCEPT);                 /* Let the user space drop it */
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_ABS, lBase + offsetof(cipLegacyWireMessage_t, randID));
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, hostToBpfWord(pRandID), 0U, 1U);
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_DROP);                   /* Loopback */
+
+    const uint32_t lID = lBase + offsetof(cipLegacyWireMessage_t, id);
+    if(lLittleEndian) {
+        /* No byte swap in classic BPF, rebuild the ID from its bytes */
+        (void)bpfStmt(pBuilder, BPF_LD  | BPF_B   | BPF_ABS, lID + 3U);
+        for(uint32_t i = 3U; 0U < i; i--) {
+            (void)bpfStmt(pBuilder, BPF_ALU | BPF_LSH | BPF_K, 8U);
+            (void)bpfStmt(pBuilder, BPF_MISC | BPF_TAX, 0U);
+            (void)bpfStmt(pBuilder, BPF_LD  | BPF_B   | BPF_ABS, lID + i - 1U);
+            (void)bpfStmt(pBuilder, BPF_ALU | BPF_OR  | BPF_X, 0U);
+        }
+    } else {
+        (void)bpfStmt(pBuilder, BPF_LD  | BPF_W   | BPF_ABS, lID);
+    }
+    (void)bpfStmt(pBuilder, BPF_ST, BPF_MEM_ID);
+
+    /* EFF is the lowest bit of the flags word */
+    const uint32_t lFlags = lBase + offsetof(cipLegacyWireMessage_t, flags);
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_B   | BPF_ABS, lLittleEndian ? lFlags : lFlags + 3U);
+    (void)bpfStmt(pBuilder, BPF_ALU | BPF_AND | BPF_K, can_serial_FLAG_EFF);
+    (void)bpfStmt(pBuilder, BPF_ST, BPF_MEM_EFF);
+}
+
+/* ID rules, w/ the ID in M[BPF_MEM_ID] and the EFF flag in M[BPF_MEM_EFF] */
+static void bpfRules(cipBpfBuilder_t * const pBuilder, const cipFilterTable_t * const pTable) {
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_MEM, BPF_MEM_EFF);
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, 0U, 1U, 0U);
+    const size_t lToExt0 = bpfStmt(pBuilder, BPF_JMP | BPF_JA, 0U);
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_MEM, BPF_MEM_ID);
+    (void)bpfStmt(pBuilder, BPF_ALU | BPF_AND | BPF_K, can_serial_EXT_ID_MASK);
+    (void)bpfJump(pBuilder, BPF_JMP | BPF_JGT | BPF_K, can_serial_STD_ID_MASK, 0U, 1U);
+    const size_t lToExt1 = bpfStmt(pBuilder, BPF_JMP | BPF_JA, 0U);
+
+    /* Standard IDs : one range per run of set bits in the bitmap */
+    for(uint32_t lID = 0U; lID <= can_serial_STD_ID_MASK; lID++) {
+        if(0U == (pTable->stdBitmap[lID >> 6U] & (1ULL << (lID & 63U)))) {
+            continue;
+        }
+
+        const uint32_t lLo = lID;
+        while(lID < can_serial_STD_ID_MASK && 0U != (pTable->stdBitmap[(lID + 1U) >> 6U] & (1ULL << ((lID + 1U) & 63U)))) {
+            lID++;
+        }
+        bpfRange(pBuilder, lLo, lID);
+    }
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_DROP);
+
+    /* Extended IDs */
+    bpfLandHere(pBuilder, lToExt0);
+    bpfLandHere(pBuilder, lToExt1);
+    (void)bpfStmt(pBuilder, BPF_LD  | BPF_MEM, BPF_MEM_ID);
+    (void)bpfStmt(pBuilder, BPF_ALU | BPF_AND | BPF_K, can_serial_EXT_ID_MASK);
+    for(size_t i = 0U; i < pTable->nbRanges; i++) {
+        bpfRange(pBuilder, pTable->ranges[i].lo, pTable->ranges[i].hi);
+    }
+    for(size_t i = 0U; i < pTable->nbExtRules; i++) {
+        (void)bpfStmt(pBuilder, BPF_LD  | BPF_MEM, BPF_MEM_ID);
+        (void)bpfStmt(pBuilder, BPF_ALU | BPF_AND | BPF_K, pTable->extRules[i].mask);
+        (void)bpfJump(pBuilder, BPF_JMP | BPF_JEQ | BPF_K, pTable->extRules[i].id, 0U, 1U);
+        (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_ACCEPT);
+    }
+    (void)bpfStmt(pBuilder, BPF_RET | BPF_K, BPF_DROP);
+}
+
+static size_t buildBpf(const cipFilterTable_t * const pTable,
+    const uint32_t pRandID,
+    const bool pWithRules,
+    struct sock_filter * const pProg,
+    const size_t pCap)
+{
+    cipBpfBuilder_t lBuilder = {.prog = pProg, .cap = pCap, .len = 0U};
+
+    /* Compact or legacy datagram ? */
+    (void)bpfStmt(&lBuilder, BPF_LD  | BPF_H   | BPF_ABS, BPF_UDP_HEADER_SIZE);
+    const size_t lToLegacy = bpfJump(&lBuilder, BPF_JMP | BPF_JEQ | BPF_K,
+        ((uint32_t)can_serial_WIRE_MAGIC_0 << 8U) | can_serial_WIRE_MAGIC_1, 0U, 0U);
+
+    const size_t lToRules = bpfCompact(&lBuilder, pRandID);
+
+    /* jf of the magic check */
+    if(lToLegacy < pCap) {
+        const size_t lOffset = lBuilder.len - lToLegacy - 1U;
+        if(UINT8_MAX < lOffset) {
+            return 0U;
+        }
+        pProg[lToLegacy].jf = (uint8_t)lOffset;
+    }
+    bpfLegacy(&lBuilder, pRandID);
+
+    /* The compact section jumps over the legacy one */
+    bpfLandHere(&lBuilder, lToRules);
+
+    if(pWithRules && pTable->enabled) {
+        bpfRules(&lBuilder, pTable);
+    } else {
+        (void)bpfStmt(&lBuilder, BPF_RET | BPF_K, BPF_ACCEPT);
+    }
+
+    return lBuilder.len;
+}
+
+/* Filter functions ------------------------------------ */
+cipErrorCode_t CIP_filterCompile(cipFilterTable_t * const pTable, const cipFilter_t * const pFilters, const size_t pCount) {
+    if(can_serial_MAX_NB_FILTERS < pCount || (0U < pCount && NULL == pFilters)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_filterCompile> Invalid filter list (max %u filters)\n", can_serial_MAX_NB_FILTERS);
+        return can_serial_ERROR_ARG;
+    }
+
+    memset(pTable, 0, sizeof(cipFilterTable_t));
+    if(0U == pCount) {
+        /* No filter, accept everything */
+        return can_serial_ERROR_NONE;
+    }
+    pTable->enabled = true;
+
+    for(size_t f = 0U; f < pCount; f++) {
+        if(0U == (pFilters[f].flags & can_serial_FLAG_EFF)) {
+            /* 11-bit rule : set the bit of every matching ID */
+            const uint32_t lMask = pFilters[f].mask & can_serial_STD_ID_MASK;
+            const uint32_t lBase = pFilters[f].id & lMask;
+            for(uint32_t lID = 0U; lID <= can_serial_STD_ID_MASK; lID++) {
+                if(lBase == (lID & lMask)) {
+                    pTable->stdBitmap[lID >> 6U] |= 1ULL << (lID & 63U);
+                }
+            }
+            continue;
+        }
+
+        /* 29-bit rule : the low don't-care bits make a range,
+         * the other don't-care bits multiply the ranges */
+        const uint32_t lMask  = pFilters[f].mask & can_serial_EXT_ID_MASK;
+        const uint32_t lBase  = pFilters[f].id & lMask;
+        const uint32_t lFree  = ~lMask & can_serial_EXT_ID_MASK;
+        const uint32_t lLow   = lFree ^ (lFree & (lFree + 1U));
+        const uint32_t lUpper = lFree & ~lLow;
+        const uint64_t lNb    = 1ULL << __builtin_popcount(lUpper);
+
+        if(can_serial_MAX_NB_FILTER_RANGES - pTable->nbRanges < lNb) {
+            pTable->extRules[pTable->nbExtRules].id   = lBase;
+            pTable->extRules[pTable->nbExtRules].mask = lMask;
+            pTable->nbExtRules++;
+            continue;
+        }
+
+        uint32_t lSub = 0U;
+        do {
+            pTable->ranges[pTable->nbRanges].lo = lBase | lSub;
+            pTable->ranges[pTable->nbRanges].hi = lBase | lSub | lLow;
+            pTable->nbRanges++;
+            lSub = (lSub - lUpper) & lUpper;
+        } while(0U != lSub);
+    }
+
+    /* Sort and merge the overlapping or adjacent ranges */
+    if(0U < pTable->nbRanges) {
+        qsort(pTable->ranges, pTable->nbRanges, sizeof(cipIdRange_t), compareRanges);
+
+        size_t lLast = 0U;
+        for(size_t i = 1U; i < pTable->nbRanges; i++) {
+            if(pTable->ranges[i].lo <= pTable->ranges[lLast].hi + 1U) {
+                if(pTable->ranges[i].hi > pTable->ranges[lLast].hi) {
+                    pTable->ranges[lLast].hi = pTable->ranges[i].hi;
+                }
+            } else {
+                pTable->ranges[++lLast] = pTable->ranges[i];
+            }
+        }
+        pTable->nbRanges = lLast + 1U;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+size_t CIP_filterBuildBpf(const cipFilterTable_t * const pTable,
+    const uint32_t pRandID,
+    struct sock_filter * const pProg,
+    const size_t pCap)
+{
+    size_t lLen = buildBpf(pTable, pRandID, true, pProg, pCap);
+    if(0U == lLen || pCap < lLen) {
+        /* Too many rules for the kernel, keep the loopback check only,
+         * the rules are still applied in user space */
+        CIP_LOG(can_serial_LOG_INFO, "<CIP_filterBuildBpf> Too many rules for a socket filter, filtering in user space\n");
+        lLen = buildBpf(pTable, pRandID, false, pProg, pCap);
+    }
+
+    return lLen <= pCap ? lLen : 0U;
+}
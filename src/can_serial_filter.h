@@ -0,0 +1,95 @@
+/**
+ * @brief CAN over serial acceptance filters
+ * 
+ * Standard (11-bit) rules are compiled to a 2048-bit bitmap,
+ * extended (29-bit) rules to sorted, merged ID ranges.
+ * The same rules are compiled to a classic BPF socket filter.
+ * 
+ * @file can_serial_filter.h
+ */
+
+#ifndef can_serial_FILTER_H
+#define can_serial_FILTER_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <linux/filter.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_STD_ID_MASK 0x7FFU
+#define can_serial_EXT_ID_MASK 0x1FFFFFFFU
+
+/* Number of ID ranges the extended rules may expand to,
+ * the rules that do not fit are checked one by one */
+#ifndef can_serial_MAX_NB_FILTER_RANGES
+#define can_serial_MAX_NB_FILTER_RANGES 256U
+#endif /* can_serial_MAX_NB_FILTER_RANGES */
+
+/* Longest BPF program we attach (BPF_MAXINSNS) */
+#define can_serial_BPF_MAX_INSNS 4096U
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipIdRange {
+    uint32_t lo;
+    uint32_t hi; /**< Included */
+} cipIdRange_t;
+
+typedef struct _cipFilterTable {
+    bool         enabled;   /**< false : every frame is accepted */
+    uint64_t     stdBitmap[(can_serial_STD_ID_MASK + 1U) / 64U];
+    cipIdRange_t ranges[can_serial_MAX_NB_FILTER_RANGES];
+    size_t       nbRanges;
+    cipFilter_t  extRules[can_serial_MAX_NB_FILTERS]; /**< Rules w/ too many ranges */
+    size_t       nbExtRules;
+} cipFilterTable_t;
+
+/* Filter functions ------------------------------------ */
+cipErrorCode_t CIP_filterCompile(cipFilterTable_t * const pTable, const cipFilter_t * const pFilters, const size_t pCount);
+
+/* Returns the number of instructions written to pProg, 0 on error */
+size_t CIP_filterBuildBpf(const cipFilterTable_t * const pTable,
+    const uint32_t pRandID,
+    struct sock_filter * const pProg,
+    const size_t pCap);
+
+static inline bool CIP_filterAccept(const cipFilterTable_t * const pTable, const uint32_t pID, const uint32_t pFlags) {
+    if(!pTable->enabled) {
+        return true;
+    }
+
+    const uint32_t lID = pID & can_serial_EXT_ID_MASK;
+    if(0U == (pFlags & can_serial_FLAG_EFF) && can_serial_STD_ID_MASK >= lID) {
+        return 0U != (pTable->stdBitmap[lID >> 6U] & (1ULL << (lID & 63U)));
+    }
+
+    /* Last range starting at or below the ID */
+    size_t lLo = 0U;
+    size_t lHi = pTable->nbRanges;
+    while(lLo < lHi) {
+        const size_t lMid = (lLo + lHi) / 2U;
+        if(pTable->ranges[lMid].lo <= lID) {
+            lLo = lMid + 1U;
+        } else {
+            lHi = lMid;
+        }
+    }
+    if(0U < lLo && pTable->ranges[lLo - 1U].hi >= lID) {
+        return true;
+    }
+
+    for(size_t i = 0U; i < pTable->nbExtRules; i++) {
+        if(0U == ((lID ^ pTable->extRules[i].id) & pTable->extRules[i].mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif /* can_serial_FILTER_H */
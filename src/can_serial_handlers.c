@@ -0,0 +1,173 @@
+/**
+ * @brief CAN over serial per CAN ID handler tables
+ * 
+ * @file can_serial_handlers.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_handlers.h"
+#include "can_serial_log.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+/* Inserts w/o growing, the ID is not in the map */
+static void extInsert(cipHandlerEntry_t * const pEntries, const uint32_t pBits, const cipHandlerEntry_t * const pEntry) {
+    const uint32_t lMask = (1U << pBits) - 1U;
+    uint32_t i = CIP_handlersHash(pEntry->id, pBits);
+    while(NULL != pEntries[i].handler.fct) {
+        i = (i + 1U) & lMask;
+    }
+    pEntries[i] = *pEntry;
+}
+
+/* Keeps the load factor under 1/2 */
+static cipErrorCode_t extReserve(cipHandlerTable_t * const pTable) {
+    if(NULL != pTable->ext && (pTable->extCount + 1U) * 2U <= (1U << pTable->extBits)) {
+        return can_serial_ERROR_NONE;
+    }
+
+    const uint32_t lBits = NULL == pTable->ext ? can_serial_HANDLERS_MIN_EXT_BITS : pTable->extBits + 1U;
+    cipHandlerEntry_t * const lEntries = (cipHandlerEntry_t *)calloc(1U << lBits, sizeof(cipHandlerEntry_t));
+    if(NULL == lEntries) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_registerHandler> Failed to allocate %u handler slots\n", 1U << lBits);
+        return can_serial_ERROR_SYS;
+    }
+
+    /* Rehash */
+    for(uint32_t i = 0U; NULL != pTable->ext && i < (1U << pTable->extBits); i++) {
+        if(NULL != pTable->ext[i].handler.fct) {
+            extInsert(lEntries, lBits, &pTable->ext[i]);
+        }
+    }
+
+    free(pTable->ext);
+    pTable->ext     = lEntries;
+    pTable->extBits = lBits;
+
+    return can_serial_ERROR_NONE;
+}
+
+static cipErrorCode_t extSet(cipHandlerTable_t * const pTable, const uint32_t pID, const cipHandlerFct_t pFct, void * const pCtx) {
+    /* Look for the ID */
+    uint32_t lMask = NULL == pTable->ext ? 0U : (1U << pTable->extBits) - 1U;
+    uint32_t i     = NULL == pTable->ext ? 0U : CIP_handlersHash(pID, pTable->extBits);
+    while(NULL != pTable->ext && NULL != pTable->ext[i].handler.fct && pID != pTable->ext[i].id) {
+        i = (i + 1U) & lMask;
+    }
+    const bool lFound = NULL != pTable->ext && NULL != pTable->ext[i].handler.fct;
+
+    if(NULL != pFct) {
+        if(lFound) {
+            pTable->ext[i].handler.fct = pFct;
+            pTable->ext[i].handler.ctx = pCtx;
+            return can_serial_ERROR_NONE;
+        }
+
+        if(can_serial_ERROR_NONE != extReserve(pTable)) {
+            return can_serial_ERROR_SYS;
+        }
+
+        const cipHandlerEntry_t lEntry = {.id = pID, .handler = {.fct = pFct, .ctx = pCtx}};
+        extInsert(pTable->ext, pTable->extBits, &lEntry);
+        pTable->extCount++;
+        __atomic_add_fetch(&pTable->count, 1U, __ATOMIC_RELAXED);
+        return can_serial_ERROR_NONE;
+    }
+
+    if(!lFound) {
+        return can_serial_ERROR_NONE;
+    }
+
+    /* Backward shift deletion : pull back the entries of the cluster
+     * that would not be found anymore, no tombstones */
+    uint32_t j = i;
+    for(;;) {
+        j = (j + 1U) & lMask;
+        if(NULL == pTable->ext[j].handler.fct) {
+            break;
+        }
+
+        /* Move j to the hole at i unless its home slot lies in (i, j] */
+        const uint32_t lHome = CIP_handlersHash(pTable->ext[j].id, pTable->extBits);
+        if(((j - lHome) & lMask) >= ((j - i) & lMask)) {
+            pTable->ext[i] = pTable->ext[j];
+            i = j;
+        }
+    }
+    memset(&pTable->ext[i], 0, sizeof(cipHandlerEntry_t));
+    pTable->extCount--;
+    __atomic_sub_fetch(&pTable->count, 1U, __ATOMIC_RELAXED);
+
+    return can_serial_ERROR_NONE;
+}
+
+/* Handler functions ----------------------------------- */
+void CIP_handlersInit(cipHandlerTable_t * const pTable) {
+    memset(pTable, 0, sizeof(cipHandlerTable_t));
+    pthread_rwlock_init(&pTable->lock, NULL);
+}
+
+void CIP_handlersFree(cipHandlerTable_t * const pTable) {
+    free(pTable->std);
+    free(pTable->ext);
+    pTable->std      = NULL;
+    pTable->ext      = NULL;
+    pTable->extBits  = 0U;
+    pTable->extCount = 0U;
+    pTable->count    = 0U;
+}
+
+void CIP_handlersClear(cipHandlerTable_t * const pTable) {
+    if(NULL != pTable->std) {
+        memset(pTable->std, 0, (can_serial_STD_ID_MASK + 1U) * sizeof(cipHandler_t));
+    }
+    if(NULL != pTable->ext) {
+        memset(pTable->ext, 0, (1U << pTable->extBits) * sizeof(cipHandlerEntry_t));
+    }
+    pTable->extCount = 0U;
+    __atomic_store_n(&pTable->count, 0U, __ATOMIC_RELAXED);
+}
+
+cipErrorCode_t CIP_handlersSet(cipHandlerTable_t * const pTable,
+    const uint32_t pCANID,
+    const cipHandlerFct_t pFct,
+    void * const pCtx)
+{
+    const uint32_t lID = pCANID & can_serial_EXT_ID_MASK;
+
+    if(0U != (pCANID & can_serial_ID_EXT) || can_serial_STD_ID_MASK < lID) {
+        return extSet(pTable, lID, pFct, pCtx);
+    }
+
+    if(NULL == pTable->std) {
+        if(NULL == pFct) {
+            return can_serial_ERROR_NONE;
+        }
+
+        pTable->std = (cipHandler_t *)calloc(can_serial_STD_ID_MASK + 1U, sizeof(cipHandler_t));
+        if(NULL == pTable->std) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_registerHandler> Failed to allocate the standard ID table\n");
+            return can_serial_ERROR_SYS;
+        }
+    }
+
+    if(NULL == pTable->std[lID].fct && NULL != pFct) {
+        __atomic_add_fetch(&pTable->count, 1U, __ATOMIC_RELAXED);
+    } else if(NULL != pTable->std[lID].fct && NULL == pFct) {
+        __atomic_sub_fetch(&pTable->count, 1U, __ATOMIC_RELAXED);
+    }
+    pTable->std[lID].fct = pFct;
+    pTable->std[lID].ctx = NULL != pFct ? pCtx : NULL;
+
+    return can_serial_ERROR_NONE;
+}
@@ -0,0 +1,85 @@
+/**
+ * @brief CAN over serial per CAN ID handler tables
+ * 
+ * Standard IDs index a 2048-entry table directly,
+ * extended IDs go through an open-addressing hash map
+ * (linear probing, backward shift deletion).
+ * 
+ * @file can_serial_handlers.h
+ */
+
+#ifndef can_serial_HANDLERS_H
+#define can_serial_HANDLERS_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_filter.h"
+
+#include <pthread.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_HANDLERS_MIN_EXT_BITS 4U /**< 16 slots */
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipHandler {
+    cipHandlerFct_t  fct;   /**< NULL : free slot */
+    void            *ctx;
+} cipHandler_t;
+
+typedef struct _cipHandlerEntry {
+    uint32_t     id;
+    cipHandler_t handler;
+} cipHandlerEntry_t;
+
+typedef struct _cipHandlerTable {
+    cipHandler_t      *std;     /**< 2048 entries, allocated on first use */
+    cipHandlerEntry_t *ext;     /**< 1 << extBits entries, allocated on first use */
+    uint32_t           extBits;
+    size_t             extCount;
+    size_t             count;   /**< Number of registered handlers */
+    pthread_rwlock_t   lock;    /**< Read : dispatch, write : (un)registration */
+} cipHandlerTable_t;
+
+/* Handler functions ----------------------------------- */
+void CIP_handlersInit(cipHandlerTable_t * const pTable);
+void CIP_handlersFree(cipHandlerTable_t * const pTable);
+void CIP_handlersClear(cipHandlerTable_t * const pTable);
+
+/* pFct NULL : unregisters. The write lock must be held. */
+cipErrorCode_t CIP_handlersSet(cipHandlerTable_t * const pTable,
+    const uint32_t pCANID,
+    const cipHandlerFct_t pFct,
+    void * const pCtx);
+
+static inline uint32_t CIP_handlersHash(const uint32_t pID, const uint32_t pBits) {
+    /* Fibonacci hashing, the high bits are the best mixed */
+    return (uint32_t)(pID * 2654435761U) >> (32U - pBits);
+}
+
+/* The read lock must be held, returns NULL if no handler is registered for this frame */
+static inline const cipHandler_t *CIP_handlersFind(const cipHandlerTable_t * const pTable, const uint32_t pID, const uint32_t pFlags) {
+    const uint32_t lID = pID & can_serial_EXT_ID_MASK;
+    if(0U == (pFlags & can_serial_FLAG_EFF) && can_serial_STD_ID_MASK >= lID) {
+        return (NULL != pTable->std && NULL != pTable->std[lID].fct) ? &pTable->std[lID] : NULL;
+    }
+
+    if(0U == pTable->extCount) {
+        return NULL;
+    }
+
+    const uint32_t lMask = (1U << pTable->extBits) - 1U;
+    for(uint32_t i = CIP_handlersHash(lID, pTable->extBits); NULL != pTable->ext[i].handler.fct; i = (i + 1U) & lMask) {
+        if(lID == pTable->ext[i].id) {
+            return &pTable->ext[i].handler;
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* can_serial_HANDLERS_H */
@@ -0,0 +1,139 @@
+/**
+ * @brief CAN over serial latency histogram functions
+ * 
+ * @file can_serial_latency.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial_latency.h"
+#include "can_serial.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Defines --------------------------------------------- */
+#define LOAD(pField) __atomic_load_n(&(pField), __ATOMIC_RELAXED)
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Support functions ----------------------------------- */
+/* Highest value counted in bucket pIdx */
+static uint64_t bucketHighest(const size_t pIdx) {
+    if(can_serial_HIST_SUB_COUNT > pIdx) {
+        return (uint64_t)pIdx;
+    }
+
+    const unsigned int lShift = (unsigned int)(pIdx >> can_serial_HIST_SUB_BITS) - 1U;
+    const uint64_t     lSub   = (uint64_t)(pIdx & (can_serial_HIST_SUB_COUNT - 1U));
+
+    return ((can_serial_HIST_SUB_COUNT + lSub + 1U) << lShift) - 1U;
+}
+
+/* Histogram functions --------------------------------- */
+void CIP_latencyHistInit(cipLatencyHist_t * const pHist) {
+    memset(pHist, 0, sizeof(cipLatencyHist_t));
+    pHist->minNs = UINT64_MAX;
+}
+
+void CIP_latencyHistMerge(cipLatencyHist_t * const pDst, const cipLatencyHist_t * const pSrc) {
+    for(size_t i = 0U; i < can_serial_HIST_NB_BUCKETS; i++) {
+        pDst->counts[i] += pSrc->counts[i];
+    }
+    pDst->total  += pSrc->total;
+    pDst->sumNs  += pSrc->sumNs;
+    pDst->skewed += pSrc->skewed;
+    pDst->minNs   = pSrc->minNs < pDst->minNs ? pSrc->minNs : pDst->minNs;
+    pDst->maxNs   = pSrc->maxNs > pDst->maxNs ? pSrc->maxNs : pDst->maxNs;
+}
+
+uint64_t CIP_latencyHistPercentile(const cipLatencyHist_t * const pHist, const double pPercentile) {
+    if(0U == pHist->total) {
+        return 0U;
+    }
+
+    /* Rank of the sample, 1-based */
+    const double lPercentile = 0.0 > pPercentile ? 0.0 : (100.0 < pPercentile ? 100.0 : pPercentile);
+    uint64_t lRank = (uint64_t)(lPercentile / 100.0 * (double)pHist->total + 0.5);
+    lRank = 0U == lRank ? 1U : lRank;
+
+    uint64_t lSeen = 0U;
+    for(size_t i = 0U; i < can_serial_HIST_NB_BUCKETS; i++) {
+        lSeen += pHist->counts[i];
+        if(lSeen >= lRank) {
+            /* The max is exact, do not report more */
+            const uint64_t lHighest = bucketHighest(i);
+            return lHighest < pHist->maxNs ? lHighest : pHist->maxNs;
+        }
+    }
+
+    return pHist->maxNs;
+}
+
+/* Module functions ------------------------------------ */
+cipErrorCode_t CIP_setLatencyTracking(const cipID_t pID, const bool pEnable) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setLatencyTracking> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+    gCIP[pID].latencyTracking = pEnable;
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_getLatencyHist(const cipID_t pID, cipLatencyHist_t * const pHist) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getLatencyHist> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == pHist) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getLatencyHist> Parameter ptr is NULL !\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Read w/o the mutex, the snapshot may be a few samples off */
+    const cipLatencyHist_t * const lHist = &gCIP[pID].latency;
+    for(size_t i = 0U; i < can_serial_HIST_NB_BUCKETS; i++) {
+        pHist->counts[i] = LOAD(lHist->counts[i]);
+    }
+    pHist->total  = LOAD(lHist->total);
+    pHist->sumNs  = LOAD(lHist->sumNs);
+    pHist->minNs  = LOAD(lHist->minNs);
+    pHist->maxNs  = LOAD(lHist->maxNs);
+    pHist->skewed = LOAD(lHist->skewed);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_resetLatencyHist(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_resetLatencyHist> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* The writer records under the mutex */
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+    CIP_latencyHistInit(&gCIP[pID].latency);
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    return can_serial_ERROR_NONE;
+}
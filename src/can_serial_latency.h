@@ -0,0 +1,63 @@
+/**
+ * @brief CAN over serial latency histogram
+ * 
+ * HDR-style log-linear buckets : values under 2^SUB_BITS have their own
+ * bucket, above, each power of 2 is split in 2^SUB_BITS linear sub-buckets.
+ * One writer (the module RX path, under the module RX mutex),
+ * any number of lock-free readers.
+ * 
+ * @file can_serial_latency.h
+ */
+
+#ifndef can_serial_LATENCY_H
+#define can_serial_LATENCY_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_HIST_SUB_COUNT (1U << can_serial_HIST_SUB_BITS)
+
+/* Latency functions ----------------------------------- */
+static inline size_t CIP_latencyBucket(const uint64_t pValue) {
+    if(can_serial_HIST_SUB_COUNT > pValue) {
+        return (size_t)pValue;
+    }
+
+    const unsigned int lExp = 63U - (unsigned int)__builtin_clzll(pValue);
+    if(can_serial_HIST_MAX_EXP < lExp) {
+        return can_serial_HIST_NB_BUCKETS - 1U;
+    }
+
+    const unsigned int lShift = lExp - can_serial_HIST_SUB_BITS;
+    return ((size_t)(lShift + 1U) << can_serial_HIST_SUB_BITS)
+        + (size_t)((pValue >> lShift) & (can_serial_HIST_SUB_COUNT - 1U));
+}
+
+/* Single writer : relaxed load + store, no locked instruction */
+#define CIP_LATENCY_BUMP(pField, pValue) \
+    __atomic_store_n(&(pField), __atomic_load_n(&(pField), __ATOMIC_RELAXED) + (pValue), __ATOMIC_RELAXED)
+
+static inline void CIP_latencyRecord(cipLatencyHist_t * const pHist, const uint64_t pNow, const uint64_t pSent) {
+    uint64_t lValue = 0U;
+    if(pNow >= pSent) {
+        lValue = pNow - pSent;
+    } else {
+        CIP_LATENCY_BUMP(pHist->skewed, 1U);
+    }
+
+    CIP_LATENCY_BUMP(pHist->counts[CIP_latencyBucket(lValue)], 1U);
+    CIP_LATENCY_BUMP(pHist->total, 1U);
+    CIP_LATENCY_BUMP(pHist->sumNs, lValue);
+    if(lValue < __atomic_load_n(&pHist->minNs, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&pHist->minNs, lValue, __ATOMIC_RELAXED);
+    }
+    if(lValue > __atomic_load_n(&pHist->maxNs, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&pHist->maxNs, lValue, __ATOMIC_RELAXED);
+    }
+}
+
+#endif /* can_serial_LATENCY_H */
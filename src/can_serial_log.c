@@ -0,0 +1,487 @@
+/**
+ * @brief CAN over serial logging
+ *
+ * Asynchronous messages go through a bounded multi-producer ring :
+ * each slot has a sequence number telling whether it is free for
+ * the producer at that position or ready for the consumer.
+ * Producers claim a position with a CAS and never wait,
+ * the message is dropped (and counted) when the ring is full.
+ * The consumer side (log thread, CIP_logFlush, synchronous messages)
+ * runs under a mutex, which also serializes the sink.
+ * The log thread sleeps on an eventfd, the first message queued
+ * after it woke up writes to it.
+ *
+ * @file can_serial_log.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_log.h"
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_LOG_RING_MASK (can_serial_LOG_RING_SIZE - 1U)
+
+/* Type definitions ------------------------------------ */
+/* How a conversion reads its argument */
+typedef enum _cipLogArg {
+    LOG_ARG_NONE = 0U,  /**< "%%" or unsupported conversion, no argument */
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_LONG,
+    LOG_ARG_ULONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_ULLONG,
+    LOG_ARG_SSIZE,
+    LOG_ARG_SIZE,
+    LOG_ARG_INTMAX,
+    LOG_ARG_UINTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR         /**< %p and %s */
+} cipLogArg_t;
+
+typedef struct _cipLogRecord {
+    uint64_t        seq;        /**< position : free, position + 1 : ready */
+    const char     *format;
+    uint64_t        args[can_serial_LOG_MAX_ARGS];
+    int             errnum;
+    cipLogLevel_t   level;
+} cipLogRecord_t;
+
+/* Global variables ------------------------------------ */
+cipLogLevel_t gCIPLogLevel = can_serial_LOG_INFO;
+
+/* Static variables ------------------------------------ */
+static const char * const sLevelPrefixes[] = {
+    "[ERROR] ",
+    "[WARN ] ",
+    "[INFO ] ",
+    "[DEBUG] "
+};
+
+static pthread_once_t   sLogOnce    = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  sLogMutex   = PTHREAD_MUTEX_INITIALIZER;
+static cipLogSinkFct_t  sSinkFct    = NULL;
+static void            *sSinkCtx    = NULL;
+
+static cipLogRecord_t   sRing[can_serial_LOG_RING_SIZE];
+static uint64_t         sHead __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) = 0U; /**< Next position claimed by a producer */
+static uint64_t         sTail __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) = 0U; /**< Next position read, under sLogMutex */
+static uint64_t         sDropped    = 0U;
+static int              sWakeFd     = -1;       /**< Log thread wake up, -1 w/o log thread */
+static bool             sWakePending __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) = false; /**< sWakeFd written, the log thread did not drain yet */
+
+/* The sink runs w/ sLogMutex held, it must not take it again */
+static __thread bool    sInSink     = false;
+
+/* Support functions ----------------------------------- */
+static void CIP_logDefaultSink(void * const pCtx, const cipLogLevel_t pLevel, const char * const pLine) {
+    (void)pCtx;
+    (void)pLevel;
+
+    (void)fputs(pLine, stdout);
+}
+
+/* Classifies the conversion starting at pFormat ('%'),
+ * returns the character following it */
+static const char *CIP_logConversion(const char *pFormat, cipLogArg_t * const pArg) {
+    *pArg = LOG_ARG_NONE;
+    pFormat++;
+
+    /* Flags, width, precision */
+    while('\0' != *pFormat && NULL != strchr("-+ #0123456789.", *pFormat)) {
+        pFormat++;
+    }
+
+    /* Length modifier */
+    unsigned int lLong = 0U;
+    char lSize = '\0';
+    while('\0' != *pFormat && NULL != strchr("hlLjzt", *pFormat)) {
+        if('l' == *pFormat) {
+            lLong++;
+        } else if('h' != *pFormat) {
+            lSize = *pFormat;
+        }
+        pFormat++;
+    }
+
+    const char lConv = *pFormat;
+    if('\0' == lConv) {
+        return pFormat;
+    }
+
+    if('d' == lConv || 'i' == lConv) {
+        *pArg = 'z' == lSize ? LOG_ARG_SSIZE
+            : 'j' == lSize ? LOG_ARG_INTMAX
+            : 't' == lSize ? LOG_ARG_PTRDIFF
+            : 2U <= lLong ? LOG_ARG_LLONG
+            : 1U == lLong ? LOG_ARG_LONG : LOG_ARG_INT;
+    } else if(NULL != strchr("uoxX", lConv)) {
+        *pArg = 'z' == lSize ? LOG_ARG_SIZE
+            : 'j' == lSize ? LOG_ARG_UINTMAX
+            : 't' == lSize ? LOG_ARG_PTRDIFF
+            : 2U <= lLong ? LOG_ARG_ULLONG
+            : 1U == lLong ? LOG_ARG_ULONG : LOG_ARG_UINT;
+    } else if('c' == lConv) {
+        *pArg = LOG_ARG_INT;
+    } else if('p' == lConv || 's' == lConv) {
+        *pArg = LOG_ARG_PTR;
+    } else if(NULL != strchr("fFeEgGaA", lConv) && 'L' != lSize) {
+        *pArg = LOG_ARG_DOUBLE;
+    }
+
+    return pFormat + 1;
+}
+
+/* Formats one conversion with its argument, returns the length it would take */
+static int CIP_logFormatArg(char * const pBuf,
+    const size_t pCap,
+    const char * const pSpec,
+    const cipLogArg_t pArg,
+    const uint64_t pValue)
+{
+    switch(pArg) {
+        case LOG_ARG_INT:
+            return snprintf(pBuf, pCap, pSpec, (int)(int64_t)pValue);
+        case LOG_ARG_UINT:
+            return snprintf(pBuf, pCap, pSpec, (unsigned int)pValue);
+        case LOG_ARG_LONG:
+            return snprintf(pBuf, pCap, pSpec, (long)(int64_t)pValue);
+        case LOG_ARG_ULONG:
+            return snprintf(pBuf, pCap, pSpec, (unsigned long)pValue);
+        case LOG_ARG_LLONG:
+            return snprintf(pBuf, pCap, pSpec, (long long)(int64_t)pValue);
+        case LOG_ARG_ULLONG:
+            return snprintf(pBuf, pCap, pSpec, (unsigned long long)pValue);
+        case LOG_ARG_SSIZE:
+            return snprintf(pBuf, pCap, pSpec, (ssize_t)(int64_t)pValue);
+        case LOG_ARG_SIZE:
+            return snprintf(pBuf, pCap, pSpec, (size_t)pValue);
+        case LOG_ARG_INTMAX:
+            return snprintf(pBuf, pCap, pSpec, (intmax_t)(int64_t)pValue);
+        case LOG_ARG_UINTMAX:
+            return snprintf(pBuf, pCap, pSpec, (uintmax_t)pValue);
+        case LOG_ARG_PTRDIFF:
+            return snprintf(pBuf, pCap, pSpec, (ptrdiff_t)(int64_t)pValue);
+        case LOG_ARG_DOUBLE: {
+            double lDouble = 0.0;
+            memcpy(&lDouble, &pValue, sizeof(lDouble));
+            return snprintf(pBuf, pCap, pSpec, lDouble);
+        }
+        case LOG_ARG_PTR:
+            return snprintf(pBuf, pCap, pSpec, (const void *)(uintptr_t)pValue);
+        case LOG_ARG_NONE:
+        default:
+            /* "%%", or a conversion we cannot replay */
+            return snprintf(pBuf, pCap, "%s", 0 == strcmp(pSpec, "%%") ? "%" : pSpec);
+    }
+}
+
+/* printf w/ the arguments captured by CIP_logPush */
+static size_t CIP_logFormat(char * const pBuf,
+    const size_t pCap,
+    const char *pFormat,
+    const uint64_t * const pArgs)
+{
+    size_t lLen = 0U;
+    size_t lArg = 0U;
+
+    while('\0' != *pFormat && lLen + 1U < pCap) {
+        if('%' != *pFormat) {
+            pBuf[lLen++] = *pFormat++;
+            continue;
+        }
+
+        cipLogArg_t lType = LOG_ARG_NONE;
+        const char * const lEnd = CIP_logConversion(pFormat, &lType);
+
+        char lSpec[32U] = "";
+        const size_t lSpecLen = (size_t)(lEnd - pFormat) < sizeof(lSpec) ? (size_t)(lEnd - pFormat) : sizeof(lSpec) - 1U;
+        memcpy(lSpec, pFormat, lSpecLen);
+        lSpec[lSpecLen] = '\0';
+        pFormat = lEnd;
+
+        uint64_t lValue = 0U;
+        if(LOG_ARG_NONE != lType && can_serial_LOG_MAX_ARGS > lArg) {
+            lValue = pArgs[lArg++];
+        }
+
+        const int lWritten = CIP_logFormatArg(&pBuf[lLen], pCap - lLen, lSpec, lType, lValue);
+        if(0 < lWritten) {
+            lLen += (size_t)lWritten < pCap - lLen ? (size_t)lWritten : pCap - lLen - 1U;
+        }
+    }
+    pBuf[lLen] = '\0';
+
+    return lLen;
+}
+
+/* Appends the errno line of the message, if any */
+static size_t CIP_logAppendErrno(char * const pBuf, size_t pLen, const int pErrno) {
+    if(0 != pErrno && can_serial_LOG_LINE_MAX_LEN - 1U > pLen) {
+        const int lWritten = snprintf(&pBuf[pLen], can_serial_LOG_LINE_MAX_LEN - pLen, "        errno = %d (%s)\n", pErrno, strerror(pErrno));
+        if(0 < lWritten) {
+            pLen += (size_t)lWritten < can_serial_LOG_LINE_MAX_LEN - pLen ? (size_t)lWritten : can_serial_LOG_LINE_MAX_LEN - pLen - 1U;
+        }
+    }
+
+    return pLen;
+}
+
+static void CIP_logSink(const cipLogLevel_t pLevel, const char * const pLine) {
+    const cipLogSinkFct_t lFct = NULL != sSinkFct ? sSinkFct : CIP_logDefaultSink;
+    sInSink = true;
+    lFct(sSinkCtx, pLevel, pLine);
+    sInSink = false;
+}
+
+/* Consumer side, sLogMutex must be held */
+static size_t CIP_logDrain(void) {
+    char   lLine[can_serial_LOG_LINE_MAX_LEN];
+    size_t lCount = 0U;
+
+    const uint64_t lDropped = __atomic_exchange_n(&sDropped, 0U, __ATOMIC_RELAXED);
+    if(0U < lDropped) {
+        (void)snprintf(lLine, sizeof(lLine), "%s<CIP_log> %" PRIu64 " messages dropped, the log ring was full or the sink logged\n",
+            sLevelPrefixes[can_serial_LOG_WARN], lDropped);
+        CIP_logSink(can_serial_LOG_WARN, lLine);
+        lCount++;
+    }
+
+    for(;;) {
+        cipLogRecord_t * const lRecord = &sRing[sTail & can_serial_LOG_RING_MASK];
+        if(sTail + 1U != __atomic_load_n(&lRecord->seq, __ATOMIC_ACQUIRE)) {
+            /* Empty, or the producer is still copying */
+            break;
+        }
+
+        const size_t lPrefixLen = strlen(sLevelPrefixes[lRecord->level]);
+        memcpy(lLine, sLevelPrefixes[lRecord->level], lPrefixLen);
+        size_t lLen = lPrefixLen + CIP_logFormat(&lLine[lPrefixLen], sizeof(lLine) - lPrefixLen, lRecord->format, lRecord->args);
+        lLen = CIP_logAppendErrno(lLine, lLen, lRecord->errnum);
+        (void)lLen;
+
+        const cipLogLevel_t lLevel = lRecord->level;
+
+        /* Hand the slot back to the producers before calling the sink */
+        __atomic_store_n(&lRecord->seq, sTail + can_serial_LOG_RING_SIZE, __ATOMIC_RELEASE);
+        sTail++;
+
+        CIP_logSink(lLevel, lLine);
+        lCount++;
+    }
+
+    return lCount;
+}
+
+static void *CIP_logThread(void *pArg) {
+    (void)pArg;
+
+    for(;;) {
+        uint64_t lCount = 0U;
+        if(sizeof(lCount) != read(sWakeFd, &lCount, sizeof(lCount)) && EINTR != errno) {
+            /* Cannot happen on a valid eventfd, leave the flushing to the other messages */
+            break;
+        }
+
+        /* Cleared before draining : a message queued from now on wakes us again */
+        (void)__atomic_exchange_n(&sWakePending, false, __ATOMIC_ACQ_REL);
+        (void)CIP_logFlush();
+    }
+
+    return NULL;
+}
+
+static void CIP_logAtExit(void) {
+    (void)CIP_logFlush();
+    (void)fflush(stdout);
+}
+
+static void CIP_logStart(void) {
+    for(size_t i = 0U; i < can_serial_LOG_RING_SIZE; i++) {
+        sRing[i].seq = i;
+    }
+
+    (void)atexit(CIP_logAtExit);
+
+    /* W/o log thread, the queue is still flushed
+     * by the synchronous messages and at exit */
+    if(0 > (sWakeFd = eventfd(0U, EFD_CLOEXEC))) {
+        return;
+    }
+
+    pthread_t lThread;
+    if(0 == pthread_create(&lThread, NULL, CIP_logThread, NULL)) {
+        (void)pthread_detach(lThread);
+    } else {
+        (void)close(sWakeFd);
+        sWakeFd = -1;
+    }
+}
+
+/* Log functions --------------------------------------- */
+void CIP_logPush(const cipLogLevel_t pLevel, const int pErrno, const char * const pFormat, ...) {
+    (void)pthread_once(&sLogOnce, CIP_logStart);
+
+    /* Claim a slot */
+    cipLogRecord_t *lRecord = NULL;
+    uint64_t lPos = __atomic_load_n(&sHead, __ATOMIC_RELAXED);
+    for(;;) {
+        lRecord = &sRing[lPos & can_serial_LOG_RING_MASK];
+        const int64_t lDiff = (int64_t)(__atomic_load_n(&lRecord->seq, __ATOMIC_ACQUIRE) - lPos);
+        if(0 == lDiff) {
+            if(__atomic_compare_exchange_n(&sHead, &lPos, lPos + 1U, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            /* lPos was reloaded by the failed CAS */
+        } else if(0 > lDiff) {
+            /* Full, never wait for the consumer */
+            (void)__atomic_fetch_add(&sDropped, 1U, __ATOMIC_RELAXED);
+            return;
+        } else {
+            lPos = __atomic_load_n(&sHead, __ATOMIC_RELAXED);
+        }
+    }
+
+    /* Capture the arguments the format reads */
+    va_list lArgs;
+    va_start(lArgs, pFormat);
+
+    size_t lArg = 0U;
+    const char *lFormat = pFormat;
+    while(NULL != (lFormat = strchr(lFormat, '%')) && can_serial_LOG_MAX_ARGS > lArg) {
+        cipLogArg_t lType = LOG_ARG_NONE;
+        lFormat = CIP_logConversion(lFormat, &lType);
+
+        uint64_t * const lValue = &lRecord->args[lArg];
+        switch(lType) {
+            case LOG_ARG_INT:       *lValue = (uint64_t)(int64_t)va_arg(lArgs, int);                break;
+            case LOG_ARG_UINT:      *lValue = (uint64_t)va_arg(lArgs, unsigned int);                break;
+            case LOG_ARG_LONG:      *lValue = (uint64_t)(int64_t)va_arg(lArgs, long);               break;
+            case LOG_ARG_ULONG:     *lValue = (uint64_t)va_arg(lArgs, unsigned long);               break;
+            case LOG_ARG_LLONG:     *lValue = (uint64_t)(int64_t)va_arg(lArgs, long long);          break;
+            case LOG_ARG_ULLONG:    *lValue = (uint64_t)va_arg(lArgs, unsigned long long);          break;
+            case LOG_ARG_SSIZE:     *lValue = (uint64_t)(int64_t)va_arg(lArgs, ssize_t);            break;
+            case LOG_ARG_SIZE:      *lValue = (uint64_t)va_arg(lArgs, size_t);                      break;
+            case LOG_ARG_INTMAX:    *lValue = (uint64_t)(int64_t)va_arg(lArgs, intmax_t);           break;
+            case LOG_ARG_UINTMAX:   *lValue = (uint64_t)va_arg(lArgs, uintmax_t);                   break;
+            case LOG_ARG_PTRDIFF:   *lValue = (uint64_t)(int64_t)va_arg(lArgs, ptrdiff_t);          break;
+            case LOG_ARG_PTR:       *lValue = (uint64_t)(uintptr_t)va_arg(lArgs, const void *);     break;
+            case LOG_ARG_DOUBLE: {
+                const double lDouble = va_arg(lArgs, double);
+                memcpy(lValue, &lDouble, sizeof(lDouble));
+                break;
+            }
+            case LOG_ARG_NONE:
+            default:
+                continue;
+        }
+        lArg++;
+    }
+
+    va_end(lArgs);
+
+    lRecord->format = pFormat;
+    lRecord->errnum = pErrno;
+    lRecord->level  = pLevel;
+
+    /* Ready for the consumer */
+    __atomic_store_n(&lRecord->seq, lPos + 1U, __ATOMIC_RELEASE);
+
+    /* Wake the log thread up, unless a message already did */
+    if(0 <= sWakeFd && !__atomic_exchange_n(&sWakePending, true, __ATOMIC_ACQ_REL)) {
+        const uint64_t lOne = 1U;
+        const int lErrno = errno;
+        (void)write(sWakeFd, &lOne, sizeof(lOne));
+        errno = lErrno;
+    }
+}
+
+void CIP_logWrite(const cipLogLevel_t pLevel, const int pErrno, const char * const pFormat, ...) {
+    (void)pthread_once(&sLogOnce, CIP_logStart);
+
+    /* Logged by the sink, the lock is ours already */
+    if(sInSink) {
+        (void)__atomic_fetch_add(&sDropped, 1U, __ATOMIC_RELAXED);
+        return;
+    }
+
+    char lLine[can_serial_LOG_LINE_MAX_LEN];
+    const size_t lPrefixLen = strlen(sLevelPrefixes[pLevel]);
+    memcpy(lLine, sLevelPrefixes[pLevel], lPrefixLen);
+
+    va_list lArgs;
+    va_start(lArgs, pFormat);
+    const int lWritten = vsnprintf(&lLine[lPrefixLen], sizeof(lLine) - lPrefixLen, pFormat, lArgs);
+    va_end(lArgs);
+
+    size_t lLen = lPrefixLen;
+    if(0 < lWritten) {
+        lLen += (size_t)lWritten < sizeof(lLine) - lPrefixLen ? (size_t)lWritten : sizeof(lLine) - lPrefixLen - 1U;
+    }
+    (void)CIP_logAppendErrno(lLine, lLen, pErrno);
+
+    /* The queued messages came first */
+    pthread_mutex_lock(&sLogMutex);
+    (void)CIP_logDrain();
+    CIP_logSink(pLevel, lLine);
+    pthread_mutex_unlock(&sLogMutex);
+}
+
+size_t CIP_logFlush(void) {
+    (void)pthread_once(&sLogOnce, CIP_logStart);
+
+    /* Called by the sink, the drain in progress goes on */
+    if(sInSink) {
+        return 0U;
+    }
+
+    pthread_mutex_lock(&sLogMutex);
+    const size_t lCount = CIP_logDrain();
+    pthread_mutex_unlock(&sLogMutex);
+
+    return lCount;
+}
+
+cipErrorCode_t CIP_setLogLevel(const cipLogLevel_t pLevel) {
+    if(can_serial_LOG_DEBUG < pLevel) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setLogLevel> Unknown log level %u\n", pLevel);
+        return can_serial_ERROR_ARG;
+    }
+
+    __atomic_store_n(&gCIPLogLevel, pLevel, __ATOMIC_RELAXED);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setLogSink(const cipLogSinkFct_t pFct, void * const pCtx) {
+    /* The sink would wait for itself */
+    if(sInSink) {
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Waits for the sink being called, if any */
+    pthread_mutex_lock(&sLogMutex);
+    sSinkFct = pFct;
+    sSinkCtx = pCtx;
+    pthread_mutex_unlock(&sLogMutex);
+
+    return can_serial_ERROR_NONE;
+}
@@ -0,0 +1,62 @@
+/**
+ * @brief CAN over serial logging
+ *
+ * CIP_LOG* format the message right away and give it to the sink.
+ * CIP_LOG_ASYNC* only copy the format and its arguments in a lock-free
+ * ring, the log thread formats them later : use them on the send and
+ * receive paths. String arguments of asynchronous messages must
+ * outlive the process (literals), pass errno with CIP_LOG_ASYNC_ERRNO
+ * instead of strerror. Messages above can_serial_LOG_LEVEL_MAX
+ * or the runtime level cost a load and a branch.
+ *
+ * @file can_serial_log.h
+ */
+
+#ifndef can_serial_LOG_H
+#define can_serial_LOG_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial.h"
+
+#include <stdbool.h>
+
+/* Defines --------------------------------------------- */
+#define can_serial_LOG_MAX_ARGS         6U      /**< Arguments kept per asynchronous message */
+#define can_serial_LOG_RING_SIZE        1024U   /**< Queued asynchronous messages, power of 2 */
+#define can_serial_LOG_LINE_MAX_LEN     512U
+
+/* Variables ------------------------------------------- */
+extern cipLogLevel_t gCIPLogLevel;
+
+/* Log functions --------------------------------------- */
+void CIP_logWrite(const cipLogLevel_t pLevel, const int pErrno, const char * const pFormat, ...)
+    __attribute__((format(printf, 3, 4)));
+
+void CIP_logPush(const cipLogLevel_t pLevel, const int pErrno, const char * const pFormat, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static inline bool CIP_logEnabled(const cipLogLevel_t pLevel) {
+    return can_serial_LOG_LEVEL_MAX >= (unsigned int)pLevel
+        && __atomic_load_n(&gCIPLogLevel, __ATOMIC_RELAXED) >= pLevel;
+}
+
+/* A non-zero errno adds an "errno = %d (%s)" line */
+#define CIP_LOG_ERRNO(pLevel, pErrno, ...) \
+    do { \
+        if(CIP_logEnabled(pLevel)) { \
+            CIP_logWrite((pLevel), (pErrno), __VA_ARGS__); \
+        } \
+    } while(0)
+
+#define CIP_LOG(pLevel, ...) CIP_LOG_ERRNO(pLevel, 0, __VA_ARGS__)
+
+#define CIP_LOG_ASYNC_ERRNO(pLevel, pErrno, ...) \
+    do { \
+        if(CIP_logEnabled(pLevel)) { \
+            CIP_logPush((pLevel), (pErrno), __VA_ARGS__); \
+        } \
+    } while(0)
+
+#define CIP_LOG_ASYNC(pLevel, ...) CIP_LOG_ASYNC_ERRNO(pLevel, 0, __VA_ARGS__)
+
+#endif /* can_serial_LOG_H */
@@ -9,21 +9,125 @@
 
 /* Includes -------------------------------------------- */
 #include "can_serial.h"
+#include "can_serial_ring.h"
+#include "can_serial_txqueue.h"
+#include "can_serial_txprio.h"
+#include "can_serial_cyclic.h"
+#include "can_serial_capture.h"
+#include "can_serial_wire.h"
+#include "can_serial_filter.h"
+#include "can_serial_handlers.h"
+#include "can_serial_latency.h"
+#include "can_serial_socket_mgt.h"
 
 #include <netinet/in.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <stdint.h>  /* TODO : Delete this and use custom types */
 #include <stdbool.h> /* TODO : Delete this and use custom types */
 
 /* Defines --------------------------------------------- */
+/* Number of frames the RX thread drains from the socket per syscall */
+#ifndef can_serial_RX_BATCH_SIZE
+#define can_serial_RX_BATCH_SIZE 32U
+#endif /* can_serial_RX_BATCH_SIZE */
+
+/* Number of frames sent per sendmmsg syscall */
+#ifndef can_serial_TX_BATCH_SIZE
+#define can_serial_TX_BATCH_SIZE 64U
+#endif /* can_serial_TX_BATCH_SIZE */
+
+/* Size of the buffer the datagrams of a sendmmsg syscall are built in */
+#ifndef can_serial_TX_BUFFER_SIZE
+#define can_serial_TX_BUFFER_SIZE (16U * 1024U)
+#endif /* can_serial_TX_BUFFER_SIZE */
+
+/* Number of queued messages the TX writer sends per wake-up */
+#ifndef can_serial_TX_QUEUE_BATCH_SIZE
+#define can_serial_TX_QUEUE_BATCH_SIZE 256U
+#endif /* can_serial_TX_QUEUE_BATCH_SIZE */
+
+/* Number of messages the TX writer sends per batch in CAN ID order
+ * (CIP_setTxPriority) : a high-priority message waits for at most
+ * this many lower-priority ones already on their way */
+#ifndef can_serial_TX_PRIORITY_BATCH_SIZE
+#define can_serial_TX_PRIORITY_BATCH_SIZE 32U
+#endif /* can_serial_TX_PRIORITY_BATCH_SIZE */
+
+/* Frames sent back to back after an idle period when the TX
+ * is paced (CIP_setTxBitrate), sized to the adapters' FIFOs */
+#ifndef can_serial_TX_PACING_BURST_FRAMES
+#define can_serial_TX_PACING_BURST_FRAMES 4U
+#endif /* can_serial_TX_PACING_BURST_FRAMES */
+
+/* Worst-case length of a classic CAN frame on the bus (extended ID,
+ * 8 bytes, worst-case bit stuffing, intermission included) */
+#define can_serial_CAN_FRAME_MAX_BITS 160U
+
+/* Maximum number of reactor threads (see CIP_setReactorThreads) */
+#ifndef can_serial_MAX_NB_REACTOR_THREADS
+#define can_serial_MAX_NB_REACTOR_THREADS 4U
+#endif /* can_serial_MAX_NB_REACTOR_THREADS */
+
+/* Number of epoll events handled per reactor wake-up */
+#ifndef can_serial_REACTOR_MAX_EVENTS
+#define can_serial_REACTOR_MAX_EVENTS 32U
+#endif /* can_serial_REACTOR_MAX_EVENTS */
+
+/* Size of the serial port RX stream buffer */
+#ifndef can_serial_SERIAL_RX_BUFFER_SIZE
+#define can_serial_SERIAL_RX_BUFFER_SIZE 4096U
+#endif /* can_serial_SERIAL_RX_BUFFER_SIZE */
+
+/* How long a serial write waits for the adapter to accept data */
+#ifndef can_serial_SERIAL_TX_TIMEOUT_MS
+#define can_serial_SERIAL_TX_TIMEOUT_MS 100
+#endif /* can_serial_SERIAL_TX_TIMEOUT_MS */
+
+/* How long a UDP send waits for a full socket send buffer to drain */
+#ifndef can_serial_UDP_TX_TIMEOUT_MS
+#define can_serial_UDP_TX_TIMEOUT_MS 100
+#endif /* can_serial_UDP_TX_TIMEOUT_MS */
+
+#define can_serial_SERIAL_DEVICE_MAX_LEN 64U
 
 /* Type definitions ------------------------------------ */
 typedef int cipSocket_t;
 
+typedef enum _cipTransports {
+    can_serial_TRANSPORT_UDP    = 0U, /**< UDP broadcast (CIP_init) */
+    can_serial_TRANSPORT_SERIAL = 1U  /**< SLCAN over a serial port (CIP_initSerial) */
+} cipTransport_t;
+
+/* Counters written by the RX side (RX thread, reactor, recv callers) */
+typedef struct _cipRxCounters {
+    uint64_t rxFrames;
+    uint64_t rxBytes;
+    uint64_t loopbackFrames;
+    uint64_t filteredFrames;
+    uint64_t badDatagrams;
+    uint64_t eagainSpins;
+    uint64_t rxRingDrops;
+    uint64_t callbackCalls;
+    uint64_t callbackFailures;
+    uint64_t callbackTimeNs;
+} __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) cipRxCounters_t;
+
+/* Counters written by the senders, on their own cache lines */
+typedef struct _cipTxCounters {
+    uint64_t txFrames;
+    uint64_t txBytes;
+    uint64_t txFailures;
+    uint64_t txQueueFull;
+    uint64_t txErrno[can_serial_STATS_NB_ERRNO];
+} __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) cipTxCounters_t;
+
 typedef struct _cipInternalVariables {
-    uint8_t   cipInstanceID; /* TODO : Multiline CAN */
+    uint8_t   cipInstanceID; /**< Index of this module in the module table */
     cipMode_t cipMode;
+    bool      isCreated;     /**< Set up by CIP_createModule, or by the first CIP_init* */
     bool      isInitialized;
     bool      isStopped;
 
@@ -31,21 +135,170 @@ typedef struct _cipInternalVariables {
     uint32_t randID; /**< Random ID to ignore our own messages upon reception */
 
     /* Socket */
-    cipSocket_t         canSocket; /* The socket used to communicate CAN frames */
+    cipTransport_t      transport;
+    cipSocket_t         canSocket; /* The socket (or serial port fd) used to communicate CAN frames */
     struct sockaddr_in  socketInAddress;
     char               *canIP;      /* IP Address */
     cipPort_t           canPort;    /* Server port number */
     struct hostent     *hostPtr;    /* Server information */
     struct addrinfo    *addrinfo;   /* Address information fetched w/ getaddrinfo */
 
+    /* UDP wire format */
+    cipWireFormat_t wireFormat; /**< Format of the sent datagrams */
+    uint8_t         rxDatagrams[can_serial_RX_BATCH_SIZE][can_serial_WIRE_MAX_DATAGRAM];
+    size_t          rxDatagramLens[can_serial_RX_BATCH_SIZE];
+    size_t          rxNbDatagrams;  /**< Datagrams received by the last recvmmsg */
+    size_t          rxDatagramIdx;  /**< Next datagram to decode */
+    uint64_t        rxDatagramStamps[can_serial_RX_BATCH_SIZE]; /**< Kernel RX time of each datagram */
+    cipWireReader_t rxReader;       /**< Frames of the datagram being decoded */
+    uint64_t        rxReaderStamp;  /**< Kernel RX time of the datagram being decoded */
+    uint8_t         txBuffer[can_serial_TX_BUFFER_SIZE];
+
+    /* Acceptance filters */
+    cipFilterTable_t filters;
+
+    /* Serial port */
+    char     serialDevice[can_serial_SERIAL_DEVICE_MAX_LEN];
+    uint32_t serialBaudrate;
+    char     serialRxBuf[can_serial_SERIAL_RX_BUFFER_SIZE]; /**< Received characters not decoded yet */
+    size_t   serialRxLen;
+    uint64_t serialRxStamp; /**< Time of the last read */
+
+    /* Timestamps */
+    bool     txTimestamping; /**< Report TX timestamps (CIP_setTxTimestamping) */
+    uint64_t txTimestamp;    /**< TX time of the last message sent */
+    uint64_t rxDeliverStamp; /**< RX time of the message being handed over to a callback */
+
+    /* Latency tracking */
+    bool             latencyTracking; /**< Embed send times, record latencies (CIP_setLatencyTracking) */
+    cipLatencyHist_t latency;
+
     /* Rx Thread */
+    pthread_t rxThread;
     bool rxThreadOn;
+    bool rxResume;  /**< RX was on when CIP_stop was called, CIP_restart resumes it */
+    uint32_t rxGeneration; /**< Bumped when CIP_stop/CIP_reset retire the RX thread, atomic */
+    bool inReactor; /**< RX is serviced by a reactor thread instead of rxThread, atomic */
+    int  wakeFd; /**< eventfd used to wake the RX thread up (stop/reset) */
     uint8_t callerID;
     cipPutMessageFct_t putMessageFct;
-    pthread_mutex_t mutex;
-} cipInternalStruct_t;
+    cipPutMessagesFct_t putMessagesFct; /**< Batch variant, preferred over putMessageFct */
+    union { /**< Preallocated frames drained by the RX thread, sized to the mode */
+        cipMessage_t   frames[can_serial_RX_BATCH_SIZE];
+        cipFdMessage_t fdFrames[can_serial_RX_BATCH_SIZE];
+    } rx;
+    cipHandlerTable_t handlers; /**< Per CAN ID handlers, before putMessageFct/rxRing */
+
+    /* Rx ring, filled by the RX thread instead of calling putMessageFct */
+    size_t    rxRingCapacity; /**< 0 : no ring */
+    cipRing_t rxRing;
+
+    /* TX queue, emptied by the TX writer thread (CIP_setTxQueueSize) */
+    size_t       txQueueCapacity;  /**< 0 : no queue, the senders write themselves */
+    cipTxQueue_t txQueue;
+    pthread_t    txThread;
+    bool         txWriterOn;       /**< The senders queue their messages for txThread */
+    int          txWakeFd;         /**< eventfd used to wake the TX writer up */
+    bool         txWriterSleeping; /**< The writer waits on txWakeFd, the producers must kick it */
+    bool         txWriterStop;
+
+    /* TX priority queue, the writer sends the lowest CAN IDs first (CIP_setTxPriority) */
+    bool         txPriority;
+    cipTxHeap_t  txHeap;           /**< Only used by the TX writer */
+    size_t       txPending __attribute__((aligned(can_serial_CACHE_LINE_SIZE))); /**< Messages queued or in txHeap, up to the queue capacity */
+
+    /* Cyclic messages (CIP_addCyclic) */
+    cipCyclicWheel_t cyclic;
+
+    /* Traffic capture (CIP_startCapture) */
+    cipCapture_t capture;
+
+    /* TX pacing, token bucket under the TX mutex (CIP_setTxBitrate) */
+    uint32_t     txBitrate;        /**< Nominal CAN bitrate (bit/s), 0 : not paced */
+    uint64_t     txTokens;         /**< Bucket level, in bits x 10^9 */
+    uint64_t     txTokensStamp;    /**< Last refill (CLOCK_MONOTONIC, ns) */
+    int          txPaceFd;         /**< timerfd waited on for tokens, -1 when unpaced or unavailable */
+
+    /* Statistics, relaxed atomics, never under a mutex */
+    cipRxCounters_t rxStats;
+    cipTxCounters_t txStats;
+
+    /* The RX and TX paths never share a lock */
+    pthread_mutex_t rxMutex; /**< Receive side : datagram/serial decoding, latency histogram, filters */
+    pthread_mutex_t txMutex __attribute__((aligned(can_serial_CACHE_LINE_SIZE))); /**< Send side : TX buffer, wire format, TX timestamps */
+} __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) cipInternalStruct_t;
 
 /* Private functions ----------------------------------- */
+#define CIP_STATS_ADD(pCounters, pField, pValue) \
+    ((void)__atomic_fetch_add(&(pCounters).pField, (uint64_t)(pValue), __ATOMIC_RELAXED))
+
+static inline void CIP_statsTxErrno(cipTxCounters_t * const pCounters, const int pErrno) {
+    const size_t lIdx = (0 < pErrno && can_serial_STATS_NB_ERRNO > (unsigned int)pErrno) ? (size_t)pErrno : 0U;
+    CIP_STATS_ADD(*pCounters, txErrno[lIdx], 1U);
+}
+
+static inline uint64_t CIP_monotonicNs(void) {
+    struct timespec lTime;
+    (void)clock_gettime(CLOCK_MONOTONIC, &lTime);
+    return (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+}
+
+static inline uint64_t CIP_timespecToNs(const struct timespec * const pTime) {
+    return (uint64_t)pTime->tv_sec * 1000000000U + (uint64_t)pTime->tv_nsec;
+}
+
+/* User space fallback when the kernel gives no timestamp */
+static inline uint64_t CIP_realtimeNs(void) {
+    struct timespec lTime;
+    (void)clock_gettime(CLOCK_REALTIME, &lTime);
+    return CIP_timespecToNs(&lTime);
+}
+
+/* Something consumes the received messages : put message function(s), RX ring or handlers */
+static inline bool CIP_hasRxConsumer(const cipInternalStruct_t * const pModule) {
+    return NULL != pModule->putMessageFct
+        || (NULL != pModule->putMessagesFct && can_serial_MODE_FD != pModule->cipMode)
+        || 0U < pModule->rxRingCapacity
+        || 0U < __atomic_load_n(&pModule->handlers.count, __ATOMIC_RELAXED);
+}
+
+/* Clears the wake-up eventfd written by CIP_stop/CIP_reset,
+ * the caller checks isStopped next */
+static inline void CIP_clearWakeFd(const cipInternalStruct_t * const pModule) {
+    uint64_t lEvent = 0U;
+    if(sizeof(lEvent) != read(pModule->wakeFd, &lEvent, sizeof(lEvent))) {
+        /* Already cleared */
+    }
+}
+
+/* Socket error w/ TX timestamping : reads the timestamps the sender
+ * did not pick up, never waits for it, it reads them after sending.
+ * Returns true when the error was the timestamps */
+static inline bool CIP_readPendingTxTimestamps(cipInternalStruct_t * const pModule, const cipID_t pID) {
+    if(!pModule->txTimestamping) {
+        return false;
+    }
+
+    if(0 == pthread_mutex_trylock(&pModule->txMutex)) {
+        CIP_readTxTimestamps(pID);
+        pthread_mutex_unlock(&pModule->txMutex);
+    }
+
+    return true;
+}
+
 cipErrorCode_t CIP_startRxThread(const cipID_t pID);
+cipErrorCode_t CIP_wakeRxThread(const cipID_t pID);
+cipErrorCode_t CIP_joinRxThread(const cipID_t pID);
+cipErrorCode_t CIP_rxProcess(const cipID_t pID);
+
+/* TX writer functions (TX queue), the stop sends the queued messages first */
+cipErrorCode_t CIP_startTxWriter(const cipID_t pID);
+cipErrorCode_t CIP_stopTxWriter(const cipID_t pID);
+
+/* Reactor functions */
+bool CIP_reactorEnabled(void);
+cipErrorCode_t CIP_reactorRegister(const cipID_t pID);
+cipErrorCode_t CIP_reactorJoin(const cipID_t pID);
 
 #endif /* can_serial_PRIVATE_H */
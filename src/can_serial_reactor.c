@@ -0,0 +1,281 @@
+/**
+ * @brief CAN over serial epoll reactor
+ * One reactor thread (or a small pool) services
+ * the sockets of many modules instead of one RX
+ * thread per module. Module pID is always serviced
+ * by reactor (pID % number of reactors), so the
+ * frames of a module stay in order.
+ * 
+ * @file can_serial_reactor.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_socket_mgt.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+#define REACTOR_SHUTDOWN_EVENT  UINT64_MAX  /**< epoll data of the reactor's own eventfd */
+#define REACTOR_WAKE_FD_BIT     1U          /**< Set in the epoll data of a module's wakeFd */
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipReactor {
+    int             epollFd;
+    int             shutdownFd;  /**< eventfd used to stop the reactor thread */
+    pthread_t       thread;
+    pthread_mutex_t mutex;       /**< Guards cond */
+    pthread_cond_t  cond;        /**< Signaled when a module leaves the reactor */
+} cipReactor_t;
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+static cipReactor_t    sReactors[can_serial_MAX_NB_REACTOR_THREADS];
+static size_t          sNbReactors = 0U;
+static pthread_mutex_t sConfigMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Reactor functions ----------------------------------- */
+static cipReactor_t *CIP_reactorOf(const cipID_t pID) {
+    return &sReactors[pID % sNbReactors];
+}
+
+static void CIP_reactorRelease(cipReactor_t * const pReactor, const cipID_t pID, const cipErrorCode_t pErrorCode) {
+    (void)epoll_ctl(pReactor->epollFd, EPOLL_CTL_DEL, gCIP[pID].canSocket, NULL);
+    (void)epoll_ctl(pReactor->epollFd, EPOLL_CTL_DEL, gCIP[pID].wakeFd, NULL);
+
+    if(can_serial_ERROR_NONE != pErrorCode) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_reactorThread> Module %u left the reactor. (error code = %d)\n", pID, pErrorCode);
+    }
+
+    pthread_mutex_lock(&pReactor->mutex);
+    __atomic_store_n(&gCIP[pID].inReactor, false, __ATOMIC_RELEASE);
+    gCIP[pID].rxThreadOn = false;
+    pthread_cond_broadcast(&pReactor->cond);
+    pthread_mutex_unlock(&pReactor->mutex);
+}
+
+static void *CIP_reactorThread(void *pArg) {
+    cipReactor_t * const lReactor = (cipReactor_t *)pArg;
+
+    struct epoll_event lEvents[can_serial_REACTOR_MAX_EVENTS];
+
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_reactorThread> Starting reactor thread.\n");
+    for(;;) {
+        errno = 0;
+        const int lNbEvents = epoll_wait(lReactor->epollFd, lEvents, can_serial_REACTOR_MAX_EVENTS, -1);
+        if(0 > lNbEvents) {
+            if(EINTR == errno) {
+                continue;
+            }
+
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_reactorThread> epoll_wait failed !\n");
+            break;
+        }
+
+        for(int i = 0; i < lNbEvents; i++) {
+            const uint64_t lData = lEvents[i].data.u64;
+            if(REACTOR_SHUTDOWN_EVENT == lData) {
+                CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_reactorThread> Reactor thread stopped.\n");
+                return NULL;
+            }
+
+            const cipID_t lID = (cipID_t)(lData >> 1U);
+
+            /* The module may have left earlier in this batch of events */
+            if(!__atomic_load_n(&gCIP[lID].inReactor, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+
+            if(0U != (lData & REACTOR_WAKE_FD_BIT)) {
+                /* Woken up by CIP_stop/CIP_reset */
+                CIP_clearWakeFd(&gCIP[lID]);
+                if(gCIP[lID].isStopped) {
+                    CIP_reactorRelease(lReactor, lID, can_serial_ERROR_NONE);
+                }
+                continue;
+            }
+
+            if(0U != (lEvents[i].events & EPOLLERR) && CIP_readPendingTxTimestamps(&gCIP[lID], lID)) {
+                lEvents[i].events &= ~(uint32_t)EPOLLERR;
+            }
+
+            if(0U != (lEvents[i].events & (EPOLLERR | EPOLLHUP))) {
+                CIP_reactorRelease(lReactor, lID, can_serial_ERROR_NET);
+                continue;
+            }
+
+            /* Drain all the ready CAN messages of this module */
+            const cipErrorCode_t lErrorCode = CIP_rxProcess(lID);
+            if(can_serial_ERROR_NONE != lErrorCode) {
+                CIP_reactorRelease(lReactor, lID, lErrorCode);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void CIP_reactorStopAll(void) {
+    for(size_t i = 0U; i < sNbReactors; i++) {
+        const uint64_t lEvent = 1U;
+        if(sizeof(lEvent) != write(sReactors[i].shutdownFd, &lEvent, sizeof(lEvent))) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_setReactorThreads> Failed to signal reactor %zu\n", i);
+        }
+        pthread_join(sReactors[i].thread, NULL);
+
+        (void)close(sReactors[i].epollFd);
+        (void)close(sReactors[i].shutdownFd);
+        pthread_mutex_destroy(&sReactors[i].mutex);
+        pthread_cond_destroy(&sReactors[i].cond);
+    }
+    sNbReactors = 0U;
+}
+
+static cipErrorCode_t CIP_reactorStart(cipReactor_t * const pReactor) {
+    errno = 0;
+    if(0 > (pReactor->epollFd = epoll_create1(EPOLL_CLOEXEC))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_setReactorThreads> epoll_create1 failed !\n");
+        return can_serial_ERROR_SYS;
+    }
+
+    if(0 > (pReactor->shutdownFd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_setReactorThreads> eventfd failed !\n");
+        (void)close(pReactor->epollFd);
+        return can_serial_ERROR_SYS;
+    }
+
+    pthread_mutex_init(&pReactor->mutex, NULL);
+    pthread_cond_init(&pReactor->cond, NULL);
+
+    struct epoll_event lEvent = {.events = EPOLLIN, .data.u64 = REACTOR_SHUTDOWN_EVENT};
+    if(0 > epoll_ctl(pReactor->epollFd, EPOLL_CTL_ADD, pReactor->shutdownFd, &lEvent)
+        || 0 != pthread_create(&pReactor->thread, NULL, CIP_reactorThread, (void *)pReactor))
+    {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setReactorThreads> Reactor thread creation failed\n");
+        (void)close(pReactor->epollFd);
+        (void)close(pReactor->shutdownFd);
+        pthread_mutex_destroy(&pReactor->mutex);
+        pthread_cond_destroy(&pReactor->cond);
+        return can_serial_ERROR_SYS;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_setReactorThreads(const size_t pNbThreads) {
+    if(can_serial_MAX_NB_REACTOR_THREADS < pNbThreads) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setReactorThreads> At most %u reactor threads are supported\n", can_serial_MAX_NB_REACTOR_THREADS);
+        return can_serial_ERROR_ARG;
+    }
+
+    pthread_mutex_lock(&sConfigMutex);
+
+    /* The modules must leave the reactors first */
+    for(cipID_t lID = 0U; lID < can_serial_MAX_NB_MODULES; lID++) {
+        if(__atomic_load_n(&gCIP[lID].inReactor, __ATOMIC_ACQUIRE)) {
+            CIP_LOG(can_serial_LOG_ERROR, "<CIP_setReactorThreads> CAN-IP module %u is serviced by a reactor, stop it first.\n", lID);
+            pthread_mutex_unlock(&sConfigMutex);
+            return can_serial_ERROR_ALREADY_INIT;
+        }
+    }
+
+    CIP_reactorStopAll();
+
+    for(size_t i = 0U; i < pNbThreads; i++) {
+        if(can_serial_ERROR_NONE != CIP_reactorStart(&sReactors[i])) {
+            CIP_reactorStopAll();
+            pthread_mutex_unlock(&sConfigMutex);
+            return can_serial_ERROR_SYS;
+        }
+        sNbReactors = i + 1U;
+    }
+
+    pthread_mutex_unlock(&sConfigMutex);
+
+    return can_serial_ERROR_NONE;
+}
+
+bool CIP_reactorEnabled(void) {
+    return 0U < sNbReactors;
+}
+
+cipErrorCode_t CIP_reactorRegister(const cipID_t pID) {
+    pthread_mutex_lock(&sConfigMutex);
+
+    if(0U == sNbReactors) {
+        pthread_mutex_unlock(&sConfigMutex);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(__atomic_load_n(&gCIP[pID].inReactor, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&sConfigMutex);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    cipReactor_t * const lReactor = CIP_reactorOf(pID);
+
+    /* Must be set before the fds are in the epoll set */
+    __atomic_store_n(&gCIP[pID].inReactor, true, __ATOMIC_RELEASE);
+    gCIP[pID].rxThreadOn = true;
+
+    struct epoll_event lSocketEvent = {.events = EPOLLIN, .data.u64 = (uint64_t)pID << 1U};
+    struct epoll_event lWakeEvent   = {.events = EPOLLIN, .data.u64 = ((uint64_t)pID << 1U) | REACTOR_WAKE_FD_BIT};
+
+    errno = 0;
+    if(0 > epoll_ctl(lReactor->epollFd, EPOLL_CTL_ADD, gCIP[pID].canSocket, &lSocketEvent)
+        || 0 > epoll_ctl(lReactor->epollFd, EPOLL_CTL_ADD, gCIP[pID].wakeFd, &lWakeEvent))
+    {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_reactorRegister> epoll_ctl failed !\n");
+        (void)epoll_ctl(lReactor->epollFd, EPOLL_CTL_DEL, gCIP[pID].canSocket, NULL);
+        __atomic_store_n(&gCIP[pID].inReactor, false, __ATOMIC_RELEASE);
+        gCIP[pID].rxThreadOn = false;
+        pthread_mutex_unlock(&sConfigMutex);
+        return can_serial_ERROR_SYS;
+    }
+
+    pthread_mutex_unlock(&sConfigMutex);
+
+    CIP_LOG(can_serial_LOG_INFO, "<CIP_reactorRegister> Module %u registered to reactor %zu\n", pID, (size_t)(pID % sNbReactors));
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_reactorJoin(const cipID_t pID) {
+    if(!__atomic_load_n(&gCIP[pID].inReactor, __ATOMIC_ACQUIRE)) {
+        return can_serial_ERROR_NONE;
+    }
+
+    cipReactor_t * const lReactor = CIP_reactorOf(pID);
+
+    /* Called from the reactor itself (callback) : leave now, while the fds are still open */
+    if(pthread_equal(lReactor->thread, pthread_self())) {
+        CIP_reactorRelease(lReactor, pID, can_serial_ERROR_NONE);
+        return can_serial_ERROR_NONE;
+    }
+
+    /* Wait for the reactor to see that the module is stopped */
+    pthread_mutex_lock(&lReactor->mutex);
+    while(__atomic_load_n(&gCIP[pID].inReactor, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&lReactor->cond, &lReactor->mutex);
+    }
+    pthread_mutex_unlock(&lReactor->mutex);
+
+    return can_serial_ERROR_NONE;
+}
@@ -5,8 +5,14 @@
  */
 
 /* Includes -------------------------------------------- */
+#define _GNU_SOURCE /* For recvmmsg() */
+
 #include "can_serial_private.h"
 #include "can_serial_error_codes.h"
+#include "can_serial_serial_mgt.h"
+#include "can_serial_wire.h"
+#include "can_serial_socket_mgt.h"
+#include "can_serial_log.h"
 
 /* C system */
 #include <stddef.h>
@@ -14,75 +20,313 @@
 #include <string.h>
 #include <pthread.h>
 
+/* Networking headers */
+#include <sys/socket.h>
+
 /* errno */
 #include <errno.h>
 
 /* Defines --------------------------------------------- */
+/* Room for SCM_TIMESTAMPNS and SCM_TIMESTAMPING */
+#define RX_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(3U * sizeof(struct timespec)))
 
 /* Type definitions ------------------------------------ */
 
 /* Global variables ------------------------------------ */
 
 /* Static variables ------------------------------------ */
-// static const socklen_t sAddrLen = sizeof(struct sockaddr);
 
 /* Extern variables ------------------------------------ */
-extern cipInternalStruct_t gCIP;
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Decodes the datagrams already received, then drains the socket,
+ * can_serial_RX_BATCH_SIZE datagrams per syscall.
+ * Decodes into pMsgs (CAN FD frames are skipped) or into pFdMsgs.
+ * The frames that do not fit are decoded by the next call.
+ * The module RX mutex must be held. */
+static cipErrorCode_t CIP_udpRecvBatch(const cipID_t pID,
+    cipMessage_t * const pMsgs,
+    cipFdMessage_t * const pFdMsgs,
+    const size_t pMax,
+    size_t * const pCount)
+{
+    struct mmsghdr lHdrs[can_serial_RX_BATCH_SIZE];
+    struct iovec   lIovs[can_serial_RX_BATCH_SIZE];
+    char           lControls[can_serial_RX_BATCH_SIZE][RX_CONTROL_SIZE] __attribute__((aligned(sizeof(size_t))));
+
+    bool lDrained = false;
+
+    /* Counted locally, published once per call */
+    const size_t lStart    = *pCount;
+    size_t       lBytes    = 0U;
+    size_t       lFiltered = 0U;
+    size_t       lBad      = 0U;
+    size_t       lEagain   = 0U;
+    uint64_t     lNow      = 0U; /* Decode time, taken once per recvmmsg */
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    for(;;) {
+        cipWireFrame_t lFrame;
+        while(*pCount < pMax) {
+            if(CIP_wireReaderNext(&gCIP[pID].rxReader, &lFrame)) {
+                if(!CIP_filterAccept(&gCIP[pID].filters, lFrame.id, lFrame.flags)) {
+                    lFiltered++;
+                    continue;
+                } else if(NULL != pFdMsgs) {
+                    cipFdMessage_t * const lMsg = &pFdMsgs[*pCount];
+                    lMsg->id     = lFrame.id;
+                    lMsg->size   = lFrame.size;
+                    lMsg->flags  = lFrame.flags;
+                    lMsg->randID    = gCIP[pID].rxReader.randID;
+                    lMsg->timestamp = gCIP[pID].rxReaderStamp;
+                    memcpy(lMsg->data, lFrame.data, lFrame.size);
+                    memset(&lMsg->data[lFrame.size], 0, CAN_FD_MESSAGE_MAX_SIZE - lFrame.size);
+                } else if(CAN_MESSAGE_MAX_SIZE >= lFrame.size) {
+                    cipMessage_t * const lMsg = &pMsgs[*pCount];
+                    lMsg->id     = lFrame.id;
+                    lMsg->size   = lFrame.size;
+                    lMsg->flags  = lFrame.flags;
+                    lMsg->randID    = gCIP[pID].rxReader.randID;
+                    lMsg->timestamp = gCIP[pID].rxReaderStamp;
+                    memcpy(lMsg->data, lFrame.data, lFrame.size);
+                    memset(&lMsg->data[lFrame.size], 0, CAN_MESSAGE_MAX_SIZE - lFrame.size);
+                } else {
+                    /* CAN FD payload, a classic module cannot hold it */
+                    continue;
+                }
+                lBytes += lFrame.size;
+                (*pCount)++;
+
+                if(0U != gCIP[pID].rxReader.sendStamp && gCIP[pID].latencyTracking) {
+                    if(0U == lNow) {
+                        lNow = CIP_realtimeNs();
+                    }
+                    CIP_latencyRecord(&gCIP[pID].latency, lNow, gCIP[pID].rxReader.sendStamp);
+                }
+                continue;
+            }
+
+            if(gCIP[pID].rxDatagramIdx >= gCIP[pID].rxNbDatagrams) {
+                break;
+            }
+
+            /* Next datagram */
+            const size_t lIdx = gCIP[pID].rxDatagramIdx++;
+            gCIP[pID].rxReaderStamp = gCIP[pID].rxDatagramStamps[lIdx];
+            if(can_serial_ERROR_NONE != CIP_wireReaderInit(&gCIP[pID].rxReader,
+                gCIP[pID].rxDatagrams[lIdx], gCIP[pID].rxDatagramLens[lIdx]))
+            {
+                CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvBatch> Dropped inconsistent datagram of size %zu\n", gCIP[pID].rxDatagramLens[lIdx]);
+                lBad++;
+            }
+        }
+
+        if(pMax <= *pCount || lDrained) {
+            break;
+        }
+
+        memset(lHdrs, 0, sizeof(lHdrs));
+        for(size_t i = 0U; i < can_serial_RX_BATCH_SIZE; i++) {
+            lIovs[i].iov_base = (void *)gCIP[pID].rxDatagrams[i];
+            lIovs[i].iov_len  = can_serial_WIRE_MAX_DATAGRAM;
+            lHdrs[i].msg_hdr.msg_iov    = &lIovs[i];
+            lHdrs[i].msg_hdr.msg_iovlen = 1U;
+            lHdrs[i].msg_hdr.msg_control    = lControls[i];
+            lHdrs[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+        }
+
+        errno = 0;
+        const int lReceived = recvmmsg(gCIP[pID].canSocket, lHdrs, can_serial_RX_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if(0 > lReceived) {
+            if(EAGAIN == errno || EWOULDBLOCK == errno) {
+                /* Nothing (more) to read on the socket */
+                lEagain++;
+                break;
+            }
+
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_recvBatch> recvmmsg failed !\n");
+            lErrorCode = can_serial_ERROR_NET;
+            break;
+        }
+
+        for(size_t i = 0U; i < (size_t)lReceived; i++) {
+            /* A truncated datagram is inconsistent */
+            gCIP[pID].rxDatagramLens[i] = 0 != (lHdrs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0U : lHdrs[i].msg_len;
+
+            /* Kernel RX time, user space time if the kernel gave none */
+            gCIP[pID].rxDatagramStamps[i] = CIP_cmsgTimestamp(&lHdrs[i].msg_hdr);
+            if(0U == gCIP[pID].rxDatagramStamps[i]) {
+                gCIP[pID].rxDatagramStamps[i] = CIP_realtimeNs();
+            }
+        }
+        gCIP[pID].rxNbDatagrams = (size_t)lReceived;
+        lNow = 0U;
+        gCIP[pID].rxDatagramIdx = 0U;
+
+        /* The socket is drained, decode and stop */
+        lDrained = (size_t)lReceived < can_serial_RX_BATCH_SIZE;
+    }
+
+    cipRxCounters_t * const lStats = &gCIP[pID].rxStats;
+    CIP_STATS_ADD(*lStats, rxFrames,       *pCount - lStart);
+    CIP_STATS_ADD(*lStats, rxBytes,        lBytes);
+    CIP_STATS_ADD(*lStats, filteredFrames, lFiltered);
+    CIP_STATS_ADD(*lStats, badDatagrams,   lBad);
+    CIP_STATS_ADD(*lStats, eagainSpins,    lEagain);
+
+    return lErrorCode;
+}
 
 cipErrorCode_t CIP_recv(const cipID_t pID, cipMessage_t * const pMsg, ssize_t * const pReadBytes) {
-    pthread_mutex_lock(&gCIP.mutex);
-    
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_recv> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recv> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
     /* Check if the module is already initialized */
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_rxThread> CAN-IP module %u is not initialized.\n", gCIP.cipInstanceID);
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> CAN-IP module %u is not initialized.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
 
     if(NULL == pMsg) {
-        printf("[ERROR] <CIP_rxThread> Message is NULL\n");
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> Message is NULL\n");
         return can_serial_ERROR_ARG;
     }
 
     if(NULL == pReadBytes) {
-        printf("[ERROR] <CIP_rxThread> pReadBytes output pointer is NULL\n");
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> pReadBytes output pointer is NULL\n");
         return can_serial_ERROR_ARG;
     }
 
-    *pReadBytes = 0;
-    struct sockaddr_in lSrcAddr;
-    socklen_t lSrcAddrLen = sizeof(lSrcAddr);
-    //char lSrcIPAddr[INET_ADDRSTRLEN] = "";
-    
-    /* Receive the CAN frame */
-    *pReadBytes = recvfrom(gCIP.canSocket, (void *)pMsg, sizeof(cipMessage_t), 0, 
-        (struct sockaddr *)&lSrcAddr, &lSrcAddrLen);
-    //*pReadBytes = recv(gCIP.canSocket, (void *)pMsg, sizeof(cipMessage_t), 0);
-    if(0 > *pReadBytes) {
-        if(EAGAIN != errno && EWOULDBLOCK != errno) {
-            printf("[ERROR] <CIP_send> recvfrom failed !\n");
-            if(0 != errno) {
-                printf("        errno = %d (%s)\n", errno, strerror(errno));
-            }
-            return can_serial_ERROR_NET;
-        } else {
-            /* Nothing to read on the socket */
-        }
-    } else if (0 == *pReadBytes) {
-        /* Nothing was read from the socket */
+    size_t lCount = 0U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport) {
+        /* Decode one SLCAN frame from the serial port */
+        lErrorCode = CIP_serialRecvBatch(pID, pMsg, 1U, &lCount);
     } else {
-        /* We got our message */
-        
-        // inet_ntop(PF_INET, &lSrcAddr.sin_addr, lSrcIPAddr, INET_ADDRSTRLEN);
-        // printf("[DEBUG] <CIP_send> Received %ld bytes from %s\n", *pReadBytes, lSrcIPAddr, lSrcAddrLen);
+        /* Decode one frame, the others of its datagram are kept */
+        lErrorCode = CIP_udpRecvBatch(pID, pMsg, NULL, 1U, &lCount);
+    }
+
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    *pReadBytes = 0U < lCount ? (ssize_t)sizeof(cipMessage_t) : 0;
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_recvBatch(const cipID_t pID, cipMessage_t * const pMsgs, const size_t pMax, size_t * const pCount) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvBatch> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvBatch> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(NULL == pMsgs || NULL == pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvBatch> Message array or pCount output pointer is NULL\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    *pCount = 0U;
+
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport) {
+        lErrorCode = CIP_serialRecvBatch(pID, pMsgs, pMax, pCount);
+    } else {
+        lErrorCode = CIP_udpRecvBatch(pID, pMsgs, NULL, pMax, pCount);
+    }
+
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_recvFdBatch(const cipID_t pID, cipFdMessage_t * const pMsgs, const size_t pMax, size_t * const pCount) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvFdBatch> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvFdBatch> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(can_serial_MODE_FD != gCIP[pID].cipMode) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvFdBatch> CAN-IP module %u is not in CAN FD mode.\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(NULL == pMsgs || NULL == pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_recvFdBatch> Message array or pCount output pointer is NULL\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    *pCount = 0U;
+
+    pthread_mutex_lock(&gCIP[pID].rxMutex);
+    const cipErrorCode_t lErrorCode = CIP_udpRecvBatch(pID, NULL, pMsgs, pMax, pCount);
+    pthread_mutex_unlock(&gCIP[pID].rxMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_pollMessages(const cipID_t pID, cipMessage_t * const pMsgs, const size_t pMax, size_t * const pCount) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollMessages> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == gCIP[pID].rxRing.frames || gCIP[pID].rxRing.isFd) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollMessages> CAN-IP module %u has no classic RX ring.\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(NULL == pMsgs || NULL == pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollMessages> Message array or pCount output pointer is NULL\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    *pCount = CIP_ringPop(&gCIP[pID].rxRing, pMsgs, pMax);
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_pollFdMessages(const cipID_t pID, cipFdMessage_t * const pMsgs, const size_t pMax, size_t * const pCount) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollFdMessages> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == gCIP[pID].rxRing.frames || !gCIP[pID].rxRing.isFd) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollFdMessages> CAN-IP module %u has no CAN FD RX ring.\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(NULL == pMsgs || NULL == pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_pollFdMessages> Message array or pCount output pointer is NULL\n");
+        return can_serial_ERROR_ARG;
     }
 
-    pthread_mutex_unlock(&gCIP.mutex);
+    *pCount = CIP_ringPopFd(&gCIP[pID].rxRing, pMsgs, pMax);
 
     return can_serial_ERROR_NONE;
 }
@@ -0,0 +1,150 @@
+/**
+ * @brief CAN over serial lock-free SPSC ring buffer
+ * 
+ * @file can_serial_ring.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_ring.h"
+#include "can_serial_error_codes.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+/* Producer side : number of slots we may fill at head */
+static inline size_t ringFree(cipRing_t * const pRing, const size_t pCount) {
+    const size_t lCapacity = pRing->mask + 1U;
+
+    /* Only reload the consumer's tail when our copy says we are full */
+    if(lCapacity - (pRing->head - pRing->cachedTail) < pCount) {
+        pRing->cachedTail = __atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE);
+    }
+
+    const size_t lFree = lCapacity - (pRing->head - pRing->cachedTail);
+    return pCount < lFree ? pCount : lFree;
+}
+
+/* Consumer side : number of slots we may read at tail */
+static inline size_t ringUsed(cipRing_t * const pRing, const size_t pMax) {
+    /* Only reload the producer's head when our copy says we are empty */
+    if(pRing->cachedHead - pRing->tail < pMax) {
+        pRing->cachedHead = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+    }
+
+    const size_t lUsed = pRing->cachedHead - pRing->tail;
+    return pMax < lUsed ? pMax : lUsed;
+}
+
+/* Ring functions -------------------------------------- */
+cipErrorCode_t CIP_ringInit(cipRing_t * const pRing, const size_t pCapacity, const bool pFd) {
+    if(NULL == pRing || 0U == pCapacity || can_serial_RING_MAX_CAPACITY < pCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_ringInit> Invalid ring or capacity\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Round the capacity up to a power of 2 */
+    size_t lCapacity = 1U;
+    while(lCapacity < pCapacity) {
+        lCapacity <<= 1U;
+    }
+
+    const size_t lSlotSize = pFd ? sizeof(cipFdMessage_t) : sizeof(cipMessage_t);
+    if(SIZE_MAX / lSlotSize < lCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_ringInit> %zu messages do not fit in memory\n", lCapacity);
+        return can_serial_ERROR_ARG;
+    }
+
+    void *lFrames = NULL;
+    if(0 != posix_memalign(&lFrames, can_serial_CACHE_LINE_SIZE, lCapacity * lSlotSize)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_ringInit> Failed to allocate %zu messages\n", lCapacity);
+        return can_serial_ERROR_SYS;
+    }
+
+    memset(pRing, 0, sizeof(cipRing_t));
+    pRing->frames = lFrames;
+    pRing->mask   = lCapacity - 1U;
+    pRing->isFd   = pFd;
+
+    return can_serial_ERROR_NONE;
+}
+
+void CIP_ringFree(cipRing_t * const pRing) {
+    if(NULL != pRing) {
+        free(pRing->frames);
+        memset(pRing, 0, sizeof(cipRing_t));
+    }
+}
+
+void CIP_ringClear(cipRing_t * const pRing) {
+    __atomic_store_n(&pRing->head, 0U, __ATOMIC_RELEASE);
+    __atomic_store_n(&pRing->tail, 0U, __ATOMIC_RELEASE);
+    pRing->cachedTail = 0U;
+    pRing->cachedHead = 0U;
+}
+
+size_t CIP_ringPush(cipRing_t * const pRing, const cipMessage_t * const pMsgs, const size_t pCount) {
+    const size_t lHead  = pRing->head; /* Only written by us */
+    const size_t lCount = ringFree(pRing, pCount);
+
+    for(size_t i = 0U; i < lCount; i++) {
+        ((cipMessage_t *)pRing->frames)[(lHead + i) & pRing->mask] = pMsgs[i];
+    }
+
+    /* Publish the whole batch at once */
+    __atomic_store_n(&pRing->head, lHead + lCount, __ATOMIC_RELEASE);
+
+    return lCount;
+}
+
+size_t CIP_ringPop(cipRing_t * const pRing, cipMessage_t * const pMsgs, const size_t pMax) {
+    const size_t lTail  = pRing->tail; /* Only written by us */
+    const size_t lCount = ringUsed(pRing, pMax);
+
+    for(size_t i = 0U; i < lCount; i++) {
+        pMsgs[i] = ((cipMessage_t *)pRing->frames)[(lTail + i) & pRing->mask];
+    }
+
+    /* Release the slots to the producer */
+    __atomic_store_n(&pRing->tail, lTail + lCount, __ATOMIC_RELEASE);
+
+    return lCount;
+}
+
+size_t CIP_ringPushFd(cipRing_t * const pRing, const cipFdMessage_t * const pMsgs, const size_t pCount) {
+    const size_t lHead  = pRing->head; /* Only written by us */
+    const size_t lCount = ringFree(pRing, pCount);
+
+    for(size_t i = 0U; i < lCount; i++) {
+        ((cipFdMessage_t *)pRing->frames)[(lHead + i) & pRing->mask] = pMsgs[i];
+    }
+
+    __atomic_store_n(&pRing->head, lHead + lCount, __ATOMIC_RELEASE);
+
+    return lCount;
+}
+
+size_t CIP_ringPopFd(cipRing_t * const pRing, cipFdMessage_t * const pMsgs, const size_t pMax) {
+    const size_t lTail  = pRing->tail; /* Only written by us */
+    const size_t lCount = ringUsed(pRing, pMax);
+
+    for(size_t i = 0U; i < lCount; i++) {
+        pMsgs[i] = ((cipFdMessage_t *)pRing->frames)[(lTail + i) & pRing->mask];
+    }
+
+    __atomic_store_n(&pRing->tail, lTail + lCount, __ATOMIC_RELEASE);
+
+    return lCount;
+}
@@ -0,0 +1,64 @@
+/**
+ * @brief CAN over serial lock-free SPSC ring buffer
+ * 
+ * @file can_serial_ring.h
+ */
+
+#ifndef can_serial_RING_H
+#define can_serial_RING_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines --------------------------------------------- */
+#ifndef can_serial_CACHE_LINE_SIZE
+#define can_serial_CACHE_LINE_SIZE 64U
+#endif /* can_serial_CACHE_LINE_SIZE */
+
+/* Largest capacity that can be rounded up to a power of 2 */
+#define can_serial_RING_MAX_CAPACITY (SIZE_MAX / 2U + 1U)
+
+/* Type definitions ------------------------------------ */
+/**
+ * @brief Single-producer/single-consumer ring of CAN messages.
+ * The producer only writes head, the consumer only writes tail,
+ * each on its own cache line, so no lock is needed.
+ * A ring holds either classic or CAN FD messages, so that
+ * classic modules do not pay for 64-byte slots.
+ */
+typedef struct _cipRing {
+    /* Read-only after CIP_ringInit */
+    void         *frames;   /**< cipMessage_t or cipFdMessage_t slots, NULL : no ring */
+    size_t        mask;     /**< Capacity - 1, capacity is a power of 2 */
+    bool          isFd;
+
+    /* Producer side */
+    size_t head       __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+    size_t cachedTail; /**< Producer's copy of tail, to avoid reading the consumer's line */
+
+    /* Consumer side */
+    size_t tail       __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+    size_t cachedHead; /**< Consumer's copy of head, to avoid reading the producer's line */
+} __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) cipRing_t;
+
+/* Ring functions -------------------------------------- */
+cipErrorCode_t CIP_ringInit(cipRing_t * const pRing, const size_t pCapacity, const bool pFd);
+void CIP_ringFree(cipRing_t * const pRing);
+void CIP_ringClear(cipRing_t * const pRing);
+
+/* Producer side, returns the number of messages pushed */
+size_t CIP_ringPush(cipRing_t * const pRing, const cipMessage_t * const pMsgs, const size_t pCount);
+
+/* Consumer side, returns the number of messages popped */
+size_t CIP_ringPop(cipRing_t * const pRing, cipMessage_t * const pMsgs, const size_t pMax);
+
+/* Same for CAN FD rings */
+size_t CIP_ringPushFd(cipRing_t * const pRing, const cipFdMessage_t * const pMsgs, const size_t pCount);
+size_t CIP_ringPopFd(cipRing_t * const pRing, cipFdMessage_t * const pMsgs, const size_t pMax);
+
+#endif /* can_serial_RING_H */
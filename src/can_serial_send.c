@@ -5,13 +5,28 @@
  */
 
 /* Includes -------------------------------------------- */
+#define _GNU_SOURCE /* For sendmmsg() */
+
 #include "can_serial_private.h"
 #include "can_serial_error_codes.h"
+#include "can_serial_serial_mgt.h"
+#include "can_serial_socket_mgt.h"
+#include "can_serial_wire.h"
+#include "can_serial_log.h"
 
 /* C system */
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/* Networking headers */
+#include <sys/socket.h>
 
 /* errno */
 #include <errno.h>
@@ -25,8 +40,386 @@
 /* Static variables ------------------------------------ */
 
 /* Extern variables ------------------------------------ */
-extern cipInternalStruct_t gCIP;
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+
+/* Support functions ----------------------------------- */
+static inline void messageToFrame(const cipMessage_t * const pMsgs,
+    const cipFdMessage_t * const pFdMsgs,
+    const size_t pIdx,
+    cipWireFrame_t * const pFrame)
+{
+    if(NULL != pFdMsgs) {
+        pFrame->id    = pFdMsgs[pIdx].id;
+        pFrame->flags = pFdMsgs[pIdx].flags;
+        pFrame->size  = pFdMsgs[pIdx].size;
+        pFrame->data  = pFdMsgs[pIdx].data;
+    } else {
+        pFrame->id    = pMsgs[pIdx].id;
+        pFrame->flags = pMsgs[pIdx].flags;
+        pFrame->size  = pMsgs[pIdx].size;
+        pFrame->data  = pMsgs[pIdx].data;
+    }
+}
+
+/* Packs the messages (pMsgs or pFdMsgs) in as few datagrams as the wire
+ * format allows and sends them with as few sendmmsg syscalls as possible.
+ * The module TX mutex must be held. */
+static cipErrorCode_t CIP_udpSendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const cipFdMessage_t * const pFdMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent)
+{
+    struct mmsghdr lHdrs[can_serial_TX_BATCH_SIZE];
+    struct iovec   lIovs[can_serial_TX_BATCH_SIZE];
+    size_t         lFirst[can_serial_TX_BATCH_SIZE]; /* First message of each datagram */
+    size_t         lLast[can_serial_TX_BATCH_SIZE];  /* Past the last message of each datagram */
+    size_t         lBytes[can_serial_TX_BATCH_SIZE]; /* CAN payload bytes of each datagram */
+
+    size_t lSent      = 0U;
+    size_t lSentBytes = 0U;
+    size_t i          = 0U;
+
+    /* The datagrams of this batch leave right away */
+    const uint64_t lSendStamp = gCIP[pID].latencyTracking ? CIP_realtimeNs() : 0U;
+
+    while(i < pCount) {
+        /* Build the datagrams in the TX buffer */
+        size_t lNb   = 0U;
+        size_t lUsed = 0U;
+        while(lNb < can_serial_TX_BATCH_SIZE
+            && i < pCount
+            && lUsed + can_serial_WIRE_HEADER_SIZE + can_serial_WIRE_MAX_FRAME_SIZE <= can_serial_TX_BUFFER_SIZE)
+        {
+            const size_t lRoom = can_serial_TX_BUFFER_SIZE - lUsed;
+            cipWireWriter_t lWriter;
+            CIP_wireWriterInit(&lWriter, &gCIP[pID].txBuffer[lUsed],
+                lRoom < can_serial_WIRE_MAX_DATAGRAM ? lRoom : can_serial_WIRE_MAX_DATAGRAM,
+                gCIP[pID].wireFormat, gCIP[pID].randID);
+            lWriter.sendStamp = lSendStamp;
+
+            lFirst[lNb] = i;
+            lBytes[lNb] = 0U;
+            for(; i < pCount; i++) {
+                cipWireFrame_t lFrame;
+                messageToFrame(pMsgs, pFdMsgs, i, &lFrame);
+
+                const cipErrorCode_t lErrorCode = CIP_wireWriterAppend(&lWriter, &lFrame);
+                if(can_serial_ERROR_ARG == lErrorCode && 0U == lWriter.count) {
+                    /* Skip it, the datagram starts after it */
+                    CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendBatch> Message %zu cannot be encoded\n", i);
+                    if(NULL != pResults) {
+                        pResults[i] = can_serial_ERROR_ARG;
+                    }
+                    lFirst[lNb] = i + 1U;
+                } else if(can_serial_ERROR_NONE != lErrorCode) {
+                    /* Datagram full, or an invalid message to skip in the next one */
+                    break;
+                } else {
+                    lBytes[lNb] += lFrame.size;
+                }
+            }
+
+            if(0U == lWriter.count) {
+                break;
+            }
+
+            lLast[lNb] = i;
+            lIovs[lNb].iov_base = (void *)lWriter.buf;
+            lIovs[lNb].iov_len  = lWriter.len;
+            memset(&lHdrs[lNb], 0, sizeof(struct mmsghdr));
+            lHdrs[lNb].msg_hdr.msg_name    = (void *)&gCIP[pID].socketInAddress;
+            lHdrs[lNb].msg_hdr.msg_namelen = sizeof(gCIP[pID].socketInAddress);
+            lHdrs[lNb].msg_hdr.msg_iov     = &lIovs[lNb];
+            lHdrs[lNb].msg_hdr.msg_iovlen  = 1U;
+
+            lUsed += lWriter.len;
+            lNb++;
+        }
+
+        /* sendmmsg stops at the first failing datagram,
+         * so mark its messages as failed and carry on with the next ones */
+        size_t lDone = 0U;
+        while(lDone < lNb) {
+            errno = 0;
+            int lResult = sendmmsg(gCIP[pID].canSocket, &lHdrs[lDone], (unsigned int)(lNb - lDone), 0);
+            if(0 > lResult && EINTR == errno) {
+                continue;
+            }
+
+            if(0 > lResult && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+                /* The socket send buffer is full, wait for it to drain */
+                struct pollfd lFd = {.fd = gCIP[pID].canSocket, .events = POLLOUT, .revents = 0};
+                if(0 < poll(&lFd, 1U, can_serial_UDP_TX_TIMEOUT_MS)) {
+                    if(0 != (lFd.revents & POLLERR) && gCIP[pID].txTimestamping) {
+                        /* Our TX timestamps, not a socket error */
+                        CIP_readTxTimestamps(pID);
+                    }
+                    continue;
+                }
+                errno = EAGAIN;
+            }
+
+            if(0 >= lResult) {
+                CIP_statsTxErrno(&gCIP[pID].txStats, errno);
+                CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_sendBatch> sendmmsg failed for message %zu !\n", lFirst[lDone]);
+                lHdrs[lDone].msg_len = 0U;
+                lResult = 1;
+            }
+
+            for(size_t d = lDone; d < lDone + (size_t)lResult; d++) {
+                const bool lComplete = lIovs[d].iov_len == lHdrs[d].msg_len;
+                if(lComplete) {
+                    lSent      += lLast[d] - lFirst[d];
+                    lSentBytes += lBytes[d];
+                }
+                for(size_t j = lFirst[d]; NULL != pResults && j < lLast[d]; j++) {
+                    pResults[j] = lComplete ? can_serial_ERROR_NONE : can_serial_ERROR_NET;
+                }
+            }
+            lDone += (size_t)lResult;
+        }
+    }
+
+    CIP_STATS_ADD(gCIP[pID].txStats, txFrames,   lSent);
+    CIP_STATS_ADD(gCIP[pID].txStats, txBytes,    lSentBytes);
+    CIP_STATS_ADD(gCIP[pID].txStats, txFailures, pCount - lSent);
+
+    /* Over loopback and most NICs, the timestamps are already queued */
+    if(gCIP[pID].txTimestamping && 0U < lSent) {
+        CIP_readTxTimestamps(pID);
+    }
+
+    *pSent = lSent;
+
+    return pCount == lSent ? can_serial_ERROR_NONE : can_serial_ERROR_NET;
+}
+
+/* Worst-case on-bus length of a classic frame, in bits :
+ * the stuffed part (SOF to CRC), one stuff bit every 4 bits at worst,
+ * then CRC delimiter, ACK, EOF and intermission */
+static inline uint64_t CIP_canFrameBits(const cipMessage_t * const pMsg) {
+    const uint64_t lData = 0U != (pMsg->flags & can_serial_FLAG_RTR) ? 0U
+        : 8U * (uint64_t)(CAN_MESSAGE_MAX_SIZE < pMsg->size ? CAN_MESSAGE_MAX_SIZE : pMsg->size);
+    const uint64_t lStuffed = (0U != (pMsg->flags & can_serial_FLAG_EFF) ? 54U : 34U) + lData;
+
+    return lStuffed + (lStuffed - 1U) / 4U + 13U;
+}
+
+/* Waits until the token bucket holds pCost nano-bits */
+static void CIP_txPaceWait(const cipID_t pID, const uint64_t pCost) {
+    const uint64_t lWaitNs = (pCost - gCIP[pID].txTokens + gCIP[pID].txBitrate - 1U) / gCIP[pID].txBitrate;
+    const uint64_t lWakeNs = gCIP[pID].txTokensStamp + lWaitNs;
+
+    struct itimerspec lTimer;
+    memset(&lTimer, 0, sizeof(lTimer));
+    lTimer.it_value.tv_sec  = (time_t)(lWakeNs / 1000000000U);
+    lTimer.it_value.tv_nsec = (long)(lWakeNs % 1000000000U);
+
+    /* CIP_init creates the timerfd, sleep if it could not */
+    errno = 0;
+    if(0 <= gCIP[pID].txPaceFd
+        && 0 == timerfd_settime(gCIP[pID].txPaceFd, TFD_TIMER_ABSTIME, &lTimer, NULL))
+    {
+        uint64_t lExpirations = 0U;
+        while(sizeof(lExpirations) != read(gCIP[pID].txPaceFd, &lExpirations, sizeof(lExpirations)) && EINTR == errno) {
+            /* Interrupted, wait again */
+        }
+        return;
+    }
+
+    while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &lTimer.it_value, NULL)) {
+        /* Interrupted, sleep again */
+    }
+}
+
+/* Sends classic messages over the module's transport,
+ * no faster than the configured bitrate (CIP_setTxBitrate).
+ * The module TX mutex must be held. */
+static cipErrorCode_t CIP_txSendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent)
+{
+    const bool lSerial = can_serial_TRANSPORT_SERIAL == gCIP[pID].transport;
+
+    if(0U == gCIP[pID].txBitrate) {
+        return lSerial ? CIP_serialSendBatch(pID, pMsgs, pCount, pResults, pSent)
+            : CIP_udpSendBatch(pID, pMsgs, NULL, pCount, pResults, pSent);
+    }
+
+    const uint64_t lDepth = (uint64_t)can_serial_TX_PACING_BURST_FRAMES * can_serial_CAN_FRAME_MAX_BITS * 1000000000U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+    size_t lSent = 0U;
+    size_t i     = 0U;
+
+    while(i < pCount) {
+        /* Refill the bucket, pBitrate nano-bits per ns */
+        const uint64_t lNow = CIP_monotonicNs();
+        const uint64_t lElapsed = lNow - gCIP[pID].txTokensStamp;
+        gCIP[pID].txTokens = lElapsed >= lDepth / gCIP[pID].txBitrate ? lDepth
+            : gCIP[pID].txTokens + lElapsed * gCIP[pID].txBitrate;
+        if(lDepth < gCIP[pID].txTokens) {
+            gCIP[pID].txTokens = lDepth;
+        }
+        gCIP[pID].txTokensStamp = lNow;
+
+        /* Release the frames the bucket pays for */
+        size_t lNb = 0U;
+        while(i + lNb < pCount) {
+            const uint64_t lCost = CIP_canFrameBits(&pMsgs[i + lNb]) * 1000000000U;
+            if(gCIP[pID].txTokens < lCost) {
+                break;
+            }
+            gCIP[pID].txTokens -= lCost;
+            lNb++;
+        }
+
+        if(0U == lNb) {
+            CIP_txPaceWait(pID, CIP_canFrameBits(&pMsgs[i]) * 1000000000U);
+            continue;
+        }
+
+        size_t lChunkSent = 0U;
+        const cipErrorCode_t lChunkError = lSerial
+            ? CIP_serialSendBatch(pID, &pMsgs[i], lNb, NULL != pResults ? &pResults[i] : NULL, &lChunkSent)
+            : CIP_udpSendBatch(pID, &pMsgs[i], NULL, lNb, NULL != pResults ? &pResults[i] : NULL, &lChunkSent);
+        if(can_serial_ERROR_NONE != lChunkError) {
+            lErrorCode = lChunkError;
+        }
+        lSent += lChunkSent;
+        i     += lNb;
+    }
+
+    *pSent = lSent;
+
+    return lErrorCode;
+}
+
+/* Records the messages handed to the module, if it is captured */
+static inline void CIP_txCapture(const cipID_t pID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    if(CIP_captureOn(&gCIP[pID].capture)) {
+        CIP_captureMessages(pID, can_serial_CAPTURE_TX, pMsgs, pCount, CIP_realtimeNs());
+    }
+}
+
+static inline void CIP_txCaptureFd(const cipID_t pID, const cipFdMessage_t * const pMsgs, const size_t pCount) {
+    if(CIP_captureOn(&gCIP[pID].capture)) {
+        CIP_captureFdMessages(pID, can_serial_CAPTURE_TX, pMsgs, pCount, CIP_realtimeNs());
+    }
+}
+
+/* A writer thread sends the messages of this module */
+static inline bool CIP_txQueued(const cipID_t pID) {
+    return gCIP[pID].txWriterOn;
+}
+
+/* Reserves room for up to pCount messages until the writer sent them,
+ * so that it can always move the whole queue into its heap */
+static size_t CIP_txReserve(const cipID_t pID, const size_t pCount) {
+    const size_t lCapacity = gCIP[pID].txQueue.mask + 1U;
+    const size_t lPending  = __atomic_fetch_add(&gCIP[pID].txPending, pCount, __ATOMIC_RELAXED);
+
+    const size_t lAccepted = lPending >= lCapacity ? 0U
+        : lCapacity - lPending < pCount ? lCapacity - lPending : pCount;
+    if(lAccepted < pCount) {
+        (void)__atomic_fetch_sub(&gCIP[pID].txPending, pCount - lAccepted, __ATOMIC_RELAXED);
+    }
+
+    return lAccepted;
+}
+
+/* Queues the messages, returns how many the queue accepted */
+static size_t CIP_txEnqueue(const cipID_t pID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    const size_t lRoom   = gCIP[pID].txPriority ? CIP_txReserve(pID, pCount) : pCount;
+    const size_t lPushed = CIP_txQueuePush(&gCIP[pID].txQueue, pMsgs, lRoom);
+    if(lPushed < pCount) {
+        CIP_STATS_ADD(gCIP[pID].txStats, txQueueFull, pCount - lPushed);
+    }
+    CIP_txCapture(pID, pMsgs, lPushed);
+
+    /* Pairs w/ the fence of the writer going to sleep : either it sees
+     * the messages, or we see it sleeping */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(0U < lPushed
+        && __atomic_load_n(&gCIP[pID].txWriterSleeping, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&gCIP[pID].txWriterSleeping, false, __ATOMIC_RELAXED))
+    {
+        const uint64_t lEvent = 1U;
+        if(sizeof(lEvent) != write(gCIP[pID].txWakeFd, &lEvent, sizeof(lEvent))) {
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_send> Failed to wake the TX writer of module %u up\n", pID);
+        }
+    }
+
+    return lPushed;
+}
 
+static void *CIP_txWriter(void *pArg) {
+    /* The module ID is passed by value in the argument */
+    const cipID_t lID = (cipID_t)(uintptr_t)pArg;
+
+    cipMessage_t lMsgs[can_serial_TX_QUEUE_BATCH_SIZE];
+    struct pollfd lFd = {.fd = gCIP[lID].txWakeFd, .events = POLLIN, .revents = 0};
+
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_txWriter> Starting TX writer.\n");
+    for(;;) {
+        size_t lCount = 0U;
+        if(gCIP[lID].txPriority) {
+            /* Take everything queued, then send the highest priorities */
+            size_t lPopped = 0U;
+            while(0U < (lPopped = CIP_txQueuePop(&gCIP[lID].txQueue, lMsgs, can_serial_TX_QUEUE_BATCH_SIZE))) {
+                for(size_t i = 0U; i < lPopped; i++) {
+                    (void)CIP_txHeapPush(&gCIP[lID].txHeap, &lMsgs[i]);
+                }
+            }
+            lCount = CIP_txHeapPop(&gCIP[lID].txHeap, lMsgs, can_serial_TX_PRIORITY_BATCH_SIZE);
+        } else {
+            lCount = CIP_txQueuePop(&gCIP[lID].txQueue, lMsgs, can_serial_TX_QUEUE_BATCH_SIZE);
+        }
+
+        if(0U < lCount) {
+            /* The failures are counted in the statistics */
+            size_t lSent = 0U;
+            pthread_mutex_lock(&gCIP[lID].txMutex);
+            (void)CIP_txSendBatch(lID, lMsgs, lCount, NULL, &lSent);
+            pthread_mutex_unlock(&gCIP[lID].txMutex);
+
+            if(gCIP[lID].txPriority) {
+                (void)__atomic_fetch_sub(&gCIP[lID].txPending, lCount, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+
+        /* Stopped once the queue is empty */
+        if(__atomic_load_n(&gCIP[lID].txWriterStop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        /* Tell the producers to kick us, then make sure nothing came in meanwhile */
+        __atomic_store_n(&gCIP[lID].txWriterSleeping, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(!CIP_txQueueIsEmpty(&gCIP[lID].txQueue) || __atomic_load_n(&gCIP[lID].txWriterStop, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&gCIP[lID].txWriterSleeping, false, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        errno = 0;
+        if(0 > poll(&lFd, 1U, -1) && EINTR != errno) {
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_txWriter> poll failed !\n");
+        }
+        uint64_t lEvent = 0U;
+        if(sizeof(lEvent) != read(gCIP[lID].txWakeFd, &lEvent, sizeof(lEvent))) {
+            /* Already cleared */
+        }
+        __atomic_store_n(&gCIP[lID].txWriterSleeping, false, __ATOMIC_RELAXED);
+    }
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_txWriter> TX writer stopped.\n");
+
+    return NULL;
+}
 
 cipErrorCode_t CIP_send(const cipID_t pID,
     const uint32_t pCANID,
@@ -34,17 +427,15 @@ cipErrorCode_t CIP_send(const cipID_t pID,
     const uint8_t * const pData,
     const uint32_t pFlags)
 {
-    pthread_mutex_lock(&gCIP.mutex);
-
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_send> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_send> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
     /* Check if the module is already initialized */
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_rxThread> CAN-IP module %u is not initialized.\n", gCIP.cipInstanceID);
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> CAN-IP module %u is not initialized.\n", pID);
         return can_serial_ERROR_NOT_INIT;
     }
 
@@ -59,22 +450,239 @@ cipErrorCode_t CIP_send(const cipID_t pID,
     }
     
     /* Set the random ID in the message */
-    lMsg.randID = gCIP.randID;
+    lMsg.randID = gCIP[pID].randID;
+
+    if(CIP_txQueued(pID)) {
+        return 1U == CIP_txEnqueue(pID, &lMsg, 1U) ? can_serial_ERROR_NONE : can_serial_ERROR_FULL;
+    }
 
-    ssize_t lSentBytes = 0;
+    CIP_txCapture(pID, &lMsg, 1U);
 
-    errno = 0;
-    lSentBytes = sendto(gCIP.canSocket, (const void *)&lMsg, sizeof(cipMessage_t), 0, 
-        (const struct sockaddr *)&gCIP.socketInAddress, sizeof(gCIP.socketInAddress));
-    if(sizeof(cipMessage_t) != lSentBytes) {
-        printf("[ERROR] <CIP_send> sendto failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
+    size_t lSent = 0U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+
+    if(can_serial_TRANSPORT_SERIAL == gCIP[pID].transport) {
+        /* Write the SLCAN frame to the serial port */
+        lErrorCode = CIP_txSendBatch(pID, &lMsg, 1U, NULL, &lSent);
+    } else {
+        /* Report why this message failed (ARG : cannot be encoded) */
+        (void)CIP_txSendBatch(pID, &lMsg, 1U, &lErrorCode, &lSent);
+    }
+
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_sendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendBatch> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendBatch> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(NULL == pMsgs && 0U < pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendBatch> Message array is NULL\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    size_t lSent = 0U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    if(CIP_txQueued(pID)) {
+        lSent = CIP_txEnqueue(pID, pMsgs, pCount);
+        for(size_t i = 0U; NULL != pResults && i < pCount; i++) {
+            pResults[i] = i < lSent ? can_serial_ERROR_NONE : can_serial_ERROR_FULL;
         }
-        return can_serial_ERROR_NET;
+        if(NULL != pSent) {
+            *pSent = lSent;
+        }
+
+        return pCount == lSent ? can_serial_ERROR_NONE : can_serial_ERROR_FULL;
+    }
+
+    CIP_txCapture(pID, pMsgs, pCount);
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+
+    /* Encode all the SLCAN frames and write them at once,
+     * or pack them in datagrams, as fast as the pacing allows */
+    lErrorCode = CIP_txSendBatch(pID, pMsgs, pCount, pResults, &lSent);
+
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    if(NULL != pSent) {
+        *pSent = lSent;
+    }
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_sendFd(const cipID_t pID,
+    const uint32_t pCANID,
+    const uint8_t pSize,
+    const uint8_t * const pData,
+    const uint32_t pFlags)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFd> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFd> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(can_serial_MODE_FD != gCIP[pID].cipMode) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFd> CAN-IP module %u is not in CAN FD mode.\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(CAN_FD_MESSAGE_MAX_SIZE < pSize || (0U < pSize && NULL == pData)) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFd> Invalid CAN FD payload\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Build the CAN FD message, padded to the next CAN FD length */
+    cipFdMessage_t lMsg;
+    memset(lMsg.data, 0, CAN_FD_MESSAGE_MAX_SIZE);
+    lMsg.id     = pCANID;
+    lMsg.size   = CIP_dlcToLength(CIP_lengthToDlc(pSize));
+    lMsg.flags  = pFlags | can_serial_FLAG_FDF;
+    lMsg.randID = gCIP[pID].randID;
+    if(0U < pSize) {
+        memcpy(lMsg.data, pData, pSize);
+    }
+
+    CIP_txCaptureFd(pID, &lMsg, 1U);
+
+    size_t lSent = 0U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+    (void)CIP_udpSendBatch(pID, NULL, &lMsg, 1U, &lErrorCode, &lSent);
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_sendFdBatch(const cipID_t pID,
+    const cipFdMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFdBatch> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[pID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFdBatch> CAN-IP module %u is not initialized.\n", pID);
+        return can_serial_ERROR_NOT_INIT;
+    }
+
+    if(can_serial_MODE_FD != gCIP[pID].cipMode) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFdBatch> CAN-IP module %u is not in CAN FD mode.\n", pID);
+        return can_serial_ERROR_CONFIG;
+    }
+
+    if(NULL == pMsgs && 0U < pCount) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_sendFdBatch> Message array is NULL\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    CIP_txCaptureFd(pID, pMsgs, pCount);
+
+    size_t lSent = 0U;
+
+    pthread_mutex_lock(&gCIP[pID].txMutex);
+    const cipErrorCode_t lErrorCode = CIP_udpSendBatch(pID, NULL, pMsgs, pCount, pResults, &lSent);
+    pthread_mutex_unlock(&gCIP[pID].txMutex);
+
+    if(NULL != pSent) {
+        *pSent = lSent;
+    }
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_startTxWriter(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startTxWriter> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    errno = 0;
+    const int lWakeFd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(0 > lWakeFd) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_startTxWriter> eventfd failed !\n");
+        return can_serial_ERROR_SYS;
+    }
+
+    gCIP[pID].txWriterSleeping = false;
+    gCIP[pID].txWriterStop     = false;
+    gCIP[pID].txWakeFd         = lWakeFd;
+
+    if(0 != pthread_create(&gCIP[pID].txThread, NULL, CIP_txWriter, (void *)(uintptr_t)pID)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startTxWriter> Thread creation failed\n");
+        gCIP[pID].txWakeFd = -1;
+        (void)close(lWakeFd);
+        return can_serial_ERROR_SYS;
+    }
+    gCIP[pID].txWriterOn = true;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_stopTxWriter(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stopTxWriter> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(!CIP_txQueued(pID)) {
+        return can_serial_ERROR_NONE;
+    }
+
+    /* The writer empties the queue before it sees the stop */
+    __atomic_store_n(&gCIP[pID].txWriterStop, true, __ATOMIC_RELEASE);
+
+    const uint64_t lEvent = 1U;
+    errno = 0;
+    if(sizeof(lEvent) != write(gCIP[pID].txWakeFd, &lEvent, sizeof(lEvent))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_stopTxWriter> eventfd write failed !\n");
+        return can_serial_ERROR_SYS;
+    }
+
+    if(0 != pthread_join(gCIP[pID].txThread, NULL)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_stopTxWriter> pthread_join failed\n");
+        return can_serial_ERROR_SYS;
     }
+    gCIP[pID].txWriterOn = false;
 
-    pthread_mutex_unlock(&gCIP.mutex);
+    (void)close(gCIP[pID].txWakeFd);
+    gCIP[pID].txWakeFd = -1;
 
     return can_serial_ERROR_NONE;
 }
@@ -0,0 +1,333 @@
+/**
+ * @brief CAN over serial serial port management functions
+ * SLCAN (Lawicel) frames over a raw tty.
+ *
+ * @file can_serial_serial_mgt.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial_serial_mgt.h"
+#include "can_serial_slcan.h"
+#include "can_serial_log.h"
+
+/* Serial headers */
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <poll.h>
+
+/* C system */
+#include <unistd.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* Defines --------------------------------------------- */
+#define SLCAN_CLOSE_CHANNEL "C\r"
+#define SLCAN_OPEN_CHANNEL  "O\r"
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipBaudrate {
+    uint32_t baudrate;
+    speed_t  speed;
+} cipBaudrate_t;
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+static const cipBaudrate_t sBaudrates[] = {
+    {9600U,    B9600},
+    {19200U,   B19200},
+    {38400U,   B38400},
+    {57600U,   B57600},
+    {115200U,  B115200},
+    {230400U,  B230400},
+    {460800U,  B460800},
+    {500000U,  B500000},
+    {921600U,  B921600},
+    {1000000U, B1000000},
+    {2000000U, B2000000},
+    {3000000U, B3000000},
+    {4000000U, B4000000}
+};
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Support functions ----------------------------------- */
+static bool baudrateToSpeed(const uint32_t pBaudrate, speed_t * const pSpeed) {
+    for(size_t i = 0U; i < sizeof(sBaudrates) / sizeof(sBaudrates[0U]); i++) {
+        if(pBaudrate == sBaudrates[i].baudrate) {
+            *pSpeed = sBaudrates[i].speed;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Writes the whole buffer, waiting for the tty to drain when it is full.
+ * Returns the number of characters written. */
+static size_t serialWrite(const cipID_t pID, const char * const pBuf, const size_t pLen) {
+    size_t lWritten = 0U;
+
+    while(lWritten < pLen) {
+        errno = 0;
+        const ssize_t lResult = write(gCIP[pID].canSocket, &pBuf[lWritten], pLen - lWritten);
+        if(0 <= lResult) {
+            lWritten += (size_t)lResult;
+            continue;
+        }
+
+        if(EINTR == errno) {
+            continue;
+        }
+
+        if(EAGAIN != errno && EWOULDBLOCK != errno) {
+            CIP_statsTxErrno(&gCIP[pID].txStats, errno);
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_serialSendBatch> write failed !\n");
+            break;
+        }
+
+        /* The tty output queue is full */
+        struct pollfd lFd = {.fd = gCIP[pID].canSocket, .events = POLLOUT, .revents = 0};
+        if(0 >= poll(&lFd, 1U, can_serial_SERIAL_TX_TIMEOUT_MS)) {
+            CIP_statsTxErrno(&gCIP[pID].txStats, ETIMEDOUT);
+            CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_serialSendBatch> Serial port is not draining\n");
+            break;
+        }
+    }
+
+    return lWritten;
+}
+
+/* Serial port management functions -------------------- */
+cipErrorCode_t CIP_initSerialPort(const cipID_t pID) {
+    speed_t lSpeed = B0;
+    if(!baudrateToSpeed(gCIP[pID].serialBaudrate, &lSpeed)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerialPort> Unsupported baudrate %u\n", gCIP[pID].serialBaudrate);
+        return can_serial_ERROR_ARG;
+    }
+
+    CIP_LOG(can_serial_LOG_DEBUG, "<CIP_initSerialPort> Device   = %s\n", gCIP[pID].serialDevice);
+    CIP_LOG(can_serial_LOG_DEBUG, "<CIP_initSerialPort> Baudrate = %u\n", gCIP[pID].serialBaudrate);
+
+    /* Non-blocking, the RX thread polls the fd */
+    errno = 0;
+    if(0 > (gCIP[pID].canSocket = open(gCIP[pID].serialDevice, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initSerialPort> open failed !\n");
+        return can_serial_ERROR_NET;
+    }
+
+    /* We are the only user of this adapter */
+    (void)ioctl(gCIP[pID].canSocket, TIOCEXCL);
+
+    struct termios lTermios;
+    if(0 > tcgetattr(gCIP[pID].canSocket, &lTermios)) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initSerialPort> tcgetattr failed !\n");
+        (void)close(gCIP[pID].canSocket);
+        return can_serial_ERROR_NET;
+    }
+
+    /* Raw 8N1, no flow control, no echo, no line discipline processing */
+    cfmakeraw(&lTermios);
+    lTermios.c_cflag |= CLOCAL | CREAD;
+    lTermios.c_cflag &= ~(CSTOPB | CRTSCTS);
+    lTermios.c_iflag &= ~(IXON | IXOFF | IXANY);
+
+    /* read() returns whatever is in the buffer at once,
+     * the RX thread only calls it when poll says there is data */
+    lTermios.c_cc[VMIN]  = 0U;
+    lTermios.c_cc[VTIME] = 0U;
+
+    if(0 > cfsetispeed(&lTermios, lSpeed)
+        || 0 > cfsetospeed(&lTermios, lSpeed)
+        || 0 > tcsetattr(gCIP[pID].canSocket, TCSANOW, &lTermios))
+    {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initSerialPort> Failed to configure the serial port !\n");
+        (void)close(gCIP[pID].canSocket);
+        return can_serial_ERROR_NET;
+    }
+
+    /* Low latency mode, so that USB-serial drivers push data to us
+     * without waiting for their latency timer (not all drivers support it) */
+    struct serial_struct lSerial;
+    if(0 == ioctl(gCIP[pID].canSocket, TIOCGSERIAL, &lSerial)) {
+        lSerial.flags |= ASYNC_LOW_LATENCY;
+        (void)ioctl(gCIP[pID].canSocket, TIOCSSERIAL, &lSerial);
+    }
+
+    (void)tcflush(gCIP[pID].canSocket, TCIOFLUSH);
+    gCIP[pID].serialRxLen = 0U;
+
+    /* (Re)open the CAN channel of the adapter */
+    const char lOpen[] = SLCAN_CLOSE_CHANNEL SLCAN_OPEN_CHANNEL;
+    if(sizeof(lOpen) - 1U != serialWrite(pID, lOpen, sizeof(lOpen) - 1U)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_initSerialPort> Failed to open the CAN channel\n");
+        (void)close(gCIP[pID].canSocket);
+        return can_serial_ERROR_NET;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_closeSerialPort(const cipID_t pID) {
+    /* Close the CAN channel, the adapter may already be gone */
+    (void)serialWrite(pID, SLCAN_CLOSE_CHANNEL, sizeof(SLCAN_CLOSE_CHANNEL) - 1U);
+
+    errno = 0;
+    if(0 > close(gCIP[pID].canSocket)) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_closeSerialPort> close failed !\n");
+        return can_serial_ERROR_NET;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_serialRecvBatch(const cipID_t pID,
+    cipMessage_t * const pMsgs,
+    const size_t pMax,
+    size_t * const pCount)
+{
+    char * const lBuf = gCIP[pID].serialRxBuf;
+    bool lDrained = false;
+
+    /* Counted locally, published once per call */
+    size_t lBytes    = 0U;
+    size_t lFiltered = 0U;
+    size_t lBad      = 0U;
+    size_t lEagain   = 0U;
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    *pCount = 0U;
+
+    for(;;) {
+        /* Decode the complete frames, keep the partial one for later */
+        size_t lConsumed = 0U;
+        const size_t lParsed = CIP_slcanParse(lBuf, gCIP[pID].serialRxLen, pMsgs + *pCount, pMax - *pCount, &lConsumed);
+
+        /* Keep the frames the acceptance filters let through */
+        const size_t lEnd = *pCount + lParsed;
+        for(size_t i = *pCount; i < lEnd; i++) {
+            if(CIP_filterAccept(&gCIP[pID].filters, pMsgs[i].id, pMsgs[i].flags)) {
+                pMsgs[i].timestamp = gCIP[pID].serialRxStamp;
+                lBytes += pMsgs[i].size;
+                pMsgs[(*pCount)++] = pMsgs[i];
+            } else {
+                lFiltered++;
+            }
+        }
+        if(0U < lConsumed) {
+            gCIP[pID].serialRxLen -= lConsumed;
+            memmove(lBuf, &lBuf[lConsumed], gCIP[pID].serialRxLen);
+        }
+
+        if(pMax <= *pCount || lDrained) {
+            break;
+        }
+
+        if(can_serial_SERIAL_RX_BUFFER_SIZE == gCIP[pID].serialRxLen) {
+            /* No frame is that long, drop the garbage */
+            CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_serialRecvBatch> Dropped %u characters w/o frame end\n", can_serial_SERIAL_RX_BUFFER_SIZE);
+            gCIP[pID].serialRxLen = 0U;
+            lBad++;
+        }
+
+        /* Read as much as possible at once */
+        const size_t lFree = can_serial_SERIAL_RX_BUFFER_SIZE - gCIP[pID].serialRxLen;
+        errno = 0;
+        const ssize_t lRead = read(gCIP[pID].canSocket, &lBuf[gCIP[pID].serialRxLen], lFree);
+        if(0 > lRead) {
+            if(EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+                lEagain++;
+                break;
+            }
+
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_serialRecvBatch> read failed !\n");
+            lErrorCode = can_serial_ERROR_NET;
+            break;
+        } else if(0 == lRead) {
+            /* Nothing to read */
+            lEagain++;
+            break;
+        }
+
+        gCIP[pID].serialRxLen  += (size_t)lRead;
+        gCIP[pID].serialRxStamp = CIP_realtimeNs();
+
+        /* A short read means the tty is empty, decode and stop */
+        lDrained = (size_t)lRead < lFree;
+    }
+
+    cipRxCounters_t * const lStats = &gCIP[pID].rxStats;
+    CIP_STATS_ADD(*lStats, rxFrames,       *pCount);
+    CIP_STATS_ADD(*lStats, rxBytes,        lBytes);
+    CIP_STATS_ADD(*lStats, filteredFrames, lFiltered);
+    CIP_STATS_ADD(*lStats, badDatagrams,   lBad);
+    CIP_STATS_ADD(*lStats, eagainSpins,    lEagain);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_serialSendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent)
+{
+    char   lBuf[can_serial_TX_BATCH_SIZE * can_serial_SLCAN_MAX_FRAME_LEN];
+    size_t lEnds[can_serial_TX_BATCH_SIZE];
+
+    size_t lSent  = 0U;
+    size_t lBytes = 0U;
+
+    for(size_t lBase = 0U; lBase < pCount; lBase += can_serial_TX_BATCH_SIZE) {
+        const size_t lChunk = (pCount - lBase) < can_serial_TX_BATCH_SIZE ? (pCount - lBase) : can_serial_TX_BATCH_SIZE;
+
+        /* Encode the whole chunk, then write it at once */
+        size_t lLen = 0U;
+        for(size_t i = 0U; i < lChunk; i++) {
+            const size_t lFrameLen = CIP_slcanEncode(&pMsgs[lBase + i], &lBuf[lLen]);
+            if(0U == lFrameLen) {
+                CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_serialSendBatch> Message %zu cannot be encoded\n", lBase + i);
+            }
+            lLen    += lFrameLen;
+            lEnds[i] = 0U == lFrameLen ? 0U : lLen; /* 0 : invalid message */
+        }
+
+        const size_t lWritten = serialWrite(pID, lBuf, lLen);
+        if(gCIP[pID].txTimestamping && 0U < lWritten) {
+            gCIP[pID].txTimestamp = CIP_realtimeNs();
+        }
+
+        for(size_t i = 0U; i < lChunk; i++) {
+            cipErrorCode_t lResult = can_serial_ERROR_NONE;
+            if(0U == lEnds[i]) {
+                lResult = can_serial_ERROR_ARG;
+            } else if(lWritten < lEnds[i]) {
+                lResult = can_serial_ERROR_NET;
+            } else {
+                lSent++;
+                lBytes += pMsgs[lBase + i].size;
+            }
+
+            if(NULL != pResults) {
+                pResults[lBase + i] = lResult;
+            }
+        }
+    }
+
+    CIP_STATS_ADD(gCIP[pID].txStats, txFrames,   lSent);
+    CIP_STATS_ADD(gCIP[pID].txStats, txBytes,    lBytes);
+    CIP_STATS_ADD(gCIP[pID].txStats, txFailures, pCount - lSent);
+
+    *pSent = lSent;
+
+    return pCount == lSent ? can_serial_ERROR_NONE : can_serial_ERROR_NET;
+}
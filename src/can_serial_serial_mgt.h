@@ -0,0 +1,39 @@
+/**
+ * @brief CAN over serial serial port management functions
+ * 
+ * @file can_serial_serial_mgt.h
+ */
+
+#ifndef can_serial_SERIAL_MGT_H
+#define can_serial_SERIAL_MGT_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Serial port management functions -------------------- */
+cipErrorCode_t CIP_initSerialPort(const cipID_t pID);
+cipErrorCode_t CIP_closeSerialPort(const cipID_t pID);
+
+/* Must be called w/ the module RX mutex locked */
+cipErrorCode_t CIP_serialRecvBatch(const cipID_t pID,
+    cipMessage_t * const pMsgs,
+    const size_t pMax,
+    size_t * const pCount);
+
+/* Must be called w/ the module TX mutex locked */
+cipErrorCode_t CIP_serialSendBatch(const cipID_t pID,
+    const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    cipErrorCode_t * const pResults,
+    size_t * const pSent);
+
+#endif /* can_serial_SERIAL_MGT_H */
@@ -0,0 +1,301 @@
+/**
+ * @brief CAN over serial SLCAN (Lawicel) ASCII codec
+ * Table-driven, w/ SSE2 kernels for the hex data fields
+ * and a scalar fallback.
+ * 
+ * @file can_serial_slcan.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_slcan.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+/* Defines --------------------------------------------- */
+#define SLCAN_STD_ID_LEN 3U
+#define SLCAN_EXT_ID_LEN 8U
+#define SLCAN_TIMESTAMP_LEN 4U
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+static const char sHexDigits[16U] = "0123456789ABCDEF";
+
+/* Frame type, indexed by (RTR << 1) | EFF */
+static const char sFrameTypes[4U] = {'t', 'T', 'r', 'R'};
+
+/* Two hex characters per byte value */
+static const char sHexPairs[2U * 256U + 1U] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/* Nibble value per character, 0xFF if not a hex digit */
+static const uint8_t sHexValues[256U] = {
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0x00U, 0x01U, 0x02U, 0x03U, 0x04U, 0x05U, 0x06U, 0x07U, 0x08U, 0x09U, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU
+};
+
+/* Support functions ----------------------------------- */
+/* Decodes pLen hex characters, returns false on a non-hex character */
+static inline bool hexToU32(const char * const pHex, const size_t pLen, uint32_t * const pValue) {
+    uint32_t lValue = 0U;
+    uint8_t  lBad   = 0U;
+    for(size_t i = 0U; i < pLen; i++) {
+        const uint8_t lNibble = sHexValues[(uint8_t)pHex[i]];
+        lBad  |= lNibble;
+        lValue = (lValue << 4U) | (lNibble & 0xFU);
+    }
+
+    *pValue = lValue;
+
+    return 0U == (lBad & 0xF0U);
+}
+
+/* Encodes the 8 data bytes (CAN_MESSAGE_MAX_SIZE) as 16 hex characters,
+ * the caller only keeps the 2 * size first ones */
+static inline void hexEncodeData(const uint8_t * const pData, char * const pOut) {
+#if defined(__SSE2__)
+    const __m128i lBytes = _mm_loadl_epi64((const __m128i *)pData);
+    const __m128i lMask  = _mm_set1_epi8(0x0F);
+    const __m128i lHi    = _mm_and_si128(_mm_srli_epi16(lBytes, 4), lMask);
+    const __m128i lLo    = _mm_and_si128(lBytes, lMask);
+
+    /* hi0 lo0 hi1 lo1 ... then '0' + n, + 7 more for 'A'-'F' */
+    const __m128i lNibbles = _mm_unpacklo_epi8(lHi, lLo);
+    const __m128i lLetters = _mm_and_si128(_mm_cmpgt_epi8(lNibbles, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+    const __m128i lASCII   = _mm_add_epi8(_mm_add_epi8(lNibbles, _mm_set1_epi8('0')), lLetters);
+
+    _mm_storeu_si128((__m128i *)pOut, lASCII);
+#else /* __SSE2__ */
+    for(size_t i = 0U; i < CAN_MESSAGE_MAX_SIZE; i++) {
+        memcpy(&pOut[2U * i], &sHexPairs[2U * pData[i]], 2U);
+    }
+#endif /* __SSE2__ */
+}
+
+/* Decodes 2 * pSize hex characters into pSize bytes, returns false on a non-hex character */
+static inline bool hexDecodeData(const char * const pIn, const uint8_t pSize, uint8_t * const pData) {
+#if defined(__SSE2__)
+    if(CAN_MESSAGE_MAX_SIZE == pSize) {
+        const __m128i lChars = _mm_loadu_si128((const __m128i *)pIn);
+        const __m128i lLower = _mm_or_si128(lChars, _mm_set1_epi8(0x20));
+
+        const __m128i lIsDigit = _mm_and_si128(_mm_cmpgt_epi8(lChars, _mm_set1_epi8('0' - 1)),
+            _mm_cmplt_epi8(lChars, _mm_set1_epi8('9' + 1)));
+        const __m128i lIsAlpha = _mm_and_si128(_mm_cmpgt_epi8(lLower, _mm_set1_epi8('a' - 1)),
+            _mm_cmplt_epi8(lLower, _mm_set1_epi8('f' + 1)));
+        if(0xFFFF != _mm_movemask_epi8(_mm_or_si128(lIsDigit, lIsAlpha))) {
+            return false;
+        }
+
+        const __m128i lNibbles = _mm_or_si128(
+            _mm_and_si128(lIsDigit, _mm_sub_epi8(lChars, _mm_set1_epi8('0'))),
+            _mm_andnot_si128(lIsDigit, _mm_sub_epi8(lLower, _mm_set1_epi8('a' - 10))));
+
+        /* Each 16 bit lane holds (low nibble << 8) | high nibble */
+        const __m128i lHi    = _mm_and_si128(lNibbles, _mm_set1_epi16(0x00FF));
+        const __m128i lLo    = _mm_srli_epi16(lNibbles, 8);
+        const __m128i lBytes = _mm_or_si128(_mm_slli_epi16(lHi, 4), lLo);
+
+        _mm_storel_epi64((__m128i *)pData, _mm_packus_epi16(lBytes, lBytes));
+
+        return true;
+    }
+#endif /* __SSE2__ */
+
+    uint8_t lBad = 0U;
+    for(uint8_t i = 0U; i < pSize; i++) {
+        const uint8_t lHi = sHexValues[(uint8_t)pIn[2U * i]];
+        const uint8_t lLo = sHexValues[(uint8_t)pIn[2U * i + 1U]];
+        lBad    |= lHi | lLo;
+        pData[i] = (uint8_t)((lHi << 4U) | (lLo & 0xFU));
+    }
+
+    return 0U == (lBad & 0xF0U);
+}
+
+/* SLCAN codec functions ------------------------------- */
+size_t CIP_slcanEncode(const cipMessage_t * const pMsg, char * const pBuf) {
+    if(CAN_MESSAGE_MAX_SIZE < pMsg->size) {
+        return 0U;
+    }
+
+    const bool lExtended = (0U != (pMsg->flags & can_serial_FLAG_EFF)) || (0x7FFU < pMsg->id);
+    const bool lRemote   = 0U != (pMsg->flags & can_serial_FLAG_RTR);
+
+    size_t lPos = 0U;
+    pBuf[lPos++] = sFrameTypes[(lRemote ? 2U : 0U) | (lExtended ? 1U : 0U)];
+
+    if(lExtended) {
+        memcpy(&pBuf[lPos + 0U], &sHexPairs[2U * ((pMsg->id >> 24U) & 0x1FU)], 2U);
+        memcpy(&pBuf[lPos + 2U], &sHexPairs[2U * ((pMsg->id >> 16U) & 0xFFU)], 2U);
+        memcpy(&pBuf[lPos + 4U], &sHexPairs[2U * ((pMsg->id >> 8U) & 0xFFU)], 2U);
+        memcpy(&pBuf[lPos + 6U], &sHexPairs[2U * (pMsg->id & 0xFFU)], 2U);
+        lPos += SLCAN_EXT_ID_LEN;
+    } else {
+        pBuf[lPos] = sHexDigits[(pMsg->id >> 8U) & 0x7U];
+        memcpy(&pBuf[lPos + 1U], &sHexPairs[2U * (pMsg->id & 0xFFU)], 2U);
+        lPos += SLCAN_STD_ID_LEN;
+    }
+
+    pBuf[lPos++] = sHexDigits[pMsg->size];
+
+    if(!lRemote) {
+        /* Writes 16 characters, there is always room for them */
+        hexEncodeData(pMsg->data, &pBuf[lPos]);
+        lPos += 2U * pMsg->size;
+    }
+
+    pBuf[lPos++] = '\r';
+
+    return lPos;
+}
+
+size_t CIP_slcanEncodeBatch(const cipMessage_t * const pMsgs,
+    const size_t pCount,
+    char * const pBuf,
+    const size_t pCap,
+    size_t * const pLen)
+{
+    size_t lPos = 0U;
+    size_t i    = 0U;
+
+    for(; i < pCount && can_serial_SLCAN_MAX_FRAME_LEN <= pCap - lPos; i++) {
+        const size_t lFrameLen = CIP_slcanEncode(&pMsgs[i], &pBuf[lPos]);
+        if(0U == lFrameLen) {
+            break;
+        }
+        lPos += lFrameLen;
+    }
+
+    *pLen = lPos;
+
+    return i;
+}
+
+cipErrorCode_t CIP_slcanDecode(const char * const pLine, const size_t pLen, cipMessage_t * const pMsg) {
+    if(0U == pLen) {
+        return can_serial_ERROR_ARG;
+    }
+
+    bool lExtended = false;
+    bool lRemote   = false;
+    switch(pLine[0U]) {
+        case 't':
+            break;
+        case 'T':
+            lExtended = true;
+            break;
+        case 'r':
+            lRemote = true;
+            break;
+        case 'R':
+            lExtended = true;
+            lRemote   = true;
+            break;
+        default:
+            /* Not a CAN frame */
+            return can_serial_ERROR_ARG;
+    }
+
+    const size_t lIDLen = lExtended ? SLCAN_EXT_ID_LEN : SLCAN_STD_ID_LEN;
+    if(pLen < 1U + lIDLen + 1U) {
+        return can_serial_ERROR_ARG;
+    }
+
+    uint32_t lID  = 0U;
+    uint32_t lDLC = 0U;
+    if(!hexToU32(&pLine[1U], lIDLen, &lID)
+        || !hexToU32(&pLine[1U + lIDLen], 1U, &lDLC)
+        || CAN_MESSAGE_MAX_SIZE < lDLC)
+    {
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Data, then an optional timestamp */
+    const size_t lDataPos = 1U + lIDLen + 1U;
+    const size_t lDataLen = lRemote ? 0U : 2U * lDLC;
+    if(pLen != lDataPos + lDataLen && pLen != lDataPos + lDataLen + SLCAN_TIMESTAMP_LEN) {
+        return can_serial_ERROR_ARG;
+    }
+
+    memset(pMsg, 0, sizeof(cipMessage_t));
+    if(!hexDecodeData(&pLine[lDataPos], (uint8_t)(lDataLen / 2U), pMsg->data)) {
+        return can_serial_ERROR_ARG;
+    }
+
+    pMsg->id    = lID;
+    pMsg->size  = (uint8_t)lDLC;
+    pMsg->flags = (lExtended ? can_serial_FLAG_EFF : 0U) | (lRemote ? can_serial_FLAG_RTR : 0U);
+
+    return can_serial_ERROR_NONE;
+}
+
+size_t CIP_slcanParse(const char * const pBuf,
+    const size_t pLen,
+    cipMessage_t * const pMsgs,
+    const size_t pMax,
+    size_t * const pConsumed)
+{
+    size_t lCount = 0U;
+    size_t lPos   = 0U;
+
+    while(lCount < pMax && lPos < pLen) {
+        /* Error bells are not terminated by '\r' */
+        if('\a' == pBuf[lPos]) {
+            lPos++;
+            continue;
+        }
+
+        const char * const lEnd = (const char *)memchr(&pBuf[lPos], '\r', pLen - lPos);
+        if(NULL == lEnd) {
+            /* Partial frame, wait for the rest */
+            break;
+        }
+
+        const size_t lLineLen = (size_t)(lEnd - &pBuf[lPos]);
+
+        /* Skip the acknowledges ("", "z", "Z") and bad lines,
+         * the stream resynchronises on the next '\r' */
+        if(can_serial_ERROR_NONE == CIP_slcanDecode(&pBuf[lPos], lLineLen, &pMsgs[lCount])) {
+            lCount++;
+        }
+
+        lPos += lLineLen + 1U;
+    }
+
+    *pConsumed = lPos;
+
+    return lCount;
+}
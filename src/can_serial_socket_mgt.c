@@ -7,6 +7,8 @@
 /* Includes -------------------------------------------- */
 #include "can_serial_private.h"
 #include "can_serial_error_codes.h"
+#include "can_serial_socket_mgt.h"
+#include "can_serial_log.h"
 
 /* Networking headers */
 #include <sys/types.h>
@@ -16,6 +18,7 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <linux/net_tstamp.h>
 
 /* C system */
 #include <unistd.h>
@@ -28,6 +31,12 @@
 #include <errno.h>
 
 /* Defines --------------------------------------------- */
+/* Software timestamps, raw hardware ones when the NIC is set up for it */
+#define RX_TIMESTAMPING_FLAGS (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE \
+    | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE)
+
+/* Only the timestamp comes back on the error queue, not the datagram */
+#define TX_TIMESTAMPING_FLAGS (SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY)
 
 /* Type definitions ------------------------------------ */
 
@@ -36,7 +45,7 @@
 /* Static variables ------------------------------------ */
 
 /* Extern variables ------------------------------------ */
-extern cipInternalStruct_t gCIP;
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
 
 /* Socket management functions ------------------------- */
 static cipErrorCode_t listNetItfs(void) {
@@ -44,10 +53,7 @@ static cipErrorCode_t listNetItfs(void) {
     struct ifaddrs *lIfAddrs = NULL;
 
     if(0 > getifaddrs(&lIfAddrs)) {
-        printf("[ERROR] <CIP_initcanSocket> getifaddrs failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> getifaddrs failed !\n");
 
         return can_serial_ERROR_NET;
     }
@@ -58,7 +64,7 @@ static cipErrorCode_t listNetItfs(void) {
         if (lTmpIfAddr->ifa_addr && lTmpIfAddr->ifa_addr->sa_family == PF_INET)
         {
             struct sockaddr_in *pAddr = (struct sockaddr_in *)lTmpIfAddr->ifa_addr;
-            printf("%s: %s\n", lTmpIfAddr->ifa_name, inet_ntoa(pAddr->sin_addr));
+            CIP_LOG(can_serial_LOG_INFO, "%s: %s\n", lTmpIfAddr->ifa_name, inet_ntoa(pAddr->sin_addr));
         }
 
         lTmpIfAddr = lTmpIfAddr->ifa_next;
@@ -70,24 +76,19 @@ static cipErrorCode_t listNetItfs(void) {
 }
 
 cipErrorCode_t CIP_initCanSocket(const cipID_t pID) {
-    (void) pID;
-
     /* Construct local address structure */
-    gCIP.socketInAddress.sin_family         = PF_INET;
-    gCIP.socketInAddress.sin_port           = htons(gCIP.canPort);
-    // gCIP.socketInAddress.sin_addr.s_addr    = inet_addr(gCIP.canIP);
-    gCIP.socketInAddress.sin_addr.s_addr    = INADDR_ANY; /* Set it to INADDR_ANY to bind */
+    gCIP[pID].socketInAddress.sin_family         = PF_INET;
+    gCIP[pID].socketInAddress.sin_port           = htons(gCIP[pID].canPort);
+    // gCIP[pID].socketInAddress.sin_addr.s_addr    = inet_addr(gCIP[pID].canIP);
+    gCIP[pID].socketInAddress.sin_addr.s_addr    = INADDR_ANY; /* Set it to INADDR_ANY to bind */
 
-    printf("[DEBUG] <CIP_initcanSocket> IPAddr = %s\n", gCIP.canIP);
-    printf("[DEBUG] <CIP_initcanSocket> Port   = %d\n", gCIP.canPort);
+    CIP_LOG(can_serial_LOG_DEBUG, "<CIP_initcanSocket> IPAddr = %s\n", gCIP[pID].canIP);
+    CIP_LOG(can_serial_LOG_DEBUG, "<CIP_initcanSocket> Port   = %d\n", gCIP[pID].canPort);
     
     /* Create the UDP socket (DGRAM for UDP */
     errno = 0;
-    if(0 > (gCIP.canSocket = socket(gCIP.socketInAddress.sin_family, SOCK_DGRAM, IPPROTO_IP))) {
-        printf("[ERROR] <CIP_initcanSocket> socket failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > (gCIP[pID].canSocket = socket(gCIP[pID].socketInAddress.sin_family, SOCK_DGRAM, IPPROTO_IP))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> socket failed !\n");
 
         return can_serial_ERROR_NET;
     }
@@ -97,49 +98,34 @@ cipErrorCode_t CIP_initCanSocket(const cipID_t pID) {
 
     /* Configure the socket for broadcast */
     const int lBroadcastPermission = 1;
-    if(0 > setsockopt(gCIP.canSocket, SOL_SOCKET, SO_BROADCAST, (const void *)&lBroadcastPermission, sizeof(lBroadcastPermission))) {
-        printf("[ERROR] <CIP_initcanSocket> setsockopt SO_BROADCAST failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_BROADCAST, (const void *)&lBroadcastPermission, sizeof(lBroadcastPermission))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> setsockopt SO_BROADCAST failed !\n");
         return can_serial_ERROR_NET;
     }
 
     /* Set the address to be reusable */
     int lEnable = 1;
-    if(0 > setsockopt(gCIP.canSocket, SOL_SOCKET, SO_REUSEADDR, (const void *)&lEnable, sizeof(lEnable))) {
-        printf("[ERROR] <CIP_initcanSocket> setsockopt SO_REUSEADDR failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_REUSEADDR, (const void *)&lEnable, sizeof(lEnable))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> setsockopt SO_REUSEADDR failed !\n");
         return can_serial_ERROR_NET;
     }
 
     /* Set the port to be reusable */
-    if(0 > setsockopt(gCIP.canSocket, SOL_SOCKET, SO_REUSEPORT, (const void *)&lEnable, sizeof(lEnable))) {
-        printf("[ERROR] <CIP_initcanSocket> setsockopt SO_REUSEPORT failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_REUSEPORT, (const void *)&lEnable, sizeof(lEnable))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> setsockopt SO_REUSEPORT failed !\n");
         return can_serial_ERROR_NET;
     }
 
     /* Set the socket as non-blocking */
     int lFlags = 0;
-    if(0 > (lFlags = fcntl(gCIP.canSocket, F_GETFL))) {
-        printf("[ERROR] <CIP_initcanSocket> fcntl F_GETFL failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > (lFlags = fcntl(gCIP[pID].canSocket, F_GETFL))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> fcntl F_GETFL failed !\n");
         return can_serial_ERROR_NET;
     }
 
     lFlags |= O_NONBLOCK;
-    if(0 > fcntl(gCIP.canSocket, F_SETFL, lFlags)) {
-        printf("[ERROR] <CIP_initcanSocket> fcntl F_SETFL failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > fcntl(gCIP[pID].canSocket, F_SETFL, lFlags)) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> fcntl F_SETFL failed !\n");
         return can_serial_ERROR_NET;
     }
 
@@ -151,48 +137,144 @@ cipErrorCode_t CIP_initCanSocket(const cipID_t pID) {
     // };
 
     // char lPortStr[16U] = "";
-    // if(0 > snprintf(lPortStr, 16U, "%d", gCIP.canPort)) {
+    // if(0 > snprintf(lPortStr, 16U, "%d", gCIP[pID].canPort)) {
     //     printf("[ERROR] <CIP_initcanSocket> snprintf for port failed !\n");
     //     return can_serial_ERROR_SYS;
     // }
 
-    // int lFctReturn = getaddrinfo(gCIP.canIP, lPortStr, &lHints, &gCIP.addrinfo);
-    // if(0 != lFctReturn || NULL == gCIP.addrinfo) {
+    // int lFctReturn = getaddrinfo(gCIP[pID].canIP, lPortStr, &lHints, &gCIP[pID].addrinfo);
+    // if(0 != lFctReturn || NULL == gCIP[pID].addrinfo) {
     //     printf("[ERROR] <CIP_initcanSocket> getaddrinfo failed !\n");
-    //     printf("        Invalid address (%s) or port (%d)\n", gCIP.canIP, gCIP.canPort);
+    //     printf("        Invalid address (%s) or port (%d)\n", gCIP[pID].canIP, gCIP[pID].canPort);
     //     return can_serial_ERROR_NET;
     // }
 
+    if(can_serial_ERROR_NONE != CIP_setSocketTimestamping(pID)) {
+        return can_serial_ERROR_NET;
+    }
+
+    /* Filter before binding, so that no unfiltered datagram gets queued */
+    if(can_serial_ERROR_NONE != CIP_attachSocketFilter(pID)) {
+        return can_serial_ERROR_NET;
+    }
+
     /* Bind socket for reception */
     errno = 0;
-    if(0 > bind(gCIP.canSocket, (struct sockaddr *)&gCIP.socketInAddress, sizeof(gCIP.socketInAddress))) {
-        printf("[ERROR] <CIP_initcanSocket> bind failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > bind(gCIP[pID].canSocket, (struct sockaddr *)&gCIP[pID].socketInAddress, sizeof(gCIP[pID].socketInAddress))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> bind failed !\n");
         return can_serial_ERROR_NET;
     }
 
     /* Set the sockInAddress to the specified broadcast address for sending */
-    gCIP.socketInAddress.sin_addr.s_addr = inet_addr("255.255.255.255");
-    //printf("[DEBUG] socketInAddress.sin_addr.s_addr = %ld\n", gCIP.socketInAddress.sin_addr.s_addr);
+    gCIP[pID].socketInAddress.sin_addr.s_addr = inet_addr("255.255.255.255");
+    //printf("[DEBUG] socketInAddress.sin_addr.s_addr = %ld\n", gCIP[pID].socketInAddress.sin_addr.s_addr);
 
     /* Socket initialized */
     return can_serial_ERROR_NONE;
 }
 
 cipErrorCode_t CIP_closeSocket(const cipID_t pID) {
-    (void)pID;
-
     /* Close the socket */
     errno = 0;
-    if(0 > close(gCIP.canSocket)) {
-        printf("[ERROR] <CIP_initcanSocket> close failed !\n");
-        if(0 != errno) {
-            printf("        errno = %d (%s)\n", errno, strerror(errno));
-        }
+    if(0 > close(gCIP[pID].canSocket)) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_initcanSocket> close failed !\n");
+        return can_serial_ERROR_NET;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_attachSocketFilter(const cipID_t pID) {
+    struct sock_filter lProg[can_serial_BPF_MAX_INSNS];
+
+    /* Loopback check and acceptance filters */
+    const size_t lLen = CIP_filterBuildBpf(&gCIP[pID].filters, gCIP[pID].randID, lProg, can_serial_BPF_MAX_INSNS);
+    if(0U == lLen) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_attachSocketFilter> Failed to build the socket filter\n");
+        return can_serial_ERROR_CONFIG;
+    }
+
+    const struct sock_fprog lFprog = {.len = (unsigned short)lLen, .filter = lProg};
+
+    errno = 0;
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_ATTACH_FILTER, (const void *)&lFprog, sizeof(lFprog))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_attachSocketFilter> setsockopt SO_ATTACH_FILTER failed !\n");
         return can_serial_ERROR_NET;
     }
 
     return can_serial_ERROR_NONE;
 }
+
+cipErrorCode_t CIP_setSocketTimestamping(const cipID_t pID) {
+    /* Nanosecond RX timestamps, always available */
+    const int lEnable = 1;
+    errno = 0;
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_TIMESTAMPNS, (const void *)&lEnable, sizeof(lEnable))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_setSocketTimestamping> setsockopt SO_TIMESTAMPNS failed !\n");
+        return can_serial_ERROR_NET;
+    }
+
+    /* Hardware RX and TX timestamps need SO_TIMESTAMPING */
+    const int lFlags = RX_TIMESTAMPING_FLAGS | (gCIP[pID].txTimestamping ? TX_TIMESTAMPING_FLAGS : 0);
+    errno = 0;
+    if(0 > setsockopt(gCIP[pID].canSocket, SOL_SOCKET, SO_TIMESTAMPING, (const void *)&lFlags, sizeof(lFlags))) {
+        if(gCIP[pID].txTimestamping) {
+            CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_setSocketTimestamping> setsockopt SO_TIMESTAMPING failed !\n");
+            return can_serial_ERROR_NET;
+        }
+
+        CIP_LOG(can_serial_LOG_INFO, "<CIP_setSocketTimestamping> SO_TIMESTAMPING is not available, using SO_TIMESTAMPNS\n");
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+uint64_t CIP_cmsgTimestamp(const struct msghdr * const pHdr) {
+    uint64_t lSoftware = 0U;
+
+    for(struct cmsghdr *lCmsg = CMSG_FIRSTHDR(pHdr); NULL != lCmsg; lCmsg = CMSG_NXTHDR((struct msghdr *)pHdr, lCmsg)) {
+        if(SOL_SOCKET != lCmsg->cmsg_level) {
+            continue;
+        }
+
+        if(SCM_TIMESTAMPING == lCmsg->cmsg_type) {
+            /* struct scm_timestamping : software, (deprecated), raw hardware */
+            struct timespec lTimes[3U];
+            memcpy(lTimes, CMSG_DATA(lCmsg), sizeof(lTimes));
+            if(0 != lTimes[2U].tv_sec || 0 != lTimes[2U].tv_nsec) {
+                return CIP_timespecToNs(&lTimes[2U]);
+            }
+            if(0 != lTimes[0U].tv_sec || 0 != lTimes[0U].tv_nsec) {
+                lSoftware = CIP_timespecToNs(&lTimes[0U]);
+            }
+        } else if(SCM_TIMESTAMPNS == lCmsg->cmsg_type && 0U == lSoftware) {
+            struct timespec lTime;
+            memcpy(&lTime, CMSG_DATA(lCmsg), sizeof(lTime));
+            lSoftware = CIP_timespecToNs(&lTime);
+        }
+    }
+
+    return lSoftware;
+}
+
+void CIP_readTxTimestamps(const cipID_t pID) {
+    char lControl[CMSG_SPACE(3U * sizeof(struct timespec)) + CMSG_SPACE(64U)];
+
+    /* Keep the most recent one */
+    for(;;) {
+        struct msghdr lHdr;
+        memset(&lHdr, 0, sizeof(lHdr));
+        lHdr.msg_control    = lControl;
+        lHdr.msg_controllen = sizeof(lControl);
+
+        if(0 > recvmsg(gCIP[pID].canSocket, &lHdr, MSG_ERRQUEUE | MSG_DONTWAIT)) {
+            /* EAGAIN : the error queue is empty */
+            break;
+        }
+
+        const uint64_t lTimestamp = CIP_cmsgTimestamp(&lHdr);
+        if(0U != lTimestamp) {
+            gCIP[pID].txTimestamp = lTimestamp;
+        }
+    }
+}
@@ -11,6 +11,8 @@
 #include "can_serial_error_codes.h"
 #include "can_serial.h"
 
+#include <sys/socket.h>
+
 /* Defines --------------------------------------------- */
 
 /* Type definitions ------------------------------------ */
@@ -20,5 +22,14 @@
 /* Socket management functions ------------------------- */
 cipErrorCode_t CIP_initCanSocket(const cipID_t pID);
 cipErrorCode_t CIP_closeSocket(const cipID_t pID);
+cipErrorCode_t CIP_attachSocketFilter(const cipID_t pID);
+cipErrorCode_t CIP_setSocketTimestamping(const cipID_t pID);
+
+/* Kernel timestamp carried by the control messages of pHdr, in ns, 0 if none */
+uint64_t CIP_cmsgTimestamp(const struct msghdr * const pHdr);
+
+/* Reads the TX timestamps queued on the socket error queue.
+ * The module TX mutex must be held. */
+void CIP_readTxTimestamps(const cipID_t pID);
 
 #endif /* can_serial_SOCKET_MGT_H */
@@ -0,0 +1,98 @@
+/**
+ * @brief CAN over serial statistics functions
+ * 
+ * @file can_serial_stats.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_private.h"
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdio.h>
+
+/* Defines --------------------------------------------- */
+#define LOAD(pField) __atomic_load_n(&(pField), __ATOMIC_RELAXED)
+#define CLEAR(pField) __atomic_store_n(&(pField), 0U, __ATOMIC_RELAXED)
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Extern variables ------------------------------------ */
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
+
+/* Statistics functions -------------------------------- */
+cipErrorCode_t CIP_getStats(const cipID_t pID, cipStats_t * const pStats) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getStats> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == pStats) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getStats> Parameter ptr is NULL !\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    const cipRxCounters_t * const lRx = &gCIP[pID].rxStats;
+    const cipTxCounters_t * const lTx = &gCIP[pID].txStats;
+
+    pStats->rxFrames         = LOAD(lRx->rxFrames);
+    pStats->rxBytes          = LOAD(lRx->rxBytes);
+    pStats->loopbackFrames   = LOAD(lRx->loopbackFrames);
+    pStats->filteredFrames   = LOAD(lRx->filteredFrames);
+    pStats->badDatagrams     = LOAD(lRx->badDatagrams);
+    pStats->eagainSpins      = LOAD(lRx->eagainSpins);
+    pStats->rxRingDrops      = LOAD(lRx->rxRingDrops);
+    pStats->callbackCalls    = LOAD(lRx->callbackCalls);
+    pStats->callbackFailures = LOAD(lRx->callbackFailures);
+    pStats->callbackTimeNs   = LOAD(lRx->callbackTimeNs);
+
+    pStats->txFrames   = LOAD(lTx->txFrames);
+    pStats->txBytes    = LOAD(lTx->txBytes);
+    pStats->txFailures = LOAD(lTx->txFailures);
+    pStats->txQueueFull = LOAD(lTx->txQueueFull);
+    for(size_t i = 0U; i < can_serial_STATS_NB_ERRNO; i++) {
+        pStats->txErrno[i] = LOAD(lTx->txErrno[i]);
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_resetStats(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_resetStats> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipRxCounters_t * const lRx = &gCIP[pID].rxStats;
+    cipTxCounters_t * const lTx = &gCIP[pID].txStats;
+
+    CLEAR(lRx->rxFrames);
+    CLEAR(lRx->rxBytes);
+    CLEAR(lRx->loopbackFrames);
+    CLEAR(lRx->filteredFrames);
+    CLEAR(lRx->badDatagrams);
+    CLEAR(lRx->eagainSpins);
+    CLEAR(lRx->rxRingDrops);
+    CLEAR(lRx->callbackCalls);
+    CLEAR(lRx->callbackFailures);
+    CLEAR(lRx->callbackTimeNs);
+
+    CLEAR(lTx->txFrames);
+    CLEAR(lTx->txBytes);
+    CLEAR(lTx->txFailures);
+    CLEAR(lTx->txQueueFull);
+    for(size_t i = 0U; i < can_serial_STATS_NB_ERRNO; i++) {
+        CLEAR(lTx->txErrno[i]);
+    }
+
+    return can_serial_ERROR_NONE;
+}
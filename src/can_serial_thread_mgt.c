@@ -8,6 +8,8 @@
 #include "can_serial_private.h"
 #include "can_serial_error_codes.h"
 #include "can_serial.h"
+#include "can_serial_socket_mgt.h"
+#include "can_serial_log.h"
 
 /* C system */
 #include <stddef.h>
@@ -15,6 +17,10 @@
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <poll.h>
+
+/* errno */
+#include <errno.h>
 
 /* Defines --------------------------------------------- */
 
@@ -23,10 +29,9 @@
 /* Global variables ------------------------------------ */
 
 /* Static variables ------------------------------------ */
-static pthread_t sThread = 0;
 
 /* Extern variables ------------------------------------ */
-extern cipInternalStruct_t gCIP;
+extern cipInternalStruct_t gCIP[can_serial_MAX_NB_MODULES];
 
 /* Thread management functions ------------------------- */
 cipErrorCode_t CIP_setPutMessageFunction(const cipID_t pID,
@@ -34,130 +39,454 @@ cipErrorCode_t CIP_setPutMessageFunction(const cipID_t pID,
     const cipPutMessageFct_t pFct)
 {
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_setPutMessageFunction> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setPutMessageFunction> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
     if(NULL == pFct) {
-        printf("[ERROR] <CIP_setPutMessageFunction> Function ptr arg is NULL !\n");
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setPutMessageFunction> Function ptr arg is NULL !\n");
         return can_serial_ERROR_ARG;
     }
 
-    gCIP.callerID      = pCallerID;
-    gCIP.putMessageFct = pFct;
+    gCIP[pID].callerID      = pCallerID;
+    gCIP[pID].putMessageFct = pFct;
 
     return can_serial_ERROR_NONE;
 }
 
-static void CIP_rxThreadCleanup(void *pPtr) {
-    (void)pPtr;
-    gCIP.rxThreadOn = false;
+cipErrorCode_t CIP_setPutMessagesFunction(const cipID_t pID,
+    const uint8_t pCallerID,
+    const cipPutMessagesFct_t pFct)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setPutMessagesFunction> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    if(NULL == pFct) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setPutMessagesFunction> Function ptr arg is NULL !\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    if(can_serial_MODE_FD == gCIP[pID].cipMode) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_setPutMessagesFunction> CAN FD modules hand their messages over one at a time\n");
+        return can_serial_ERROR_CONFIG;
+    }
+
+    gCIP[pID].callerID       = pCallerID;
+    gCIP[pID].putMessagesFct = pFct;
+
+    return can_serial_ERROR_NONE;
 }
 
-static void CIP_rxThread(const cipID_t * const pID) {
-    /* Check if the parameter is NULL */
-    if(NULL == pID) {
-        printf("[ERROR] <CIP_rxThread> ID ptr is NULL !\n");
-        return;
+cipErrorCode_t CIP_registerHandler(const cipID_t pID,
+    const uint32_t pCANID,
+    const cipHandlerFct_t pFct,
+    void * const pCtx)
+{
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_registerHandler> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
     }
 
-    /* Save the parameter before it is destroyed by the tread creator */
-    const cipID_t lID = *pID;
+    if(0U != (pCANID & ~(can_serial_ID_EXT | can_serial_EXT_ID_MASK))) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_registerHandler> CAN ID 0x%X is not valid\n", pCANID);
+        return can_serial_ERROR_ARG;
+    }
 
+    /* Waits for the batch being dispatched, if any */
+    pthread_rwlock_wrlock(&gCIP[pID].handlers.lock);
+    const cipErrorCode_t lErrorCode = CIP_handlersSet(&gCIP[pID].handlers, pCANID, pFct, pCtx);
+    pthread_rwlock_unlock(&gCIP[pID].handlers.lock);
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_getRxTimestamp(const cipID_t pID, uint64_t * const pTimestamp) {
     /* Check the ID */
-    if(lID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_rxThread> No CAN-IP module has the ID %u\n", lID);
-        return;
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getRxTimestamp> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
     }
 
-    /* Check if the module is already initialized */
-    if(!gCIP.isInitialized) {
-        printf("[ERROR] <CIP_rxThread> CAN-IP module %u is not initialized.\n", gCIP.cipInstanceID);
-        return;
+    if(NULL == pTimestamp) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_getRxTimestamp> Parameter ptr is NULL !\n");
+        return can_serial_ERROR_ARG;
     }
 
-    if(NULL == gCIP.putMessageFct) {
-        printf("[ERROR] <CIP_rxThread> Message buffer getter function is NULL.\n");
-        return;
+    *pTimestamp = gCIP[pID].rxDeliverStamp;
+
+    return can_serial_ERROR_NONE;
+}
+
+/* Gives the frame to its handler, if it has one.
+ * The handlers read lock must be held. */
+static inline bool CIP_rxHandle(const cipID_t pID,
+    const uint32_t pCANID,
+    const uint8_t pSize,
+    const uint8_t * const pData,
+    const uint32_t pFlags,
+    cipErrorCode_t * const pErrorCode)
+{
+    const cipHandler_t * const lHandler = CIP_handlersFind(&gCIP[pID].handlers, pCANID, pFlags);
+    if(NULL == lHandler) {
+        return false;
+    }
+
+    const int lResult = lHandler->fct(lHandler->ctx, pCANID, pSize, pData, pFlags);
+    if(0 != lResult) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> Handler of CAN ID 0x%X failed w/ error code %d\n", pCANID, lResult);
+        CIP_STATS_ADD(gCIP[pID].rxStats, callbackFailures, 1U);
+        *pErrorCode = can_serial_ERROR_CONFIG;
     }
 
+    return true;
+}
+
+/* CAN FD modules only run over UDP */
+static cipErrorCode_t CIP_rxProcessFd(const cipID_t pID) {
     cipErrorCode_t  lErrorCode      = can_serial_ERROR_NONE;
     int             lGetBufferError = 0;
-    ssize_t         lReadBytes      = 0;
-
-    /* Starting thread routine */
-    pthread_cleanup_push((void (*)(void *))CIP_rxThreadCleanup, NULL);
-
-    gCIP.rxThreadOn = true;
-
-    /* Infinite Rx loop */
-    printf("[DEBUG] <CIP_rxThread> Starting RX thread.\n");
-    while (can_serial_ERROR_NONE == lErrorCode) {
-        /* Initialize a CIP message */
-        cipMessage_t lMsg;
-        memset(&lMsg, 0, sizeof(cipMessage_t));
-        
-        /* Reading a CAN message */
-        lErrorCode = CIP_recv(lID, &lMsg, &lReadBytes);
+    size_t          lCount          = 0U;
+
+    /* A callback may retire us (CIP_stop/CIP_reset) */
+    const uint32_t  lGeneration     = __atomic_load_n(&gCIP[pID].rxGeneration, __ATOMIC_ACQUIRE);
+
+    do {
+        lErrorCode = CIP_recvFdBatch(pID, gCIP[pID].rx.fdFrames, can_serial_RX_BATCH_SIZE, &lCount);
         if(can_serial_ERROR_NONE != lErrorCode) {
-            printf("[ERROR] <CIP_rxThread> CIP_recv failed w/ error code %u\n", lErrorCode);
+            CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> CIP_recvFdBatch failed w/ error code %u\n", lErrorCode);
             break;
         }
 
-        if(can_serial_ERROR_NONE == lErrorCode && 0 > lReadBytes) {
-            /* Nothing read, the socket is non-blocking */
+        /* Filter out the loopback messages from this instance of CIP */
+        size_t lKept = 0U;
+        for(size_t i = 0U; i < lCount; i++) {
+            if(gCIP[pID].randID == gCIP[pID].rx.fdFrames[i].randID) {
+                continue;
+            }
+
+            if(lKept != i) {
+                gCIP[pID].rx.fdFrames[lKept] = gCIP[pID].rx.fdFrames[i];
+            }
+            lKept++;
+        }
+        CIP_STATS_ADD(gCIP[pID].rxStats, loopbackFrames, lCount - lKept);
+
+        if(CIP_captureOn(&gCIP[pID].capture)) {
+            CIP_captureFdMessages(pID, can_serial_CAPTURE_RX, gCIP[pID].rx.fdFrames, lKept, CIP_realtimeNs());
+        }
+
+        /* Per CAN ID handlers first, the rest goes on */
+        if(0U < __atomic_load_n(&gCIP[pID].handlers.count, __ATOMIC_RELAXED)) {
+            const uint64_t lStart = CIP_monotonicNs();
+            size_t lLeft = 0U;
+            size_t i     = 0U;
+            pthread_rwlock_rdlock(&gCIP[pID].handlers.lock);
+            for(; i < lKept && can_serial_ERROR_NONE == lErrorCode; i++) {
+                const cipFdMessage_t * const lMsg = &gCIP[pID].rx.fdFrames[i];
+                gCIP[pID].rxDeliverStamp = lMsg->timestamp;
+                if(!CIP_rxHandle(pID, lMsg->id, lMsg->size, lMsg->data, lMsg->flags, &lErrorCode)) {
+                    if(lLeft != i) {
+                        gCIP[pID].rx.fdFrames[lLeft] = *lMsg;
+                    }
+                    lLeft++;
+                }
+            }
+            pthread_rwlock_unlock(&gCIP[pID].handlers.lock);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackCalls,  i - lLeft);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackTimeNs, CIP_monotonicNs() - lStart);
+            lKept = lLeft;
+        }
+
+        if(NULL != gCIP[pID].rxRing.frames) {
+            CIP_STATS_ADD(gCIP[pID].rxStats, rxRingDrops, lKept - CIP_ringPushFd(&gCIP[pID].rxRing, gCIP[pID].rx.fdFrames, lKept));
             continue;
         }
-        
-        if(sizeof(cipMessage_t) != lReadBytes) {
-            printf("[ERROR] <CIP_rxThread> CIP_recv received inconsistent data of size %d\n", lReadBytes);
+
+        if(NULL == gCIP[pID].putMessageFct) {
+            /* Handlers only, nobody wants the other frames */
+            continue;
+        }
+
+        const uint64_t lStart = CIP_monotonicNs();
+        size_t i = 0U;
+        while(i < lKept) {
+            const cipFdMessage_t * const lMsg = &gCIP[pID].rx.fdFrames[i++];
+
+            gCIP[pID].rxDeliverStamp = lMsg->timestamp;
+            lGetBufferError = gCIP[pID].putMessageFct(gCIP[pID].callerID, lMsg->id, lMsg->size, lMsg->data, lMsg->flags);
+            if(0 != lGetBufferError) {
+                CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> putMessageFct callback failed w/ error code %d\n", lGetBufferError);
+                CIP_STATS_ADD(gCIP[pID].rxStats, callbackFailures, 1U);
+                lErrorCode = can_serial_ERROR_CONFIG;
+                break;
+            }
+        }
+        CIP_STATS_ADD(gCIP[pID].rxStats, callbackCalls,  i);
+        CIP_STATS_ADD(gCIP[pID].rxStats, callbackTimeNs, CIP_monotonicNs() - lStart);
+    } while(can_serial_ERROR_NONE == lErrorCode && can_serial_RX_BATCH_SIZE == lCount
+        && lGeneration == __atomic_load_n(&gCIP[pID].rxGeneration, __ATOMIC_ACQUIRE));
+
+    return lErrorCode;
+}
+
+cipErrorCode_t CIP_rxProcess(const cipID_t pID) {
+    if(can_serial_MODE_FD == gCIP[pID].cipMode) {
+        return CIP_rxProcessFd(pID);
+    }
+
+    cipErrorCode_t  lErrorCode      = can_serial_ERROR_NONE;
+    int             lGetBufferError = 0;
+    size_t          lCount          = 0U;
+
+    /* A serial port does not loop our own frames back */
+    const bool lCheckLoopback = can_serial_TRANSPORT_UDP == gCIP[pID].transport;
+
+    /* A callback may retire us (CIP_stop/CIP_reset) */
+    const uint32_t lGeneration = __atomic_load_n(&gCIP[pID].rxGeneration, __ATOMIC_ACQUIRE);
+
+    do {
+        lErrorCode = CIP_recvBatch(pID, gCIP[pID].rx.frames, can_serial_RX_BATCH_SIZE, &lCount);
+        if(can_serial_ERROR_NONE != lErrorCode) {
+            CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> CIP_recvBatch failed w/ error code %u\n", lErrorCode);
             break;
         }
 
-        /* Check if the message is a loopback message from this instance of CIP */
-        if(gCIP.randID == lMsg.randID) {
-            /* We sent this ! Ignoring... */
+        /* Filter out the loopback messages from this instance of CIP */
+        size_t lKept = 0U;
+        for(size_t i = 0U; i < lCount; i++) {
+            if(lCheckLoopback && gCIP[pID].randID == gCIP[pID].rx.frames[i].randID) {
+                /* We sent this ! Ignoring... */
+                continue;
+            }
+
+            if(lKept != i) {
+                gCIP[pID].rx.frames[lKept] = gCIP[pID].rx.frames[i];
+            }
+            lKept++;
+        }
+        CIP_STATS_ADD(gCIP[pID].rxStats, loopbackFrames, lCount - lKept);
+
+        if(CIP_captureOn(&gCIP[pID].capture)) {
+            CIP_captureMessages(pID, can_serial_CAPTURE_RX, gCIP[pID].rx.frames, lKept, CIP_realtimeNs());
+        }
+
+        /* Per CAN ID handlers first, the rest goes on */
+        if(0U < __atomic_load_n(&gCIP[pID].handlers.count, __ATOMIC_RELAXED)) {
+            const uint64_t lStart = CIP_monotonicNs();
+            size_t lLeft = 0U;
+            size_t i     = 0U;
+            pthread_rwlock_rdlock(&gCIP[pID].handlers.lock);
+            for(; i < lKept && can_serial_ERROR_NONE == lErrorCode; i++) {
+                const cipMessage_t * const lMsg = &gCIP[pID].rx.frames[i];
+                gCIP[pID].rxDeliverStamp = lMsg->timestamp;
+                if(!CIP_rxHandle(pID, lMsg->id, lMsg->size, lMsg->data, lMsg->flags, &lErrorCode)) {
+                    if(lLeft != i) {
+                        gCIP[pID].rx.frames[lLeft] = *lMsg;
+                    }
+                    lLeft++;
+                }
+            }
+            pthread_rwlock_unlock(&gCIP[pID].handlers.lock);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackCalls,  i - lLeft);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackTimeNs, CIP_monotonicNs() - lStart);
+            lKept = lLeft;
+        }
+
+        if(NULL != gCIP[pID].rxRing.frames) {
+            /* Hand the messages over to the consumer thread */
+            CIP_STATS_ADD(gCIP[pID].rxStats, rxRingDrops, lKept - CIP_ringPush(&gCIP[pID].rxRing, gCIP[pID].rx.frames, lKept));
             continue;
         }
 
-        /* Get buffer to store this data */
-        lGetBufferError = gCIP.putMessageFct(gCIP.callerID, lMsg.id, lMsg.size, lMsg.data, lMsg.flags);
-        if(0 != lGetBufferError) {
-            printf("[ERROR] <CIP_rxThread> putMessageFct callback failed w/ error code %u\n", lErrorCode);
-            break;
+        if(NULL != gCIP[pID].putMessagesFct) {
+            if(0U == lKept) {
+                continue;
+            }
+
+            /* The whole batch in one call, w/o copy */
+            const uint64_t lStart = CIP_monotonicNs();
+            gCIP[pID].rxDeliverStamp = gCIP[pID].rx.frames[0U].timestamp;
+            lGetBufferError = gCIP[pID].putMessagesFct(gCIP[pID].callerID, gCIP[pID].rx.frames, lKept);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackCalls,  1U);
+            CIP_STATS_ADD(gCIP[pID].rxStats, callbackTimeNs, CIP_monotonicNs() - lStart);
+            if(0 != lGetBufferError) {
+                CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> putMessagesFct callback failed w/ error code %d\n", lGetBufferError);
+                CIP_STATS_ADD(gCIP[pID].rxStats, callbackFailures, 1U);
+                lErrorCode = can_serial_ERROR_CONFIG;
+            }
+            continue;
         }
 
-        usleep(10000U);
+        if(NULL == gCIP[pID].putMessageFct) {
+            /* Handlers only, nobody wants the other frames */
+            continue;
+        }
+
+        const uint64_t lStart = CIP_monotonicNs();
+        size_t i = 0U;
+        while(i < lKept) {
+            const cipMessage_t * const lMsg = &gCIP[pID].rx.frames[i++];
+
+            /* Get buffer to store this data */
+            gCIP[pID].rxDeliverStamp = lMsg->timestamp;
+            lGetBufferError = gCIP[pID].putMessageFct(gCIP[pID].callerID, lMsg->id, lMsg->size, lMsg->data, lMsg->flags);
+            if(0 != lGetBufferError) {
+                CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxProcess> putMessageFct callback failed w/ error code %d\n", lGetBufferError);
+                CIP_STATS_ADD(gCIP[pID].rxStats, callbackFailures, 1U);
+                lErrorCode = can_serial_ERROR_CONFIG;
+                break;
+            }
+        }
+        CIP_STATS_ADD(gCIP[pID].rxStats, callbackCalls,  i);
+        CIP_STATS_ADD(gCIP[pID].rxStats, callbackTimeNs, CIP_monotonicNs() - lStart);
+    } while(can_serial_ERROR_NONE == lErrorCode && can_serial_RX_BATCH_SIZE == lCount
+        && lGeneration == __atomic_load_n(&gCIP[pID].rxGeneration, __ATOMIC_ACQUIRE));
+
+    return lErrorCode;
+}
+
+/* An RX thread and the generation it was started in */
+typedef struct _cipRxThreadInfo {
+    cipID_t  id;
+    uint32_t generation;
+} cipRxThreadInfo_t;
+
+static void CIP_rxThreadCleanup(void *pInfo) {
+    const cipRxThreadInfo_t * const lInfo = (const cipRxThreadInfo_t *)pInfo;
+
+    /* A retired thread no longer owns rxThreadOn, a new one may run */
+    if(lInfo->generation == __atomic_load_n(&gCIP[lInfo->id].rxGeneration, __ATOMIC_ACQUIRE)) {
+        gCIP[lInfo->id].rxThreadOn = false;
+    }
+}
+
+static void *CIP_rxThread(void *pArg) {
+    /* The module ID is passed by value in the argument */
+    const cipID_t lID = (cipID_t)(uintptr_t)pArg;
+
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= lID) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> No CAN-IP module has the ID %u\n", lID);
+        return NULL;
+    }
+
+    /* Check if the module is already initialized */
+    if(!gCIP[lID].isInitialized) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> CAN-IP module %u is not initialized.\n", lID);
+        gCIP[lID].rxThreadOn = false;
+        return NULL;
+    }
+
+    if(!CIP_hasRxConsumer(&gCIP[lID])) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> Message buffer getter function is NULL.\n");
+        gCIP[lID].rxThreadOn = false;
+        return NULL;
     }
 
-    printf("[ERROR] <CIP_rxThread> RX thread shut down. (error code = %d)\n", lErrorCode);
+    cipErrorCode_t lErrorCode = can_serial_ERROR_NONE;
+
+    /* Starting thread routine, until CIP_stop/CIP_reset retire it */
+    const cipRxThreadInfo_t lInfo = {lID, __atomic_load_n(&gCIP[lID].rxGeneration, __ATOMIC_ACQUIRE)};
+    pthread_cleanup_push(CIP_rxThreadCleanup, (void *)&lInfo);
+
+    /* Block on the socket and on the wake-up eventfd */
+    struct pollfd lFds[2U] = {
+        {.fd = gCIP[lID].canSocket, .events = POLLIN, .revents = 0},
+        {.fd = gCIP[lID].wakeFd,    .events = POLLIN, .revents = 0}
+    };
+
+    /* Rx loop, until the module is stopped */
+    CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_rxThread> Starting RX thread.\n");
+    while (can_serial_ERROR_NONE == lErrorCode && !gCIP[lID].isStopped
+        && lInfo.generation == __atomic_load_n(&gCIP[lID].rxGeneration, __ATOMIC_ACQUIRE))
+    {
+        errno = 0;
+        if(0 > poll(lFds, 2U, -1)) {
+            if(EINTR == errno) {
+                continue;
+            }
+
+            CIP_LOG_ASYNC_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_rxThread> poll failed !\n");
+            lErrorCode = can_serial_ERROR_SYS;
+            break;
+        }
 
-    gCIP.rxThreadOn = false;
+        if(0 != (lFds[1U].revents & POLLIN)) {
+            /* Woken up by CIP_stop/CIP_reset */
+            CIP_clearWakeFd(&gCIP[lID]);
+            continue;
+        }
+
+        if(0 != (lFds[0U].revents & POLLERR) && CIP_readPendingTxTimestamps(&gCIP[lID], lID)) {
+            lFds[0U].revents &= (short)~POLLERR;
+        }
+
+        if(0 != (lFds[0U].revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> Socket error (revents = 0x%X)\n", lFds[0U].revents);
+            lErrorCode = can_serial_ERROR_NET;
+            break;
+        }
+
+        /* Drain all the ready CAN messages before blocking again */
+        lErrorCode = CIP_rxProcess(lID);
+    }
+
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        CIP_LOG_ASYNC(can_serial_LOG_ERROR, "<CIP_rxThread> RX thread shut down. (error code = %d)\n", lErrorCode);
+    } else {
+        CIP_LOG_ASYNC(can_serial_LOG_DEBUG, "<CIP_rxThread> RX thread stopped.\n");
+    }
 
     /* Mandatory pop */
     pthread_cleanup_pop(1);
+
+    return NULL;
 }
 
 cipErrorCode_t CIP_startRxThread(const cipID_t pID) {
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_startRxThread> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startRxThread> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
-    if(NULL == gCIP.putMessageFct) {
-        printf("[ERROR] <CIP_startRxThread> Message buffer getter function is NULL.\n");
+    if(!CIP_hasRxConsumer(&gCIP[pID])) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startRxThread> Message buffer getter function is NULL.\n");
         return can_serial_ERROR_CONFIG;
     }
 
+    if(gCIP[pID].rxThreadOn) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startRxThread> CAN-IP module %u already receives.\n", pID);
+        return can_serial_ERROR_ALREADY_INIT;
+    }
+
+    /* Let a reactor thread service this module */
+    if(CIP_reactorEnabled()) {
+        return CIP_reactorRegister(pID);
+    }
+
+    /* Reap a previous RX thread that shut down on its own */
+    if(can_serial_ERROR_NONE != CIP_joinRxThread(pID)) {
+        return can_serial_ERROR_SYS;
+    }
+
+    /* Set before the thread runs, so that a second call sees it */
+    gCIP[pID].rxThreadOn = true;
+
     int lSysResult = 0;
-    lSysResult = pthread_create(&sThread, NULL, (void * (*)(void *))CIP_rxThread, (void *)&pID);
+    lSysResult = pthread_create(&gCIP[pID].rxThread, NULL, CIP_rxThread, (void *)(uintptr_t)pID);
     if (0 < lSysResult) {
-        printf("[ERROR] <CIP_startRxThread> Thread creation failed\n");
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_startRxThread> Thread creation failed\n");
+        gCIP[pID].rxThreadOn = false;
+        gCIP[pID].rxThread   = 0;
         return can_serial_ERROR_SYS;
     } else {
-        printf("[INFO ] <CIP_startRxThread> Thread creation successful\n");
+        CIP_LOG(can_serial_LOG_INFO, "<CIP_startRxThread> Thread creation successful\n");
     }
 
     return can_serial_ERROR_NONE;
@@ -165,18 +494,72 @@ cipErrorCode_t CIP_startRxThread(const cipID_t pID) {
 
 cipErrorCode_t CIP_isRxThreadOn(const cipID_t pID, bool * const pOn) {
     /* Check the ID */
-    if(pID != gCIP.cipInstanceID) {
-        printf("[ERROR] <CIP_isRxThreadOn> No CAN-IP module has the ID %u\n", pID);
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_isRxThreadOn> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
     /* Check argument ptr */
     if(NULL == pOn) {
-        printf("[ERROR] <CIP_isRxThreadOn> Parameter ptr is NULL !\n");
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_isRxThreadOn> Parameter ptr is NULL !\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    *pOn = gCIP[pID].rxThreadOn;
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_wakeRxThread(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_wakeRxThread> No CAN-IP module has the ID %u\n", pID);
+        return can_serial_ERROR_ARG;
+    }
+
+    const uint64_t lEvent = 1U;
+    errno = 0;
+    if(sizeof(lEvent) != write(gCIP[pID].wakeFd, &lEvent, sizeof(lEvent))) {
+        CIP_LOG_ERRNO(can_serial_LOG_ERROR, errno, "<CIP_wakeRxThread> eventfd write failed !\n");
+        return can_serial_ERROR_SYS;
+    }
+
+    return can_serial_ERROR_NONE;
+}
+
+cipErrorCode_t CIP_joinRxThread(const cipID_t pID) {
+    /* Check the ID */
+    if(can_serial_MAX_NB_MODULES <= pID) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_joinRxThread> No CAN-IP module has the ID %u\n", pID);
         return can_serial_ERROR_ARG;
     }
 
-    *pOn = gCIP.rxThreadOn;
+    /* Retire the running RX thread, it must not touch the module again */
+    __atomic_add_fetch(&gCIP[pID].rxGeneration, 1U, __ATOMIC_ACQ_REL);
+
+    if(__atomic_load_n(&gCIP[pID].inReactor, __ATOMIC_ACQUIRE)) {
+        return CIP_reactorJoin(pID);
+    }
+
+    /* Nothing to join */
+    if(0 == gCIP[pID].rxThread) {
+        return can_serial_ERROR_NONE;
+    }
+
+    /* Called from the RX thread itself (callback) : it exits on its own once the callback returns */
+    if(pthread_equal(gCIP[pID].rxThread, pthread_self())) {
+        (void)pthread_detach(gCIP[pID].rxThread);
+        gCIP[pID].rxThread   = 0;
+        gCIP[pID].rxThreadOn = false;
+        return can_serial_ERROR_NONE;
+    }
+
+    if(0 != pthread_join(gCIP[pID].rxThread, NULL)) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_joinRxThread> pthread_join failed\n");
+        return can_serial_ERROR_SYS;
+    }
+    gCIP[pID].rxThread   = 0;
+    gCIP[pID].rxThreadOn = false;
 
     return can_serial_ERROR_NONE;
 }
@@ -0,0 +1,129 @@
+/**
+ * @brief CAN over serial TX priority queue
+ *
+ * @file can_serial_txprio.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_txprio.h"
+#include "can_serial_error_codes.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static inline bool CIP_txHeapBefore(const cipTxHeapEntry_t * const pA, const cipTxHeapEntry_t * const pB) {
+    return pA->key < pB->key || (pA->key == pB->key && pA->seq < pB->seq);
+}
+
+/* TX priority queue functions ------------------------- */
+cipErrorCode_t CIP_txHeapInit(cipTxHeap_t * const pHeap, const size_t pCapacity) {
+    if(NULL == pHeap || 0U == pCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txHeapInit> Invalid heap or capacity\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    if(SIZE_MAX / sizeof(cipTxHeapEntry_t) < pCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txHeapInit> %zu messages do not fit in memory\n", pCapacity);
+        return can_serial_ERROR_ARG;
+    }
+
+    cipTxHeapEntry_t * const lEntries = malloc(pCapacity * sizeof(cipTxHeapEntry_t));
+    if(NULL == lEntries) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txHeapInit> Failed to allocate %zu messages\n", pCapacity);
+        return can_serial_ERROR_SYS;
+    }
+
+    memset(pHeap, 0, sizeof(cipTxHeap_t));
+    pHeap->entries  = lEntries;
+    pHeap->capacity = pCapacity;
+
+    return can_serial_ERROR_NONE;
+}
+
+void CIP_txHeapFree(cipTxHeap_t * const pHeap) {
+    if(NULL == pHeap) {
+        return;
+    }
+
+    free(pHeap->entries);
+    memset(pHeap, 0, sizeof(cipTxHeap_t));
+}
+
+void CIP_txHeapClear(cipTxHeap_t * const pHeap) {
+    if(NULL == pHeap) {
+        return;
+    }
+
+    pHeap->count = 0U;
+    pHeap->seq   = 0U;
+}
+
+bool CIP_txHeapPush(cipTxHeap_t * const pHeap, const cipMessage_t * const pMsg) {
+    if(pHeap->capacity <= pHeap->count) {
+        return false;
+    }
+
+    const cipTxHeapEntry_t lEntry = {
+        .key = CIP_txArbitrationKey(pMsg->id, pMsg->flags),
+        .seq = pHeap->seq++,
+        .msg = *pMsg
+    };
+
+    /* Sift up */
+    size_t i = pHeap->count++;
+    while(0U < i) {
+        const size_t lParent = (i - 1U) / 2U;
+        if(!CIP_txHeapBefore(&lEntry, &pHeap->entries[lParent])) {
+            break;
+        }
+        pHeap->entries[i] = pHeap->entries[lParent];
+        i = lParent;
+    }
+    pHeap->entries[i] = lEntry;
+
+    return true;
+}
+
+size_t CIP_txHeapPop(cipTxHeap_t * const pHeap, cipMessage_t * const pMsgs, const size_t pMax) {
+    size_t lPopped = 0U;
+
+    while(lPopped < pMax && 0U < pHeap->count) {
+        pMsgs[lPopped++] = pHeap->entries[0U].msg;
+
+        /* Sift the last entry down from the root */
+        const cipTxHeapEntry_t * const lLast = &pHeap->entries[--pHeap->count];
+        size_t i = 0U;
+        for(;;) {
+            size_t lChild = 2U * i + 1U;
+            if(lChild >= pHeap->count) {
+                break;
+            }
+            if(lChild + 1U < pHeap->count && CIP_txHeapBefore(&pHeap->entries[lChild + 1U], &pHeap->entries[lChild])) {
+                lChild++;
+            }
+            if(!CIP_txHeapBefore(&pHeap->entries[lChild], lLast)) {
+                break;
+            }
+            pHeap->entries[i] = pHeap->entries[lChild];
+            i = lChild;
+        }
+        if(i != pHeap->count) {
+            pHeap->entries[i] = *lLast;
+        }
+    }
+
+    return lPopped;
+}
@@ -0,0 +1,63 @@
+/**
+ * @brief CAN over serial TX priority queue
+ *
+ * @file can_serial_txprio.h
+ */
+
+#ifndef can_serial_TXPRIO_H
+#define can_serial_TXPRIO_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipTxHeapEntry {
+    uint32_t     key;   /**< Arbitration field, lower wins the bus */
+    uint64_t     seq;   /**< Submission order, FIFO within one key */
+    cipMessage_t msg;
+} cipTxHeapEntry_t;
+
+/**
+ * @brief Binary min-heap of CAN messages, ordered like the CAN
+ * arbitration would order them, then by submission.
+ * Only used by the TX writer thread, no lock needed.
+ */
+typedef struct _cipTxHeap {
+    cipTxHeapEntry_t *entries;  /**< NULL : no heap */
+    size_t            capacity;
+    size_t            count;
+    uint64_t          seq;      /**< Next submission number */
+} cipTxHeap_t;
+
+/* TX priority queue functions ------------------------- */
+cipErrorCode_t CIP_txHeapInit(cipTxHeap_t * const pHeap, const size_t pCapacity);
+void CIP_txHeapFree(cipTxHeap_t * const pHeap);
+void CIP_txHeapClear(cipTxHeap_t * const pHeap);
+
+/* Returns false when the heap is full */
+bool CIP_txHeapPush(cipTxHeap_t * const pHeap, const cipMessage_t * const pMsg);
+
+/* Pops up to pMax messages, highest priority first, returns their number */
+size_t CIP_txHeapPop(cipTxHeap_t * const pHeap, cipMessage_t * const pMsgs, const size_t pMax);
+
+/* Arbitration field of a classic frame as a comparable key :
+ * base ID, RTR/SRR, IDE, extended ID, RTR.
+ * A standard frame beats the extended frames of the same base ID,
+ * a data frame beats the remote frame of the same ID. */
+static inline uint32_t CIP_txArbitrationKey(const uint32_t pID, const uint32_t pFlags) {
+    const uint32_t lRtr = 0U != (pFlags & can_serial_FLAG_RTR) ? 1U : 0U;
+
+    if(0U != (pFlags & can_serial_FLAG_EFF)) {
+        const uint32_t lID = pID & 0x1FFFFFFFU;
+        return ((lID >> 18U) << 21U) | (1U << 20U) | (1U << 19U) | ((lID & 0x3FFFFU) << 1U) | lRtr;
+    }
+
+    return ((pID & 0x7FFU) << 21U) | (lRtr << 20U);
+}
+
+#endif /* can_serial_TXPRIO_H */
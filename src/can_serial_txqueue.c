@@ -0,0 +1,129 @@
+/**
+ * @brief CAN over serial lock-free MPSC TX queue
+ *
+ * @file can_serial_txqueue.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_txqueue.h"
+#include "can_serial_error_codes.h"
+#include "can_serial_log.h"
+
+/* C system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Global variables ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* TX queue functions ---------------------------------- */
+cipErrorCode_t CIP_txQueueInit(cipTxQueue_t * const pQueue, const size_t pCapacity) {
+    if(NULL == pQueue || 0U == pCapacity || can_serial_RING_MAX_CAPACITY < pCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txQueueInit> Invalid queue or capacity\n");
+        return can_serial_ERROR_ARG;
+    }
+
+    /* Round the capacity up to a power of 2 */
+    size_t lCapacity = 1U;
+    while(lCapacity < pCapacity) {
+        lCapacity <<= 1U;
+    }
+
+    if(SIZE_MAX / sizeof(cipTxSlot_t) < lCapacity) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txQueueInit> %zu messages do not fit in memory\n", lCapacity);
+        return can_serial_ERROR_ARG;
+    }
+
+    void *lSlots = NULL;
+    if(0 != posix_memalign(&lSlots, can_serial_CACHE_LINE_SIZE, lCapacity * sizeof(cipTxSlot_t))) {
+        CIP_LOG(can_serial_LOG_ERROR, "<CIP_txQueueInit> Failed to allocate %zu messages\n", lCapacity);
+        return can_serial_ERROR_SYS;
+    }
+
+    memset(pQueue, 0, sizeof(cipTxQueue_t));
+    pQueue->slots = lSlots;
+    pQueue->mask  = lCapacity - 1U;
+    CIP_txQueueClear(pQueue);
+
+    return can_serial_ERROR_NONE;
+}
+
+void CIP_txQueueFree(cipTxQueue_t * const pQueue) {
+    if(NULL == pQueue) {
+        return;
+    }
+
+    free(pQueue->slots);
+    memset(pQueue, 0, sizeof(cipTxQueue_t));
+}
+
+void CIP_txQueueClear(cipTxQueue_t * const pQueue) {
+    if(NULL == pQueue || NULL == pQueue->slots) {
+        return;
+    }
+
+    for(size_t i = 0U; i <= pQueue->mask; i++) {
+        pQueue->slots[i].seq = i;
+    }
+    pQueue->head = 0U;
+    pQueue->tail = 0U;
+}
+
+size_t CIP_txQueuePush(cipTxQueue_t * const pQueue, const cipMessage_t * const pMsgs, const size_t pCount) {
+    size_t lPushed = 0U;
+
+    while(lPushed < pCount) {
+        /* Claim the slot at head */
+        cipTxSlot_t *lSlot = NULL;
+        uint64_t lPos = __atomic_load_n(&pQueue->head, __ATOMIC_RELAXED);
+        for(;;) {
+            lSlot = &pQueue->slots[lPos & pQueue->mask];
+            const int64_t lDiff = (int64_t)(__atomic_load_n(&lSlot->seq, __ATOMIC_ACQUIRE) - lPos);
+            if(0 == lDiff) {
+                if(__atomic_compare_exchange_n(&pQueue->head, &lPos, lPos + 1U, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+                /* lPos was reloaded by the failed CAS */
+            } else if(0 > lDiff) {
+                /* Full, the writer has not sent this slot yet */
+                return lPushed;
+            } else {
+                lPos = __atomic_load_n(&pQueue->head, __ATOMIC_RELAXED);
+            }
+        }
+
+        lSlot->msg = pMsgs[lPushed++];
+
+        /* Publish it to the writer */
+        __atomic_store_n(&lSlot->seq, lPos + 1U, __ATOMIC_RELEASE);
+    }
+
+    return lPushed;
+}
+
+size_t CIP_txQueuePop(cipTxQueue_t * const pQueue, cipMessage_t * const pMsgs, const size_t pMax) {
+    size_t lPopped = 0U;
+
+    while(lPopped < pMax) {
+        cipTxSlot_t * const lSlot = &pQueue->slots[pQueue->tail & pQueue->mask];
+        if(pQueue->tail + 1U != __atomic_load_n(&lSlot->seq, __ATOMIC_ACQUIRE)) {
+            /* Empty, or its producer is still copying */
+            break;
+        }
+
+        pMsgs[lPopped++] = lSlot->msg;
+
+        /* Free for the producers one lap later */
+        __atomic_store_n(&lSlot->seq, pQueue->tail + pQueue->mask + 1U, __ATOMIC_RELEASE);
+        pQueue->tail++;
+    }
+
+    return lPopped;
+}
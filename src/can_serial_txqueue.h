@@ -0,0 +1,63 @@
+/**
+ * @brief CAN over serial lock-free MPSC TX queue
+ *
+ * @file can_serial_txqueue.h
+ */
+
+#ifndef can_serial_TXQUEUE_H
+#define can_serial_TXQUEUE_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+#include "can_serial_ring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Type definitions ------------------------------------ */
+typedef struct _cipTxSlot {
+    uint64_t     seq;   /**< Position it is free for, position + 1 once filled */
+    cipMessage_t msg;
+} cipTxSlot_t;
+
+/**
+ * @brief Multi-producer/single-consumer queue of CAN messages.
+ * Any thread sending on the module is a producer : it claims a slot
+ * with a CAS on head, fills it and publishes it through its sequence
+ * number, it never waits for the consumer. The TX writer thread is
+ * the only consumer, it alone writes tail.
+ */
+typedef struct _cipTxQueue {
+    /* Read-only after CIP_txQueueInit */
+    cipTxSlot_t *slots; /**< NULL : no queue */
+    size_t       mask;  /**< Capacity - 1, capacity is a power of 2 */
+
+    /* Producers side */
+    uint64_t head __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+
+    /* Consumer side */
+    uint64_t tail __attribute__((aligned(can_serial_CACHE_LINE_SIZE)));
+} __attribute__((aligned(can_serial_CACHE_LINE_SIZE))) cipTxQueue_t;
+
+/* TX queue functions ---------------------------------- */
+cipErrorCode_t CIP_txQueueInit(cipTxQueue_t * const pQueue, const size_t pCapacity);
+void CIP_txQueueFree(cipTxQueue_t * const pQueue);
+
+/* W/o producer nor consumer running */
+void CIP_txQueueClear(cipTxQueue_t * const pQueue);
+
+/* Producer side, returns the number of messages pushed, stops when the queue is full */
+size_t CIP_txQueuePush(cipTxQueue_t * const pQueue, const cipMessage_t * const pMsgs, const size_t pCount);
+
+/* Consumer side, returns the number of messages popped */
+size_t CIP_txQueuePop(cipTxQueue_t * const pQueue, cipMessage_t * const pMsgs, const size_t pMax);
+
+/* Consumer side */
+static inline bool CIP_txQueueIsEmpty(cipTxQueue_t * const pQueue) {
+    const cipTxSlot_t * const lSlot = &pQueue->slots[pQueue->tail & pQueue->mask];
+    return pQueue->tail + 1U != __atomic_load_n(&lSlot->seq, __ATOMIC_ACQUIRE);
+}
+
+#endif /* can_serial_TXQUEUE_H */
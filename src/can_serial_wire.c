@@ -0,0 +1,248 @@
+/**
+ * @brief CAN over serial UDP wire formats
+ * 
+ * @file can_serial_wire.c
+ */
+
+/* Includes -------------------------------------------- */
+#include "can_serial_wire.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/* Defines --------------------------------------------- */
+#define WIRE_ID_FLAGS_FOLLOW    0x80000000U /**< A flags word follows the ID */
+#define WIRE_ID_STAMP_FOLLOWS   0x40000000U /**< A send time follows the ID (and flags) */
+#define WIRE_ID_RESERVED        0x20000000U /**< Must be 0 */
+#define WIRE_ID_MASK            0x1FFFFFFFU
+
+#define WIRE_FD_ONLY_FLAGS      (can_serial_FLAG_BRS | can_serial_FLAG_ESI)
+
+/* Type definitions ------------------------------------ */
+
+/* Static variables ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static inline void putU32(uint8_t * const pBuf, const uint32_t pValue) {
+    pBuf[0U] = (uint8_t)(pValue >> 24U);
+    pBuf[1U] = (uint8_t)(pValue >> 16U);
+    pBuf[2U] = (uint8_t)(pValue >> 8U);
+    pBuf[3U] = (uint8_t)pValue;
+}
+
+static inline uint32_t getU32(const uint8_t * const pBuf) {
+    return ((uint32_t)pBuf[0U] << 24U)
+        | ((uint32_t)pBuf[1U] << 16U)
+        | ((uint32_t)pBuf[2U] << 8U)
+        | (uint32_t)pBuf[3U];
+}
+
+static inline void putU64(uint8_t * const pBuf, const uint64_t pValue) {
+    putU32(pBuf, (uint32_t)(pValue >> 32U));
+    putU32(&pBuf[4U], (uint32_t)pValue);
+}
+
+static inline uint64_t getU64(const uint8_t * const pBuf) {
+    return ((uint64_t)getU32(pBuf) << 32U) | getU32(&pBuf[4U]);
+}
+
+static inline size_t compactFrameLen(const cipWireFrame_t * const pFrame, const bool pStamp) {
+    return 4U + (0U != pFrame->flags ? 4U : 0U) + (pStamp ? 8U : 0U) + 1U + pFrame->size;
+}
+
+bool CIP_wireFrameIsValid(const uint32_t pFlags, const uint8_t pSize) {
+    if(0U == (pFlags & can_serial_FLAG_FDF)) {
+        return CAN_MESSAGE_MAX_SIZE >= pSize && 0U == (pFlags & WIRE_FD_ONLY_FLAGS);
+    }
+
+    /* No remote frames in CAN FD */
+    return 0U == (pFlags & can_serial_FLAG_RTR)
+        && CAN_FD_MESSAGE_MAX_SIZE >= pSize
+        && CIP_dlcToLength(CIP_lengthToDlc(pSize)) == pSize;
+}
+
+/* Writer functions ------------------------------------ */
+void CIP_wireWriterInit(cipWireWriter_t * const pWriter,
+    uint8_t * const pBuf,
+    const size_t pCap,
+    const cipWireFormat_t pFormat,
+    const uint32_t pRandID)
+{
+    pWriter->buf       = pBuf;
+    pWriter->cap       = pCap;
+    pWriter->len       = 0U;
+    pWriter->count     = 0U;
+    pWriter->format    = pFormat;
+    pWriter->randID    = pRandID;
+    pWriter->sendStamp = 0U;
+}
+
+cipErrorCode_t CIP_wireWriterAppend(cipWireWriter_t * const pWriter, const cipWireFrame_t * const pFrame) {
+    if(!CIP_wireFrameIsValid(pFrame->flags, pFrame->size)) {
+        return can_serial_ERROR_ARG;
+    }
+
+    if(can_serial_WIRE_LEGACY == pWriter->format) {
+        /* One classic frame per datagram */
+        if(CAN_MESSAGE_MAX_SIZE < pFrame->size) {
+            return can_serial_ERROR_ARG;
+        }
+
+        if(0U < pWriter->count || sizeof(cipLegacyWireMessage_t) > pWriter->cap) {
+            return can_serial_ERROR_CONFIG;
+        }
+
+        cipLegacyWireMessage_t lMsg;
+        memset(&lMsg, 0, sizeof(lMsg));
+        lMsg.id     = pFrame->id;
+        lMsg.size   = pFrame->size;
+        lMsg.flags  = pFrame->flags;
+        lMsg.randID = pWriter->randID;
+        memcpy(lMsg.data, pFrame->data, pFrame->size);
+
+        memcpy(pWriter->buf, &lMsg, sizeof(lMsg));
+        pWriter->len   = sizeof(lMsg);
+        pWriter->count = 1U;
+        return can_serial_ERROR_NONE;
+    }
+
+    if(0U != (pFrame->id & ~WIRE_ID_MASK)) {
+        return can_serial_ERROR_ARG;
+    }
+
+    const size_t lHeader = 0U == pWriter->count ? can_serial_WIRE_HEADER_SIZE : 0U;
+    const bool   lStamp  = 0U == pWriter->count && 0U != pWriter->sendStamp;
+    if(UINT8_MAX == pWriter->count || pWriter->len + lHeader + compactFrameLen(pFrame, lStamp) > pWriter->cap) {
+        return can_serial_ERROR_CONFIG;
+    }
+
+    uint8_t *lPos = &pWriter->buf[pWriter->len];
+    if(0U < lHeader) {
+        lPos[0U] = can_serial_WIRE_MAGIC_0;
+        lPos[1U] = can_serial_WIRE_MAGIC_1;
+        lPos[2U] = can_serial_WIRE_VERSION;
+        lPos[3U] = 0U;
+        putU32(&lPos[4U], pWriter->randID);
+        lPos += can_serial_WIRE_HEADER_SIZE;
+    }
+
+    putU32(lPos, pFrame->id
+        | (0U != pFrame->flags ? WIRE_ID_FLAGS_FOLLOW : 0U)
+        | (lStamp ? WIRE_ID_STAMP_FOLLOWS : 0U));
+    lPos += 4U;
+    if(0U != pFrame->flags) {
+        putU32(lPos, pFrame->flags);
+        lPos += 4U;
+    }
+    if(lStamp) {
+        putU64(lPos, pWriter->sendStamp);
+        lPos += 8U;
+    }
+    *lPos++ = pFrame->size;
+    memcpy(lPos, pFrame->data, pFrame->size);
+    lPos += pFrame->size;
+
+    pWriter->len = (size_t)(lPos - pWriter->buf);
+    pWriter->buf[3U] = ++pWriter->count;
+
+    return can_serial_ERROR_NONE;
+}
+
+/* Reader functions ------------------------------------ */
+cipErrorCode_t CIP_wireReaderInit(cipWireReader_t * const pReader, const uint8_t * const pBuf, const size_t pLen) {
+    pReader->buf       = pBuf;
+    pReader->len       = pLen;
+    pReader->pos       = 0U;
+    pReader->left      = 0U;
+    pReader->legacy    = false;
+    pReader->randID    = 0U;
+    pReader->sendStamp = 0U;
+
+    if(can_serial_WIRE_HEADER_SIZE <= pLen
+        && can_serial_WIRE_MAGIC_0 == pBuf[0U]
+        && can_serial_WIRE_MAGIC_1 == pBuf[1U]
+        && can_serial_WIRE_VERSION == pBuf[2U]
+        && 0U < pBuf[3U])
+    {
+        /* Walk the frames once, so that decoding never overruns */
+        size_t lPos = can_serial_WIRE_HEADER_SIZE;
+        uint8_t i = 0U;
+        for(; i < pBuf[3U] && lPos + 5U <= pLen; i++) {
+            const uint32_t lID = getU32(&pBuf[lPos]);
+            if(0U != (lID & WIRE_ID_RESERVED)) {
+                break;
+            }
+
+            /* ID, optional flags and send time, size */
+            const size_t lFlagsLen = 0U != (lID & WIRE_ID_FLAGS_FOLLOW) ? 4U : 0U;
+            const size_t lStampLen = 0U != (lID & WIRE_ID_STAMP_FOLLOWS) ? 8U : 0U;
+            if(lPos + 4U + lFlagsLen + lStampLen + 1U > pLen) {
+                break;
+            }
+
+            const uint32_t lFlags = 0U < lFlagsLen ? getU32(&pBuf[lPos + 4U]) : 0U;
+            lPos += 4U + lFlagsLen + lStampLen;
+
+            if(!CIP_wireFrameIsValid(lFlags, pBuf[lPos])) {
+                break;
+            }
+            lPos += 1U + pBuf[lPos];
+        }
+
+        if(pBuf[3U] == i && pLen == lPos) {
+            pReader->pos    = can_serial_WIRE_HEADER_SIZE;
+            pReader->left   = pBuf[3U];
+            pReader->randID = getU32(&pBuf[4U]);
+            return can_serial_ERROR_NONE;
+        }
+    }
+
+    /* Not a compact datagram, maybe a legacy one */
+    if(sizeof(cipLegacyWireMessage_t) == pLen
+        && CAN_MESSAGE_MAX_SIZE >= pBuf[offsetof(cipLegacyWireMessage_t, size)])
+    {
+        memcpy(&pReader->randID, &pBuf[offsetof(cipLegacyWireMessage_t, randID)], sizeof(pReader->randID));
+        pReader->left   = 1U;
+        pReader->legacy = true;
+        return can_serial_ERROR_NONE;
+    }
+
+    return can_serial_ERROR_ARG;
+}
+
+bool CIP_wireReaderNext(cipWireReader_t * const pReader, cipWireFrame_t * const pFrame) {
+    if(0U == pReader->left) {
+        return false;
+    }
+    pReader->left--;
+
+    if(pReader->legacy) {
+        memcpy(&pFrame->id, &pReader->buf[offsetof(cipLegacyWireMessage_t, id)], sizeof(pFrame->id));
+        memcpy(&pFrame->flags, &pReader->buf[offsetof(cipLegacyWireMessage_t, flags)], sizeof(pFrame->flags));
+        pFrame->size = pReader->buf[offsetof(cipLegacyWireMessage_t, size)];
+        pFrame->data = &pReader->buf[offsetof(cipLegacyWireMessage_t, data)];
+        return true;
+    }
+
+    const uint8_t *lPos = &pReader->buf[pReader->pos];
+    const uint32_t lID  = getU32(lPos);
+    lPos += 4U;
+
+    pFrame->id    = lID & WIRE_ID_MASK;
+    pFrame->flags = 0U;
+    if(0U != (lID & WIRE_ID_FLAGS_FOLLOW)) {
+        pFrame->flags = getU32(lPos);
+        lPos += 4U;
+    }
+    if(0U != (lID & WIRE_ID_STAMP_FOLLOWS)) {
+        pReader->sendStamp = getU64(lPos);
+        lPos += 8U;
+    }
+    pFrame->size = *lPos++;
+    pFrame->data = lPos;
+    lPos += pFrame->size;
+
+    pReader->pos = (size_t)(lPos - pReader->buf);
+
+    return true;
+}
@@ -0,0 +1,99 @@
+/**
+ * @brief CAN over serial UDP wire formats
+ * 
+ * Legacy : one raw, host-endian cipMessage_t (24 bytes) per datagram.
+ * 
+ * Compact (v1) : several frames per datagram, big-endian,
+ * only the used data bytes are carried.
+ *   Header : 'C' 'S' | version (1) | frame count | sender randID (u32)
+ *   Frame  : ID (u32, bit 31 : flags follow, bit 30 : send time follows)
+ *            | [flags (u32)] | [send time (u64, ns since the epoch)] | size (u8) | data
+ *   The send time, if any, applies to the whole datagram (see CIP_setLatencyTracking).
+ *   CAN FD frames (can_serial_FLAG_FDF) carry up to 64 bytes.
+ * 
+ * @file can_serial_wire.h
+ */
+
+#ifndef can_serial_WIRE_H
+#define can_serial_WIRE_H
+
+/* Includes -------------------------------------------- */
+#include "can_serial_error_codes.h"
+#include "can_serial.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines --------------------------------------------- */
+/* Largest datagram we send/receive (Ethernet MTU - IPv4/UDP headers) */
+#define can_serial_WIRE_MAX_DATAGRAM 1472U
+
+#define can_serial_WIRE_MAGIC_0         0x43U /* 'C' */
+#define can_serial_WIRE_MAGIC_1         0x53U /* 'S' */
+#define can_serial_WIRE_VERSION         1U
+#define can_serial_WIRE_HEADER_SIZE     8U
+#define can_serial_WIRE_MAX_FRAME_SIZE  (4U + 4U + 8U + 1U + CAN_FD_MESSAGE_MAX_SIZE)
+
+/* Type definitions ------------------------------------ */
+/* Legacy datagram layout, frozen so that cipMessage_t can evolve */
+typedef struct _cipLegacyWireMessage {
+    uint32_t id;
+    uint8_t  size;
+    uint8_t  data[8U];
+    uint32_t flags;
+    uint32_t randID;
+} cipLegacyWireMessage_t;
+
+/* A frame on the wire, data points into the caller's message or the datagram */
+typedef struct _cipWireFrame {
+    uint32_t       id;
+    uint32_t       flags;
+    uint8_t        size;
+    const uint8_t *data;
+} cipWireFrame_t;
+
+/* Builds one datagram */
+typedef struct _cipWireWriter {
+    uint8_t         *buf;
+    size_t           cap;
+    size_t           len;
+    uint8_t          count;
+    cipWireFormat_t  format;
+    uint32_t         randID;
+    uint64_t         sendStamp; /**< Send time carried by the first frame, 0 : none */
+} cipWireWriter_t;
+
+/* Walks the frames of one received datagram */
+typedef struct _cipWireReader {
+    const uint8_t *buf;
+    size_t         len;
+    size_t         pos;
+    uint8_t        left;    /**< Frames left to read */
+    bool           legacy;
+    uint32_t       randID;
+    uint64_t       sendStamp; /**< Send time of the datagram, 0 : none */
+} cipWireReader_t;
+
+/* Wire functions -------------------------------------- */
+void CIP_wireWriterInit(cipWireWriter_t * const pWriter,
+    uint8_t * const pBuf,
+    const size_t pCap,
+    const cipWireFormat_t pFormat,
+    const uint32_t pRandID);
+
+/* can_serial_ERROR_NONE    : appended
+ * can_serial_ERROR_ARG     : the message cannot be encoded in this format
+ * can_serial_ERROR_CONFIG  : the datagram is full */
+cipErrorCode_t CIP_wireWriterAppend(cipWireWriter_t * const pWriter, const cipWireFrame_t * const pFrame);
+
+/* Checks the whole datagram, can_serial_ERROR_ARG if it is inconsistent */
+cipErrorCode_t CIP_wireReaderInit(cipWireReader_t * const pReader, const uint8_t * const pBuf, const size_t pLen);
+
+/* Returns false when there are no frames left */
+bool CIP_wireReaderNext(cipWireReader_t * const pReader, cipWireFrame_t * const pFrame);
+
+/* Size and flags consistency, CAN FD lengths only w/ can_serial_FLAG_FDF */
+bool CIP_wireFrameIsValid(const uint32_t pFlags, const uint8_t pSize);
+
+#endif /* can_serial_WIRE_H */
@@ -7,27 +7,2311 @@
 /* Includes -------------------------------------------- */
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pty.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+/* can-serial */
+#include "can_serial.h"
+#include "can_serial_slcan.h"
 
 /* Defines --------------------------------------------- */
 
-/* Notes ----------------------------------------------- */
+/* Notes ----------------------------------------------- */
+
+/* Variable declaration -------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static void printUsage(const char * const pProgName)
+{
+    printf("[USAGE] %s test#\n", pProgName);
+    printf("        Test -1 : default/no test\n");
+    printf("        Test  1 : SLCAN over a pseudo-terminal\n");
+    printf("        Test  2 : SLCAN codec round trip\n");
+    printf("        Test  3 : UDP compact and legacy wire formats\n");
+    printf("        Test  4 : CAN FD over UDP\n");
+    printf("        Test  5 : Acceptance filters\n");
+    printf("        Test  6 : Per CAN ID handlers\n");
+    printf("        Test  7 : RX/TX timestamps\n");
+    printf("        Test  8 : Statistics\n");
+    printf("        Test  9 : Latency histogram\n");
+    printf("        Test 10 : Batch put message function\n");
+    printf("        Test 11 : Asynchronous logging\n");
+    printf("        Test 12 : Multi-producer TX queue\n");
+    printf("        Test 13 : CAN ID ordered TX queue\n");
+    printf("        Test 14 : Bitrate-paced TX\n");
+    printf("        Test 15 : Cyclic messages\n");
+    printf("        Test 16 : Memory-mapped traffic capture\n");
+    printf("        Test 17 : Capture replay\n");
+    printf("        Test 18 : Indexed capture queries\n");
+    printf("        Test 19 : Compact wire format w/o CIP_createModule\n");
+    printf("        Test 20 : Lock-free RX ring\n");
+    printf("        Test 21 : epoll reactor threads\n");
+    printf("        Test 22 : Stop and restart\n");
+}
+
+static bool readExpected(const int pFd, const char * const pExpected) {
+    char lBuf[64U] = "";
+    const size_t lLen = strlen(pExpected);
+
+    usleep(10000U);
+    if((ssize_t)lLen != read(pFd, lBuf, lLen) || 0 != memcmp(lBuf, pExpected, lLen)) {
+        printf("[ERROR] Expected \"%s\" on the serial port\n", pExpected);
+        return false;
+    }
+
+    return true;
+}
+
+/* Receives pCount messages on module pID, pMax at a time */
+static size_t recvAll(const cipID_t pID, cipMessage_t * const pMsgs, const size_t pCount, const size_t pMax) {
+    size_t lTotal = 0U;
+    for(size_t lTries = 0U; lTotal < pCount && 100U > lTries; lTries++) {
+        size_t lCount = 0U;
+        const size_t lMax = pCount - lTotal < pMax ? pCount - lTotal : pMax;
+        if(can_serial_ERROR_NONE != CIP_recvBatch(pID, &pMsgs[lTotal], lMax, &lCount)) {
+            break;
+        }
+        lTotal += lCount;
+        if(0U == lCount) {
+            usleep(1000U);
+        }
+    }
+
+    return lTotal;
+}
+
+/* Tests ----------------------------------------------- */
+static int16_t testUdpWireFormats(void) {
+    const cipPort_t lPort = 15300;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* Every size, w/ and w/o flags, several frames per datagram */
+    cipMessage_t lMsgs[300U];
+    cipMessage_t lRecv[300U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 300U; i++) {
+        lMsgs[i].id    = 0U == (i & 1U) ? (uint32_t)(i & 0x7FFU) : (uint32_t)(0x1FFFFFFFU - i);
+        lMsgs[i].flags = 0U == (i & 1U) ? 0U : can_serial_FLAG_EFF;
+        lMsgs[i].size  = (uint8_t)(i % (CAN_MESSAGE_MAX_SIZE + 1U));
+        for(uint8_t j = 0U; j < lMsgs[i].size; j++) {
+            lMsgs[i].data[j] = (uint8_t)(i + j);
+        }
+    }
+
+    /* Sent in chunks, so that the legacy datagrams fit in the socket buffer */
+    const cipWireFormat_t lFormats[2U] = {can_serial_WIRE_COMPACT, can_serial_WIRE_LEGACY};
+    for(size_t f = 0U; f < 2U; f++) {
+        if(can_serial_ERROR_NONE != CIP_setWireFormat(0U, lFormats[f])) {
+            return -1;
+        }
+
+        memset(lRecv, 0, sizeof(lRecv));
+        for(size_t lBase = 0U; lBase < 300U; lBase += 60U) {
+            size_t lSent = 0U;
+            if(can_serial_ERROR_NONE != CIP_sendBatch(0U, &lMsgs[lBase], 60U, NULL, &lSent) || 60U != lSent) {
+                printf("[ERROR] CIP_sendBatch failed (format %d)\n", (int)lFormats[f]);
+                return -1;
+            }
+
+            /* Fewer messages per call than per datagram */
+            const size_t lTotal = recvAll(1U, &lRecv[lBase], 60U, 7U);
+            if(60U != lTotal) {
+                printf("[ERROR] Received %zu messages instead of 60 (format %d)\n", lTotal, (int)lFormats[f]);
+                return -1;
+            }
+
+            /* Our own messages are dropped by the socket filter */
+            cipMessage_t lLoopback[60U];
+            size_t lCount = 0U;
+            if(can_serial_ERROR_NONE != CIP_recvBatch(0U, lLoopback, 60U, &lCount) || 0U != lCount) {
+                printf("[ERROR] %zu loopback messages received (format %d)\n", lCount, (int)lFormats[f]);
+                return -1;
+            }
+        }
+
+        for(size_t i = 0U; i < 300U; i++) {
+            if(lMsgs[i].id != lRecv[i].id
+                || lMsgs[i].flags != lRecv[i].flags
+                || lMsgs[i].size != lRecv[i].size
+                || 0 != memcmp(lMsgs[i].data, lRecv[i].data, CAN_MESSAGE_MAX_SIZE)
+                || lRecv[0U].randID != lRecv[i].randID)
+            {
+                printf("[ERROR] Message %zu differs (format %d)\n", i, (int)lFormats[f]);
+                return -1;
+            }
+        }
+    }
+
+    /* IDs over 29 bits do not fit the compact format */
+    cipErrorCode_t lResults[2U];
+    size_t lSent = 0U;
+    lMsgs[1U].id = 0xFFFFFFFFU;
+    if(can_serial_ERROR_NONE != CIP_setWireFormat(0U, can_serial_WIRE_COMPACT)
+        || can_serial_ERROR_NET != CIP_sendBatch(0U, lMsgs, 2U, lResults, &lSent)
+        || 1U != lSent
+        || can_serial_ERROR_NONE != lResults[0U]
+        || can_serial_ERROR_ARG != lResults[1U])
+    {
+        printf("[ERROR] Invalid message not reported\n");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testSlcanCodec(void) {
+    /* Every size, standard/extended and remote frames */
+    char lBuf[64U * can_serial_SLCAN_MAX_FRAME_LEN];
+    cipMessage_t lMsgs[64U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 64U; i++) {
+        lMsgs[i].id    = 0U == (i & 1U) ? (uint32_t)(0x7FFU - i) : (uint32_t)(0x1FFFFFFFU - i * 0x00101011U);
+        lMsgs[i].size  = (uint8_t)(i % (CAN_MESSAGE_MAX_SIZE + 1U));
+        lMsgs[i].flags = (0U == (i & 1U) ? 0U : can_serial_FLAG_EFF) | (0U == (i % 7U) ? can_serial_FLAG_RTR : 0U);
+        for(uint8_t j = 0U; j < lMsgs[i].size && 0U == (lMsgs[i].flags & can_serial_FLAG_RTR); j++) {
+            lMsgs[i].data[j] = (uint8_t)(i * 37U + j * 11U);
+        }
+    }
+
+    size_t lLen = 0U;
+    if(64U != CIP_slcanEncodeBatch(lMsgs, 64U, lBuf, sizeof(lBuf), &lLen)) {
+        printf("[ERROR] CIP_slcanEncodeBatch failed\n");
+        return -1;
+    }
+
+    cipMessage_t lDecoded[64U];
+    size_t lConsumed = 0U;
+    if(64U != CIP_slcanParse(lBuf, lLen, lDecoded, 64U, &lConsumed) || lLen != lConsumed) {
+        printf("[ERROR] CIP_slcanParse failed\n");
+        return -1;
+    }
+
+    for(size_t i = 0U; i < 64U; i++) {
+        if(lMsgs[i].id != lDecoded[i].id
+            || lMsgs[i].size != lDecoded[i].size
+            || lMsgs[i].flags != lDecoded[i].flags
+            || 0 != memcmp(lMsgs[i].data, lDecoded[i].data, lMsgs[i].size))
+        {
+            printf("[ERROR] Frame %zu differs after the round trip\n", i);
+            return -1;
+        }
+    }
+
+    /* Lower case is accepted, non-hex characters are not */
+    cipMessage_t lMsg;
+    if(can_serial_ERROR_NONE != CIP_slcanDecode("t1238deadbeefcafef00d", 21U, &lMsg)
+        || 0xDEU != lMsg.data[0U] || 0x0DU != lMsg.data[7U]
+        || can_serial_ERROR_NONE == CIP_slcanDecode("t1238deadbeefcafef0g0", 21U, &lMsg)
+        || can_serial_ERROR_NONE == CIP_slcanDecode("t12G0", 5U, &lMsg)
+        || can_serial_ERROR_NONE == CIP_slcanDecode("t1239", 5U, &lMsg))
+    {
+        printf("[ERROR] CIP_slcanDecode accepted/rejected the wrong frames\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int16_t testSerialPty(void) {
+    int  lMaster = -1;
+    int  lSlave  = -1;
+    char lName[64U] = "";
+
+    if(0 != openpty(&lMaster, &lSlave, lName, NULL, NULL)) {
+        printf("[ERROR] openpty failed\n");
+        return -1;
+    }
+
+    if(can_serial_ERROR_NONE != CIP_initSerial(0U, can_serial_MODE_NORMAL, lName, 3000000U)) {
+        printf("[ERROR] CIP_initSerial failed\n");
+        return -1;
+    }
+
+    /* The adapter's channel is opened */
+    if(!readExpected(lMaster, "C\rO\r")) {
+        return -1;
+    }
+
+    /* Frames split across reads, w/ an acknowledge and an error bell in between */
+    const char * const lChunks[] = {
+        "t12381122",
+        "334455667788\rT1ABCDEF0",
+        "2AABB\r\az\rr7FF0\r"
+    };
+
+    cipMessage_t lMsgs[4U];
+    size_t lTotal = 0U;
+    for(size_t i = 0U; i < sizeof(lChunks) / sizeof(lChunks[0U]); i++) {
+        size_t lCount = 0U;
+        if((ssize_t)strlen(lChunks[i]) != write(lMaster, lChunks[i], strlen(lChunks[i]))) {
+            return -1;
+        }
+        usleep(10000U);
+        if(can_serial_ERROR_NONE != CIP_recvBatch(0U, &lMsgs[lTotal], 4U - lTotal, &lCount)) {
+            printf("[ERROR] CIP_recvBatch failed\n");
+            return -1;
+        }
+        lTotal += lCount;
+    }
+
+    if(3U != lTotal
+        || 0x123U != lMsgs[0U].id || 8U != lMsgs[0U].size || 0x11U != lMsgs[0U].data[0U] || 0x88U != lMsgs[0U].data[7U]
+        || 0x1ABCDEF0U != lMsgs[1U].id || 2U != lMsgs[1U].size || can_serial_FLAG_EFF != lMsgs[1U].flags || 0xBBU != lMsgs[1U].data[1U]
+        || 0x7FFU != lMsgs[2U].id || can_serial_FLAG_RTR != lMsgs[2U].flags)
+    {
+        printf("[ERROR] Wrong frames decoded (%zu)\n", lTotal);
+        return -1;
+    }
+
+    /* Send a frame */
+    const uint8_t lData[2U] = {0xDEU, 0xADU};
+    if(can_serial_ERROR_NONE != CIP_send(0U, 0x123U, 2U, lData, 0U)
+        || !readExpected(lMaster, "t1232DEAD\r"))
+    {
+        return -1;
+    }
+
+    close(lSlave);
+    close(lMaster);
+
+    return 0;
+}
+
+static int16_t testCanFd(void) {
+    const cipPort_t lPort = 15301;
+
+    /* DLC mapping */
+    const uint8_t lLengths[16U] = {0U, 1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 12U, 16U, 20U, 24U, 32U, 48U, 64U};
+    for(uint8_t i = 0U; i < 16U; i++) {
+        if(lLengths[i] != CIP_dlcToLength(i) || i != CIP_lengthToDlc(lLengths[i])) {
+            printf("[ERROR] Wrong DLC mapping for DLC %u\n", i);
+            return -1;
+        }
+    }
+    if(9U != CIP_lengthToDlc(9U) || 14U != CIP_lengthToDlc(33U) || 15U != CIP_lengthToDlc(49U)) {
+        printf("[ERROR] Lengths are not rounded up to the next DLC\n");
+        return -1;
+    }
+
+    /* Modules 0 and 1 are CAN FD, module 2 is classic */
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_createModule(2U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_FD, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_FD, lPort)
+        || can_serial_ERROR_NONE != CIP_init(2U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* Every CAN FD length, and a classic frame */
+    cipFdMessage_t lMsgs[17U];
+    cipFdMessage_t lRecv[17U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(uint8_t i = 0U; i < 16U; i++) {
+        lMsgs[i].id    = 0x100U + i;
+        lMsgs[i].size  = lLengths[i];
+        lMsgs[i].flags = can_serial_FLAG_FDF | (0U == (i & 1U) ? can_serial_FLAG_BRS : 0U);
+        for(uint8_t j = 0U; j < lMsgs[i].size; j++) {
+            lMsgs[i].data[j] = (uint8_t)(i ^ j);
+        }
+    }
+    lMsgs[16U].id   = 0x7FFU;
+    lMsgs[16U].size = 2U;
+
+    size_t lSent = 0U;
+    if(can_serial_ERROR_NONE != CIP_sendFdBatch(0U, lMsgs, 17U, NULL, &lSent) || 17U != lSent) {
+        printf("[ERROR] CIP_sendFdBatch failed\n");
+        return -1;
+    }
+
+    size_t lTotal = 0U;
+    for(size_t lTries = 0U; 17U > lTotal && 100U > lTries; lTries++) {
+        size_t lCount = 0U;
+        if(can_serial_ERROR_NONE != CIP_recvFdBatch(1U, &lRecv[lTotal], 17U - lTotal, &lCount)) {
+            return -1;
+        }
+        lTotal += lCount;
+        usleep(1000U);
+    }
+
+    for(size_t i = 0U; i < 17U; i++) {
+        if(17U != lTotal
+            || lMsgs[i].id != lRecv[i].id
+            || lMsgs[i].flags != lRecv[i].flags
+            || lMsgs[i].size != lRecv[i].size
+            || 0 != memcmp(lMsgs[i].data, lRecv[i].data, CAN_FD_MESSAGE_MAX_SIZE))
+        {
+            printf("[ERROR] CAN FD message %zu differs (%zu received)\n", i, lTotal);
+            return -1;
+        }
+    }
+
+    /* The classic module only gets the frames that fit in 8 bytes */
+    cipMessage_t lClassic[17U];
+    if(9U + 1U != recvAll(2U, lClassic, 17U, 17U) || 0x7FFU != lClassic[9U].id) {
+        printf("[ERROR] The classic module got CAN FD payloads\n");
+        return -1;
+    }
+
+    /* Padded to the next CAN FD length */
+    const uint8_t lData[13U] = {1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 9U, 10U, 11U, 12U, 13U};
+    if(can_serial_ERROR_NONE != CIP_sendFd(0U, 0x123U, 13U, lData, can_serial_FLAG_BRS)) {
+        return -1;
+    }
+    lTotal = 0U;
+    for(size_t lTries = 0U; 0U == lTotal && 100U > lTries; lTries++) {
+        usleep(1000U);
+        (void)CIP_recvFdBatch(1U, lRecv, 1U, &lTotal);
+    }
+    if(1U != lTotal || 16U != lRecv[0U].size || 13U != lRecv[0U].data[12U] || 0U != lRecv[0U].data[13U]
+        || (can_serial_FLAG_FDF | can_serial_FLAG_BRS) != lRecv[0U].flags)
+    {
+        printf("[ERROR] CIP_sendFd payload was not padded\n");
+        return -1;
+    }
+
+    /* Invalid CAN FD lengths, FD payloads on a classic module or in the legacy format */
+    cipErrorCode_t lResult = can_serial_ERROR_NONE;
+    lMsgs[0U].size = 13U;
+    if(can_serial_ERROR_NET != CIP_sendFdBatch(0U, lMsgs, 1U, &lResult, NULL) || can_serial_ERROR_ARG != lResult
+        || can_serial_ERROR_CONFIG != CIP_sendFd(2U, 0x123U, 13U, lData, 0U)
+        || can_serial_ERROR_NONE != CIP_setWireFormat(0U, can_serial_WIRE_LEGACY)
+        || can_serial_ERROR_NET != CIP_sendFdBatch(0U, &lMsgs[15U], 1U, &lResult, NULL) || can_serial_ERROR_ARG != lResult)
+    {
+        printf("[ERROR] Invalid CAN FD messages were sent\n");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(2U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testFilters(void) {
+    const cipPort_t lPort = 15302;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* 0x100-0x10F, 0x7FF, 29-bit 0x18FF00xx and a non-contiguous 29-bit mask */
+    const cipFilter_t lFilters[] = {
+        {0x100U,      0x7F0U,      0U},
+        {0x7FFU,      0x7FFU,      0U},
+        {0x18FF0000U, 0x1FFFFF00U, can_serial_FLAG_EFF},
+        {0x00001000U, 0x1FFF0F00U, can_serial_FLAG_EFF}
+    };
+    if(can_serial_ERROR_NONE != CIP_setFilters(1U, lFilters, sizeof(lFilters) / sizeof(lFilters[0U]))) {
+        printf("[ERROR] CIP_setFilters failed\n");
+        return -1;
+    }
+
+    typedef struct {
+        uint32_t id;
+        uint32_t flags;
+        bool     accepted;
+    } filterCase_t;
+    const filterCase_t lCases[] = {
+        {0x100U,      0U,                  true},
+        {0x10FU,      0U,                  true},
+        {0x110U,      0U,                  false},
+        {0x7FFU,      0U,                  true},
+        {0x0FFU,      0U,                  false},
+        {0x100U,      can_serial_FLAG_EFF, false},
+        {0x18FF0042U, can_serial_FLAG_EFF, true},
+        {0x18FE0042U, can_serial_FLAG_EFF, false},
+        {0x0000A042U, can_serial_FLAG_EFF, true},
+        {0x0000A142U, can_serial_FLAG_EFF, false}
+    };
+    const size_t lNbCases = sizeof(lCases) / sizeof(lCases[0U]);
+
+    /* Single-frame datagrams (filtered in the kernel), then one multi-frame datagram,
+     * in the compact and legacy formats */
+    const cipWireFormat_t lFormats[2U] = {can_serial_WIRE_COMPACT, can_serial_WIRE_LEGACY};
+    for(size_t f = 0U; f < 2U; f++) {
+        for(size_t lBatch = 0U; lBatch < 2U; lBatch++) {
+            cipMessage_t lMsgs[16U];
+            memset(lMsgs, 0, sizeof(lMsgs));
+            for(size_t i = 0U; i < lNbCases; i++) {
+                lMsgs[i].id    = lCases[i].id;
+                lMsgs[i].flags = lCases[i].flags;
+                lMsgs[i].size  = 1U;
+                if(0U == lBatch && can_serial_ERROR_NONE != CIP_send(0U, lMsgs[i].id, 1U, lMsgs[i].data, lMsgs[i].flags)) {
+                    return -1;
+                }
+            }
+            if(1U == lBatch && can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, lNbCases, NULL, NULL)) {
+                return -1;
+            }
+            usleep(10000U);
+
+            cipMessage_t lRecv[16U];
+            size_t lCount = 0U;
+            if(can_serial_ERROR_NONE != CIP_recvBatch(1U, lRecv, 16U, &lCount)) {
+                return -1;
+            }
+
+            size_t lExpected = 0U;
+            for(size_t i = 0U; i < lNbCases; i++) {
+                if(!lCases[i].accepted) {
+                    continue;
+                }
+                if(lExpected >= lCount || lCases[i].id != lRecv[lExpected].id) {
+                    printf("[ERROR] ID 0x%X was not received (format %d, batch %zu)\n", lCases[i].id, (int)lFormats[f], lBatch);
+                    return -1;
+                }
+                lExpected++;
+            }
+            if(lExpected != lCount) {
+                printf("[ERROR] %zu unwanted frames received (format %d, batch %zu)\n", lCount - lExpected, (int)lFormats[f], lBatch);
+                return -1;
+            }
+        }
+
+        if(can_serial_ERROR_NONE != CIP_setWireFormat(0U, can_serial_WIRE_LEGACY)) {
+            return -1;
+        }
+    }
+
+    /* No filter : everything goes through again */
+    if(can_serial_ERROR_NONE != CIP_setFilters(1U, NULL, 0U)
+        || can_serial_ERROR_NONE != CIP_send(0U, 0x110U, 0U, NULL, 0U))
+    {
+        return -1;
+    }
+    cipMessage_t lMsg;
+    if(1U != recvAll(1U, &lMsg, 1U, 1U) || 0x110U != lMsg.id) {
+        printf("[ERROR] Filters were not removed\n");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+/* Handler contexts : one counter per registered CAN ID */
+typedef struct {
+    uint32_t id;
+    uint32_t count;
+} handlerCtx_t;
+
+static uint32_t sUnhandled = 0U;
+
+static int countHandler(void * const pCtx, const uint32_t pCANID, const uint8_t pSize, const uint8_t * const pData, const uint32_t pFlags) {
+    (void)pSize;
+    (void)pData;
+    (void)pFlags;
+
+    handlerCtx_t * const lCtx = (handlerCtx_t *)pCtx;
+    if(lCtx->id != pCANID) {
+        printf("[ERROR] Handler of 0x%X got CAN ID 0x%X\n", lCtx->id, pCANID);
+        return -1;
+    }
+    __atomic_add_fetch(&lCtx->count, 1U, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static int countUnhandled(const uint8_t pCallerID, const uint32_t pCANID, const uint8_t pSize, const uint8_t * const pData, const uint32_t pFlags) {
+    (void)pCallerID;
+    (void)pCANID;
+    (void)pSize;
+    (void)pData;
+    (void)pFlags;
+
+    __atomic_add_fetch(&sUnhandled, 1U, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static int16_t testHandlers(void) {
+    const cipPort_t lPort = 15303;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* 8 standard IDs, 500 extended IDs to make the hash map grow,
+     * and the extended ID 0x10 next to the standard ID 0x10 */
+    static handlerCtx_t sCtx[509U];
+    for(uint32_t i = 0U; i < 509U; i++) {
+        sCtx[i].id    = i < 8U ? 0x10U + i : (i < 508U ? 0x18DA0000U + (i - 8U) * 37U : 0x10U);
+        sCtx[i].count = 0U;
+        const uint32_t lCANID = 508U == i ? (can_serial_ID_EXT | 0x10U) : sCtx[i].id;
+        if(can_serial_ERROR_NONE != CIP_registerHandler(1U, lCANID, countHandler, &sCtx[i])) {
+            printf("[ERROR] CIP_registerHandler failed for 0x%X\n", lCANID);
+            return -1;
+        }
+    }
+
+    /* Unregistered IDs go to the put message function */
+    if(can_serial_ERROR_NONE != CIP_registerHandler(1U, 0x18DA0000U + 10U * 37U, NULL, NULL)
+        || can_serial_ERROR_ARG != CIP_registerHandler(1U, 0x40000000U, countHandler, &sCtx[0U])
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(1U, 0U, countUnhandled)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        printf("[ERROR] Handler setup failed\n");
+        return -1;
+    }
+
+    cipMessage_t lMsgs[509U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 509U; i++) {
+        lMsgs[i].id    = sCtx[i].id;
+        lMsgs[i].flags = i < 8U ? 0U : can_serial_FLAG_EFF;
+        lMsgs[i].size  = 1U;
+    }
+    for(size_t i = 0U; i < 509U; i += 50U) {
+        if(can_serial_ERROR_NONE != CIP_sendBatch(0U, &lMsgs[i], 509U - i < 50U ? 509U - i : 50U, NULL, NULL)) {
+            return -1;
+        }
+        usleep(2000U);
+    }
+    /* Unknown standard ID */
+    if(can_serial_ERROR_NONE != CIP_send(0U, 0x7FFU, 0U, NULL, 0U)) {
+        return -1;
+    }
+    usleep(20000U);
+
+    for(size_t i = 0U; i < 509U; i++) {
+        const uint32_t lExpected = 18U == i ? 0U : 1U;
+        if(lExpected != __atomic_load_n(&sCtx[i].count, __ATOMIC_RELAXED)) {
+            printf("[ERROR] Handler of 0x%X called %u times\n", sCtx[i].id, sCtx[i].count);
+            return -1;
+        }
+    }
+    if(2U != __atomic_load_n(&sUnhandled, __ATOMIC_RELAXED)) {
+        printf("[ERROR] %u unhandled frames instead of 2\n", sUnhandled);
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testTimestamps(void) {
+    const cipPort_t lPort = 15304;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_setTxTimestamping(0U, true)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    struct timespec lTime;
+    clock_gettime(CLOCK_REALTIME, &lTime);
+    const uint64_t lBefore = (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+
+    uint64_t lTxTime = 0U;
+    if(can_serial_ERROR_NONE != CIP_send(0U, 0x123U, 0U, NULL, 0U)
+        || can_serial_ERROR_NONE != CIP_getTxTimestamp(0U, &lTxTime))
+    {
+        return -1;
+    }
+
+    cipMessage_t lMsg;
+    if(1U != recvAll(1U, &lMsg, 1U, 1U)) {
+        printf("[ERROR] The message was not received\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &lTime);
+    const uint64_t lAfter = (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+
+    /* The kernel stamps the datagram between the send and recv calls.
+     * Broadcasts are looped back before they leave, so RX may precede TX. */
+    if(lBefore > lTxTime || lTxTime > lAfter || lBefore > lMsg.timestamp || lMsg.timestamp > lAfter) {
+        printf("[ERROR] Inconsistent timestamps : before %" PRIu64 ", TX %" PRIu64 ", RX %" PRIu64 ", after %" PRIu64 "\n",
+            lBefore, lTxTime, lMsg.timestamp, lAfter);
+        return -1;
+    }
+
+    /* Disabled on the receiver */
+    if(can_serial_ERROR_CONFIG != CIP_getTxTimestamp(1U, &lTxTime)) {
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int countFrame(const uint8_t pCallerID, const uint32_t pCANID, const uint8_t pSize, const uint8_t * const pData, const uint32_t pFlags) {
+    (void)pCallerID;
+    (void)pCANID;
+    (void)pSize;
+    (void)pData;
+    (void)pFlags;
+
+    return 0;
+}
+
+static int16_t testStats(void) {
+    const cipPort_t lPort = 15305;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* Module 1 only wants 0x100-0x1FF */
+    const cipFilter_t lFilter = {0x100U, 0x700U, 0U};
+    if(can_serial_ERROR_NONE != CIP_setFilters(1U, &lFilter, 1U)
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(0U, 0U, countFrame)
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(1U, 1U, countFrame)
+        || can_serial_ERROR_NONE != CIP_process(0U)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        return -1;
+    }
+
+    /* 10 frames in one datagram, 6 accepted by module 1 */
+    cipMessage_t lMsgs[10U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 10U; i++) {
+        lMsgs[i].id   = i < 6U ? 0x100U + i : 0x200U + i;
+        lMsgs[i].size = (uint8_t)(i % 9U);
+    }
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 10U, NULL, NULL)
+        || can_serial_ERROR_ARG != CIP_send(0U, 0x100U, 9U, lMsgs[0U].data, 0U))
+    {
+        return -1;
+    }
+    usleep(20000U);
+
+    cipStats_t lTx;
+    cipStats_t lRx;
+    if(can_serial_ERROR_NONE != CIP_getStats(0U, &lTx)
+        || can_serial_ERROR_NONE != CIP_getStats(1U, &lRx))
+    {
+        return -1;
+    }
+
+    /* 0 + 1 + ... + 8 + 0 payload bytes, 0 + ... + 5 accepted.
+     * The sender's socket filter drops its own datagram. */
+    if(10U != lTx.txFrames || 36U != lTx.txBytes || 1U != lTx.txFailures
+        || 0U != lTx.rxFrames || 0U != lTx.callbackCalls)
+    {
+        printf("[ERROR] Wrong sender stats : %" PRIu64 " frames, %" PRIu64 " bytes, %" PRIu64 " failures, %" PRIu64 " received\n",
+            lTx.txFrames, lTx.txBytes, lTx.txFailures, lTx.rxFrames);
+        return -1;
+    }
+    if(6U != lRx.rxFrames || 15U != lRx.rxBytes || 4U != lRx.filteredFrames
+        || 6U != lRx.callbackCalls || 0U != lRx.callbackFailures)
+    {
+        printf("[ERROR] Wrong receiver stats : %" PRIu64 " frames, %" PRIu64 " bytes, %" PRIu64 " filtered, %" PRIu64 " calls\n",
+            lRx.rxFrames, lRx.rxBytes, lRx.filteredFrames, lRx.callbackCalls);
+        return -1;
+    }
+
+    /* Nothing left to read */
+    size_t lCount = 0U;
+    if(can_serial_ERROR_NONE != CIP_recvBatch(1U, lMsgs, 10U, &lCount)
+        || can_serial_ERROR_NONE != CIP_getStats(1U, &lRx)
+        || 0U != lCount || 0U == lRx.eagainSpins)
+    {
+        printf("[ERROR] EAGAIN was not counted\n");
+        return -1;
+    }
+
+    if(can_serial_ERROR_NONE != CIP_resetStats(1U)
+        || can_serial_ERROR_NONE != CIP_getStats(1U, &lRx)
+        || 0U != lRx.rxFrames || 0U != lRx.callbackCalls)
+    {
+        printf("[ERROR] CIP_resetStats failed\n");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testLatencyHist(void) {
+    const cipPort_t lPort = 15306;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_setLatencyTracking(0U, true)
+        || can_serial_ERROR_NONE != CIP_setLatencyTracking(1U, true)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* 100 frames, one or several per datagram */
+    cipMessage_t lMsgs[100U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 100U; i++) {
+        lMsgs[i].id   = 0x100U + i;
+        lMsgs[i].size = (uint8_t)(i % 9U);
+        if(0U == (i % 10U) && can_serial_ERROR_NONE != CIP_send(0U, lMsgs[i].id, lMsgs[i].size, lMsgs[i].data, 0U)) {
+            return -1;
+        }
+    }
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 90U, NULL, NULL)) {
+        return -1;
+    }
+
+    cipMessage_t lRecv[100U];
+    if(100U != recvAll(1U, lRecv, 100U, 100U)) {
+        printf("[ERROR] Frames carrying a send time were not received\n");
+        return -1;
+    }
+
+    cipLatencyHist_t lHist;
+    if(can_serial_ERROR_NONE != CIP_getLatencyHist(1U, &lHist)) {
+        return -1;
+    }
+
+    const uint64_t lP50  = CIP_latencyHistPercentile(&lHist, 50.0);
+    const uint64_t lP99  = CIP_latencyHistPercentile(&lHist, 99.0);
+    const uint64_t lP999 = CIP_latencyHistPercentile(&lHist, 99.9);
+    printf("[INFO ] Latency : p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p99.9 %" PRIu64 " ns, max %" PRIu64 " ns\n",
+        lP50, lP99, lP999, lHist.maxNs);
+
+    /* Same host, same clock : never skewed, well under a second */
+    if(100U != lHist.total || 0U != lHist.skewed
+        || lHist.minNs > lP50 || lP50 > lP99 || lP99 > lP999 || lP999 > lHist.maxNs
+        || 1000000000U < lHist.maxNs)
+    {
+        printf("[ERROR] Inconsistent latency histogram (%" PRIu64 " samples)\n", lHist.total);
+        return -1;
+    }
+
+    /* Merging doubles the counts, not the percentiles */
+    cipLatencyHist_t lMerged;
+    CIP_latencyHistInit(&lMerged);
+    CIP_latencyHistMerge(&lMerged, &lHist);
+    CIP_latencyHistMerge(&lMerged, &lHist);
+    if(200U != lMerged.total || lP99 != CIP_latencyHistPercentile(&lMerged, 99.0)) {
+        printf("[ERROR] CIP_latencyHistMerge failed\n");
+        return -1;
+    }
+
+    /* No send time in the legacy format */
+    if(can_serial_ERROR_NONE != CIP_resetLatencyHist(1U)
+        || can_serial_ERROR_NONE != CIP_setWireFormat(0U, can_serial_WIRE_LEGACY)
+        || can_serial_ERROR_NONE != CIP_send(0U, 0x123U, 0U, NULL, 0U)
+        || 1U != recvAll(1U, lRecv, 1U, 1U)
+        || can_serial_ERROR_NONE != CIP_getLatencyHist(1U, &lHist)
+        || 0U != lHist.total || 0U != CIP_latencyHistPercentile(&lHist, 50.0))
+    {
+        printf("[ERROR] Legacy datagram recorded a latency\n");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static size_t   sBatchFrames = 0U;
+static size_t   sBatchCalls  = 0U;
+static uint32_t sBatchLastID = 0U;
+static bool     sBatchOrdered = true;
+
+static int countBatch(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+
+    for(size_t i = 0U; i < pCount; i++) {
+        if(sBatchLastID >= pMsgs[i].id || (uint8_t)(pMsgs[i].id % 9U) != pMsgs[i].size) {
+            sBatchOrdered = false;
+        }
+        sBatchLastID = pMsgs[i].id;
+    }
+
+    __atomic_fetch_add(&sBatchFrames, pCount, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sBatchCalls, 1U, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static int16_t testBatchCallback(void) {
+    const cipPort_t lPort = 15307;
+
+    /* Module 1 has both functions, the batch one wins */
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_createModule(2U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(2U, can_serial_MODE_FD, lPort + 1)
+        || can_serial_ERROR_NONE != CIP_setPutMessageFunction(1U, 1U, countFrame)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countBatch)
+        || can_serial_ERROR_ARG != CIP_setPutMessagesFunction(1U, 1U, NULL)
+        || can_serial_ERROR_CONFIG != CIP_setPutMessagesFunction(2U, 2U, countBatch)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        printf("[ERROR] CIP_setPutMessagesFunction failed\n");
+        return -1;
+    }
+
+    /* 64 frames in a few datagrams */
+    cipMessage_t lMsgs[64U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 64U; i++) {
+        lMsgs[i].id   = 0x100U + i;
+        lMsgs[i].size = (uint8_t)(lMsgs[i].id % 9U);
+    }
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 64U, NULL, NULL)) {
+        return -1;
+    }
+
+    for(size_t lTry = 0U; lTry < 100U && 64U > __atomic_load_n(&sBatchFrames, __ATOMIC_RELAXED); lTry++) {
+        usleep(1000U);
+    }
+
+    cipStats_t lRx;
+    if(can_serial_ERROR_NONE != CIP_getStats(1U, &lRx)) {
+        return -1;
+    }
+
+    const size_t lCalls = __atomic_load_n(&sBatchCalls, __ATOMIC_RELAXED);
+    if(64U != __atomic_load_n(&sBatchFrames, __ATOMIC_RELAXED) || !sBatchOrdered
+        || 0U == lCalls || 64U <= lCalls || lCalls != lRx.callbackCalls)
+    {
+        printf("[ERROR] %zu frames in %zu calls\n", sBatchFrames, lCalls);
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(2U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static size_t   sLogLines   = 0U;
+static size_t   sLogSends   = 0U;
+static uint64_t sLogDropped = 0U;
+static size_t   sLogDebug   = 0U;
+static bool     sLogErrno   = false;
+
+/* Called under the library's log lock */
+static void countLog(void * const pCtx, const cipLogLevel_t pLevel, const char * const pLine) {
+    (void)pCtx;
+
+    const char * const lDropped = strstr(pLine, " messages dropped");
+    sLogLines++;
+    if(NULL != strstr(pLine, "[ERROR] <CIP_send> No CAN-IP module has the ID 200\n")) {
+        sLogSends++;
+    } else if(NULL != lDropped && can_serial_LOG_WARN == pLevel) {
+        sLogDropped += strtoull(strchr(pLine, '>') + 1, NULL, 10);
+    }
+    if(can_serial_LOG_DEBUG == pLevel) {
+        sLogDebug++;
+    }
+    if(NULL != strstr(pLine, "errno = 2 (")) {
+        sLogErrno = true;
+    }
+}
+
+/* Logs from the sink, once */
+static bool sLogReentered = false;
+static bool sLogReentryOK = false;
+static void reenterLog(void * const pCtx, const cipLogLevel_t pLevel, const char * const pLine) {
+    if(!sLogReentered) {
+        sLogReentered = true;
+        sLogReentryOK = can_serial_ERROR_ARG == CIP_setLogLevel((cipLogLevel_t)4U)
+            && 0U == CIP_logFlush()
+            && can_serial_ERROR_ARG == CIP_setLogSink(NULL, NULL);
+    }
+    countLog(pCtx, pLevel, pLine);
+}
+
+static int16_t testLogging(void) {
+    if(can_serial_ERROR_NONE != CIP_setLogSink(countLog, NULL)
+        || can_serial_ERROR_ARG != CIP_setLogLevel((cipLogLevel_t)4U)
+        || can_serial_ERROR_NONE != CIP_setLogLevel(can_serial_LOG_ERROR))
+    {
+        return -1;
+    }
+
+    /* Hot path messages are queued, every one is written or counted as dropped */
+    const size_t lNbSends = 4U * 1024U;
+    for(size_t i = 0U; i < lNbSends; i++) {
+        if(can_serial_ERROR_ARG != CIP_send(200U, 0x123U, 0U, NULL, 0U)) {
+            return -1;
+        }
+    }
+    (void)CIP_logFlush();
+
+    if(lNbSends != sLogSends + sLogDropped) {
+        printf("[ERROR] %zu messages written, %" PRIu64 " dropped instead of %zu\n", sLogSends, sLogDropped, lNbSends);
+        return -1;
+    }
+
+    /* Synchronous error w/ its errno, debug messages filtered out */
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE == CIP_initSerial(0U, can_serial_MODE_NORMAL, "/dev/does-not-exist", 115200U))
+    {
+        return -1;
+    }
+    (void)CIP_logFlush();
+
+    if(!sLogErrno || 0U != sLogDebug) {
+        printf("[ERROR] errno line missing or debug messages logged\n");
+        return -1;
+    }
+
+    /* A sink logging does not deadlock, its synchronous messages are dropped */
+    sLogDropped = 0U;
+    if(can_serial_ERROR_NONE != CIP_setLogSink(reenterLog, NULL)
+        || can_serial_ERROR_ARG != CIP_setLogLevel((cipLogLevel_t)4U))
+    {
+        return -1;
+    }
+    (void)CIP_logFlush();
+
+    if(!sLogReentered || !sLogReentryOK || 1U != sLogDropped) {
+        printf("[ERROR] Logging from the sink misbehaved\n");
+        return -1;
+    }
+
+    /* Back to stdout */
+    const size_t lLines = sLogLines;
+    if(can_serial_ERROR_NONE != CIP_setLogSink(NULL, NULL)
+        || can_serial_ERROR_NONE != CIP_setLogLevel(can_serial_LOG_DEBUG)
+        || can_serial_ERROR_ARG != CIP_send(200U, 0x123U, 0U, NULL, 0U))
+    {
+        return -1;
+    }
+    (void)CIP_logFlush();
+
+    if(lLines != sLogLines)
+    {
+        printf("[ERROR] The default sink was not restored\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------- */
+/* Main tests ------------------------------------------ */
+/* ----------------------------------------------------- */
+#define TX_QUEUE_PRODUCERS  4U
+#define TX_QUEUE_FRAMES     2000U
+
+static size_t   sTxQueueFrames = 0U;
+static uint32_t sTxQueueNext[TX_QUEUE_PRODUCERS];
+static bool     sTxQueueOrdered = true;
+
+/* Each producer sends its own ID w/ an increasing counter */
+static int countQueuedFrames(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+
+    for(size_t i = 0U; i < pCount; i++) {
+        const uint32_t lProducer = pMsgs[i].id - 0x200U;
+        uint32_t lCounter = 0U;
+        memcpy(&lCounter, pMsgs[i].data, sizeof(lCounter));
+        if(TX_QUEUE_PRODUCERS <= lProducer || sTxQueueNext[lProducer] != lCounter) {
+            sTxQueueOrdered = false;
+        } else {
+            sTxQueueNext[lProducer]++;
+        }
+    }
+    __atomic_fetch_add(&sTxQueueFrames, pCount, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static void *produceFrames(void *pArg) {
+    const uint32_t lProducer = (uint32_t)(uintptr_t)pArg;
+
+    for(uint32_t lCounter = 0U; lCounter < TX_QUEUE_FRAMES; ) {
+        uint8_t lData[4U];
+        memcpy(lData, &lCounter, sizeof(lData));
+
+        const cipErrorCode_t lErrorCode = CIP_send(0U, 0x200U + lProducer, sizeof(lData), lData, 0U);
+        if(can_serial_ERROR_NONE == lErrorCode) {
+            lCounter++;
+        } else if(can_serial_ERROR_FULL == lErrorCode) {
+            /* Let the writer catch up */
+            usleep(100U);
+        } else {
+            return (void *)(uintptr_t)1U;
+        }
+    }
+
+    return NULL;
+}
+
+static int16_t testTxQueue(void) {
+    const cipPort_t lPort = 15309;
+
+    /* The queue is configured before CIP_init only */
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_ARG != CIP_setTxQueueSize(0U, SIZE_MAX)
+        || can_serial_ERROR_ARG != CIP_setTxQueueSize(0U, SIZE_MAX / 4U)
+        || can_serial_ERROR_NONE != CIP_setTxQueueSize(0U, 1000U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_ALREADY_INIT != CIP_setTxQueueSize(0U, 64U)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countQueuedFrames)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        printf("[ERROR] Failed to set the TX queue up\n");
+        return -1;
+    }
+
+    /* Concurrent senders, each one's frames arrive in order */
+    pthread_t lThreads[TX_QUEUE_PRODUCERS];
+    for(size_t i = 0U; i < TX_QUEUE_PRODUCERS; i++) {
+        if(0 != pthread_create(&lThreads[i], NULL, produceFrames, (void *)(uintptr_t)i)) {
+            return -1;
+        }
+    }
+    bool lFailed = false;
+    for(size_t i = 0U; i < TX_QUEUE_PRODUCERS; i++) {
+        void *lResult = NULL;
+        (void)pthread_join(lThreads[i], &lResult);
+        lFailed = lFailed || NULL != lResult;
+    }
+
+    const size_t lExpected = TX_QUEUE_PRODUCERS * TX_QUEUE_FRAMES;
+    for(size_t lTry = 0U; lTry < 1000U && lExpected > __atomic_load_n(&sTxQueueFrames, __ATOMIC_RELAXED); lTry++) {
+        usleep(1000U);
+    }
+
+    cipStats_t lTx;
+    if(lFailed || can_serial_ERROR_NONE != CIP_getStats(0U, &lTx)) {
+        return -1;
+    }
+
+    if(lExpected != __atomic_load_n(&sTxQueueFrames, __ATOMIC_RELAXED) || !sTxQueueOrdered
+        || lExpected != lTx.txFrames || 0U != lTx.txFailures)
+    {
+        printf("[ERROR] %zu frames received, %" PRIu64 " sent instead of %zu\n", sTxQueueFrames, lTx.txFrames, lExpected);
+        return -1;
+    }
+
+    /* A tiny queue refuses most of a large batch */
+    cipMessage_t lMsgs[1024U];
+    cipErrorCode_t lResults[1024U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 1024U; i++) {
+        lMsgs[i].id = 0x300U;
+    }
+
+    size_t lQueued = 0U;
+    if(can_serial_ERROR_NONE != CIP_reset(0U, can_serial_MODE_NORMAL)
+        || can_serial_ERROR_NONE != CIP_reset(1U, can_serial_MODE_NORMAL)
+        || can_serial_ERROR_NONE != CIP_createModule(2U)
+        || can_serial_ERROR_NONE != CIP_setTxQueueSize(2U, 4U)
+        || can_serial_ERROR_NONE != CIP_init(2U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_FULL != CIP_sendBatch(2U, lMsgs, 1024U, lResults, &lQueued)
+        || can_serial_ERROR_NONE != CIP_getStats(2U, &lTx))
+    {
+        printf("[ERROR] The TX queue did not refuse any message\n");
+        return -1;
+    }
+
+    for(size_t i = 0U; i < 1024U; i++) {
+        if((i < lQueued ? can_serial_ERROR_NONE : can_serial_ERROR_FULL) != lResults[i]) {
+            printf("[ERROR] Message %zu reported as %d (%zu queued)\n", i, lResults[i], lQueued);
+            return -1;
+        }
+    }
+
+    if(0U == lQueued || 1024U - lQueued != lTx.txQueueFull) {
+        printf("[ERROR] %zu messages queued, %" PRIu64 " refused\n", lQueued, lTx.txQueueFull);
+        return -1;
+    }
+
+    /* Sends what is still queued */
+    (void)CIP_reset(2U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+/* Arbitration order : extended IDs of base 0, then 0x001, 0x100, its RTR,
+ * the extended IDs of base 0x100 and 0x7FF */
+static const uint32_t sPrioIDs[]   = {0x00000001U, 0x001U, 0x100U, 0x100U, (0x100U << 18U) | 5U, 0x7FFU};
+static const uint32_t sPrioFlags[] = {can_serial_FLAG_EFF, 0U, 0U, can_serial_FLAG_RTR, can_serial_FLAG_EFF, 0U};
+#define TX_PRIO_CLASSES (sizeof(sPrioIDs) / sizeof(sPrioIDs[0U]))
+#define TX_PRIO_FRAMES  240U
+
+static size_t   sPrioFrames    = 0U;
+static size_t   sPrioLastClass = 0U;
+static uint32_t sPrioLastIndex = 0U;
+static bool     sPrioOrdered   = true;
+
+static int checkPriorityOrder(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+
+    for(size_t i = 0U; i < pCount; i++) {
+        /* The payload carries the class and the submission index */
+        const size_t lClass = pMsgs[i].data[0U];
+        uint32_t lIndex = 0U;
+        memcpy(&lIndex, &pMsgs[i].data[1U], sizeof(lIndex));
+
+        if(TX_PRIO_CLASSES <= lClass || sPrioIDs[lClass] != pMsgs[i].id
+            || lClass < sPrioLastClass || (lClass == sPrioLastClass && 0U < sPrioFrames && lIndex <= sPrioLastIndex))
+        {
+            sPrioOrdered = false;
+        }
+        sPrioLastClass = lClass;
+        sPrioLastIndex = lIndex;
+    }
+    __atomic_fetch_add(&sPrioFrames, pCount, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static int16_t testTxPriority(void) {
+    const cipPort_t lPort = 15310;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_setTxQueueSize(0U, 256U)
+        || can_serial_ERROR_NONE != CIP_setTxPriority(0U, true)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_ALREADY_INIT != CIP_setTxPriority(0U, false)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, checkPriorityOrder)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        printf("[ERROR] Failed to set the TX priority queue up\n");
+        return -1;
+    }
+
+    /* Bulk traffic first, the writer sleeps until the whole batch is queued */
+    cipMessage_t lMsgs[TX_PRIO_FRAMES];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(uint32_t i = 0U; i < TX_PRIO_FRAMES; i++) {
+        const size_t lClass = TX_PRIO_CLASSES - 1U - (i * 5U) % TX_PRIO_CLASSES;
+        lMsgs[i].id       = sPrioIDs[lClass];
+        lMsgs[i].flags    = sPrioFlags[lClass];
+        lMsgs[i].size     = 5U;
+        lMsgs[i].data[0U] = (uint8_t)lClass;
+        memcpy(&lMsgs[i].data[1U], &i, sizeof(i));
+    }
+    usleep(10000U);
+
+    size_t lQueued = 0U;
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, TX_PRIO_FRAMES, NULL, &lQueued) || TX_PRIO_FRAMES != lQueued) {
+        printf("[ERROR] %zu messages queued instead of %u\n", lQueued, TX_PRIO_FRAMES);
+        return -1;
+    }
+
+    for(size_t lTry = 0U; lTry < 1000U && TX_PRIO_FRAMES > __atomic_load_n(&sPrioFrames, __ATOMIC_RELAXED); lTry++) {
+        usleep(1000U);
+    }
+
+    if(TX_PRIO_FRAMES != __atomic_load_n(&sPrioFrames, __ATOMIC_RELAXED) || !sPrioOrdered) {
+        printf("[ERROR] %zu frames received, %s\n", sPrioFrames, sPrioOrdered ? "ordered" : "out of order");
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testTxPacing(void) {
+    const cipPort_t lPort = 15311;
+
+    /* 100 standard 8-byte frames, 135 bits each at worst, at 100 kbit/s */
+    const uint32_t lBitrate = 100000U;
+    const size_t   lNbMsgs  = 100U;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_setTxBitrate(0U, lBitrate)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_ALREADY_INIT != CIP_setTxBitrate(0U, 0U))
+    {
+        printf("[ERROR] Failed to set the TX pacing up\n");
+        return -1;
+    }
+
+    cipMessage_t lMsgs[100U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < lNbMsgs; i++) {
+        lMsgs[i].id   = 0x123U;
+        lMsgs[i].size = 8U;
+    }
+
+    struct timespec lStart;
+    struct timespec lEnd;
+    size_t lSent = 0U;
+    (void)clock_gettime(CLOCK_MONOTONIC, &lStart);
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, lNbMsgs, NULL, &lSent) || lNbMsgs != lSent) {
+        return -1;
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &lEnd);
+
+    /* The bucket starts empty and holds a few frames at most */
+    const double lElapsed = (double)(lEnd.tv_sec - lStart.tv_sec) + 1e-9 * (double)(lEnd.tv_nsec - lStart.tv_nsec);
+    const double lExpected = (double)(135U * lNbMsgs) / (double)lBitrate;
+    if(0.9 * lExpected > lElapsed || 3.0 * lExpected < lElapsed) {
+        printf("[ERROR] %zu frames sent in %.3f s instead of %.3f s\n", lNbMsgs, lElapsed, lExpected);
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static size_t sCyclicFast  = 0U;
+static size_t sCyclicSlow  = 0U;
+static bool   sCyclicTorn  = false;
+
+/* Payloads are 8 equal bytes, a mix of two would be a torn update */
+static int countCyclic(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+
+    for(size_t i = 0U; i < pCount; i++) {
+        for(uint8_t j = 1U; j < pMsgs[i].size; j++) {
+            if(pMsgs[i].data[0U] != pMsgs[i].data[j]) {
+                sCyclicTorn = true;
+            }
+        }
+
+        if(0x010U == pMsgs[i].id) {
+            __atomic_fetch_add(&sCyclicFast, 1U, __ATOMIC_RELAXED);
+        } else if(0x020U == pMsgs[i].id) {
+            __atomic_fetch_add(&sCyclicSlow, 1U, __ATOMIC_RELAXED);
+        }
+    }
+
+    return 0;
+}
+
+static int16_t testCyclic(void) {
+    const cipPort_t lPort = 15312;
+
+    cipMessage_t lMsg;
+    memset(&lMsg, 0, sizeof(lMsg));
+    lMsg.size = 8U;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NOT_INIT != CIP_addCyclic(0U, &lMsg, 10U, 0U, &(cipCyclicID_t){0U})
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countCyclic)
+        || can_serial_ERROR_NONE != CIP_process(1U)
+        || can_serial_ERROR_ARG != CIP_addCyclic(0U, &lMsg, 0U, 0U, &(cipCyclicID_t){0U}))
+    {
+        printf("[ERROR] Failed to set the cyclic test up\n");
+        return -1;
+    }
+
+    /* 10 ms and 25 ms (5 ms phase) */
+    cipCyclicID_t lFast = 0U;
+    cipCyclicID_t lSlow = 0U;
+    lMsg.id = 0x010U;
+    memset(lMsg.data, 0x11, sizeof(lMsg.data));
+    if(can_serial_ERROR_NONE != CIP_addCyclic(0U, &lMsg, 10U, 0U, &lFast)) {
+        return -1;
+    }
+    lMsg.id = 0x020U;
+    if(can_serial_ERROR_NONE != CIP_addCyclic(0U, &lMsg, 25U, 5U, &lSlow)) {
+        return -1;
+    }
+
+    /* Swap the fast payload while it is sent */
+    struct timespec lStart;
+    struct timespec lEnd;
+    (void)clock_gettime(CLOCK_MONOTONIC, &lStart);
+    uint8_t lData[8U];
+    for(size_t i = 0U; i < 250U; i++) {
+        memset(lData, (int)(0x20U + (i & 0x0FU)), sizeof(lData));
+        if(can_serial_ERROR_NONE != CIP_updateCyclic(0U, lFast, sizeof(lData), lData)) {
+            return -1;
+        }
+        usleep(1000U);
+    }
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &lEnd);
+
+    /* The sleeps may last longer than asked, count against the time it took */
+    const double lElapsedMs = 1e3 * (double)(lEnd.tv_sec - lStart.tv_sec) + 1e-6 * (double)(lEnd.tv_nsec - lStart.tv_nsec);
+    const double lFastExpected = lElapsedMs / 10.0;
+    const double lSlowExpected = (lElapsedMs - 5.0) / 25.0;
+    const size_t lFastCount = __atomic_load_n(&sCyclicFast, __ATOMIC_RELAXED);
+    const size_t lSlowCount = __atomic_load_n(&sCyclicSlow, __ATOMIC_RELAXED);
+    if(0.6 * lFastExpected > (double)lFastCount || 1.2 * lFastExpected + 1.0 < (double)lFastCount
+        || 0.6 * lSlowExpected > (double)lSlowCount || 1.2 * lSlowExpected + 1.0 < (double)lSlowCount
+        || sCyclicTorn)
+    {
+        printf("[ERROR] %zu fast and %zu slow frames (torn : %d)\n", lFastCount, lSlowCount, sCyclicTorn);
+        return -1;
+    }
+
+    /* A removed message stops, its handle is stale */
+    if(can_serial_ERROR_NONE != CIP_removeCyclic(0U, lSlow)
+        || can_serial_ERROR_ARG != CIP_removeCyclic(0U, lSlow)
+        || can_serial_ERROR_ARG != CIP_updateCyclic(0U, lSlow, 0U, NULL))
+    {
+        return -1;
+    }
+    const size_t lSlowRemoved = __atomic_load_n(&sCyclicSlow, __ATOMIC_RELAXED);
+    usleep(100000U);
+    if(lSlowRemoved + 1U < __atomic_load_n(&sCyclicSlow, __ATOMIC_RELAXED)) {
+        printf("[ERROR] Removed cyclic message still sent\n");
+        return -1;
+    }
+
+    /* Fill the wheel w/ messages that never come due */
+    size_t lAdded = 0U;
+    cipCyclicID_t lID = 0U;
+    lMsg.id = 0x030U;
+    while(can_serial_ERROR_NONE == CIP_addCyclic(0U, &lMsg, 60000U, 60000U, &lID)) {
+        lAdded++;
+    }
+    if(can_serial_MAX_NB_CYCLIC - 1U != lAdded) {
+        printf("[ERROR] %zu cyclic messages added\n", lAdded);
+        return -1;
+    }
+
+    /* Reset removes them all */
+    if(can_serial_ERROR_NONE != CIP_reset(0U, can_serial_MODE_NORMAL)
+        || can_serial_ERROR_ARG != CIP_updateCyclic(0U, lFast, 0U, NULL))
+    {
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static size_t sCaptureReceived = 0U;
+
+static int countCaptured(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+    (void)pMsgs;
+
+    __atomic_fetch_add(&sCaptureReceived, pCount, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/* Reads back the capture files of pPath, checks them
+ * and returns the highest sequence number, 0 on error */
+static uint64_t checkCapture(const char * const pPath,
+    const uint8_t pModule,
+    const uint8_t pDirection,
+    const uint64_t pNbRecords,
+    size_t * const pFound)
+{
+    uint64_t lLast = 0U;
+    *pFound = 0U;
+
+    for(uint32_t k = 0U; k < can_serial_CAPTURE_NB_SEGMENTS; k++) {
+        char lPath[128U];
+        (void)snprintf(lPath, sizeof(lPath), "%s.%u", pPath, k);
+        FILE * const lFile = fopen(lPath, "rb");
+        if(NULL == lFile) {
+            printf("[ERROR] Capture file %s not found\n", lPath);
+            return 0U;
+        }
+
+        cipCaptureHeader_t lHeader;
+        bool lValid = 1U == fread(&lHeader, sizeof(lHeader), 1U, lFile)
+            && 0 == memcmp(lHeader.magic, can_serial_CAPTURE_MAGIC, sizeof(can_serial_CAPTURE_MAGIC))
+            && can_serial_CAPTURE_VERSION == lHeader.version
+            && sizeof(cipCaptureRecord_t) == lHeader.recordSize
+            && pNbRecords == lHeader.nbRecords
+            && k == lHeader.segment;
+
+        for(uint64_t i = 0U; lValid && i < lHeader.nbRecords; i++) {
+            cipCaptureRecord_t lRecord;
+            if(1U != fread(&lRecord, sizeof(lRecord), 1U, lFile)) {
+                lValid = false;
+                break;
+            }
+            if(0U == lRecord.seq) {
+                continue;
+            }
+
+            /* The position gives the file and the slot,
+             * frame n carries CAN ID n */
+            const uint64_t lPos = lRecord.seq - 1U;
+            lValid = k == (lPos / pNbRecords) % can_serial_CAPTURE_NB_SEGMENTS
+                && i == lPos % pNbRecords
+                && pModule == lRecord.module
+                && pDirection == lRecord.direction
+                && 8U == lRecord.size
+                && 0U != lRecord.timestamp
+                && (uint8_t)lRecord.id == lRecord.data[0U];
+            lLast = lRecord.seq > lLast ? lRecord.seq : lLast;
+            (*pFound)++;
+        }
+
+        (void)fclose(lFile);
+        (void)unlink(lPath);
+
+        if(!lValid) {
+            printf("[ERROR] Invalid capture file %s\n", lPath);
+            return 0U;
+        }
+    }
+
+    char lIndex[128U];
+    (void)snprintf(lIndex, sizeof(lIndex), "%s.idx", pPath);
+    (void)unlink(lIndex);
 
-/* Variable declaration -------------------------------- */
+    return lLast;
+}
 
-/* Type definitions ------------------------------------ */
+static int16_t testCapture(void) {
+    const cipPort_t lPort = 15313;
+    const char * const lTxPath = "/tmp/cip_capture_test_tx";
+    const char * const lRxPath = "/tmp/cip_capture_test_rx";
+    const size_t lNbFrames = 200U;
 
-/* Support functions ----------------------------------- */
-static void printUsage(const char * const pProgName)
+    /* 16 records per file, 64 in the capture */
+    const uint64_t lNbRecords = 16U;
+    const size_t   lMaxBytes  = can_serial_CAPTURE_NB_SEGMENTS * (sizeof(cipCaptureHeader_t) + lNbRecords * sizeof(cipCaptureRecord_t));
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NOT_INIT != CIP_startCapture(0U, lTxPath, lMaxBytes)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countCaptured)
+        || can_serial_ERROR_ARG != CIP_startCapture(0U, lTxPath, sizeof(cipCaptureHeader_t))
+        || can_serial_ERROR_ARG != CIP_startCapture(0U, NULL, lMaxBytes)
+        || can_serial_ERROR_NOT_INIT != CIP_stopCapture(0U)
+        || can_serial_ERROR_NONE != CIP_startCapture(0U, lTxPath, lMaxBytes)
+        || can_serial_ERROR_ALREADY_INIT != CIP_startCapture(0U, lTxPath, lMaxBytes)
+        || can_serial_ERROR_NONE != CIP_startCapture(1U, lRxPath, lMaxBytes)
+        || can_serial_ERROR_NONE != CIP_process(1U))
+    {
+        printf("[ERROR] Failed to set the capture test up\n");
+        return -1;
+    }
+
+    /* Frame n carries CAN ID n, in batches so that the receiver keeps up */
+    cipMessage_t lMsgs[10U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < lNbFrames; i += 10U) {
+        for(size_t j = 0U; j < 10U; j++) {
+            lMsgs[j].id      = (uint32_t)(i + j);
+            lMsgs[j].size    = 8U;
+            lMsgs[j].data[0U] = (uint8_t)(i + j);
+        }
+        if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 10U, NULL, NULL)) {
+            printf("[ERROR] CIP_sendBatch failed\n");
+            return -1;
+        }
+        usleep(1000U);
+    }
+
+    for(size_t i = 0U; i < 100U && lNbFrames > __atomic_load_n(&sCaptureReceived, __ATOMIC_RELAXED); i++) {
+        usleep(10000U);
+    }
+
+    if(can_serial_ERROR_NONE != CIP_stopCapture(0U)
+        || can_serial_ERROR_NONE != CIP_stopCapture(1U)
+        || can_serial_ERROR_NOT_INIT != CIP_stopCapture(1U))
+    {
+        printf("[ERROR] Failed to stop the captures\n");
+        return -1;
+    }
+
+    /* Both wrapped around : only the last 64 frames are left */
+    const size_t lReceived = __atomic_load_n(&sCaptureReceived, __ATOMIC_RELAXED);
+    size_t lTxFound = 0U;
+    size_t lRxFound = 0U;
+    const uint64_t lTxLast = checkCapture(lTxPath, 0U, can_serial_CAPTURE_TX, lNbRecords, &lTxFound);
+    const uint64_t lRxLast = checkCapture(lRxPath, 1U, can_serial_CAPTURE_RX, lNbRecords, &lRxFound);
+    if(lNbFrames != lTxLast || can_serial_CAPTURE_NB_SEGMENTS * lNbRecords != lTxFound
+        || lReceived != lRxLast || lNbFrames / 2U > lReceived
+        || can_serial_CAPTURE_NB_SEGMENTS * lNbRecords != lRxFound)
+    {
+        printf("[ERROR] TX capture : %zu records up to %" PRIu64 ", RX capture : %zu records up to %" PRIu64 " (%zu received)\n",
+            lTxFound, lTxLast, lRxFound, lRxLast, lReceived);
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static size_t sReplayReceived = 0U;
+static bool   sReplayOrdered  = true;
+
+/* Frame n of a replay carries CAN ID n */
+static int countReplayed(const uint8_t pCallerID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pCallerID;
+
+    for(size_t i = 0U; i < pCount; i++) {
+        const size_t lIndex = __atomic_fetch_add(&sReplayReceived, 1U, __ATOMIC_RELAXED);
+        if((uint32_t)lIndex != pMsgs[i].id || (uint8_t)lIndex != pMsgs[i].data[0U]) {
+            sReplayOrdered = false;
+        }
+    }
+
+    return 0;
+}
+
+/* Replays the capture and waits for the receiver, returns the replay duration (s) */
+static double replayOnce(const char * const pPath, const double pSpeed, const size_t pNbFrames) {
+    cipReplayStats_t lStats;
+    __atomic_store_n(&sReplayReceived, 0U, __ATOMIC_RELAXED);
+
+    if(can_serial_ERROR_NONE != CIP_replayCapture(0U, pPath, pSpeed, can_serial_REPLAY_TX, &lStats)
+        || pNbFrames != lStats.frames || 0U != lStats.failed || 0U != lStats.missing)
+    {
+        printf("[ERROR] Replay at speed %.1f failed\n", pSpeed);
+        return -1.0;
+    }
+
+    for(size_t i = 0U; i < 100U && pNbFrames > __atomic_load_n(&sReplayReceived, __ATOMIC_RELAXED); i++) {
+        usleep(10000U);
+    }
+    if(pNbFrames != __atomic_load_n(&sReplayReceived, __ATOMIC_RELAXED) || !sReplayOrdered) {
+        printf("[ERROR] %zu replayed frames received (ordered : %d)\n", sReplayReceived, sReplayOrdered);
+        return -1.0;
+    }
+
+    return 1e-9 * (double)lStats.durationNs;
+}
+
+static void removeCapture(const char * const pPath) {
+    for(uint32_t k = 0U; k < can_serial_CAPTURE_NB_SEGMENTS; k++) {
+        char lFile[128U];
+        (void)snprintf(lFile, sizeof(lFile), "%s.%u", pPath, k);
+        (void)unlink(lFile);
+    }
+
+    char lIndex[128U];
+    (void)snprintf(lIndex, sizeof(lIndex), "%s.idx", pPath);
+    (void)unlink(lIndex);
+}
+
+static int16_t testReplay(void) {
+    const cipPort_t lPort = 15314;
+    const char * const lPath = "/tmp/cip_replay_test";
+    const size_t lNbFrames = 50U;
+    const size_t lMaxBytes = can_serial_CAPTURE_NB_SEGMENTS * (sizeof(cipCaptureHeader_t) + 64U * sizeof(cipCaptureRecord_t));
+
+    /* Left by an earlier run */
+    removeCapture(lPath);
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NOT_INIT != CIP_replayCapture(0U, lPath, 1.0, can_serial_REPLAY_TX, NULL)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_ARG != CIP_replayCapture(0U, lPath, -1.0, can_serial_REPLAY_TX, NULL)
+        || can_serial_ERROR_ARG != CIP_replayCapture(0U, lPath, 1.0, 0U, NULL)
+        || can_serial_ERROR_SYS != CIP_replayCapture(0U, lPath, 1.0, can_serial_REPLAY_TX, NULL)
+        || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countReplayed)
+        || can_serial_ERROR_NONE != CIP_process(1U)
+        || can_serial_ERROR_NONE != CIP_startCapture(0U, lPath, lMaxBytes))
+    {
+        printf("[ERROR] Failed to set the replay test up\n");
+        return -1;
+    }
+
+    /* Frame n carries CAN ID n, one every 2 ms */
+    for(size_t i = 0U; i < lNbFrames; i++) {
+        const uint8_t lData[8U] = {(uint8_t)i};
+        if(can_serial_ERROR_NONE != CIP_send(0U, (uint32_t)i, sizeof(lData), lData, 0U)) {
+            return -1;
+        }
+        usleep(2000U);
+    }
+
+    for(size_t i = 0U; i < 100U && lNbFrames > __atomic_load_n(&sReplayReceived, __ATOMIC_RELAXED); i++) {
+        usleep(10000U);
+    }
+    if(can_serial_ERROR_NONE != CIP_stopCapture(0U)) {
+        return -1;
+    }
+
+    /* Only RX frames asked : nothing to send */
+    cipReplayStats_t lStats;
+    if(can_serial_ERROR_NONE != CIP_replayCapture(0U, lPath, 1.0, can_serial_REPLAY_RX, &lStats) || 0U != lStats.frames) {
+        return -1;
+    }
+
+    /* Original timing, twice as fast, as fast as possible */
+    const double lOriginal = replayOnce(lPath, 1.0, lNbFrames);
+    const double lDouble   = replayOnce(lPath, 2.0, lNbFrames);
+    const double lMax      = replayOnce(lPath, can_serial_REPLAY_MAX_SPEED, lNbFrames);
+    if(0.09 > lOriginal || 0.3 < lOriginal
+        || 0.4 * lOriginal > lDouble || 0.7 * lOriginal < lDouble
+        || 0.0 > lMax || 0.5 * lDouble < lMax)
+    {
+        printf("[ERROR] Replays took %.3f s, %.3f s and %.3f s\n", lOriginal, lDouble, lMax);
+        return -1;
+    }
+
+    removeCapture(lPath);
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+    (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+typedef struct _queryCount {
+    size_t   matches;
+    size_t   stopAfter; /**< 0 : never stop */
+    uint64_t lastSeq;
+    bool     ordered;
+} queryCount_t;
+
+static int countQueried(void * const pCtx, const cipCaptureRecord_t * const pRecord) {
+    queryCount_t * const lCount = pCtx;
+
+    lCount->ordered = lCount->ordered && lCount->lastSeq < pRecord->seq;
+    lCount->lastSeq = pRecord->seq;
+    lCount->matches++;
+
+    return lCount->matches == lCount->stopAfter ? 1 : 0;
+}
+
+/* Runs the query, checks the matches and how many blocks were read */
+static bool checkQuery(const char * const pPath,
+    const cipFilter_t * const pFilter,
+    const uint64_t pFrom,
+    const uint64_t pTo,
+    const size_t pMatches,
+    const uint64_t pBlocksRead)
 {
-    printf("[USAGE] %s test#\n", pProgName);
-    printf("        Test -1 : default/no test\n");
+    queryCount_t lCount = {0U, 0U, 0U, true};
+    cipQueryStats_t lStats;
+
+    if(can_serial_ERROR_NONE != CIP_queryCapture(pPath, pFilter, NULL != pFilter ? 1U : 0U, pFrom, pTo, countQueried, &lCount, &lStats)
+        || pMatches != lCount.matches || pMatches != lStats.matches || !lCount.ordered
+        || pBlocksRead != lStats.blocksRead)
+    {
+        printf("[ERROR] Query found %zu records instead of %zu, %" PRIu64 " blocks read out of %" PRIu64 " (ordered : %d)\n",
+            lCount.matches, pMatches, lStats.blocksRead, lStats.blocks, lCount.ordered);
+        return false;
+    }
+
+    return true;
+}
+
+static int16_t testCaptureQuery(void) {
+    const cipPort_t lPort = 15315;
+    const char * const lPath = "/tmp/cip_query_test";
+    const size_t lBlock = can_serial_CAPTURE_INDEX_BLOCK;
+    const size_t lMaxBytes = can_serial_CAPTURE_NB_SEGMENTS * (sizeof(cipCaptureHeader_t) + lBlock * sizeof(cipCaptureRecord_t));
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_startCapture(0U, lPath, lMaxBytes))
+    {
+        printf("[ERROR] Failed to set the query test up\n");
+        return -1;
+    }
+
+    /* Block b of the capture holds CAN ID 0x100 + b,
+     * and one 29-bit ID in the middle of block 2 */
+    cipMessage_t lMsgs[32U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    uint64_t lBlockStart[3U];
+    uint64_t lBlockEnd[3U];
+    for(size_t b = 0U; b < 3U; b++) {
+        struct timespec lTime;
+        (void)clock_gettime(CLOCK_REALTIME, &lTime);
+        lBlockStart[b] = (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+
+        for(size_t i = 0U; i < lBlock; i += 32U) {
+            for(size_t j = 0U; j < 32U; j++) {
+                lMsgs[j].id    = 1U == b || 500U != i + j ? (uint32_t)(0x100U + b) : 0x1234567U;
+                lMsgs[j].flags = 1U == b || 500U != i + j ? 0U : can_serial_FLAG_EFF;
+                lMsgs[j].size  = 8U;
+            }
+            if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 32U, NULL, NULL)) {
+                printf("[ERROR] CIP_sendBatch failed\n");
+                return -1;
+            }
+        }
+
+        (void)clock_gettime(CLOCK_REALTIME, &lTime);
+        lBlockEnd[b] = (uint64_t)lTime.tv_sec * 1000000000U + (uint64_t)lTime.tv_nsec;
+        usleep(20000U);
+    }
+
+    /* Running capture : what is not indexed yet is read one by one */
+    const cipFilter_t lStdFilter = {0x101U, 0x7FFU, 0U};
+    const cipFilter_t lExtFilter = {0x1234567U, 0x1FFFFFFFU, can_serial_FLAG_EFF};
+    queryCount_t lCount = {0U, 0U, 0U, true};
+    if(can_serial_ERROR_NONE != CIP_queryCapture(lPath, &lStdFilter, 1U, 0U, UINT64_MAX, countQueried, &lCount, NULL)
+        || lBlock != lCount.matches
+        || can_serial_ERROR_NONE != CIP_stopCapture(0U))
+    {
+        printf("[ERROR] Query of the running capture found %zu records\n", lCount.matches);
+        return -1;
+    }
+
+    /* Indexed : one block to read for one ID or one time range */
+    if(!checkQuery(lPath, &lStdFilter, 0U, UINT64_MAX, lBlock, 1U)
+        || !checkQuery(lPath, &lExtFilter, 0U, UINT64_MAX, 2U, 2U)
+        || !checkQuery(lPath, NULL, lBlockStart[1U], lBlockEnd[1U], lBlock, 1U)
+        || !checkQuery(lPath, &lStdFilter, lBlockStart[2U], UINT64_MAX, 0U, 0U)
+        || !checkQuery(lPath, NULL, 0U, UINT64_MAX, 3U * lBlock, 3U))
+    {
+        return -1;
+    }
+
+    /* The query function may stop the query */
+    queryCount_t lStop = {0U, 10U, 0U, true};
+    cipQueryStats_t lStats;
+    if(can_serial_ERROR_NONE != CIP_queryCapture(lPath, NULL, 0U, 0U, UINT64_MAX, countQueried, &lStop, &lStats)
+        || 10U != lStop.matches || 10U != lStats.matches
+        || can_serial_ERROR_ARG != CIP_queryCapture(lPath, NULL, 0U, 0U, UINT64_MAX, NULL, NULL, NULL)
+        || can_serial_ERROR_ARG != CIP_queryCapture(lPath, NULL, 0U, 1U, 0U, countQueried, &lStop, NULL))
+    {
+        return -1;
+    }
+
+    /* W/o index, the same records */
+    char lFile[128U];
+    (void)snprintf(lFile, sizeof(lFile), "%s.idx", lPath);
+    (void)unlink(lFile);
+    lCount = (queryCount_t){0U, 0U, 0U, true};
+    if(can_serial_ERROR_NONE != CIP_queryCapture(lPath, &lStdFilter, 1U, 0U, UINT64_MAX, countQueried, &lCount, &lStats)
+        || lBlock != lCount.matches || 3U * lBlock != lStats.tailRecords || 0U != lStats.blocks)
+    {
+        printf("[ERROR] Query w/o index found %zu records\n", lCount.matches);
+        return -1;
+    }
+
+    removeCapture(lPath);
+    if(can_serial_ERROR_SYS != CIP_queryCapture(lPath, NULL, 0U, 0U, UINT64_MAX, countQueried, &lCount, NULL)) {
+        return -1;
+    }
+
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+
+    return 0;
+}
+
+static int16_t testDefaultWireFormat(void) {
+    const cipPort_t lPort = 15316;
+
+    /* Plain UDP socket, to see the datagrams as they are on the wire */
+    const int lSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    const int lEnable = 1;
+    const struct timeval lTimeout = {1, 0};
+    struct sockaddr_in lAddr;
+    memset(&lAddr, 0, sizeof(lAddr));
+    lAddr.sin_family      = AF_INET;
+    lAddr.sin_port        = htons(lPort);
+    lAddr.sin_addr.s_addr = INADDR_ANY;
+    if(0 > lSocket
+        || 0 > setsockopt(lSocket, SOL_SOCKET, SO_REUSEADDR, &lEnable, sizeof(lEnable))
+        || 0 > setsockopt(lSocket, SOL_SOCKET, SO_REUSEPORT, &lEnable, sizeof(lEnable))
+        || 0 > setsockopt(lSocket, SOL_SOCKET, SO_RCVTIMEO, &lTimeout, sizeof(lTimeout))
+        || 0 > bind(lSocket, (struct sockaddr *)&lAddr, sizeof(lAddr)))
+    {
+        printf("[ERROR] UDP socket setup failed\n");
+        return -1;
+    }
+
+    /* No CIP_createModule */
+    if(can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)) {
+        printf("[ERROR] CIP_init failed\n");
+        close(lSocket);
+        return -1;
+    }
+
+    const uint8_t lData[8U] = {1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U};
+    uint8_t lDatagram[1500U];
+    ssize_t lLen = -1;
+    if(can_serial_ERROR_NONE == CIP_send(0U, 0x123U, 8U, lData, 0U)) {
+        lLen = recv(lSocket, lDatagram, sizeof(lDatagram), 0);
+    }
+    close(lSocket);
+    (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+
+    if(2 > lLen || 'C' != lDatagram[0U] || 'S' != lDatagram[1U]) {
+        printf("[ERROR] Expected a compact datagram, got %zd bytes\n", lLen);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Waits for the RX thread of module pID to have received pCount frames in total */
+static bool waitRxFrames(const cipID_t pID, const uint64_t pCount) {
+    cipStats_t lStats;
+    for(size_t lTries = 0U; 1000U > lTries; lTries++) {
+        if(can_serial_ERROR_NONE != CIP_getStats(pID, &lStats)) {
+            return false;
+        }
+        if(pCount <= lStats.rxFrames) {
+            return pCount == lStats.rxFrames;
+        }
+        usleep(1000U);
+    }
+
+    return false;
+}
+
+/* Drains the classic RX ring of module pID, checking that the IDs follow each other from pFirstID */
+static size_t pollInOrder(const cipID_t pID, const uint32_t pFirstID) {
+    cipMessage_t lMsgs[16U];
+    size_t lTotal = 0U;
+    size_t lCount = 0U;
+    do {
+        if(can_serial_ERROR_NONE != CIP_pollMessages(pID, lMsgs, 16U, &lCount)) {
+            return 0U;
+        }
+        for(size_t i = 0U; i < lCount; i++, lTotal++) {
+            if(pFirstID + lTotal != lMsgs[i].id || lMsgs[i].data[0U] != (uint8_t)lMsgs[i].id) {
+                printf("[ERROR] Polled ID 0x%03X instead of 0x%03zX\n", lMsgs[i].id, pFirstID + lTotal);
+                return 0U;
+            }
+        }
+    } while(0U < lCount);
+
+    return lTotal;
+}
+
+static int16_t testRxRing(void) {
+    const cipPort_t lPort = 15317;
+
+    /* Module 0 sends, module 1 (classic) and 2 (CAN FD) receive in their RX rings */
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_createModule(2U)
+        || can_serial_ERROR_ARG != CIP_setRxRingSize(1U, SIZE_MAX)
+        || can_serial_ERROR_NONE != CIP_setRxRingSize(1U, 50U)
+        || can_serial_ERROR_NONE != CIP_setRxRingSize(2U, 64U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_FD, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(2U, can_serial_MODE_FD, lPort)
+        || can_serial_ERROR_NONE != CIP_startRxThread(1U)
+        || can_serial_ERROR_NONE != CIP_startRxThread(2U))
+    {
+        printf("[ERROR] Module setup failed\n");
+        return -1;
+    }
+
+    /* Each ring only holds its own kind of messages */
+    cipMessage_t   lMsg;
+    cipFdMessage_t lFdMsg;
+    size_t         lCount = 0U;
+    if(can_serial_ERROR_CONFIG != CIP_pollFdMessages(1U, &lFdMsg, 1U, &lCount)
+        || can_serial_ERROR_CONFIG != CIP_pollMessages(2U, &lMsg, 1U, &lCount)
+        || can_serial_ERROR_CONFIG != CIP_pollMessages(0U, &lMsg, 1U, &lCount))
+    {
+        printf("[ERROR] Polled a ring of the wrong kind\n");
+        return -1;
+    }
+
+    /* 50 is rounded up to 64 */
+    cipFdMessage_t lMsgs[200U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(size_t i = 0U; i < 200U; i++) {
+        lMsgs[i].id      = 0x100U + (uint32_t)i;
+        lMsgs[i].size    = 8U;
+        lMsgs[i].data[0] = (uint8_t)lMsgs[i].id;
+    }
+
+    /* Fits in the rings : every message, in order */
+    size_t lSent = 0U;
+    if(can_serial_ERROR_NONE != CIP_sendFdBatch(0U, lMsgs, 60U, NULL, &lSent) || 60U != lSent
+        || !waitRxFrames(1U, 60U) || !waitRxFrames(2U, 60U))
+    {
+        printf("[ERROR] 60 messages were not received\n");
+        return -1;
+    }
+    if(60U != pollInOrder(1U, 0x100U)) {
+        return -1;
+    }
+
+    cipFdMessage_t lFdMsgs[64U];
+    if(can_serial_ERROR_NONE != CIP_pollFdMessages(2U, lFdMsgs, 64U, &lCount) || 60U != lCount) {
+        printf("[ERROR] Polled %zu CAN FD messages instead of 60\n", lCount);
+        return -1;
+    }
+    for(size_t i = 0U; i < lCount; i++) {
+        if(lMsgs[i].id != lFdMsgs[i].id || 0 != memcmp(lMsgs[i].data, lFdMsgs[i].data, 8U)) {
+            printf("[ERROR] CAN FD message %zu differs\n", i);
+            return -1;
+        }
+    }
+
+    /* Overflow : the first 64 messages are kept, the others are dropped */
+    if(can_serial_ERROR_NONE != CIP_sendFdBatch(0U, lMsgs, 200U, NULL, &lSent) || 200U != lSent
+        || !waitRxFrames(1U, 260U) || !waitRxFrames(2U, 260U))
+    {
+        printf("[ERROR] 200 messages were not received\n");
+        return -1;
+    }
+    if(64U != pollInOrder(1U, 0x100U)
+        || can_serial_ERROR_NONE != CIP_pollFdMessages(2U, lFdMsgs, 64U, &lCount) || 64U != lCount
+        || lMsgs[63U].id != lFdMsgs[63U].id)
+    {
+        printf("[ERROR] The rings did not keep the first 64 messages\n");
+        return -1;
+    }
+
+    cipStats_t lStats;
+    for(cipID_t lID = 1U; lID <= 2U; lID++) {
+        if(can_serial_ERROR_NONE != CIP_getStats(lID, &lStats) || 136U != lStats.rxRingDrops) {
+            printf("[ERROR] Module %u dropped %" PRIu64 " messages instead of 136\n", lID, lStats.rxRingDrops);
+            return -1;
+        }
+    }
+
+    /* Drained : room again */
+    if(can_serial_ERROR_NONE != CIP_sendFdBatch(0U, &lMsgs[10U], 10U, NULL, &lSent) || 10U != lSent
+        || !waitRxFrames(1U, 270U) || 10U != pollInOrder(1U, 0x10AU))
+    {
+        printf("[ERROR] The drained ring did not take new messages\n");
+        return -1;
+    }
+
+    for(cipID_t lID = 0U; lID <= 2U; lID++) {
+        (void)CIP_reset(lID, can_serial_MODE_NORMAL);
+    }
+
+    return 0;
+}
+
+/* Reception order of each module, module sReactorResetID resets itself from its callback */
+typedef struct _reactorRx {
+    uint32_t lastID;
+    size_t   count;
+    bool     ordered;
+} reactorRx_t;
+
+static reactorRx_t  sReactorRx[4U];
+static const cipID_t sReactorResetID = 2U;
+static cipErrorCode_t sReactorResetResult = can_serial_ERROR_UNKNOWN;
+
+static int recordReactorRx(const uint8_t pID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    reactorRx_t * const lRx = &sReactorRx[pID];
+    for(size_t i = 0U; i < pCount; i++) {
+        if(lRx->lastID >= pMsgs[i].id) {
+            lRx->ordered = false;
+        }
+        __atomic_store_n(&lRx->lastID, pMsgs[i].id, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&lRx->count, 1U, __ATOMIC_RELEASE);
+
+        if(sReactorResetID == pID && 0x164U == pMsgs[i].id) {
+            /* The rest of the batch belongs to the old socket */
+            __atomic_store_n(&sReactorResetResult, CIP_reset(pID, can_serial_MODE_NORMAL), __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void *sendReactorFrames(void *pArg) {
+    const uint32_t lBase = (uint32_t)(uintptr_t)pArg;
+
+    cipMessage_t lMsgs[20U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    for(uint32_t lChunk = 0U; lChunk < 10U; lChunk++) {
+        for(uint32_t i = 0U; i < 20U; i++) {
+            lMsgs[i].id   = lBase + 20U * lChunk + i;
+            lMsgs[i].size = 1U;
+        }
+        size_t lSent = 0U;
+        (void)CIP_sendBatch(0U, lMsgs, 20U, NULL, &lSent);
+        usleep(2000U);
+    }
+
+    return NULL;
+}
+
+static bool waitReactorRx(const cipID_t pID, const size_t pCount) {
+    for(size_t lTries = 0U; 1000U > lTries && pCount > __atomic_load_n(&sReactorRx[pID].count, __ATOMIC_ACQUIRE); lTries++) {
+        usleep(1000U);
+    }
+
+    return pCount == __atomic_load_n(&sReactorRx[pID].count, __ATOMIC_ACQUIRE);
+}
+
+/* Waits for module pID to receive the message w/ the CAN ID pLastID */
+static bool waitReactorLastID(const cipID_t pID, const uint32_t pLastID) {
+    for(size_t lTries = 0U; 1000U > lTries && pLastID != __atomic_load_n(&sReactorRx[pID].lastID, __ATOMIC_ACQUIRE); lTries++) {
+        usleep(1000U);
+    }
+
+    return pLastID == __atomic_load_n(&sReactorRx[pID].lastID, __ATOMIC_ACQUIRE);
+}
+
+static bool isRxServiced(const cipID_t pID) {
+    bool lOn = false;
+    return can_serial_ERROR_NONE == CIP_isRxThreadOn(pID, &lOn) && lOn;
+}
+
+static int16_t testReactor(void) {
+    const cipPort_t lPort = 15318;
+
+    /* Modules 1 and 3 share a reactor, module 2 has the other one, module 0 sends */
+    if(can_serial_ERROR_NONE != CIP_setReactorThreads(2U)) {
+        printf("[ERROR] CIP_setReactorThreads failed\n");
+        return -1;
+    }
+    for(cipID_t lID = 0U; lID < 4U; lID++) {
+        sReactorRx[lID].ordered = true;
+        if(can_serial_ERROR_NONE != CIP_createModule(lID)
+            || can_serial_ERROR_NONE != CIP_init(lID, can_serial_MODE_NORMAL, lPort)
+            || (0U < lID && can_serial_ERROR_NONE != CIP_setPutMessagesFunction(lID, lID, recordReactorRx))
+            || (0U < lID && can_serial_ERROR_NONE != CIP_startRxThread(lID)))
+        {
+            printf("[ERROR] Module %u setup failed\n", lID);
+            return -1;
+        }
+    }
+    if(can_serial_ERROR_ALREADY_INIT != CIP_startRxThread(1U) || can_serial_ERROR_ALREADY_INIT != CIP_setReactorThreads(1U)) {
+        printf("[ERROR] Module 1 registered twice or reactors changed under it\n");
+        return -1;
+    }
+
+    /* Module 1 is reset from this thread while its reactor is busy */
+    pthread_t lSender;
+    if(0 != pthread_create(&lSender, NULL, sendReactorFrames, (void *)(uintptr_t)0x100U)) {
+        return -1;
+    }
+    for(size_t lTries = 0U; 1000U > lTries && 40U > __atomic_load_n(&sReactorRx[1U].count, __ATOMIC_ACQUIRE); lTries++) {
+        usleep(100U);
+    }
+    const cipErrorCode_t lResetResult = CIP_reset(1U, can_serial_MODE_NORMAL);
+    const size_t lCountAtReset = __atomic_load_n(&sReactorRx[1U].count, __ATOMIC_ACQUIRE);
+    pthread_join(lSender, NULL);
+
+    if(can_serial_ERROR_NONE != lResetResult || isRxServiced(1U)) {
+        printf("[ERROR] Module 1 was not reset\n");
+        return -1;
+    }
+    for(size_t lTries = 0U; 1000U > lTries && can_serial_ERROR_UNKNOWN == __atomic_load_n(&sReactorResetResult, __ATOMIC_ACQUIRE); lTries++) {
+        usleep(1000U);
+    }
+    if(!waitReactorRx(3U, 200U) || !waitReactorRx(2U, 101U)
+        || can_serial_ERROR_NONE != __atomic_load_n(&sReactorResetResult, __ATOMIC_ACQUIRE)
+        || isRxServiced(2U))
+    {
+        printf("[ERROR] Received %zu/%zu messages, reset from the callback : %d\n",
+            sReactorRx[2U].count, sReactorRx[3U].count, (int)sReactorResetResult);
+        return -1;
+    }
+    usleep(10000U);
+    if(lCountAtReset != sReactorRx[1U].count || 101U != sReactorRx[2U].count) {
+        printf("[ERROR] Messages delivered after CIP_reset\n");
+        return -1;
+    }
+
+    /* Both reset modules go back to their reactor,
+     * w/ the messages their new socket got in the meantime */
+    for(cipID_t lID = 1U; lID <= 2U; lID++) {
+        if(can_serial_ERROR_NONE != CIP_setPutMessagesFunction(lID, lID, recordReactorRx)
+            || can_serial_ERROR_NONE != CIP_startRxThread(lID))
+        {
+            printf("[ERROR] Module %u could not rejoin its reactor\n", lID);
+            return -1;
+        }
+    }
+    (void)sendReactorFrames((void *)(uintptr_t)0x1000U);
+    if(!waitReactorLastID(1U, 0x10C7U) || !waitReactorLastID(2U, 0x10C7U) || !waitReactorRx(3U, 400U)) {
+        printf("[ERROR] Received %zu/%zu/%zu messages after the resets\n",
+            sReactorRx[1U].count, sReactorRx[2U].count, sReactorRx[3U].count);
+        return -1;
+    }
+
+    for(cipID_t lID = 1U; lID < 4U; lID++) {
+        if(!sReactorRx[lID].ordered) {
+            printf("[ERROR] Module %u received its messages out of order\n", lID);
+            return -1;
+        }
+    }
+
+    for(cipID_t lID = 0U; lID < 4U; lID++) {
+        (void)CIP_reset(lID, can_serial_MODE_NORMAL);
+    }
+    if(can_serial_ERROR_NONE != CIP_setReactorThreads(0U)) {
+        printf("[ERROR] The reactors were not stopped\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static size_t sStopRestartCount = 0U;
+static bool   sResetInCallback  = false;
+static cipErrorCode_t sCallbackResetResult = can_serial_ERROR_UNKNOWN;
+
+static int countStopRestart(const uint8_t pID, const cipMessage_t * const pMsgs, const size_t pCount) {
+    (void)pMsgs;
+    __atomic_add_fetch(&sStopRestartCount, pCount, __ATOMIC_RELEASE);
+
+    if(__atomic_exchange_n(&sResetInCallback, false, __ATOMIC_ACQ_REL)) {
+        __atomic_store_n(&sCallbackResetResult, CIP_reset(pID, can_serial_MODE_NORMAL), __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/* Sends 10 messages from module 0, waits for pExpected messages in total on module 1 */
+static bool sendAndCount(const size_t pExpected) {
+    cipMessage_t lMsgs[10U];
+    memset(lMsgs, 0, sizeof(lMsgs));
+    size_t lSent = 0U;
+    if(can_serial_ERROR_NONE != CIP_sendBatch(0U, lMsgs, 10U, NULL, &lSent) || 10U != lSent) {
+        return false;
+    }
+
+    usleep(20000U);
+    return pExpected == __atomic_load_n(&sStopRestartCount, __ATOMIC_ACQUIRE);
+}
+
+static int16_t testStopRestart(void) {
+    const cipPort_t lPort = 15319;
+
+    if(can_serial_ERROR_NONE != CIP_createModule(0U)
+        || can_serial_ERROR_NONE != CIP_createModule(1U)
+        || can_serial_ERROR_NONE != CIP_init(0U, can_serial_MODE_NORMAL, lPort)
+        || can_serial_ERROR_NONE != CIP_init(1U, can_serial_MODE_NORMAL, lPort))
+    {
+        printf("[ERROR] CIP_init failed\n");
+        return -1;
+    }
+
+    /* RX thread first, then a reactor, CIP_reset in between */
+    for(size_t lNbReactors = 0U; lNbReactors <= 1U; lNbReactors++) {
+        bool lOn = false;
+        sStopRestartCount = 0U;
+        if(can_serial_ERROR_NONE != CIP_setReactorThreads(lNbReactors)
+            || can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countStopRestart)
+            || can_serial_ERROR_NONE != CIP_startRxThread(1U))
+        {
+            printf("[ERROR] Module setup failed (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        if(can_serial_ERROR_ALREADY_INIT != CIP_startRxThread(1U)) {
+            printf("[ERROR] A second RX thread was started (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        if(!sendAndCount(10U)) {
+            printf("[ERROR] Messages not received (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        /* Stopped : the RX thread is gone, the messages wait in the socket */
+        if(can_serial_ERROR_NONE != CIP_stop(1U)
+            || can_serial_ERROR_NONE != CIP_isRxThreadOn(1U, &lOn) || lOn
+            || !sendAndCount(10U))
+        {
+            printf("[ERROR] Module 1 still receives after CIP_stop (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        /* Restarted : the waiting messages, then the new ones */
+        if(can_serial_ERROR_NONE != CIP_restart(1U)
+            || can_serial_ERROR_NONE != CIP_isRxThreadOn(1U, &lOn) || !lOn
+            || !sendAndCount(30U))
+        {
+            printf("[ERROR] Module 1 received %zu messages after CIP_restart (%zu reactors)\n",
+                sStopRestartCount, lNbReactors);
+            return -1;
+        }
+
+        /* Reset from its own callback : the RX thread (or the reactor) lets go of the module */
+        sCallbackResetResult = can_serial_ERROR_UNKNOWN;
+        __atomic_store_n(&sResetInCallback, true, __ATOMIC_RELEASE);
+        (void)sendAndCount(40U);
+        if(can_serial_ERROR_NONE != __atomic_load_n(&sCallbackResetResult, __ATOMIC_ACQUIRE)
+            || can_serial_ERROR_NONE != CIP_isRxThreadOn(1U, &lOn) || lOn)
+        {
+            printf("[ERROR] CIP_reset from the callback failed (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        /* Messages got after the reset wait in the new socket */
+        const size_t lCountAtReset = __atomic_load_n(&sStopRestartCount, __ATOMIC_ACQUIRE);
+        if(can_serial_ERROR_NONE != CIP_setPutMessagesFunction(1U, 1U, countStopRestart)
+            || can_serial_ERROR_NONE != CIP_startRxThread(1U)
+            || !sendAndCount(lCountAtReset + 10U))
+        {
+            printf("[ERROR] Module 1 received %zu messages instead of %zu after its reset (%zu reactors)\n",
+                sStopRestartCount, lCountAtReset + 10U, lNbReactors);
+            return -1;
+        }
+
+        /* A module that never received stays so */
+        if(can_serial_ERROR_NONE != CIP_stop(0U) || can_serial_ERROR_NONE != CIP_restart(0U)
+            || can_serial_ERROR_NONE != CIP_isRxThreadOn(0U, &lOn) || lOn)
+        {
+            printf("[ERROR] CIP_restart started an RX thread for module 0 (%zu reactors)\n", lNbReactors);
+            return -1;
+        }
+
+        (void)CIP_reset(0U, can_serial_MODE_NORMAL);
+        (void)CIP_reset(1U, can_serial_MODE_NORMAL);
+    }
+
+    return can_serial_ERROR_NONE == CIP_setReactorThreads(0U) ? 0 : -1;
 }
 
-/* ----------------------------------------------------- */
-/* Main tests ------------------------------------------ */
-/* ----------------------------------------------------- */
 int main(const int argc, const char * const * const argv) {
     /* Test function initialization */
     int32_t lTestNum;
@@ -44,6 +2328,72 @@ int main(const int argc, const char * const * const argv) {
 
     /* Executing test */
     switch (lTestNum) {
+        case 1:
+            lResult = testSerialPty();
+            break;
+        case 2:
+            lResult = testSlcanCodec();
+            break;
+        case 3:
+            lResult = testUdpWireFormats();
+            break;
+        case 4:
+            lResult = testCanFd();
+            break;
+        case 5:
+            lResult = testFilters();
+            break;
+        case 6:
+            lResult = testHandlers();
+            break;
+        case 7:
+            lResult = testTimestamps();
+            break;
+        case 8:
+            lResult = testStats();
+            break;
+        case 9:
+            lResult = testLatencyHist();
+            break;
+        case 10:
+            lResult = testBatchCallback();
+            break;
+        case 11:
+            lResult = testLogging();
+            break;
+        case 12:
+            lResult = testTxQueue();
+            break;
+        case 13:
+            lResult = testTxPriority();
+            break;
+        case 14:
+            lResult = testTxPacing();
+            break;
+        case 15:
+            lResult = testCyclic();
+            break;
+        case 16:
+            lResult = testCapture();
+            break;
+        case 17:
+            lResult = testReplay();
+            break;
+        case 18:
+            lResult = testCaptureQuery();
+            break;
+        case 19:
+            lResult = testDefaultWireFormat();
+            break;
+        case 20:
+            lResult = testRxRing();
+            break;
+        case 21:
+            lResult = testReactor();
+            break;
+        case 22:
+            lResult = testStopRestart();
+            break;
         default:
             printf("[INFO ] test #%d not available", lTestNum);
             fflush(stdout);
@@ -51,5 +2401,5 @@ int main(const int argc, const char * const * const argv) {
             break;
     }
 
-    return EXIT_SUCCESS;
+    return 0 == lResult ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
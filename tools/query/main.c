@@ -0,0 +1,124 @@
+/**
+ * @brief CAN over serial capture query tool
+ * Prints the frames of a capture (see CIP_startCapture)
+ * w/ a given CAN ID and/or in a given time range,
+ * reading only the blocks the capture index cannot rule out.
+ * The query summary goes to stderr.
+ *
+ * @file main.c
+ */
+
+/* Includes -------------------------------------------- */
+/* can-serial */
+#include "can_serial.h"
+#include "can_serial_error_codes.h"
+
+/* C System */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Defines --------------------------------------------- */
+
+/* Notes ----------------------------------------------- */
+
+/* Variable declaration -------------------------------- */
+static bool sCountOnly = false;
+
+/* Type definitions ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static void printUsage(const char * const pProgName) {
+    fprintf(stderr, "[USAGE] %s [options] <capture path>\n", pProgName);
+    fprintf(stderr, "        -i <id>       CAN ID (hexadecimal), default : every ID\n");
+    fprintf(stderr, "        -M <mask>     CAN ID mask (hexadecimal), default : every bit\n");
+    fprintf(stderr, "        -e            29-bit CAN ID\n");
+    fprintf(stderr, "        -f <ns>       Earliest timestamp (ns since the epoch)\n");
+    fprintf(stderr, "        -t <ns>       Latest timestamp (ns since the epoch)\n");
+    fprintf(stderr, "        -c            Only count the frames\n");
+}
+
+static int printRecord(void * const pCtx, const cipCaptureRecord_t * const pRecord) {
+    (void)pCtx;
+
+    if(sCountOnly) {
+        return 0;
+    }
+
+    printf("%" PRIu64 ".%09" PRIu64 " %u %s %0*X [%u]",
+        pRecord->timestamp / 1000000000U, pRecord->timestamp % 1000000000U,
+        pRecord->module, can_serial_CAPTURE_RX == pRecord->direction ? "RX" : "TX",
+        0U != (pRecord->flags & can_serial_FLAG_EFF) ? 8 : 3, pRecord->id, pRecord->size);
+    for(uint8_t i = 0U; i < pRecord->size && i < CAN_FD_MESSAGE_MAX_SIZE; i++) {
+        printf(" %02X", pRecord->data[i]);
+    }
+    printf("\n");
+
+    return 0;
+}
+
+/* ----------------------------------------------------- */
+/* Main ------------------------------------------------ */
+/* ----------------------------------------------------- */
+int main(const int argc, char * const * const argv) {
+    cipFilter_t lFilter = {0U, 0U, 0U};
+    bool        lFiltered = false;
+    bool        lMasked   = false;
+    uint64_t    lFrom     = 0U;
+    uint64_t    lTo       = UINT64_MAX;
+
+    int lOpt = 0;
+    while(-1 != (lOpt = getopt(argc, argv, "i:M:ef:t:c"))) {
+        switch(lOpt) {
+            case 'i':
+                lFilter.id = (uint32_t)strtoul(optarg, NULL, 16);
+                lFiltered  = true;
+                break;
+            case 'M':
+                lFilter.mask = (uint32_t)strtoul(optarg, NULL, 16);
+                lMasked      = true;
+                break;
+            case 'e':
+                lFilter.flags = can_serial_FLAG_EFF;
+                break;
+            case 'f':
+                lFrom = strtoull(optarg, NULL, 10);
+                break;
+            case 't':
+                lTo = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                sCountOnly = true;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if(optind + 1 != argc || lFrom > lTo) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if(!lMasked) {
+        lFilter.mask = 0x1FFFFFFFU;
+    }
+
+    cipQueryStats_t lStats;
+    memset(&lStats, 0, sizeof(lStats));
+    const cipErrorCode_t lErrorCode = CIP_queryCapture(argv[optind], &lFilter, lFiltered ? 1U : 0U,
+        lFrom, lTo, printRecord, NULL, &lStats);
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        fprintf(stderr, "[ERROR] Query failed w/ error code %u.\n", lErrorCode);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%" PRIu64 " frames found in %.3f ms, %" PRIu64 " of %" PRIu64 " blocks read, %" PRIu64 " records not indexed\n",
+        lStats.matches, 1e-6 * (double)lStats.durationNs, lStats.blocksRead, lStats.blocks, lStats.tailRecords);
+
+    return EXIT_SUCCESS;
+}
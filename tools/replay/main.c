@@ -0,0 +1,134 @@
+/**
+ * @brief CAN over serial capture replay tool
+ * Sends the frames of a capture (see CIP_startCapture)
+ * again, over UDP or through a SLCAN adapter,
+ * w/ their original timing, scaled or as fast as possible.
+ *
+ * @file main.c
+ */
+
+/* Includes -------------------------------------------- */
+/* can-serial */
+#include "can_serial.h"
+#include "can_serial_error_codes.h"
+
+/* C System */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Defines --------------------------------------------- */
+#define DEFAULT_PORT        15024
+#define DEFAULT_BAUDRATE    115200U
+
+/* Notes ----------------------------------------------- */
+
+/* Variable declaration -------------------------------- */
+
+/* Type definitions ------------------------------------ */
+
+/* Support functions ----------------------------------- */
+static void printUsage(const char * const pProgName) {
+    fprintf(stderr, "[USAGE] %s [options] <capture path>\n", pProgName);
+    fprintf(stderr, "        -p <port>     UDP port (default %d)\n", DEFAULT_PORT);
+    fprintf(stderr, "        -D <device>   SLCAN adapter instead of UDP\n");
+    fprintf(stderr, "        -b <baudrate> SLCAN adapter baudrate (default %u)\n", DEFAULT_BAUDRATE);
+    fprintf(stderr, "        -s <factor>   Speed factor (default 1.0 : original timing)\n");
+    fprintf(stderr, "        -m            As fast as possible\n");
+    fprintf(stderr, "        -d <rx|tx|all> Directions to replay (default all)\n");
+    fprintf(stderr, "        -f            CAN FD module\n");
+}
+
+/* ----------------------------------------------------- */
+/* Main ------------------------------------------------ */
+/* ----------------------------------------------------- */
+int main(const int argc, char * const * const argv) {
+    cipPort_t   lPort       = DEFAULT_PORT;
+    const char *lDevice     = NULL;
+    uint32_t    lBaudrate   = DEFAULT_BAUDRATE;
+    double      lSpeed      = 1.0;
+    uint32_t    lDirections = can_serial_REPLAY_RX | can_serial_REPLAY_TX;
+    cipMode_t   lMode       = can_serial_MODE_NORMAL;
+
+    int lOpt = 0;
+    while(-1 != (lOpt = getopt(argc, argv, "p:D:b:s:md:f"))) {
+        switch(lOpt) {
+            case 'p':
+                lPort = (cipPort_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'D':
+                lDevice = optarg;
+                break;
+            case 'b':
+                lBaudrate = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                lSpeed = strtod(optarg, NULL);
+                if(0.0 >= lSpeed) {
+                    printUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                lSpeed = can_serial_REPLAY_MAX_SPEED;
+                break;
+            case 'd':
+                if(0 == strcmp(optarg, "rx")) {
+                    lDirections = can_serial_REPLAY_RX;
+                } else if(0 == strcmp(optarg, "tx")) {
+                    lDirections = can_serial_REPLAY_TX;
+                } else if(0 == strcmp(optarg, "all")) {
+                    lDirections = can_serial_REPLAY_RX | can_serial_REPLAY_TX;
+                } else {
+                    printUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f':
+                lMode = can_serial_MODE_FD;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if(optind + 1 != argc) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    cipErrorCode_t lErrorCode = CIP_createModule(0U);
+    if(can_serial_ERROR_NONE == lErrorCode) {
+        lErrorCode = NULL != lDevice ? CIP_initSerial(0U, lMode, lDevice, lBaudrate)
+            : CIP_init(0U, lMode, lPort);
+    }
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        fprintf(stderr, "[ERROR] Module initialization failed w/ error code %u.\n", lErrorCode);
+        return EXIT_FAILURE;
+    }
+
+    cipReplayStats_t lStats;
+    memset(&lStats, 0, sizeof(lStats));
+    lErrorCode = CIP_replayCapture(0U, argv[optind], lSpeed, lDirections, &lStats);
+
+    printf("%" PRIu64 " frames sent, %" PRIu64 " failed, %" PRIu64 " missing in %.3f s (%.0f frames/s)",
+        lStats.frames, lStats.failed, lStats.missing, 1e-9 * (double)lStats.durationNs, lStats.framesPerSec);
+    if(can_serial_REPLAY_MAX_SPEED < lSpeed) {
+        printf(", up to %.1f us late", 1e-3 * (double)lStats.maxLateNs);
+    }
+    printf("\n");
+
+    (void)CIP_reset(0U, lMode);
+
+    if(can_serial_ERROR_NONE != lErrorCode) {
+        fprintf(stderr, "[ERROR] Replay failed w/ error code %u.\n", lErrorCode);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}